@@ -0,0 +1,116 @@
+// Entity store benchmark
+// Creates 100k entities with a bounding box, sums the box centers a number of times like a
+// culling pass would, then destroys every entity. Compares the old name keyed
+// map<string, shared_ptr> storage with EntityStore, once with names and once without.
+#include <glm/glm.hpp>
+
+#include "EntityStore.h"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace glm;
+
+const int entityNum = 100000;
+const int iterateNum = 100;
+
+struct Times
+{
+	double create;
+	double iterate; // one pass
+	double destroy;
+	vec3 sum;	// printed so the passes are not optimized away
+};
+
+double elapsed(chrono::high_resolution_clock::time_point start)
+{
+	return chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+BoundingBox makeBox(int i)
+{
+	vec3 pos = vec3(i % 100, (i / 100) % 100, i / 10000);
+	return BoundingBox(pos, pos + vec3(1.0f));
+}
+
+Times oldPath()
+{
+	Times times;
+	map<string, shared_ptr<BoundingBox>> objects;
+	auto start = chrono::high_resolution_clock::now();
+	for (int i = 0; i < entityNum; ++i)
+		objects["object" + to_string(i)] = make_shared<BoundingBox>(makeBox(i));
+	times.create = elapsed(start);
+
+	start = chrono::high_resolution_clock::now();
+	times.sum = vec3(0.0f);
+	for (int n = 0; n < iterateNum; ++n)
+		for (auto &object : objects)
+			times.sum += object.second->center();
+	times.iterate = elapsed(start) / iterateNum;
+
+	start = chrono::high_resolution_clock::now();
+	for (int i = 0; i < entityNum; ++i)
+		objects.erase("object" + to_string(i));
+	times.destroy = elapsed(start);
+	return times;
+}
+
+Times newPath(bool named)
+{
+	Times times;
+	EntityStore store;
+	vector<Entity> entities;
+	entities.reserve(entityNum);
+	auto start = chrono::high_resolution_clock::now();
+	for (int i = 0; i < entityNum; ++i)
+	{
+		Entity e = store.create(named ? "object" + to_string(i) : "");
+		store.bounds.insert(e, makeBox(i));
+		entities.push_back(e);
+	}
+	times.create = elapsed(start);
+
+	start = chrono::high_resolution_clock::now();
+	times.sum = vec3(0.0f);
+	for (int n = 0; n < iterateNum; ++n)
+	{
+		const vector<BoundingBox> &boxes = store.bounds.getData();
+		for (int i = 0; i < (int)boxes.size(); ++i)
+			times.sum += boxes[i].center();
+	}
+	times.iterate = elapsed(start) / iterateNum;
+
+	start = chrono::high_resolution_clock::now();
+	for (int i = 0; i < entityNum; ++i)
+		store.destroy(entities[i]);
+	times.destroy = elapsed(start);
+	return times;
+}
+
+void print(const string &name, const Times &times, const Times &base)
+{
+	cout << name << setw(10) << times.create << setw(12) << times.iterate << " (" << setprecision(1)
+		<< base.iterate / times.iterate << "x)" << setprecision(3) << setw(12) << times.destroy
+		<< "    sum " << times.sum.x + times.sum.y + times.sum.z << endl;
+}
+
+int main()
+{
+	cout << entityNum << " entities, iteration is the average of " << iterateNum << " passes" << endl;
+
+	Times oldTimes = oldPath();
+	Times namedTimes = newPath(true);
+	Times unnamedTimes = newPath(false);
+
+	cout << fixed << setprecision(3);
+	cout << "                       create(ms) iterate(ms)         destroy(ms)" << endl;
+	print("map<string, shared_ptr>", oldTimes, oldTimes);
+	print("EntityStore, named     ", namedTimes, oldTimes);
+	print("EntityStore, unnamed   ", unnamedTimes, oldTimes);
+	return 0;
+}
@@ -0,0 +1,151 @@
+// Scaling test of the job system
+// Runs the CPU side workloads that the renderer spreads over worker threads
+// (obj face parsing, tangent generation, per object frustum culling)
+// with 1 to N threads and prints the time and speedup of each.
+// No window or OpenGL context is needed.
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "JobSystem.h"
+#include "Frustum.h"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+using namespace std;
+using namespace glm;
+
+const int lineNum = 400000;
+const int triangleNum = 2000000;
+const int objectNum = 200000;
+const int repeatNum = 5;
+
+vector<string> lines;
+vector<vec3> positions;
+vector<vec2> uvs;
+vector<BoundingBox> boxes;
+vector<mat4> models;
+
+void createData()
+{
+	srand(1);
+	for (int i = 0; i < lineNum; ++i)
+	{
+		int a = rand() % 10000 + 1, b = rand() % 10000 + 1, c = rand() % 10000 + 1;
+		lines.push_back("f " + to_string(a) + "/" + to_string(a) + "/" + to_string(a) + " "
+			+ to_string(b) + "/" + to_string(b) + "/" + to_string(b) + " "
+			+ to_string(c) + "/" + to_string(c) + "/" + to_string(c));
+	}
+
+	for (int i = 0; i < triangleNum * 3; ++i)
+	{
+		positions.push_back(vec3(rand(), rand(), rand()) / (float)RAND_MAX);
+		uvs.push_back(vec2(rand(), rand()) / (float)RAND_MAX);
+	}
+
+	for (int i = 0; i < objectNum; ++i)
+	{
+		boxes.push_back(BoundingBox(vec3(-1), vec3(1)));
+		vec3 pos = (vec3(rand(), rand(), rand()) / (float)RAND_MAX - 0.5f) * 200.0f;
+		models.push_back(translate(mat4(1.0f), pos));
+	}
+}
+
+void parseFaces(vector<int> &result)
+{
+	result.assign(lineNum * 9, 0);
+	JobSystem::parallelFor(lineNum, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i)
+		{
+			const char *p = lines[i].c_str() + 2;
+			char *next;
+			for (int k = 0; k < 9; ++k)
+			{
+				result[i * 9 + k] = strtol(p, &next, 10);
+				p = next + 1;
+			}
+		}
+	});
+}
+
+void computeTangents(vector<vec3> &tangents)
+{
+	tangents.resize(triangleNum);
+	JobSystem::parallelFor(triangleNum, [&](int begin, int end) {
+		for (int t = begin; t < end; ++t)
+		{
+			vec3 edge1 = positions[3 * t + 1] - positions[3 * t];
+			vec3 edge2 = positions[3 * t + 2] - positions[3 * t];
+			vec2 deltaUV1 = uvs[3 * t + 1] - uvs[3 * t];
+			vec2 deltaUV2 = uvs[3 * t + 2] - uvs[3 * t];
+			float f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
+			tangents[t] = normalize(f * (deltaUV2.y * edge1 - deltaUV1.y * edge2));
+		}
+	});
+}
+
+void cullObjects(vector<char> &visible)
+{
+	mat4 projection = perspective(radians(45.0f), 1.5f, 0.1f, 100.0f);
+	mat4 view = lookAt(vec3(0, 0, 0), vec3(0, 0, -1), vec3(0, 1, 0));
+	Frustum frustum(projection * view);
+	visible.resize(objectNum);
+	JobSystem::parallelFor(objectNum, [&](int begin, int end) {
+		for (int i = begin; i < end; ++i)
+			visible[i] = frustum.intersects(boxes[i].transform(models[i]));
+	}, 64);
+}
+
+// best of several runs in milliseconds
+template<typename F>
+double measure(F func)
+{
+	double best = 1e30;
+	for (int i = 0; i < repeatNum; ++i)
+	{
+		auto start = chrono::high_resolution_clock::now();
+		func();
+		auto end = chrono::high_resolution_clock::now();
+		best = std::min(best, chrono::duration<double, milli>(end - start).count());
+	}
+	return best;
+}
+
+int main(int argc, char **argv)
+{
+	int maxThreads = argc > 1 ? atoi(argv[1]) : (int)thread::hardware_concurrency();
+	if (maxThreads < 1)
+		maxThreads = 1;
+
+	createData();
+
+	vector<int> faces;
+	vector<vec3> tangents;
+	vector<char> visible;
+	double baseTime[3] = { 0, 0, 0 };
+
+	cout << "threads   parse(ms)  speedup   tangent(ms) speedup   cull(ms)   speedup" << endl;
+	for (int n = 1; n <= maxThreads; ++n)
+	{
+		JobSystem::init(n - 1);
+		double times[3] = {
+			measure([&]() { parseFaces(faces); }),
+			measure([&]() { computeTangents(tangents); }),
+			measure([&]() { cullObjects(visible); })
+		};
+		if (n == 1)
+			for (int i = 0; i < 3; ++i)
+				baseTime[i] = times[i];
+
+		cout << setw(7) << n;
+		for (int i = 0; i < 3; ++i)
+			cout << fixed << setprecision(2) << setw(12) << times[i] << setw(9) << baseTime[i] / times[i] << "x";
+		cout << endl;
+	}
+	JobSystem::shutdown();
+
+	return 0;
+}
@@ -0,0 +1,73 @@
+// Clustered light assignment benchmark
+// Bins 256 to 4096 random point lights into the 16x9x24 froxel grid of a 1200x800 camera
+// and prints the CPU time per frame on one thread and on all threads, together with the
+// average and largest light count per cluster that a fragment would loop over.
+// Only the CPU binning runs, no window or OpenGL context is needed.
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "LightClusters.h"
+#include "JobSystem.h"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <cstdlib>
+using namespace std;
+using namespace glm;
+
+const int frameNum = 100;
+
+vector<shared_ptr<PointLight>> createLights(int num)
+{
+	srand(1);
+	vector<shared_ptr<PointLight>> lights;
+	for (int i = 0; i < num; ++i)
+	{
+		vec3 pos(rand() % 6000 / 100.0f - 30.0f, rand() % 1000 / 100.0f, rand() % 6000 / 100.0f - 30.0f);
+		shared_ptr<PointLight> light = make_shared<PointLight>(pos, vec3(1.0f, 0.8f, 0.6f));
+		light->setAttenuation(1.0f, 0.35f, 0.44f); // range of about 7
+		lights.push_back(light);
+	}
+	return lights;
+}
+
+double bin(LightClusters &clusters, const vector<shared_ptr<PointLight>> &lights, int workerNum)
+{
+	JobSystem::init(workerNum);
+	mat4 projection = perspective(radians(45.0f), 1200.0f / 800.0f, 0.1f, 100.0f);
+
+	auto start = chrono::high_resolution_clock::now();
+	for (int frame = 0; frame < frameNum; ++frame)
+	{
+		vec3 eye(0.0f, 2.0f, 0.0f);
+		vec3 dir(cos(frame * 0.05f), 0.0f, sin(frame * 0.05f));
+		mat4 view = lookAt(eye, eye + dir, vec3(0.0f, 1.0f, 0.0f));
+		clusters.assign(lights, view, projection, 0.1f, 100.0f);
+	}
+	auto end = chrono::high_resolution_clock::now();
+	return chrono::duration<double, milli>(end - start).count() / frameNum;
+}
+
+int main()
+{
+	cout << "average of " << frameNum << " frames" << endl;
+	cout << fixed << setprecision(3);
+	for (int num : { 256, 1024, 4096 })
+	{
+		vector<shared_ptr<PointLight>> lights = createLights(num);
+		LightClusters clusters;
+		double singleTime = bin(clusters, lights, 0);
+		double multiTime = bin(clusters, lights, -1);
+
+		cout << setw(5) << num << " lights:  1 thread " << singleTime << " ms,  "
+			<< JobSystem::getThreadNum() << " threads " << multiTime << " ms  ("
+			<< singleTime / multiTime << "x),  lights per cluster: average "
+			<< (float)clusters.getIndexNum() / clusters.getClusterNum()
+			<< ", max " << clusters.getMaxClusterLightNum() << endl;
+	}
+
+	JobSystem::shutdown();
+	return 0;
+}
@@ -0,0 +1,106 @@
+// Software occlusion culling benchmark
+// A corridor of wall boxes (the occluders, 12 triangles each) hides a field of 20000 small
+// boxes. Prints the rasterization and test time per frame on one thread and on all threads,
+// and how many of the boxes inside the frustum were found occluded.
+// No window or OpenGL context is needed.
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "OcclusionCuller.h"
+#include "JobSystem.h"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <cstdlib>
+using namespace std;
+using namespace glm;
+
+const int wallNum = 40;
+const int boxNum = 20000;
+const int frameNum = 100;
+
+// unit cube, 12 triangles
+const vec3 cubeVertices[8] = {
+	vec3(-0.5f, -0.5f, -0.5f), vec3(0.5f, -0.5f, -0.5f), vec3(-0.5f, 0.5f, -0.5f), vec3(0.5f, 0.5f, -0.5f),
+	vec3(-0.5f, -0.5f, 0.5f), vec3(0.5f, -0.5f, 0.5f), vec3(-0.5f, 0.5f, 0.5f), vec3(0.5f, 0.5f, 0.5f)
+};
+const unsigned int cubeIndices[36] = {
+	0, 2, 1, 1, 2, 3,	4, 5, 6, 5, 7, 6,
+	0, 1, 4, 1, 5, 4,	2, 6, 3, 3, 6, 7,
+	0, 4, 2, 2, 4, 6,	1, 3, 5, 3, 7, 5
+};
+
+struct Scene
+{
+	vector<mat4> walls;
+	vector<BoundingBox> wallBounds;
+	vector<BoundingBox> boxes;
+};
+
+// walls on both sides of a corridor along -z, small boxes behind them
+Scene createScene()
+{
+	Scene scene;
+	srand(1);
+	for (int i = 0; i < wallNum; ++i)
+	{
+		float x = i % 2 ? 3.0f : -3.0f;
+		float z = -2.0f - (i / 2) * 4.0f;
+		mat4 m = scale(translate(mat4(1.0f), vec3(x, 2.0f, z)), vec3(0.2f, 4.0f, 4.0f));
+		scene.walls.push_back(m);
+		scene.wallBounds.push_back(BoundingBox(vec3(x - 0.1f, 0.0f, z - 2.0f), vec3(x + 0.1f, 4.0f, z + 2.0f)));
+	}
+	for (int i = 0; i < boxNum; ++i)
+	{
+		vec3 p(rand() % 8000 / 100.0f - 40.0f, rand() % 300 / 100.0f, -rand() % 8000 / 100.0f);
+		scene.boxes.push_back(BoundingBox(p - vec3(0.3f), p + vec3(0.3f)));
+	}
+	return scene;
+}
+
+void run(const Scene &scene, int workerNum)
+{
+	JobSystem::init(workerNum);
+	OcclusionCuller culler;
+	mat4 projection = perspective(radians(60.0f), 1200.0f / 800.0f, 0.1f, 200.0f);
+	mat4 viewProjection = projection * lookAt(vec3(0.0f, 1.7f, 0.0f), vec3(0.0f, 1.7f, -1.0f), vec3(0.0f, 1.0f, 0.0f));
+	Frustum frustum(viewProjection);
+
+	float rasterizeTime = 0.0f, testTime = 0.0f;
+	int testedNum = 0, occludedNum = 0;
+	for (int frame = 0; frame < frameNum; ++frame)
+	{
+		culler.begin(viewProjection);
+		for (int i = 0; i < (int)scene.walls.size(); ++i)
+			if (frustum.intersects(scene.wallBounds[i]))
+				culler.addOccluder(cubeVertices, cubeIndices, 12, scene.walls[i]);
+		culler.rasterize();
+
+		vector<char> visible(scene.boxes.size());
+		for (int i = 0; i < (int)scene.boxes.size(); ++i)
+			visible[i] = frustum.intersects(scene.boxes[i]);
+		culler.cull(scene.boxes, visible);
+
+		rasterizeTime += culler.getRasterizeTime();
+		testTime += culler.getTestTime();
+		testedNum = culler.getTestedNum();
+		occludedNum = culler.getOccludedNum();
+	}
+
+	cout << setw(2) << JobSystem::getThreadNum() << " threads: rasterize " << rasterizeTime / frameNum << " ms ("
+		<< culler.getOccluderTriangleNum() << " triangles), test " << testTime / frameNum << " ms, "
+		<< occludedNum << " of " << testedNum << " boxes in the frustum occluded" << endl;
+}
+
+int main()
+{
+	Scene scene = createScene();
+	cout << fixed << setprecision(3) << "average of " << frameNum << " frames" << endl;
+	run(scene, 0);
+	run(scene, -1);
+
+	JobSystem::shutdown();
+	return 0;
+}
@@ -0,0 +1,131 @@
+// Transform update benchmark
+// 100k dynamic transforms (1000 roots with 99 descendants each, three levels deep) are rotated
+// every frame. Compares the old per object path (chained glm::rotate/translate/scale and a
+// full glm::inverse) with TransformSystem::update on one thread and on all threads.
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "Transform.h"
+#include "JobSystem.h"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+using namespace std;
+using namespace glm;
+
+const int rootNum = 1000;
+const int childNum = 9;		// children of a root
+const int grandChildNum = 10;	// children of every child
+const int frameNum = 100;
+
+struct OldTransform
+{
+	vec3 position;
+	vec3 scale;
+	vector<float> rotateAngle;
+	int parent;
+	mat4 modelMatrix;
+	mat4 transInvModelMatrix;
+};
+
+// parents are always created before their children
+vector<int> createParents()
+{
+	vector<int> parents;
+	for (int r = 0; r < rootNum; ++r)
+	{
+		int root = parents.size();
+		parents.push_back(-1);
+		for (int c = 0; c < childNum; ++c)
+		{
+			int child = parents.size();
+			parents.push_back(root);
+			for (int g = 0; g < grandChildNum; ++g)
+				parents.push_back(child);
+		}
+	}
+	return parents;
+}
+
+double oldPath(const vector<int> &parents)
+{
+	vector<OldTransform> transforms(parents.size());
+	for (int i = 0; i < (int)transforms.size(); ++i)
+	{
+		transforms[i].position = vec3(i % 7, i % 5, i % 3);
+		transforms[i].scale = vec3(1.0f, 2.0f, 1.0f);
+		transforms[i].rotateAngle = { 0.0f, 0.0f, 0.0f };
+		transforms[i].parent = parents[i];
+	}
+
+	auto start = chrono::high_resolution_clock::now();
+	for (int frame = 0; frame < frameNum; ++frame)
+	{
+		for (int i = 0; i < (int)transforms.size(); ++i)
+		{
+			OldTransform &t = transforms[i];
+			t.rotateAngle[1] = frame + i * 0.01f;
+			mat4 m = glm::translate(mat4(1.0f), t.position);
+			m = glm::rotate(m, radians(t.rotateAngle[0]), vec3(1, 0, 0));
+			m = glm::rotate(m, radians(t.rotateAngle[1]), vec3(0, 1, 0));
+			m = glm::rotate(m, radians(t.rotateAngle[2]), vec3(0, 0, 1));
+			m = glm::scale(m, t.scale);
+			if (t.parent >= 0)
+				m = transforms[t.parent].modelMatrix * m;
+			t.modelMatrix = m;
+			t.transInvModelMatrix = glm::transpose(glm::inverse(m));
+		}
+	}
+	auto end = chrono::high_resolution_clock::now();
+	return chrono::duration<double, milli>(end - start).count() / frameNum;
+}
+
+double newPath(const vector<int> &parents, int workerNum)
+{
+	JobSystem::init(workerNum);
+
+	vector<TransformID> ids;
+	for (int i = 0; i < (int)parents.size(); ++i)
+	{
+		ids.push_back(TransformSystem::create());
+		TransformSystem::setLocal(ids[i], vec3(i % 7, i % 5, i % 3), quat(1.0f, 0.0f, 0.0f, 0.0f), vec3(1.0f, 2.0f, 1.0f));
+		if (parents[i] >= 0)
+			TransformSystem::setParent(ids[i], ids[parents[i]]);
+	}
+	TransformSystem::update();
+
+	auto start = chrono::high_resolution_clock::now();
+	for (int frame = 0; frame < frameNum; ++frame)
+	{
+		for (int i = 0; i < (int)ids.size(); ++i)
+			TransformSystem::setRotation(ids[i], angleAxis(radians(frame + i * 0.01f), vec3(0, 1, 0)));
+		TransformSystem::update();
+	}
+	auto end = chrono::high_resolution_clock::now();
+
+	for (int i = 0; i < (int)ids.size(); ++i)
+		TransformSystem::destroy(ids[i]);
+	return chrono::duration<double, milli>(end - start).count() / frameNum;
+}
+
+int main()
+{
+	vector<int> parents = createParents();
+	cout << parents.size() << " transforms, average of " << frameNum << " frames" << endl;
+
+	double oldTime = oldPath(parents);
+	double singleTime = newPath(parents, 0);
+	double multiTime = newPath(parents, -1);
+
+	cout << fixed << setprecision(3);
+	cout << "glm rotate + inverse:             " << oldTime << " ms" << endl;
+	cout << "TransformSystem, 1 thread:        " << singleTime << " ms  (" << oldTime / singleTime << "x)" << endl;
+	cout << "TransformSystem, " << setw(2) << JobSystem::getThreadNum() << " threads:       "
+		<< multiTime << " ms  (" << oldTime / multiTime << "x)" << endl;
+
+	JobSystem::shutdown();
+	return 0;
+}
@@ -0,0 +1,137 @@
+// Entity store checks
+// Generations of reused indices, rejection of stale handles, dense / sparse consistency of the
+// component arrays after swap removals and the optional name index.
+// No window or OpenGL context is needed, returns the number of failed checks.
+#include <glm/glm.hpp>
+
+#include "EntityStore.h"
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+using namespace std;
+using namespace glm;
+
+int failNum = 0;
+
+void check(bool condition, const char *what)
+{
+	if (!condition)
+	{
+		cout << "FAILED: " << what << endl;
+		failNum++;
+	}
+}
+
+void checkGenerations()
+{
+	EntityStore store;
+	Entity a = store.create();
+	check(store.isAlive(a), "a created entity is alive");
+	check(!store.isAlive(Entity()), "the invalid entity is never alive");
+
+	store.destroy(a);
+	check(!store.isAlive(a), "a destroyed entity is not alive");
+	check(store.getEntityNum() == 0, "a destroyed entity is not counted");
+
+	Entity b = store.create();
+	check(b.index == a.index, "a freed index is reused");
+	check(b.generation == a.generation + 1, "a reused index gets the next generation");
+	check(b != a, "the handle of a reused index differs from the old one");
+	check(store.isAlive(b) && !store.isAlive(a), "only the newest handle of an index is alive");
+}
+
+void checkStaleHandles()
+{
+	EntityStore store;
+	Entity a = store.create();
+	store.bounds.insert(a, BoundingBox(vec3(0), vec3(1)));
+	store.destroy(a);
+	check(!store.bounds.has(a) && store.bounds.size() == 0, "destroy removes the components");
+
+	Entity b = store.create();
+	store.bounds.insert(b, BoundingBox(vec3(2), vec3(3)));
+	check(!store.bounds.has(a) && store.bounds.get(a) == nullptr, "a stale handle does not reach the component of the reused index");
+	check(store.bounds.get(b) != nullptr && store.bounds.get(b)->minPos == vec3(2), "the new handle reaches its own component");
+
+	store.destroy(a);
+	check(store.isAlive(b) && store.bounds.has(b), "destroying a stale handle leaves the new entity alone");
+	store.bounds.remove(a);
+	check(store.bounds.has(b), "removing with a stale handle leaves the new component alone");
+}
+
+// every dense component must be reachable through its owner, and only live owners may have one
+void checkSwapRemove()
+{
+	EntityStore store;
+	vector<Entity> entities;
+	for (int i = 0; i < 1000; ++i)
+	{
+		entities.push_back(store.create());
+		store.bounds.insert(entities[i], BoundingBox(vec3((float)i), vec3((float)i + 1)));
+	}
+
+	srand(1);
+	vector<char> removed(entities.size(), 0);
+	int remaining = entities.size();
+	for (int step = 0; step < 700; ++step)
+	{
+		int i = rand() % entities.size();
+		if (removed[i])
+			continue;
+		if (step % 2 == 0)
+			store.destroy(entities[i]);
+		else
+			store.bounds.remove(entities[i]);
+		removed[i] = 1;
+		remaining--;
+	}
+
+	check(store.bounds.size() == remaining, "swap remove: the dense array holds the remaining components");
+	bool denseToSparse = true;
+	const vector<Entity> &owners = store.bounds.getEntities();
+	for (int i = 0; i < store.bounds.size(); ++i)
+		denseToSparse = denseToSparse && store.bounds.get(owners[i]) == &store.bounds[i];
+	check(denseToSparse, "swap remove: every dense component is found through its owner");
+
+	bool sparseToDense = true;
+	for (int i = 0; i < (int)entities.size(); ++i)
+	{
+		BoundingBox *box = store.bounds.get(entities[i]);
+		if (removed[i])
+			sparseToDense = sparseToDense && box == nullptr;
+		else
+			sparseToDense = sparseToDense && box != nullptr && box->minPos == vec3((float)i);
+	}
+	check(sparseToDense, "swap remove: removed entities have no component, the others keep their own");
+}
+
+void checkNames()
+{
+	EntityStore store;
+	Entity named = store.create("sun");
+	Entity unnamed = store.create();
+	check(named.valid() && store.find("sun") == named, "a named entity is found by its name");
+	check(store.getName(named) == "sun", "a named entity reports its name");
+	check(store.getName(unnamed) == "", "an unnamed entity has an empty name");
+	check(!store.create("sun").valid(), "a taken name is refused");
+	check(!store.find("moon").valid(), "an unknown name finds nothing");
+
+	store.destroy(named);
+	check(!store.find("sun").valid(), "destroy removes the name");
+	check(store.getName(named) == "", "a stale handle has no name");
+
+	Entity renamed = store.create("sun");
+	check(renamed.valid() && renamed != named && store.find("sun") == renamed, "a freed name can be used again");
+	check(store.getName(unnamed) == "", "names of other entities do not leak to unnamed ones");
+}
+
+int main()
+{
+	checkGenerations();
+	checkStaleHandles();
+	checkSwapRemove();
+	checkNames();
+	cout << (failNum == 0 ? "all entity store checks passed" : "entity store checks failed") << endl;
+	return failNum;
+}
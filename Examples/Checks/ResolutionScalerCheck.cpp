@@ -0,0 +1,116 @@
+// Dynamic resolution controller checks
+// A simulated GPU whose frame time grows with the pixel count feeds ResolutionScaler::update,
+// also with the time arriving a few frames late as it does from the query ring. The scale must
+// settle where the frame time meets the target, follow a change of the load and never leave
+// the scale range when the target cannot be met.
+// No window or OpenGL context is needed, returns the number of failed checks.
+#include <glm/glm.hpp>
+
+#include "ResolutionScaler.h"
+
+#include <iostream>
+#include <deque>
+#include <cmath>
+using namespace std;
+using namespace glm;
+
+int failNum = 0;
+
+void check(bool condition, const char *what)
+{
+	if (!condition)
+	{
+		cout << "FAILED: " << what << endl;
+		failNum++;
+	}
+}
+
+// frame time in ms: a fixed part and a part that scales with the pixels
+struct SimulatedGPU
+{
+	float fixedTime;
+	float fullResTime;	// pixel part at scale 1
+	float time(float scale) const { return fixedTime + fullResTime * scale * scale; }
+};
+
+// runs the controller, the time of a frame is known latency frames later
+// returns false if the scale ever left [minScale, maxScale]
+bool run(ResolutionScaler &scaler, const SimulatedGPU &gpu, int frameNum, int latency)
+{
+	bool inRange = true;
+	deque<float> inFlight;
+	for (int i = 0; i < frameNum; ++i)
+	{
+		inFlight.push_back(gpu.time(scaler.getScale()));
+		if ((int)inFlight.size() > latency)
+		{
+			scaler.update(inFlight.front());
+			inFlight.pop_front();
+		}
+		inRange = inRange && scaler.getScale() >= scaler.getMinScale() && scaler.getScale() <= scaler.getMaxScale();
+	}
+	return inRange;
+}
+
+void checkConvergence()
+{
+	for (int latency = 0; latency <= ResolutionScaler::QUERY_FRAME_NUM; ++latency)
+	{
+		ResolutionScaler scaler;
+		scaler.setScaleRange(0.5f, 1.0f);
+		scaler.setTargetTime(16.0f);
+		SimulatedGPU gpu = { 0.0f, 25.0f };
+		bool inRange = run(scaler, gpu, 300, latency);
+		check(inRange, "convergence: the scale stays in range");
+		check(fabs(scaler.getScale() - 0.8f) < 0.01f, "convergence: a pixel bound load settles at sqrt(target / time)");
+		check(fabs(gpu.time(scaler.getScale()) - 16.0f) < 0.3f, "convergence: the frame time meets the target");
+
+		// part of the frame does not scale with the resolution
+		scaler.reset();
+		gpu = { 4.0f, 20.0f };
+		inRange = run(scaler, gpu, 300, latency);
+		check(inRange, "fixed cost: the scale stays in range");
+		check(fabs(gpu.time(scaler.getScale()) - 16.0f) < 0.3f, "fixed cost: the frame time meets the target");
+
+		// the scene gets heavier without a reset
+		gpu = { 0.0f, 36.0f };
+		inRange = run(scaler, gpu, 300, latency);
+		check(inRange, "load change: the scale stays in range");
+		check(fabs(scaler.getScale() - 2.0f / 3.0f) < 0.01f, "load change: the scale follows a heavier load");
+	}
+}
+
+void checkLimits()
+{
+	ResolutionScaler scaler;
+	scaler.setScaleRange(0.5f, 1.0f);
+	scaler.setTargetTime(16.0f);
+
+	// even the smallest scale is too slow
+	SimulatedGPU gpu = { 0.0f, 100.0f };
+	check(run(scaler, gpu, 300, 3), "heavy load: the scale stays in range");
+	check(scaler.getScale() == 0.5f, "heavy load: the scale rests at the minimum");
+
+	// full resolution is fast enough
+	gpu = { 0.0f, 8.0f };
+	check(run(scaler, gpu, 300, 3), "light load: the scale stays in range");
+	check(scaler.getScale() == 1.0f, "light load: the scale returns to the maximum");
+
+	// a range above 1 renders at a higher resolution when there is time
+	scaler.setScaleRange(0.5f, 2.0f);
+	check(run(scaler, gpu, 300, 3), "supersampling: the scale stays in range");
+	check(fabs(scaler.getScale() - sqrt(2.0f)) < 0.02f, "supersampling: spare time raises the scale above 1");
+
+	// no measurement yet, the scale must not move
+	ResolutionScaler idle;
+	idle.update(0.0f);
+	check(idle.getScale() == 1.0f, "a frame without a measurement leaves the scale alone");
+}
+
+int main()
+{
+	checkConvergence();
+	checkLimits();
+	cout << (failNum == 0 ? "all resolution scaler checks passed" : "resolution scaler checks failed") << endl;
+	return failNum;
+}
@@ -0,0 +1,176 @@
+// SH irradiance checks of the cube map loaders
+// Cube face directions against the OpenGL face selection, and environments with a known irradiance
+// projected through the face and equirectangular paths: a constant color keeps band 0 only, 1 + x,
+// 1 + y and 1 + z are exact in band 1, and z * z needs band 2.
+// No window or OpenGL context is needed, returns the number of failed checks.
+#include <glm/glm.hpp>
+
+#include "CubeMap.h"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <functional>
+using namespace std;
+using namespace glm;
+
+int failNum = 0;
+
+void check(bool condition, const string &what)
+{
+	if (!condition)
+	{
+		cout << "FAILED: " << what << endl;
+		failNum++;
+	}
+}
+
+bool near(vec3 a, vec3 b, float tolerance)
+{
+	return fabs(a.x - b.x) <= tolerance && fabs(a.y - b.y) <= tolerance && fabs(a.z - b.z) <= tolerance;
+}
+
+// irradiance over PI in direction n, as the shaders evaluate the coefficients
+vec3 irradiance(const vector<vec3> &sh, vec3 n)
+{
+	float basis[9] = {
+		0.282095f,
+		0.488603f * n.y, 0.488603f * n.z, 0.488603f * n.x,
+		1.092548f * n.x * n.y, 1.092548f * n.y * n.z, 0.315392f * (3.0f * n.z * n.z - 1.0f), 1.092548f * n.x * n.z, 0.546274f * (n.x * n.x - n.y * n.y)
+	};
+	vec3 result(0.0f);
+	for (int i = 0; i < 9; ++i)
+		result += sh[i] * basis[i];
+	return result;
+}
+
+// the face and texel of a direction by the major axis, as OpenGL samples a cube map
+void glFaceCoords(vec3 dir, int &face, float &u, float &v)
+{
+	vec3 a = abs(dir);
+	if (a.x >= a.y && a.x >= a.z)
+	{
+		face = dir.x > 0.0f ? 0 : 1;
+		u = (dir.x > 0.0f ? -dir.z : dir.z) / a.x;
+		v = -dir.y / a.x;
+	}
+	else if (a.y >= a.z)
+	{
+		face = dir.y > 0.0f ? 2 : 3;
+		u = dir.x / a.y;
+		v = (dir.y > 0.0f ? dir.z : -dir.z) / a.y;
+	}
+	else
+	{
+		face = dir.z > 0.0f ? 4 : 5;
+		u = (dir.z > 0.0f ? dir.x : -dir.x) / a.z;
+		v = -dir.y / a.z;
+	}
+}
+
+void checkFaceDirections()
+{
+	bool same = true;
+	for (int face = 0; face < 6; ++face)
+		for (float u = -0.9f; u < 1.0f; u += 0.3f)
+			for (float v = -0.9f; v < 1.0f; v += 0.3f)
+			{
+				int glFace;
+				float glU, glV;
+				glFaceCoords(CubeMap::faceDirection(face, u, v), glFace, glU, glV);
+				same = same && glFace == face && fabs(glU - u) < 1e-5f && fabs(glV - v) < 1e-5f;
+			}
+	check(same, "face directions match the OpenGL cube map faces");
+}
+
+// the projection of the face path, 8 bit faces of the environment
+vector<vec3> projectFaces(function<vec3(vec3)> environment, int size = 64)
+{
+	vector<vec3> sh(9, vec3(0.0f));
+	float weightSum = 0.0f;
+	vector<unsigned char> data(size * size * 3);
+	for (int face = 0; face < 6; ++face)
+	{
+		for (int y = 0; y < size; ++y)
+			for (int x = 0; x < size; ++x)
+			{
+				float u = 2.0f * (x + 0.5f) / size - 1.0f;
+				float v = 2.0f * (y + 0.5f) / size - 1.0f;
+				vec3 color = environment(normalize(CubeMap::faceDirection(face, u, v)));
+				for (int c = 0; c < 3; ++c)
+					data[(y * size + x) * 3 + c] = (unsigned char)lround(std::min(std::max(color[c], 0.0f), 1.0f) * 255.0f);
+			}
+		weightSum += CubeMap::addSHFace(sh, face, data.data(), size, size, 3);
+	}
+	CubeMap::normalizeSH(sh, weightSum);
+	return sh;
+}
+
+// the projection of the equirectangular path, bottom row first as loadHdr reads it
+vector<vec3> projectEquirect(function<vec3(vec3)> environment, int width = 256)
+{
+	const float PI = 3.14159265359f;
+	int height = width / 2;
+	vector<float> data(width * height * 3);
+	for (int y = 0; y < height; ++y)
+	{
+		float latitude = ((y + 0.5f) / height - 0.5f) * PI;
+		for (int x = 0; x < width; ++x)
+		{
+			float phi = ((x + 0.5f) / width - 0.5f) * 2.0f * PI;
+			vec3 color = environment(vec3(cos(latitude) * cos(phi), sin(latitude), cos(latitude) * sin(phi)));
+			for (int c = 0; c < 3; ++c)
+				data[(y * width + x) * 3 + c] = color[c];
+		}
+	}
+	vector<vec3> sh(9, vec3(0.0f));
+	CubeMap::normalizeSH(sh, CubeMap::addSHEquirect(sh, data.data(), width, height, 3));
+	return sh;
+}
+
+void checkEnvironments(const string &path, function<vector<vec3>(function<vec3(vec3)>)> project, float tolerance)
+{
+	// a constant color: band 0 only, the same irradiance over PI in every direction
+	vec3 color(0.8f, 0.4f, 0.2f);
+	vector<vec3> sh = project([&](vec3) { return color; });
+	bool band0 = near(sh[0], color / 0.282095f, tolerance * 4.0f);
+	for (int i = 1; i < 9; ++i)
+		band0 = band0 && near(sh[i], vec3(0.0f), tolerance);
+	check(band0, path + ": a constant environment projects on band 0 only");
+	check(near(irradiance(sh, vec3(0, 1, 0)), color, tolerance) && near(irradiance(sh, normalize(vec3(1, -2, 3))), color, tolerance),
+		path + ": a constant environment lights all directions the same");
+
+	// 1 + a: irradiance over PI is 1 + 2/3 cos, the linear band convolved with the clamped cosine
+	vec3 axes[3] = { vec3(1, 0, 0), vec3(0, 1, 0), vec3(0, 0, 1) };
+	const char *names[3] = { "x", "y", "z" };
+	for (int i = 0; i < 3; ++i)
+	{
+		vec3 a = axes[i];
+		sh = project([&](vec3 d) { return vec3(0.5f + 0.5f * dot(a, d)); });
+		vec3 side = axes[(i + 1) % 3];
+		check(near(irradiance(sh, a), vec3(0.5f + 1.0f / 3.0f), tolerance)
+			&& near(irradiance(sh, -a), vec3(0.5f - 1.0f / 3.0f), tolerance)
+			&& near(irradiance(sh, side), vec3(0.5f), tolerance),
+			path + ": a gradient along " + names[i] + " lights its own axis");
+	}
+
+	// z * z: 1/2 along z and 1/4 across it, needs band 2
+	sh = project([](vec3 d) { return vec3(d.z * d.z); });
+	check(near(irradiance(sh, vec3(0, 0, 1)), vec3(0.5f), tolerance) && near(irradiance(sh, vec3(0, 0, -1)), vec3(0.5f), tolerance)
+		&& near(irradiance(sh, vec3(1, 0, 0)), vec3(0.25f), tolerance) && near(irradiance(sh, vec3(0, 1, 0)), vec3(0.25f), tolerance),
+		path + ": a z * z environment keeps its band 2 shape");
+}
+
+int main()
+{
+	checkFaceDirections();
+	checkEnvironments("faces", [](function<vec3(vec3)> e) { return projectFaces(e); }, 0.01f);
+	checkEnvironments("equirectangular", [](function<vec3(vec3)> e) { return projectEquirect(e); }, 0.005f);
+	// empty projections are left at 0
+	vector<vec3> sh(9, vec3(0.0f));
+	CubeMap::normalizeSH(sh, 0.0f);
+	check(near(irradiance(sh, vec3(0, 1, 0)), vec3(0.0f), 0.0f), "no samples leave no irradiance");
+	cout << (failNum == 0 ? "all SH checks passed" : "SH checks failed") << endl;
+	return failNum;
+}
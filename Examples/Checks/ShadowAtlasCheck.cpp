@@ -0,0 +1,128 @@
+// Shadow atlas allocator checks
+// Allocation sizes and positions, merging of released tiles and a random allocate / release run
+// where the live tiles must stay inside the atlas, never overlap and add up to the usage.
+// No window or OpenGL context is needed, returns the number of failed checks.
+#include <glm/glm.hpp>
+
+#include "ShadowAtlas.h"
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+using namespace std;
+using namespace glm;
+
+int failNum = 0;
+
+void check(bool condition, const char *what)
+{
+	if (!condition)
+	{
+		cout << "FAILED: " << what << endl;
+		failNum++;
+	}
+}
+
+bool overlap(ivec3 a, ivec3 b)
+{
+	return a.x < b.x + b.z && b.x < a.x + a.z && a.y < b.y + b.z && b.y < a.y + a.z;
+}
+
+void checkSizes()
+{
+	ShadowAtlas atlas(1024, 64);
+	int tile = atlas.allocate(1024);
+	check(tile >= 0 && atlas.getTile(tile) == ivec3(0, 0, 1024), "a full size tile takes the whole atlas");
+	check(atlas.getUsage() == 1.0f, "a full size tile uses all of the atlas");
+	check(atlas.allocate(64) < 0, "a full atlas refuses more tiles");
+	atlas.release(tile);
+	check(atlas.getUsage() == 0.0f, "a released tile frees its area");
+
+	check(atlas.getTile(atlas.allocate(100)).z == 128, "sizes round up to a power of two fraction");
+	check(atlas.getTile(atlas.allocate(10)).z == 64, "sizes round up to the smallest tile");
+	atlas.reset(1024, 64);
+	check(atlas.getTile(atlas.allocate(4096)).z == 1024, "sizes are capped at the atlas size");
+
+	atlas.reset(1024, 64);
+	vector<ivec3> quadrants;
+	for (int i = 0; i < 4; ++i)
+		quadrants.push_back(atlas.getTile(atlas.allocate(512)));
+	check(atlas.allocate(512) < 0, "four half size tiles fill the atlas");
+	for (int i = 0; i < 4; ++i)
+		for (int j = i + 1; j < 4; ++j)
+			check(!overlap(quadrants[i], quadrants[j]), "half size tiles do not overlap");
+}
+
+void checkMerge()
+{
+	ShadowAtlas atlas(1024, 64);
+	vector<int> tiles;
+	for (int i = 0; i < 16; ++i)
+		tiles.push_back(atlas.allocate(256));
+	check(atlas.allocate(256) < 0, "16 quarter size tiles fill the atlas");
+	for (int tile : tiles)
+		atlas.release(tile);
+	check(atlas.allocate(1024) >= 0, "released siblings merge back into the root");
+
+	// a free node of the requested size is taken before a larger one is split
+	atlas.reset(1024, 64);
+	int small = atlas.allocate(256);
+	ivec3 smallTile = atlas.getTile(small);
+	int large = atlas.allocate(512);
+	atlas.release(small);
+	check(atlas.getTile(atlas.allocate(256)) == smallTile, "a released tile is reused for the same size");
+	check(atlas.allocate(512) >= 0 && atlas.allocate(512) >= 0, "the free quadrants stay whole");
+	atlas.release(large);
+	check(atlas.allocate(512) >= 0, "a released quadrant is whole again");
+}
+
+void checkRandom()
+{
+	ShadowAtlas atlas(4096, 64);
+	vector<int> tiles;
+	srand(1);
+	for (int step = 0; step < 20000; ++step)
+	{
+		if (!tiles.empty() && rand() % 2)
+		{
+			int i = rand() % tiles.size();
+			atlas.release(tiles[i]);
+			tiles[i] = tiles.back();
+			tiles.pop_back();
+		}
+		else
+		{
+			int tile = atlas.allocate(64 << (rand() % 5));
+			if (tile >= 0)
+				tiles.push_back(tile);
+		}
+
+		if (step % 100 != 0)
+			continue;
+		long long area = 0;
+		bool inside = true, separate = true;
+		for (int i = 0; i < (int)tiles.size(); ++i)
+		{
+			ivec3 a = atlas.getTile(tiles[i]);
+			inside = inside && a.x >= 0 && a.y >= 0 && a.x + a.z <= 4096 && a.y + a.z <= 4096;
+			area += (long long)a.z * a.z;
+			for (int j = i + 1; j < (int)tiles.size(); ++j)
+				separate = separate && !overlap(a, atlas.getTile(tiles[j]));
+		}
+		check(inside, "random run: tiles stay inside the atlas");
+		check(separate, "random run: tiles do not overlap");
+		check(area == (long long)(atlas.getUsage() * 4096.0 * 4096.0 + 0.5), "random run: usage matches the tiles");
+	}
+	for (int tile : tiles)
+		atlas.release(tile);
+	check(atlas.allocate(4096) >= 0, "random run: everything merges back after releasing all tiles");
+}
+
+int main()
+{
+	checkSizes();
+	checkMerge();
+	checkRandom();
+	cout << (failNum == 0 ? "all shadow atlas checks passed" : "shadow atlas checks failed") << endl;
+	return failNum;
+}
@@ -0,0 +1,120 @@
+// Render target format checks
+// Texel sizes of every format the renderer allocates, and the bytes a texel of each target group
+// takes in the quality() and bandwidth() profiles, summed as Renderer::getRenderTargetMemory does.
+// No window or OpenGL context is needed, returns the number of failed checks.
+#include "RenderTargetFormats.h"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+using namespace std;
+
+int failNum = 0;
+
+void check(bool condition, const string &what)
+{
+	if (!condition)
+	{
+		cout << "FAILED: " << what << endl;
+		failNum++;
+	}
+}
+
+// size of a format, without the message of unknown formats
+int texelBytes(GLenum format, bool *known = nullptr)
+{
+	stringstream message;
+	streambuf *coutBuffer = cout.rdbuf(message.rdbuf());
+	int bytes = getBytesPerTexel(format);
+	cout.rdbuf(coutBuffer);
+	if (known)
+		*known = message.str().empty();
+	return bytes;
+}
+
+void checkFormats()
+{
+	struct { GLenum format; int bytes; const char *name; } formats[] = {
+		{ GL_DEPTH_COMPONENT16, 2, "DEPTH_COMPONENT16" },
+		{ GL_RGB8, 4, "RGB8" },
+		{ GL_RGBA8, 4, "RGBA8" },
+		{ GL_R11F_G11F_B10F, 4, "R11F_G11F_B10F" },
+		{ GL_RG16_SNORM, 4, "RG16_SNORM" },
+		{ GL_RG16F, 4, "RG16F" },
+		{ GL_R32F, 4, "R32F" },
+		{ GL_DEPTH_COMPONENT24, 4, "DEPTH_COMPONENT24" },
+		{ GL_DEPTH_COMPONENT32F, 4, "DEPTH_COMPONENT32F" },
+		{ GL_DEPTH24_STENCIL8, 4, "DEPTH24_STENCIL8" },
+		{ GL_RGB16F, 8, "RGB16F" },
+		{ GL_RGBA16F, 8, "RGBA16F" },
+		{ GL_RGBA16, 8, "RGBA16" },
+		{ GL_RG32F, 8, "RG32F" },
+		{ GL_DEPTH32F_STENCIL8, 8, "DEPTH32F_STENCIL8" },
+		{ GL_RGB32F, 16, "RGB32F" },
+		{ GL_RGBA32F, 16, "RGBA32F" }
+	};
+	for (auto &f : formats)
+	{
+		bool known;
+		int bytes = texelBytes(f.format, &known);
+		check(known && bytes == f.bytes, string(f.name) + " takes " + to_string(f.bytes) + " bytes, got " + to_string(bytes));
+	}
+
+	bool known;
+	check(texelBytes(GL_RGBA4, &known) == 4 && !known, "unknown formats are reported and counted at 4 bytes");
+
+	check(getPixelFormat(GL_DEPTH_COMPONENT16) == GL_DEPTH_COMPONENT && getPixelFormat(GL_DEPTH_COMPONENT24) == GL_DEPTH_COMPONENT
+		&& getPixelFormat(GL_DEPTH_COMPONENT32F) == GL_DEPTH_COMPONENT, "depth formats take depth pixels");
+	check(getPixelFormat(GL_R11F_G11F_B10F) == GL_RGBA && getPixelFormat(GL_RG16_SNORM) == GL_RGBA, "color formats take RGBA pixels");
+}
+
+// bytes a texel of each target group takes, as the renderer counts them
+struct ProfileBytes
+{
+	int scene;		// scene color and post process color
+	int shadow;		// directional and point shadows
+	int RSM;		// depth, position, normal and flux of the RSM
+	int RSMIndirect;
+};
+
+ProfileBytes profileBytes(const RenderTargetFormats &formats, const string &name)
+{
+	ProfileBytes bytes;
+	bool known = true, k;
+	bytes.scene = 2 * texelBytes(formats.sceneColor, &k); known = known && k;
+	bytes.shadow = texelBytes(formats.dirShadow, &k); known = known && k;
+	bytes.shadow += texelBytes(formats.pointShadow, &k); known = known && k;
+	bytes.RSM = texelBytes(formats.RSMDepth, &k); known = known && k;
+	bytes.RSM += texelBytes(formats.RSMNormal, &k); known = known && k;
+	bytes.RSM += texelBytes(formats.RSMFlux, &k); known = known && k;
+	if (formats.RSMPosition)
+		bytes.RSM += texelBytes(GL_RGB16F);
+	bytes.RSMIndirect = texelBytes(formats.RSMIndirect, &k); known = known && k;
+	check(known, name + ": every format has a known size");
+	return bytes;
+}
+
+void checkProfiles()
+{
+	ProfileBytes quality = profileBytes(RenderTargetFormats::quality(), "quality");
+	ProfileBytes bandwidth = profileBytes(RenderTargetFormats::bandwidth(), "bandwidth");
+
+	check(quality.scene == 8 && bandwidth.scene == 8, "scene color: RGB8 and R11F_G11F_B10F are both 4 bytes");
+	check(quality.shadow == 8 && bandwidth.shadow == 6, "shadows: 16 bit point shadows save 2 bytes");
+	check(quality.RSM == 24 && bandwidth.RSM == 12, "RSM: the bandwidth profile halves the RSM");
+	check(quality.RSMIndirect == 8 && bandwidth.RSMIndirect == 4, "RSM gather: the low resolution result halves");
+
+	RenderTargetFormats q = RenderTargetFormats::quality(), b = RenderTargetFormats::bandwidth();
+	check(getPixelFormat(q.pointShadow) == GL_DEPTH_COMPONENT && getPixelFormat(b.pointShadow) == GL_DEPTH_COMPONENT,
+		"point shadows stay depth formats in both profiles");
+	check(getPixelFormat(q.dirShadow) == GL_DEPTH_COMPONENT && getPixelFormat(b.dirShadow) == GL_DEPTH_COMPONENT,
+		"directional shadows stay depth formats in both profiles");
+}
+
+int main()
+{
+	checkFormats();
+	checkProfiles();
+	cout << (failNum == 0 ? "all render target format checks passed" : "render target format checks failed") << endl;
+	return failNum;
+}
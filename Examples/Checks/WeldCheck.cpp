@@ -0,0 +1,118 @@
+// Position welding checks of the depth stream, see Object::bindDepthStream
+// Split vertices of the same corner must become one position, separate positions must stay apart
+// and every vertex must keep its exact position through the remap.
+// No window or OpenGL context is needed, returns the number of failed checks.
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <string>
+using namespace std;
+using namespace glm;
+
+int failNum = 0;
+
+void check(bool condition, const string &what)
+{
+	if (!condition)
+	{
+		cout << "FAILED: " << what << endl;
+		failNum++;
+	}
+}
+
+bool samePosition(vec3 a, vec3 b)
+{
+	return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+// every vertex maps to its own position, and positions are unique and in first use order
+void checkRemap(const vector<vec3> &vertices, const vector<vec3> &positions, const vector<unsigned int> &remap, const char *what)
+{
+	bool exact = remap.size() == vertices.size(), ordered = true, unique = true;
+	unsigned int next = 0;
+	for (int i = 0; exact && i < (int)vertices.size(); ++i)
+	{
+		exact = remap[i] < positions.size() && samePosition(positions[remap[i]], vertices[i]);
+		if (exact && remap[i] >= next)
+		{
+			ordered = ordered && remap[i] == next;
+			next = remap[i] + 1;
+		}
+	}
+	for (int i = 0; i < (int)positions.size(); ++i)
+		for (int j = i + 1; j < (int)positions.size(); ++j)
+			unique = unique && !samePosition(positions[i], positions[j]);
+	check(exact, string(what) + ": vertices keep their positions");
+	check(ordered, string(what) + ": positions follow the first vertex using them");
+	check(unique, string(what) + ": positions are welded into one");
+}
+
+// 24 vertices of a cube split by face normals, like Cube::create
+void checkCube()
+{
+	vector<vec3> corners{
+		vec3(0.5f, 0.5f, 0.5f), vec3(-0.5f, 0.5f, 0.5f), vec3(-0.5f, -0.5f, 0.5f), vec3(0.5f, -0.5f, 0.5f),
+		vec3(0.5f, 0.5f, -0.5f), vec3(-0.5f, 0.5f, -0.5f), vec3(-0.5f, -0.5f, -0.5f), vec3(0.5f, -0.5f, -0.5f) };
+	int faces[6][4] = { {0, 1, 2, 3}, {0, 3, 7, 4}, {0, 4, 5, 1}, {1, 5, 6, 2}, {7, 6, 5, 4}, {3, 2, 6, 7} };
+	vector<vec3> vertices;
+	for (int f = 0; f < 6; ++f)
+		for (int v = 0; v < 4; ++v)
+			vertices.push_back(corners[faces[f][v]]);
+
+	vector<vec3> positions;
+	vector<unsigned int> remap;
+	Object::weldPositions(vertices, positions, remap);
+	check(positions.size() == 8, "cube: 24 split vertices weld into 8 corners");
+	checkRemap(vertices, positions, remap, "cube");
+}
+
+void checkSeparate()
+{
+	vector<vec3> vertices{ vec3(0, 0, 0), vec3(1, 0, 0), vec3(0, 1, 0), vec3(0, 0, 1), vec3(1e-7f, 0, 0), vec3(0, 0, nextafter(1.0f, 2.0f)) };
+	vector<vec3> positions;
+	vector<unsigned int> remap;
+	Object::weldPositions(vertices, positions, remap);
+	check(positions.size() == vertices.size(), "separate: close but different positions stay apart");
+	checkRemap(vertices, positions, remap, "separate");
+
+	// the outputs are replaced, not appended to
+	Object::weldPositions(vector<vec3>{ vec3(2, 2, 2), vec3(2, 2, 2) }, positions, remap);
+	check(positions.size() == 1 && remap.size() == 2 && remap[0] == 0 && remap[1] == 0, "reuse: a second weld starts over");
+
+	Object::weldPositions(vector<vec3>(), positions, remap);
+	check(positions.empty() && remap.empty(), "empty: nothing to weld");
+}
+
+// a grid of quads with 4 own vertices each, inner corners are shared by 4 quads
+void checkGrid()
+{
+	const int size = 32;
+	vector<vec3> vertices;
+	for (int y = 0; y < size; ++y)
+		for (int x = 0; x < size; ++x)
+		{
+			vertices.push_back(vec3(x, 0.0f, y));
+			vertices.push_back(vec3(x + 1, 0.0f, y));
+			vertices.push_back(vec3(x + 1, 0.0f, y + 1));
+			vertices.push_back(vec3(x, 0.0f, y + 1));
+		}
+
+	vector<vec3> positions;
+	vector<unsigned int> remap;
+	Object::weldPositions(vertices, positions, remap);
+	check(positions.size() == (size + 1) * (size + 1), "grid: quad corners weld into the grid points");
+	checkRemap(vertices, positions, remap, "grid");
+}
+
+int main()
+{
+	checkCube();
+	checkSeparate();
+	checkGrid();
+	cout << (failNum == 0 ? "all welding checks passed" : "welding checks failed") << endl;
+	return failNum;
+}
@@ -70,6 +70,8 @@ public:
         //setClearColor(vec3(1.0, 1.0, 1.0));
         setCamera(camera);
         setMSAA(true);
+        // four cascades over the first 50 units of the view
+        setShadowCascades(4, 0.75f, 50.0f);
 
     }
 
@@ -8,13 +8,15 @@
 #include "Renderer.h"
 
 #include <iostream>
+#include <fstream>
 #include <memory>
+#include <string>
 using namespace std;
 
 class myRenderer : public Renderer
 {
 public:
-    myRenderer()
+    myRenderer(bool sponzaScene_, bool depthPrePass_) : sponzaScene(sponzaScene_), depthPrePass(depthPrePass_)
     {
         windowWidth = 1200;
         windowHeight = 800;
@@ -74,9 +76,18 @@ public:
         test4->setMaterial(RSM_depthMtl);
 
 
-        // sponza
-        //sponza = make_shared<Model>("./resources/models/Sponza-master/sponza.obj");
-        //sponza->setScale({ 0.01, 0.01, 0.01 });
+        // sponza, the heavy overdraw case of the depth pre-pass, the obj is not in the repository
+        const string sponzaPath = "./resources/models/Sponza-master/sponza.obj";
+        if (sponzaScene && !ifstream(sponzaPath))
+        {
+            cout << "Sponza not found at " << sponzaPath << ", running the default scene" << endl;
+            sponzaScene = false;
+        }
+        if (sponzaScene)
+        {
+            sponza = make_shared<Model>(sponzaPath);
+            sponza->setScale({ 0.01, 0.01, 0.01 });
+        }
 
         // Gui
         gui = make_shared<Gui>();
@@ -94,17 +105,23 @@ public:
         setClearColor(vec3(0, 0, 0));
         setCamera(camera);
         setMSAA(true);
+        // RSM.frag is expensive per fragment, shade every pixel only once
+        setDepthPrePass(depthPrePass);
 
     }
 
     virtual void addResources() override
     {
-        addObject("cube1", cube1);
-        addObject("cube2", cube2);
-        addObject("cube3", cube3);
-        addObject("suzanne", buddha);
+        if (sponzaScene)
+            addObject("sponza", sponza);
+        else
+        {
+            addObject("cube1", cube1);
+            addObject("cube2", cube2);
+            addObject("cube3", cube3);
+            addObject("suzanne", buddha);
+        }
         //addObject("plane", plane);
-       // addObject("sponza", sponza);
         //addObject("test1", test1);
         //addObject("test2", test2);
         //addObject("test3", test3);
@@ -124,9 +141,25 @@ public:
     {
     }
 
+    // print the main pass cost, run once more with --no-prepass to compare, pass --sponza for Sponza,
+    // indirect light is computed inline, then at half and quarter resolution, 300 frames each
+    virtual void userEvents() override
+    {
+        if (++frameNum % 300 != 0)
+            return;
+        const char *modes[3] = { "inline RSM", "RSM gather 1/2", "RSM gather 1/4" };
+        cout << modes[gatherMode] << (depthPrePass ? ", depth pre-pass" : ", no depth pre-pass") << ": main pass " << getMainPassTime() << " ms, " << getShadedSampleNum() << " shaded samples" << endl;
+        gatherMode = (gatherMode + 1) % 3;
+        setRSMGatherPass(gatherMode > 0, gatherMode == 1 ? 2 : 4);
+    }
+
 private:
     int windowWidth;
     int windowHeight;
+    bool sponzaScene;
+    bool depthPrePass;
+    int frameNum = 0;
+    int gatherMode = 0;
     vec3 lightDir;
     shared_ptr<Model> buddha;
     shared_ptr<Camera> camera;
@@ -148,9 +181,19 @@ private:
     shared_ptr<Gui> gui;
 };
 
-int main()
+int main(int argc, char *argv[])
 {
-    myRenderer r;
+    bool sponzaScene = false, depthPrePass = true;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (string(argv[i]) == "--sponza")
+            sponzaScene = true;
+        else if (string(argv[i]) == "--no-prepass")
+            depthPrePass = false;
+        else
+            cout << "unknown option " << argv[i] << ", use --sponza and --no-prepass" << endl;
+    }
+    myRenderer r(sponzaScene, depthPrePass);
     r.run();
 
     return 0;
@@ -0,0 +1,606 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Renderer.h"
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Renderer benchmarks
+// The first argument picks one: point-shadows, dir-shadows, shadow-cache, shadow-atlas, shadow-filters,
+// dirty-regions, depth-stream, target-formats, environment-swap. Each builds its scene, most of them a
+// field of 400 boxes, and switches to its next mode every 300 frames after printing the averages of the
+// mode that just ran.
+
+// averages over the frames of one mode
+struct BenchmarkStats
+{
+    float frameTime = 0.0f;	// ms
+    float shadowPassTime = 0.0f;
+    float mainPassTime = 0.0f;
+    double shadedSampleNum = 0.0;
+    float shadowUpdateNum = 0.0f;
+    float casterNum = 0.0f;	// directional layers and point lights
+    float pointFaceDrawNum = 0.0f;
+    float dirShadowDrawNum = 0.0f;
+    float atlasUsage = 0.0f;
+    float dirShadowUpdateArea = 0.0f;
+    double depthFetchMB = 0.0;
+    double interleavedFetchMB = 0.0;
+};
+
+class BenchmarkRenderer : public Renderer
+{
+public:
+    BenchmarkRenderer(const string &title, const vector<string> &modes_) : modes(modes_)
+    {
+        windowWidth = 1200;
+        windowHeight = 800;
+        // initalize window, should be called first
+        init(title, windowWidth, windowHeight);
+        setClearColor(vec3(0, 0, 0));
+        setMSAA(true);
+    }
+
+    virtual void addResources() override
+    {
+        for (auto &object : objects)
+            addObject(object.first, object.second);
+        for (auto &light : lights)
+            addLight(light.first, light.second);
+    }
+
+    virtual void userEvents() override
+    {
+        float time = glfwGetTime();
+        if (frameNum == 0)
+            startTime = time;
+        animate(time);
+
+        sums.shadowPassTime += getShadowPassTime();
+        sums.mainPassTime += getMainPassTime();
+        sums.shadedSampleNum += getShadedSampleNum();
+        sums.shadowUpdateNum += getShadowUpdateNum();
+        for (int num : getDirCasterNums())
+            sums.casterNum += num;
+        for (int num : getPointCasterNums())
+            sums.casterNum += num;
+        for (int num : getPointFaceDrawNums())
+            sums.pointFaceDrawNum += num;
+        sums.dirShadowDrawNum += getDirShadowDrawNum();
+        sums.atlasUsage += getShadowAtlasUsage();
+        sums.dirShadowUpdateArea += getDirShadowUpdateArea();
+        sums.depthFetchMB += getDepthFetchBytes() / 1048576.0;
+        sums.interleavedFetchMB += getInterleavedFetchBytes() / 1048576.0;
+
+        if (++frameNum % modeFrames != 0)
+            return;
+        BenchmarkStats stats = sums;
+        stats.frameTime = (time - startTime) * 1000.0f / modeFrames;
+        stats.shadowPassTime /= modeFrames;
+        stats.mainPassTime /= modeFrames;
+        stats.shadedSampleNum /= modeFrames;
+        stats.shadowUpdateNum /= modeFrames;
+        stats.casterNum /= modeFrames;
+        stats.pointFaceDrawNum /= modeFrames;
+        stats.dirShadowDrawNum /= modeFrames;
+        stats.atlasUsage /= modeFrames;
+        stats.dirShadowUpdateArea /= modeFrames;
+        stats.depthFetchMB /= modeFrames;
+        stats.interleavedFetchMB /= modeFrames;
+        cout << modes[mode] << ": ";
+        report(stats);
+        cout << endl;
+
+        mode = (mode + 1) % (int)modes.size();
+        setMode(mode);
+        startTime = time;
+        sums = BenchmarkStats();
+    }
+
+protected:
+    static const int modeFrames = 300;
+    int windowWidth;
+    int windowHeight;
+    int frameNum = 0;
+    int mode = 0;
+    shared_ptr<Camera> camera;
+    shared_ptr<Cube> ground;
+
+    virtual void setMode(int mode_) = 0;
+    virtual void animate(float time) {}
+    virtual void report(const BenchmarkStats &stats) = 0; // one line without the mode name
+
+    void createCamera(vec3 position, vec3 direction)
+    {
+        float aspect = (float)windowWidth / (float)windowHeight;
+        camera = make_shared<Camera>(aspect, position, direction);
+        setCamera(camera);
+    }
+
+    void add(const string &name, shared_ptr<Object> object) { objects.push_back({ name, object }); }
+    void add(const string &name, shared_ptr<Light> light) { lights.push_back({ name, light }); }
+
+    // a 60 x 60 ground with objectNum objects on a 3 unit grid, boxes of four heights or boxes and spheres
+    vector<shared_ptr<Object>> addField(int objectNum, vec3 color, bool spheres = false)
+    {
+        ground = make_shared<Cube>(60.0, 0.1, 60.0);
+        ground->setPosition(vec3(0, -0.05, 0));
+        ground->setMaterial(make_shared<Material>(vec3(1.0), vec3(0.8), vec3(0.1), 16));
+        add("ground", ground);
+
+        shared_ptr<Material> mtl = make_shared<Material>(vec3(1.0), color, vec3(0.3), 32);
+        vector<shared_ptr<Object>> field(objectNum);
+        for (int i = 0; i < objectNum; ++i)
+        {
+            if (spheres)
+            {
+                vec3 pos(-28.5 + (i % 20) * 3.0, 0.8, -28.5 + (i / 20) * 3.0);
+                if (i % 2)
+                    field[i] = make_shared<Sphere>(0.8f, 3, pos);
+                else
+                    field[i] = make_shared<Cube>(1.2, 1.6, 1.2, pos);
+            }
+            else
+            {
+                field[i] = make_shared<Cube>(0.8, 0.8 + i % 4 * 0.5, 0.8);
+                field[i]->setPosition(vec3(-28.5 + (i % 20) * 3.0, (0.8 + i % 4 * 0.5) * 0.5, -28.5 + (i / 20) * 3.0));
+            }
+            field[i]->setMaterial(mtl);
+            add("object" + to_string(i), field[i]);
+        }
+        return field;
+    }
+
+    vector<shared_ptr<PointLight>> addPointLights(int lightNum, vec3 color, float linear, float quadratic)
+    {
+        vector<shared_ptr<PointLight>> pointLights(lightNum);
+        for (int i = 0; i < lightNum; ++i)
+        {
+            pointLights[i] = make_shared<PointLight>(vec3(0.0f), color);
+            pointLights[i]->setAttenuation(1.0f, linear, quadratic);
+            add("pointLight" + to_string(i), pointLights[i]);
+        }
+        return pointLights;
+    }
+
+    // lights around the y axis, tilted down by height
+    vector<shared_ptr<DirectionalLight>> addDirLights(int lightNum, float height, vec3 color)
+    {
+        vector<shared_ptr<DirectionalLight>> dirLights(lightNum);
+        for (int i = 0; i < lightNum; ++i)
+        {
+            float angle = i * 6.2832f / lightNum;
+            dirLights[i] = make_shared<DirectionalLight>(vec3(cos(angle), -height, sin(angle)), color);
+            add("dirLight" + to_string(i), dirLights[i]);
+        }
+        return dirLights;
+    }
+
+    // point lights on circles around the origin
+    void circleLights(const vector<shared_ptr<PointLight>> &pointLights, float time, float radius, float radiusStep = 0.0f)
+    {
+        int lightNum = pointLights.size();
+        for (int i = 0; i < lightNum; ++i)
+        {
+            float angle = time * 0.3f + i * 6.2832f / lightNum;
+            float r = radius + (i % 3) * radiusStep;
+            pointLights[i]->setPosition(vec3(cos(angle) * r, 3.0f, sin(angle) * r));
+        }
+    }
+
+private:
+    vector<string> modes;
+    vector<pair<string, shared_ptr<Object>>> objects;
+    vector<pair<string, shared_ptr<Light>>> lights;
+    BenchmarkStats sums;
+    float startTime = 0.0f;
+};
+
+// Ten point lights circle over the field so every cube map is rendered each frame
+class PointShadowBenchmark : public BenchmarkRenderer
+{
+public:
+    PointShadowBenchmark() : BenchmarkRenderer("Point Shadows", { "geometry shader", "per face passes" })
+    {
+        createCamera(vec3(0.0f, 25.0f, 35.0f), vec3(0, -0.6, -1));
+        pointLights = addPointLights(10, vec3(0.6f), 0.14f, 0.07f);
+        addField(400, vec3(0.4, 0.6, 0.9));
+        setMode(0);
+    }
+
+protected:
+    virtual void setMode(int mode_) override
+    {
+        setPointShadowMode(mode_ ? PointShadowMode::PerFace : PointShadowMode::GeometryShader);
+    }
+
+    virtual void animate(float time) override { circleLights(pointLights, time, 8.0f, 7.0f); }
+
+    virtual void report(const BenchmarkStats &stats) override
+    {
+        cout << "shadow pass " << stats.shadowPassTime << " ms, " << stats.casterNum << " casters, "
+            << stats.pointFaceDrawNum << " face draws per frame";
+    }
+
+private:
+    vector<shared_ptr<PointLight>> pointLights;
+};
+
+// Five directional lights with four cascades each, 20 shadow layers, the camera turns so every layer is
+// rendered each frame
+class DirShadowBenchmark : public BenchmarkRenderer
+{
+public:
+    DirShadowBenchmark() : BenchmarkRenderer("Directional Shadows", { "pass per layer", "layered pass" })
+    {
+        createCamera(vec3(0.0f, 6.0f, 20.0f), vec3(0, -0.3, -1));
+        addDirLights(5, 2.0f, vec3(0.25f));
+        addField(400, vec3(0.5, 0.8, 0.4));
+        setShadowCascades(4, 0.75f, 50.0f);
+        setMode(0);
+    }
+
+protected:
+    virtual void setMode(int mode_) override
+    {
+        setDirShadowMode(mode_ ? DirShadowMode::Layered : DirShadowMode::PerLayer);
+    }
+
+    virtual void animate(float time) override { camera->processMouseMovement(1.0f, 0.0f); }
+
+    virtual void report(const BenchmarkStats &stats) override
+    {
+        cout << stats.frameTime << " ms per frame, shadow pass " << stats.shadowPassTime << " ms, "
+            << stats.dirShadowDrawNum << " draw calls, " << stats.casterNum << " casters per frame";
+    }
+};
+
+// One directional and three point lights over static boxes while the camera moves on its own and one
+// box circles through them
+class ShadowCacheBenchmark : public BenchmarkRenderer
+{
+public:
+    ShadowCacheBenchmark() : BenchmarkRenderer("Shadow Cache",
+        { "no shadow caching", "shadow caching", "shadow caching, static layers" })
+    {
+        createCamera(vec3(0.0f, 4.0f, 14.0f), vec3(0, -0.3, -1));
+        add("directionalLight", make_shared<DirectionalLight>(vec3(-0.5, -1.0, -0.3)));
+        vector<shared_ptr<PointLight>> pointLights = addPointLights(3, vec3(1.0f), 0.09f, 0.032f);
+        pointLights[0]->setPosition(vec3(6.0, 3.0, 0.0));
+        pointLights[0]->setColor(vec3(1.0, 0.8, 0.6));
+        pointLights[1]->setPosition(vec3(-6.0, 3.0, 0.0));
+        pointLights[1]->setColor(vec3(0.6, 0.8, 1.0));
+        pointLights[2]->setPosition(vec3(0.0, 3.0, -6.0));
+        for (auto &object : addField(400, vec3(0.9, 0.5, 0.3)))
+            object->setStatic(true);
+        ground->setStatic(true);
+        mover = make_shared<Cube>(1.0, 1.0, 1.0);
+        mover->setMaterial(make_shared<Material>(vec3(1.0), vec3(0.9, 0.5, 0.3), vec3(0.3), 32));
+        add("mover", mover);
+        setMode(0);
+    }
+
+protected:
+    virtual void setMode(int mode_) override
+    {
+        setShadowCaching(mode_ > 0);
+        setStaticShadowCache(mode_ == 2);
+    }
+
+    // the camera strafes and turns, only the mover changes the shadows
+    virtual void animate(float time) override
+    {
+        camera->processKeyboard(sin(time * 0.5f) > 0.0f ? CameraMovement::LEFT : CameraMovement::RIGHT, 0.01f);
+        camera->processMouseMovement(1.0f, 0.0f);
+        mover->setPosition(vec3(cos(time) * 4.0f, 0.5f, sin(time) * 4.0f));
+    }
+
+    virtual void report(const BenchmarkStats &stats) override
+    {
+        cout << stats.frameTime << " ms per frame, " << stats.shadowUpdateNum << " shadow maps rendered per frame, "
+            << stats.casterNum << " casters drawn per frame";
+    }
+
+private:
+    shared_ptr<Cube> mover;
+};
+
+// 24 point lights wander over the field while the camera flies over it, more lights than the cube map
+// array holds
+class ShadowAtlasBenchmark : public BenchmarkRenderer
+{
+public:
+    ShadowAtlasBenchmark() : BenchmarkRenderer("Shadow Atlas", { "cube map array", "atlas 64 MB", "atlas 16 MB" })
+    {
+        createCamera(vec3(0.0f, 12.0f, 30.0f), vec3(0, -0.4, -1));
+        pointLights = addPointLights(24, vec3(0.6f), 0.35f, 0.44f);
+        for (int i = 0; i < (int)pointLights.size(); ++i)
+            pointLights[i]->setColor(vec3(0.4f + i % 3 * 0.2f, 0.5f, 0.8f - i % 3 * 0.2f));
+        addField(400, vec3(0.8, 0.7, 0.5));
+        setClusteredShading(true);
+        setMode(0);
+    }
+
+protected:
+    virtual void setMode(int mode_) override { setShadowAtlas(mode_ > 0, mode_ == 1 ? 64 : 16); }
+
+    virtual void animate(float time) override
+    {
+        for (int i = 0; i < (int)pointLights.size(); ++i)
+        {
+            float t = time * 0.2f + i * 0.7f;
+            pointLights[i]->setPosition(vec3(sin(t * 1.3f) * 25.0f, 2.5f, cos(t * 0.9f + i) * 25.0f));
+        }
+        camera->processKeyboard(sin(time * 0.3f) > 0.0f ? CameraMovement::FORWARD : CameraMovement::BACKWARD, 0.02f);
+    }
+
+    virtual void report(const BenchmarkStats &stats) override
+    {
+        cout << stats.frameTime << " ms per frame, " << getShadowMapMemory() / (1 << 20) << " MB of shadow maps, "
+            << stats.atlasUsage * 100.0f << "% of the atlas in use";
+    }
+
+private:
+    vector<shared_ptr<PointLight>> pointLights;
+};
+
+// Three directional lights with four cascades each, the camera turns slowly
+class ShadowFilterBenchmark : public BenchmarkRenderer
+{
+public:
+    ShadowFilterBenchmark() : BenchmarkRenderer("Shadow Filters", { "PCF", "VSM", "EVSM" })
+    {
+        createCamera(vec3(0.0f, 5.0f, 18.0f), vec3(0, -0.3, -1));
+        addDirLights(3, 1.5f, vec3(0.35f));
+        addField(400, vec3(0.7, 0.7, 0.9));
+        setShadowCascades(4, 0.75f, 50.0f);
+        setMode(0);
+    }
+
+protected:
+    virtual void setMode(int mode_) override
+    {
+        setShadowFilter(mode_ == 0 ? ShadowFilter::PCF : mode_ == 1 ? ShadowFilter::VSM : ShadowFilter::EVSM);
+    }
+
+    virtual void animate(float time) override { camera->processMouseMovement(0.3f, 0.0f); }
+
+    virtual void report(const BenchmarkStats &stats) override
+    {
+        cout << "main pass " << stats.mainPassTime << " ms, "
+            << stats.mainPassTime * 1e6 / std::max(stats.shadedSampleNum, 1.0) << " ns per shaded sample, shadow pass "
+            << stats.shadowPassTime << " ms, " << getShadowMapMemory() / (1 << 20) << " MB of shadow maps";
+    }
+};
+
+// The camera stands still under a directional light with four cascades while one box is dragged around,
+// as with the transform widgets of the object panel
+class DirtyRegionBenchmark : public BenchmarkRenderer
+{
+public:
+    DirtyRegionBenchmark() : BenchmarkRenderer("Shadow Dirty Regions", { "whole layers", "dirty regions" })
+    {
+        createCamera(vec3(0.0f, 20.0f, 30.0f), vec3(0, -0.6, -1));
+        add("directionalLight", make_shared<DirectionalLight>(vec3(-0.4, -1.0, -0.3)));
+        addField(400, vec3(0.5, 0.7, 0.4));
+        dragged = make_shared<Cube>(1.0, 1.0, 1.0);
+        dragged->setMaterial(make_shared<Material>(vec3(1.0), vec3(0.9, 0.3, 0.2), vec3(0.3), 32));
+        add("dragged", dragged);
+        setShadowCascades(4);
+        setMode(0);
+    }
+
+protected:
+    virtual void setMode(int mode_) override { setShadowDirtyRegions(mode_ == 1); }
+
+    virtual void animate(float time) override
+    {
+        dragged->setPosition(vec3(cos(time * 0.7f) * 10.0f, 1.5f, sin(time * 0.4f) * 6.0f));
+    }
+
+    virtual void report(const BenchmarkStats &stats) override
+    {
+        cout << "shadow pass " << stats.shadowPassTime << " ms, " << stats.dirShadowUpdateArea * 100.0f
+            << "% of the layers rendered, " << stats.casterNum << " casters drawn per frame";
+    }
+
+private:
+    shared_ptr<Cube> dragged;
+};
+
+// Spheres and boxes under a directional light with four cascades and four circling point lights, so every
+// shadow map is rendered each frame, with the depth pre-pass on
+class DepthStreamBenchmark : public BenchmarkRenderer
+{
+public:
+    DepthStreamBenchmark() : BenchmarkRenderer("Depth Stream", { "interleaved vertex", "position stream" })
+    {
+        createCamera(vec3(0.0f, 20.0f, 30.0f), vec3(0, -0.6, -1));
+        add("directionalLight", make_shared<DirectionalLight>(vec3(-0.4, -1.0, -0.3)));
+        pointLights = addPointLights(4, vec3(0.5f), 0.14f, 0.07f);
+        addField(400, vec3(0.6, 0.6, 0.8), true);
+        setShadowCascades(4);
+        setDepthPrePass(true);
+        setMode(0);
+    }
+
+protected:
+    virtual void setMode(int mode_) override { setDepthPositionStream(mode_ == 1); }
+
+    virtual void animate(float time) override { circleLights(pointLights, time, 12.0f); }
+
+    virtual void report(const BenchmarkStats &stats) override
+    {
+        cout << "shadow pass " << stats.shadowPassTime << " ms, vertex fetch " << stats.depthFetchMB
+            << " MB per frame, " << stats.interleavedFetchMB << " MB interleaved";
+    }
+
+private:
+    vector<shared_ptr<PointLight>> pointLights;
+};
+
+// The depth stream scene with RSM indirect light in the gather pass, the memory of every render target
+// is printed after the pass times
+class TargetFormatBenchmark : public BenchmarkRenderer
+{
+public:
+    TargetFormatBenchmark() : BenchmarkRenderer("Render Target Formats", { "quality", "bandwidth" })
+    {
+        createCamera(vec3(0.0f, 20.0f, 30.0f), vec3(0, -0.6, -1));
+        add("directionalLight", make_shared<DirectionalLight>(vec3(-0.4, -1.0, -0.3)));
+        pointLights = addPointLights(4, vec3(0.5f), 0.14f, 0.07f);
+        addField(400, vec3(0.8, 0.4, 0.3), true);
+        setShadowCascades(4);
+        setRSMGatherPass(true);
+        setMode(0);
+    }
+
+protected:
+    virtual void setMode(int mode_) override
+    {
+        setRenderTargetFormats(mode_ == 1 ? RenderTargetFormats::bandwidth() : RenderTargetFormats::quality());
+    }
+
+    virtual void animate(float time) override { circleLights(pointLights, time, 12.0f); }
+
+    virtual void report(const BenchmarkStats &stats) override
+    {
+        cout << "main pass " << stats.mainPassTime << " ms, shadow pass " << stats.shadowPassTime << " ms";
+        GLuint64 total = 0;
+        for (auto &target : getRenderTargetMemory())
+        {
+            cout << endl << "    " << target.first << ": " << target.second / 1048576.0 << " MB";
+            total += target.second;
+        }
+        cout << endl << "    total: " << total / 1048576.0 << " MB";
+    }
+
+private:
+    vector<shared_ptr<PointLight>> pointLights;
+};
+
+// PBR spheres of rising roughness under an environment map that is replaced at every mode switch,
+// alternating the HDR bridge and the skybox faces. The next map is loaded 100 frames before the switch,
+// so the loading is not measured, the longest frame and the frames until the IBL maps were done are
+// taken from the first 200 frames of a mode
+class EnvironmentSwapBenchmark : public BenchmarkRenderer
+{
+public:
+    EnvironmentSwapBenchmark() : BenchmarkRenderer("Environment Swap", { "all at once", "1 ms slices" })
+    {
+        createCamera(vec3(0.0f, 0.0f, 12.0f), vec3(0, 0, -1));
+        add("direction light", make_shared<DirectionalLight>(vec3(-1, -1, -1)));
+        for (int i = 0; i < 8; ++i)
+        {
+            shared_ptr<Sphere> sphere = make_shared<Sphere>(0.8, 5, vec3(-7.0 + i * 2.0, 0.0, 0.0));
+            sphere->setMaterial(make_shared<PBRMaterial>(vec3(0.9), i % 2 ? 1.0 : 0.0, 0.05 + i * 0.12)); // albedo metallic roughness
+            add("sphere" + to_string(i), sphere);
+        }
+        cubeMap = loadEnvironment(0);
+        setPBRMode(true);
+        setIBLBudget(1000.0f);
+        lastTime = glfwGetTime();
+    }
+
+    virtual void addResources() override
+    {
+        BenchmarkRenderer::addResources();
+        addEnvironmentMap(cubeMap);
+        addSkybox(cubeMap);
+    }
+
+protected:
+    virtual void setMode(int mode_) override
+    {
+        setIBLBudget(mode_ == 1 ? 1.0f : 1000.0f);
+        addEnvironmentMap(nextMap);
+        addSkybox(nextMap);
+        nextMap = nullptr;
+        longestFrame = 0.0f;
+        readyFrame = -1;
+    }
+
+    virtual void animate(float time) override
+    {
+        int frame = frameNum % modeFrames;
+        if (frame < 200)
+        {
+            longestFrame = std::max(longestFrame, time - lastTime);
+            if (readyFrame < 0 && isIBLReady())
+                readyFrame = frame;
+        }
+        lastTime = time;
+        if (frame == 199)
+            nextMap = loadEnvironment(frameNum / modeFrames + 1);
+    }
+
+    virtual void report(const BenchmarkStats &stats) override
+    {
+        cout << "longest frame " << longestFrame * 1000.0f << " ms, IBL done after " << readyFrame << " frames";
+    }
+
+private:
+    shared_ptr<CubeMap> cubeMap;
+    shared_ptr<CubeMap> nextMap;
+    float lastTime = 0.0f;
+    float longestFrame = 0.0f;
+    int readyFrame = -1;
+
+    shared_ptr<CubeMap> loadEnvironment(int index)
+    {
+        shared_ptr<CubeMap> map = make_shared<CubeMap>();
+        if (index % 2 == 0)
+        {
+            map->loadHdr("./resources/pbr/textures/hdr/Brooklyn_Bridge_Planks_2k.hdr", 512);
+        }
+        else
+        {
+            vector<string> facesPath{ "resources/skybox/right.jpg", "resources/skybox/left.jpg",
+                "resources/skybox/top.jpg", "resources/skybox/bottom.jpg",
+                "resources/skybox/front.jpg", "resources/skybox/back.jpg" };
+            map->load(facesPath);
+        }
+        return map;
+    }
+};
+
+int main(int argc, char *argv[])
+{
+    string name = argc > 1 ? argv[1] : "";
+    shared_ptr<BenchmarkRenderer> r;
+    if (name == "point-shadows")
+        r = make_shared<PointShadowBenchmark>();
+    else if (name == "dir-shadows")
+        r = make_shared<DirShadowBenchmark>();
+    else if (name == "shadow-cache")
+        r = make_shared<ShadowCacheBenchmark>();
+    else if (name == "shadow-atlas")
+        r = make_shared<ShadowAtlasBenchmark>();
+    else if (name == "shadow-filters")
+        r = make_shared<ShadowFilterBenchmark>();
+    else if (name == "dirty-regions")
+        r = make_shared<DirtyRegionBenchmark>();
+    else if (name == "depth-stream")
+        r = make_shared<DepthStreamBenchmark>();
+    else if (name == "target-formats")
+        r = make_shared<TargetFormatBenchmark>();
+    else if (name == "environment-swap")
+        r = make_shared<EnvironmentSwapBenchmark>();
+    else
+    {
+        cout << "Usage: RenderBenchmarks point-shadows | dir-shadows | shadow-cache | shadow-atlas | shadow-filters"
+            " | dirty-regions | depth-stream | target-formats | environment-swap" << endl;
+        return 1;
+    }
+    r->run();
+
+    return 0;
+}
@@ -76,6 +76,8 @@ public:
 
 	glm::vec3 getPos() const { return position; }
 	glm::vec3 getViewDir() const { return front; }
+	float getNear() const { return near; }
+	float getFar() const { return far; }
 
 	// 
 	void processKeyboard(CameraMovement direction, float deltaTime);
@@ -20,20 +20,51 @@ public:
 	void loadHdr(const string &path, int resolution = 512);
 	void drawAsSkybox(const glm::mat4& view, const glm::mat4& projection);
 	void setGammaCorrection(bool b) { gammaCorrection = b; }
-	void preComputeMaps(); // generate irradianceMap, prefilterMap, brdfLUTTexture for IBL
+	void preComputeMaps(); // generate irradianceMap, prefilterMap, brdfLUTTexture for IBL at once
+
+	// Incremental precompute
+	// beginPreCompute() allocates the maps and queues their faces, mips and row tiles, every preComputeStep()
+	// then renders the queued tiles that fit in budget ms of GPU time, at least one. The time of a sample is
+	// measured with the timer query of the step two steps back. The BRDF LUT does not depend on the
+	// environment, a finished one of another cube map is reused when given.
+	void beginPreCompute(shared_ptr<Texture> brdfLUT = nullptr);
+	void preComputeStep(float budget);
+	bool isPreComputed() { return preComputeStarted && nextTask == tasks.size(); }
+	float getPreComputeProgress() { return totalCost > 0.0f ? doneCost / totalCost : 0.0f; }
+	// irradiance over PI as 9 SH coefficients, projected on the CPU when loading, the ambient light until
+	// the maps are done
+	const vector<glm::vec3> &getSHIrradiance() { return SHIrradiance; }
 
 	shared_ptr<Texture> getCubeMap() { return cubeMap; }
 	shared_ptr<Texture> getIrradianceMap() { return irradianceMap; }
 	shared_ptr<Texture> getPrefilterMapID() { return prefilterMap; }
 	shared_ptr<Texture> getBrdfLUTTextureID() { return brdfLUTTexture; }
 
+	// SH projection of the loaders, the samples of a face or an equirectangular image are added to sh
+	// and their weight returned, normalizeSH scales the sums to irradiance over PI
+	static glm::vec3 faceDirection(int face, float u, float v);
+	static float addSHFace(vector<glm::vec3> &sh, int face, const unsigned char *data, int width, int height, int channels);
+	static float addSHEquirect(vector<glm::vec3> &sh, const float *data, int width, int height, int channels);
+	static void normalizeSH(vector<glm::vec3> &sh, float weightSum);
+
 private:
+	struct PreComputeTask
+	{
+		int pass;	// 0 irradiance, 1 prefilter, 2 BRDF LUT
+		int face;
+		int mip;
+		int y0, y1;	// rows of the tile
+		float cost;	// samples of the tile
+	};
+
 	void init();
-	void generateIrradianceMap();
-	void generatePrefilterMap();
-	void generateBrdfLUTTexture();
+	void allocateMaps(shared_ptr<Texture> brdfLUT);
+	void queueTiles(int pass, int face, int mip, int size, float samples);
+	void runTask(const PreComputeTask &task);
+	void endPreCompute();
 
 	Cube box;
+	Rectangle rect;
 
 	bool gammaCorrection;
 	shared_ptr<Texture> cubeMap;
@@ -44,6 +75,23 @@ private:
 
 	shared_ptr<Shader> skyboxShader;
 
+	// Incremental precompute
+	bool preComputeStarted;
+	vector<PreComputeTask> tasks;
+	size_t nextTask;
+	float totalCost;
+	float doneCost;
+	float msPerSample;
+	GLuint captureFBO;
+	GLuint timeQueries[2];
+	float sliceCost[2];	// samples of the slice timed by the query, 0 for none
+	int stepNum;
+	shared_ptr<Shader> convolutionShader;
+	shared_ptr<Shader> prefilterShader;
+	shared_ptr<Shader> brdfLUTShader;
+
+	vector<glm::vec3> SHIrradiance;
+
 	glm::mat4 captureProjection;
 	vector<glm::mat4> captureViews;
 };
@@ -0,0 +1,110 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include "Mesh.h"
+#include "Light.h"
+#include "Shader.h"
+#include "Frustum.h"
+#include "Transform.h"
+using namespace std;
+
+// Generational entity handle
+// The generation changes when an index is reused, so handles of destroyed entities stay invalid.
+struct Entity
+{
+	unsigned int index;
+	unsigned int generation;
+
+	Entity() : index(0xffffffff), generation(0) {}
+	Entity(unsigned int index_, unsigned int generation_) : index(index_), generation(generation_) {}
+	bool valid() const { return index != 0xffffffff; }
+	bool operator==(const Entity &e) const { return index == e.index && generation == e.generation; }
+	bool operator!=(const Entity &e) const { return !(*this == e); }
+};
+
+// Sparse set of one component type
+// Components are packed in a dense array, iteration never touches entities without the component.
+// Removal moves the last component into the hole, so dense order is not stable.
+template<typename T>
+class ComponentArray
+{
+public:
+	void insert(Entity e, const T &component)
+	{
+		if (e.index >= sparse.size())
+			sparse.resize(e.index + 1, -1);
+		if (sparse[e.index] >= 0)
+		{
+			components[sparse[e.index]] = component;
+			entities[sparse[e.index]] = e;
+			return;
+		}
+		sparse[e.index] = components.size();
+		entities.push_back(e);
+		components.push_back(component);
+	}
+
+	void remove(Entity e)
+	{
+		if (!has(e))
+			return;
+		int i = sparse[e.index];
+		int last = components.size() - 1;
+		if (i != last)
+		{
+			components[i] = move(components[last]);
+			entities[i] = entities[last];
+			sparse[entities[i].index] = i;
+		}
+		components.pop_back();
+		entities.pop_back();
+		sparse[e.index] = -1;
+	}
+
+	bool has(Entity e) const
+	{
+		return e.index < sparse.size() && sparse[e.index] >= 0 && entities[sparse[e.index]].generation == e.generation;
+	}
+
+	T *get(Entity e) { return has(e) ? &components[sparse[e.index]] : nullptr; }
+
+	int size() const { return components.size(); }
+	T &operator[](int i) { return components[i]; }
+	vector<T> &getData() { return components; }
+	const vector<Entity> &getEntities() const { return entities; } // owner of each dense component
+
+private:
+	vector<int> sparse; // entity index -> dense index, -1 for none
+	vector<Entity> entities;
+	vector<T> components;
+};
+
+// Entity store of a scene
+// An entity is only a handle, its data lives in the component arrays below.
+// Names are an optional secondary index, unnamed entities cost no string work.
+class EntityStore
+{
+public:
+	Entity create(const string &name = ""); // invalid entity if the name is taken
+	void destroy(Entity e);	// also removes all components
+	bool isAlive(Entity e) const;
+
+	Entity find(const string &name) const;
+	string getName(Entity e) const;
+	int getEntityNum() const { return generations.size() - freeIndices.size(); }
+
+	// components
+	ComponentArray<TransformID> transforms;
+	ComponentArray<shared_ptr<Object>> meshes;
+	ComponentArray<BoundingBox> bounds; // world space
+	ComponentArray<shared_ptr<Light>> lights;
+	ComponentArray<shared_ptr<Shader>> shaders;
+
+private:
+	vector<unsigned int> generations;
+	vector<unsigned int> freeIndices;
+	unordered_map<string, Entity> nameIndex;
+	unordered_map<unsigned int, string> entityNames;
+};
@@ -0,0 +1,37 @@
+#pragma once
+#include <glm/glm.hpp>
+using namespace glm;
+
+// axis aligned bounding box
+struct BoundingBox
+{
+	BoundingBox() : minPos(vec3(0)), maxPos(vec3(0)), valid(false) {}
+	BoundingBox(vec3 minPos_, vec3 maxPos_) : minPos(minPos_), maxPos(maxPos_), valid(true) {}
+
+	void expand(const vec3 &p);
+	BoundingBox transform(const mat4 &m) const; // bounding box of the transformed box
+	vec3 center() const { return (minPos + maxPos) * 0.5f; }
+	vec3 extent() const { return (maxPos - minPos) * 0.5f; }
+
+	vec3 minPos;
+	vec3 maxPos;
+	bool valid;
+};
+
+// view frustum, planes are extracted from a view-projection matrix
+class Frustum
+{
+public:
+	Frustum();
+	Frustum(const mat4 &viewProjection);
+
+	void set(const mat4 &viewProjection);
+	bool intersects(const BoundingBox &box) const;
+	bool intersects(const vec3 &center, float radius) const;
+	const vec4 &getPlane(int i) const { return planes[i]; }
+	// the near plane passes everything, for shadow casters between a light and its volume
+	void extrudeNear() { planes[4] = vec4(0.0f, 0.0f, 0.0f, 1.0f); }
+
+private:
+	vec4 planes[6]; // left, right, bottom, top, near, far. xyz: normal, w: distance
+};
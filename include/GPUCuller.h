@@ -0,0 +1,97 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+#include "Shader.h"
+#include "Texture.h"
+using namespace std;
+
+// GPU driven culling
+// A compute pass tests the world bounding box of every object against a view and
+// writes one indirect draw command per sub mesh, culled sub meshes get zero instances.
+// Those commands serve the passes that still draw object by object.
+// Surviving draws are also compacted into a range per material group, draw() then issues
+// one multi draw per group from geometry merged over all objects. The draw count comes
+// from the GPU on OpenGL 4.6, otherwise the whole range is drawn and its unused commands
+// are zero. The base instance of a command is its object, it offsets the instanced object
+// index attribute, location 5, and vertex shaders with indirectDraw set read the matrices
+// at that index from the object buffer, binding 9.
+class GPUCuller
+{
+public:
+	GPUCuller();
+	~GPUCuller();
+
+	void init();
+	void setObjects(const vector<shared_ptr<Object>> &objects_); // rebuild draw list
+	void updateBounds();	// upload world space bounds, once per frame
+
+	void cull(const mat4 &viewProjection, bool occlusion = false); // frustum (and Hi-Z) test
+	void cullSphere(const vec3 &center, float radius);	// point light range test
+	// depth pyramid for next frame from the rendered width x height corner of the framebuffer, allocated once
+	// at the target size so dynamic resolution changes do not reallocate it
+	void buildHiZ(GLuint framebuffer, int width, int height, int targetWidth, int targetHeight, const mat4 &viewProjection);
+
+	// objects draw from the command buffer until unbind
+	void bindCommands();
+	void unbindCommands();
+	// visible draws of the last cull, one multi draw per material group, materials are left out
+	// for depth only shaders
+	void draw(shared_ptr<Shader> shader, bool positionStream = false, bool materials = true);
+
+	int getDrawNum() { return drawNum; }
+	int getVisibleNum() { return visibleNum; } // visible draws of the main view, one frame late
+	int getGroupNum() { return groups.size(); } // multi draws per pass
+
+private:
+	struct DrawGroup
+	{
+		shared_ptr<Material> material;
+		int firstCommand;	// range in the compacted commands
+		int commandNum;
+	};
+
+	vector<shared_ptr<Object>> objects;
+	vector<int> firstCommands;	// first command index of each object
+	vector<DrawGroup> groups;
+	int drawNum;
+	int visibleNum;
+
+	shared_ptr<Shader> cullShader;
+	shared_ptr<Shader> hiZShader;
+	GLuint boundsBuffer;	// per object world bounds
+	GLuint drawInfoBuffer;	// per draw object, index range and material group
+	GLuint commandBuffer;	// indirect commands, one per draw
+	GLuint drawCommandBuffer;	// visible commands compacted per group
+	GLuint groupCountBuffer;	// visible commands of each group, the parameter buffer of the multi draws
+	GLuint readbackBuffer;	// group count copy, read in the next frame
+	GLuint objectBuffer;	// model and normal matrix of each object
+
+	// merged geometry, the indices are absolute so both streams take the same commands
+	GLuint mergedVAO;
+	GLuint mergedVBO;
+	GLuint mergedEBO;
+	GLuint mergedDepthVAO;	// positions only
+	GLuint mergedDepthVBO;
+	GLuint mergedDepthEBO;
+	GLuint objectIndexVBO;	// 0 to object count - 1, instanced in both merged VAOs
+
+	// Hi-Z pyramid of the previous frame
+	GLuint hiZFBO;
+	shared_ptr<Texture> hiZDepth;
+	shared_ptr<Texture> hiZ;
+	int hiZWidth;	// allocated size
+	int hiZHeight;
+	int hiZLevels;
+	int hiZRenderWidth;	// part of level 0 the pyramid was built from
+	int hiZRenderHeight;
+	mat4 hiZViewProjection;
+	bool hiZValid;
+
+	void dispatch(const mat4 &viewProjection, const vec4 &sphere, int mode);
+	void createHiZ(int width, int height);
+	void mergeGeometry(vector<GLuint> &drawInfos);
+	void bindObjectIndices();
+};
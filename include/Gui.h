@@ -9,6 +9,7 @@
 #include "Light.h"
 #include "Mesh.h"
 #include "Material.h"
+#include "EntityStore.h"
 using namespace std;
 
 class Renderer;
@@ -25,9 +26,8 @@ public:
 private:
 	friend class Renderer;
 	GLFWwindow *window;
-	map<string, shared_ptr<Object>> objects;
-	map<string, shared_ptr<Light>> lights;
-	map<string, shared_ptr<Material>> materials;
+	EntityStore items; // edited objects, lights and materials by name
+	ComponentArray<shared_ptr<Material>> materials; // material entries of items
 	vector<string> names;
 	char** cNames;
 
@@ -0,0 +1,64 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+using namespace std;
+
+struct Job
+{
+	function<void()> task;
+	shared_ptr<Job> parent;
+	atomic<int> unfinished; // itself and unfinished children
+};
+typedef shared_ptr<Job> JobHandle;
+
+// Work stealing job scheduler
+// Every thread owns a deque, it pushes and pops jobs at the back while idle threads steal from the front.
+// A job is finished when its task and all of its children are finished.
+// OpenGL calls must go through runOnMainThread, the renderer executes them once per frame.
+class JobSystem
+{
+public:
+	static void init(int workerNum = -1); // -1: one worker per additional hardware thread
+	static void shutdown();
+	static int getThreadNum(); // workers and main thread
+	static bool isMainThread();
+
+	static JobHandle create(function<void()> task, JobHandle parent = nullptr);
+	static void run(JobHandle job);
+	static void wait(JobHandle job); // executes other jobs while waiting
+
+	// split [0, count) into ranges, func(begin, end) is called for each range
+	static void parallelFor(int count, function<void(int, int)> func, int grainSize = 0);
+
+	// main thread affinity queue
+	static void runOnMainThread(function<void()> task);
+	static void processMainThreadJobs();
+
+private:
+	struct WorkQueue
+	{
+		mutex queueMutex;
+		deque<JobHandle> jobs;
+	};
+
+	static vector<unique_ptr<WorkQueue>> queues; // 0: main thread
+	static vector<thread> workers;
+	static atomic<bool> running;
+	static mutex sleepMutex;
+	static condition_variable wakeUp;
+	static mutex mainThreadMutex;
+	static vector<function<void()>> mainThreadJobs;
+	static thread::id mainThreadID;
+	static thread_local int threadIndex;
+
+	static void workerLoop(int index);
+	static JobHandle getJob();
+	static void execute(JobHandle job);
+	static void finish(Job *job);
+};
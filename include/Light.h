@@ -24,6 +24,9 @@ public:
 	vec3 getDiffuse() { return diffuseStrength; }
 	vec3 getSpecular() { return specularStrength; }
 	LightType getType() { return type; }
+	// changes whenever a parameter changes, never shared by two lights,
+	// so a cached shadow map can remember which light state it was rendered with
+	unsigned int getVersion() { return version; }
 	virtual void setShaderAttr(std::shared_ptr<Shader> shader, int lightNum) = 0; // shaderı
 
 protected:
@@ -34,8 +37,13 @@ protected:
 	vec3 specularStrength;
 
 	void updateLightStrength(); 
+	void markChanged() { version = ++versionCounter; }
 
 	LightType type;
+
+private:
+	unsigned int version;
+	static unsigned int versionCounter;
 };
 
 // Դ
@@ -48,14 +56,18 @@ public:
 	void setPosition(vec3 pos);
 	vec3 getPos() { return position; }
 	void setAttenuation(float constant_, float linear_, float quadratic_);
+	float getConstant() { return constant; }
+	float getLinear() { return linear; }
+	float getQuadratic() { return quadratic; }
+	float getRange(float threshold = 5.0f / 256.0f); // distance where the light falls below threshold
 	virtual void setShaderAttr(std::shared_ptr<Shader> shader, int lightNum) override;
 
+private:
+	vec3 position;
 	// attenuation coefficient
 	float constant;
 	float linear;
 	float quadratic;
-private:
-	vec3 position;
 
 };
 
@@ -0,0 +1,77 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "Light.h"
+#include "Shader.h"
+using namespace std;
+using namespace glm;
+
+// Clustered light assignment
+// The view frustum is split into a grid of froxels, screen tiles in x and y and exponential
+// depth slices in z. Every frame the point light spheres are binned into the froxels on the
+// CPU, one job per depth slice, and uploaded to three SSBOs the fragment shaders read:
+//	binding 4: light data, binding 5: offset and count of every cluster, binding 6: light indices.
+// A fragment then only loops over the lights of its own cluster.
+class LightClusters
+{
+public:
+	LightClusters(int tileX = 16, int tileY = 9, int sliceNum = 24);
+	~LightClusters();
+
+	void init();
+	// shadowNum: the first point lights that own a cube shadow map
+	void assign(const vector<shared_ptr<PointLight>> &lights, const mat4 &view, const mat4 &projection,
+		float near, float far, int shadowNum = 0);	// CPU binning
+	void upload();	// write the SSBOs
+	void bind();	// bind the SSBOs for drawing
+	void setShaderAttr(shared_ptr<Shader> shader, vec2 screenSize); // grid size and depth slicing
+
+	int getClusterNum() { return tileX * tileY * sliceNum; }
+	int getLightNum() { return lightNum; }
+	int getIndexNum() { return indices.size(); }	// light references over all clusters
+	int getMaxClusterLightNum() { return maxClusterLightNum; }
+
+private:
+	// std430 layout, must match the shaders
+	struct LightData
+	{
+		vec4 position;		// xyz: world position, w: range
+		vec4 ambient;		// w: cube shadow map index, -1 for none
+		vec4 diffuse;
+		vec4 specular;
+		vec4 attenuation;	// constant, linear, quadratic
+	};
+	// view space sphere and depth slices touched by it
+	struct LightBounds
+	{
+		vec3 center;
+		float radius;
+		int firstSlice;
+		int lastSlice;	// less than firstSlice if the light is not visible
+	};
+
+	int tileX;
+	int tileY;
+	int sliceNum;
+	float near;
+	float far;
+	float sliceScale;	// slice = log(depth) * sliceScale + sliceBias
+	float sliceBias;
+	int lightNum;
+	int maxClusterLightNum;
+
+	vector<LightData> lightData;
+	vector<LightBounds> lightBounds;
+	vector<vector<GLuint>> clusterLights;	// light indices of every cluster, storage is reused
+	vector<GLuint> grid;					// offset and count of every cluster
+	vector<GLuint> indices;
+
+	GLuint lightBuffer;
+	GLuint gridBuffer;
+	GLuint indexBuffer;
+
+	float sliceDepth(int slice);
+	void assignSlice(int slice, float projX, float projY);
+};
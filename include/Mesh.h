@@ -9,6 +9,8 @@
 #include <map>
 #include "Material.h"
 #include "Shader.h"
+#include "Frustum.h"
+#include "Transform.h"
 using namespace std;
 
 struct VertexIndex
@@ -27,32 +29,82 @@ public:
 
 	void setMaterial(shared_ptr<Material> mtl);
 	virtual void draw(shared_ptr<Shader> shader);
+	// depth only without materials, from the position stream unless positionStream is false
+	void drawDepth(shared_ptr<Shader> shader, bool positionStream = true);
+	// depth only, every sub mesh drawn directly instanceNum times without materials or indirect commands
+	void drawInstanced(shared_ptr<Shader> shader, int instanceNum, bool positionStream = true);
 
-	void setTransform(const vec3& pos_, const vec3& scale_, const vector<float>& rotation_);
+	// local transform, relative to the parent
+	void setTransform(const vec3& pos_, const vec3& scale_, const vec3& rotation_);
 	void setPosition(const vec3& pos_);
 	void setScale(const vec3& scale_);
-	void setRotation(const vector<float>& rotation_);
+	void setRotation(const vec3& rotation_);
 	void setRotateX(float degree);
 	void setRotateY(float degree);
 	void setRotateZ(float degree);
+	void setParent(shared_ptr<Object> parent); // nullptr to detach
 
-	mat4 getTransMat() { return modelMatrix; }
+	// world matrix of the last TransformSystem::update, stale after a setter until the next update,
+	// the renderer updates at the start of every frame
+	mat4 getTransMat() { return TransformSystem::getWorldMatrix(transform); }
 	glm::vec3 getPosition() { return position; }
 	glm::vec3 getScale() { return scale; }
-	vector<float> getRotation() { return rotateAngle; }
+	glm::vec3 getRotation() { return rotateAngle; }
+	TransformID getTransform() { return transform; }
+	BoundingBox getBoundingBox() { return localBounds.transform(getTransMat()); } // world space bounding box, as stale as getTransMat
+	BoundingBox getLocalBoundingBox() { return localBounds; }
+	int getSubMeshNum() { return indices.size(); }
+	int getIndexNum(int subMesh) { return indices[subMesh].size(); }
+	const vector<glm::vec3> &getVertices() { return vertices; } // object space, kept after bind()
+	const vector<unsigned int> &getIndices(int subMesh) { return indices[subMesh]; }
+	vector<float> getInterleavedData() { return transformToInterleavedData(); } // layout of the main pass VAOs
+	virtual shared_ptr<Material> getMaterial(int subMesh); // nullptr when the sub mesh has none
+	int getTriangleNum();
+	// bytes of the vertices the sub meshes use, in the interleaved stream and in the position stream
+	int getVertexFetchBytes() { return vertexFetchBytes; }
+	int getDepthFetchBytes() { return depthFetchBytes; }
+
+	// software occlusion culling, flagged objects are always rendered as occluders
+	void setOccluder(bool b) { occluder = b; }
+	bool isOccluder() { return occluder; }
+	// hardware occlusion queries, for objects that are often hidden and costly to draw
+	void setOcclusionQuery(bool b) { occlusionQuery = b; }
+	bool isOcclusionQuery() { return occlusionQuery; }
+	// static objects are kept in cached shadow layers, see Renderer::setStaticShadowCache,
+	// call Renderer::invalidateShadows after changing it on an added object
+	void setStatic(bool b) { staticObject = b; }
+	bool isStatic() { return staticObject; }
+
+	// draw sub meshes with commands written by GPU culling, buffer 0 for direct drawing
+	void setIndirectBuffer(unsigned int buffer, int firstCommand = 0);
 
 	void bind();
 
+	// one position for every set of vertices at exactly the same place, remap gives the position of each vertex
+	static void weldPositions(const vector<vec3> &points, vector<vec3> &positions, vector<unsigned int> &remap);
+
 protected:
 	unsigned int VBO;
 	vector<unsigned int> VAOs;
 	vector<unsigned int> EBOs;
+	// position stream of the depth passes, vertices with the same position are welded into one
+	unsigned int depthVBO;
+	vector<unsigned int> depthVAOs;
+	vector<unsigned int> depthEBOs;
+	int vertexFetchBytes;
+	int depthFetchBytes;
 
 	vec3 position; // mesh middle position
 	vec3 scale;
-	vector<float> rotateAngle; // rotate angles of three axis
-	mat4 modelMatrix;
-	mat4 transInvModelMatrix; // transpose(inverse(modelMatrix))
+	vec3 rotateAngle; // rotate angles of three axis
+	TransformID transform; // model and normal matrices live in the transform system
+	BoundingBox localBounds;
+
+	unsigned int indirectBuffer;
+	int indirectFirstCommand;
+	bool occluder;
+	bool occlusionQuery;
+	bool staticObject;
 
 	int drawVertexNum;
 	int faceNum;
@@ -68,7 +120,9 @@ protected:
 
 	vector<float> transformToInterleavedData();
 
-	void updateModelMatrix(); // update model matrix according current position and scale
+	void drawSubMesh(int i, bool positionStream = false);
+	void bindDepthStream();
+	void updateModelMatrix(); // push current position, rotation and scale to the transform system
 	pair<vec3, vec3> computeTB(const vec3& pos1, const vec3& pos2, const vec3& pos3,
 		const vec2& uv1, const vec2& uv2, const vec2& uv3);	// compute tangent and bitangent
 };
@@ -98,6 +152,7 @@ public:
 	void loadObj(const string &path);	// load obj model
 
 	virtual void draw(shared_ptr<Shader> shader) override;
+	virtual shared_ptr<Material> getMaterial(int subMesh) override;
 
 private:
 	vector<string> materialName;
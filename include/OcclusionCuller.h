@@ -0,0 +1,83 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "Frustum.h"
+using namespace std;
+using namespace glm;
+
+// Software occlusion culling
+// A few large occluders are rasterized on the CPU into a small depth buffer, then the
+// screen bounds of other objects are tested against it before they are submitted.
+// The screen is split into tiles, every tile is rasterized by one job with SSE, four
+// pixels at a time, and keeps the farthest depth of each 8x8 block for a coarse test.
+// Depth is stored as 1/w, which is linear in screen space, larger is nearer and 0 is empty,
+// so it needs a perspective projection. Only CPU memory is touched, no GL context is needed.
+class OcclusionCuller
+{
+public:
+	OcclusionCuller(int width = 256, int height = 128);
+
+	// occluders: objects covering at least minScreenArea of the screen with at most maxTriangleNum triangles
+	void setOccluderSelection(float minScreenArea, int maxTriangleNum);
+	bool selectOccluder(const BoundingBox &box, int triangleNum) const;
+	float getScreenArea(const BoundingBox &box) const; // covered fraction of the screen, 1 if it crosses the near plane
+
+	void begin(const mat4 &viewProjection_);	// clear occluders and depth
+	// the data must stay alive until rasterize()
+	void addOccluder(const vec3 *vertices, const unsigned int *indices, int triangleNum, const mat4 &model);
+	void rasterize();	// render the occluders on worker threads
+	bool isVisible(const BoundingBox &box) const;
+	void cull(const vector<BoundingBox> &bounds, vector<char> &visible); // test boxes with visible set, in parallel
+
+	int getWidth() { return width; }
+	int getHeight() { return height; }
+	const vector<float> &getDepth() { return depth; }
+
+	// statistics of the last frame
+	int getOccluderNum() { return occluders.size(); }
+	int getOccluderTriangleNum() { return triangles.size(); } // after clipping and culling
+	int getTestedNum() { return testedNum; }
+	int getOccludedNum() { return occludedNum; }
+	float getRasterizeTime() { return rasterizeTime; } // ms
+	float getTestTime() { return testTime; }	// ms
+
+private:
+	struct Occluder
+	{
+		const vec3 *vertices;
+		const unsigned int *indices;
+		int triangleNum;
+		mat4 mvp;
+	};
+	// pixel space x and y, NDC z
+	struct ScreenTriangle
+	{
+		vec3 v[3];
+		int minX, minY, maxX, maxY; // pixel bounds, inclusive
+	};
+
+	int width;
+	int height;
+	int tileNumX;
+	int tileNumY;
+	int blockNumX;	// 8x8 blocks of the coarse depth
+	int blockNumY;
+	float minScreenArea;
+	int maxTriangleNum;
+
+	mat4 viewProjection;
+	vector<Occluder> occluders;
+	vector<ScreenTriangle> triangles;
+	vector<vector<int>> tileTriangles;	// triangles overlapping each tile
+	vector<float> depth;
+	vector<float> blockDepth;			// farthest depth of each block
+
+	int testedNum;
+	int occludedNum;
+	float rasterizeTime;
+	float testTime;
+
+	void setupTriangles(const Occluder &occluder, int first, int num, vector<ScreenTriangle> &out) const;
+	void addTriangle(const vec4 *clip, int vertexNum, vector<ScreenTriangle> &out) const;
+	void rasterizeTile(int tile);
+};
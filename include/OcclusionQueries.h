@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+#include "Shader.h"
+using namespace std;
+
+// Hardware occlusion queries
+// Objects that opt in with Object::setOcclusionQuery are drawn by the last known result:
+//	visible:	drawn directly inside a query, the result decides the next frames
+//	occluded:	only the bounding box is drawn inside a query, with color and depth writes off,
+//				then the object is drawn under conditional rendering on that query
+// Results are read once available, the CPU never waits for them and a query stays
+// in flight until its result arrives. Queries use GL_ANY_SAMPLES_PASSED_CONSERVATIVE,
+// so no other occlusion query may be active at the same time.
+class OcclusionQueries
+{
+public:
+	OcclusionQueries();
+	~OcclusionQueries();
+
+	void init();
+	// objects without a query are drawn first, so their depth can occlude the others
+	void render(const vector<shared_ptr<Object>> &objects, const mat4 &viewProjection,
+		const function<void(shared_ptr<Object>)> &drawObject);
+
+	// statistics of the last frame
+	int getQueryNum() { return queryNum; }			// queries issued
+	int getResultNum() { return resultNum; }		// results read
+	int getConditionalNum() { return conditionalNum; } // objects drawn under conditional rendering
+	float getHitRate() { return hitRate; }			// occluded fraction of the results read
+	float getLatency() { return latency; }			// average frames from issue to result
+
+private:
+	struct Query
+	{
+		weak_ptr<Object> object;
+		GLuint id;
+		bool pending;
+		bool visible;	// last result
+		int issueFrame;
+	};
+	unordered_map<Object *, Query> queries;
+	int frame;
+
+	shared_ptr<Shader> boxShader;
+	GLuint boxVAO;
+	GLuint boxVBO;
+	GLuint boxEBO;
+
+	int queryNum;
+	int resultNum;
+	int conditionalNum;
+	float hitRate;
+	float latency;
+
+	void readResults();
+	void drawBox(const BoundingBox &box);
+};
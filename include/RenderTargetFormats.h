@@ -0,0 +1,30 @@
+#pragma once
+#include <glad/glad.h>
+using namespace std;
+
+// Internal formats of the render targets, applied with Renderer::setRenderTargetFormats
+// quality() keeps full precision targets, bandwidth() the smaller ones:
+//	sceneColor:		R11F_G11F_B10F keeps HDR range at the size of RGB8
+//	pointShadow:	16 bit depth, point shadows store the linear distance to the light
+//	RSMNormal:		RG16_SNORM holds octahedral normals
+//	RSMPosition:	off, RSM positions are rebuilt from the RSM depth and the light matrix
+//	RSMIndirect:	R11F_G11F_B10F, the gather pass writes no alpha
+struct RenderTargetFormats
+{
+	GLenum sceneColor;	// lit scene and post processing color
+	GLenum dirShadow;	// directional layers and their static copies
+	GLenum pointShadow;	// cube map arrays, their static copies and the shadow atlas
+	GLenum RSMDepth;
+	GLenum RSMNormal;
+	bool RSMPosition;	// store RSM positions in their own target
+	GLenum RSMFlux;
+	GLenum RSMIndirect;	// low resolution result of the RSM gather pass
+
+	static RenderTargetFormats quality();
+	static RenderTargetFormats bandwidth();
+};
+
+// bytes of a texel, three channel formats are counted padded to four as GPUs store them
+int getBytesPerTexel(GLenum internalFormat);
+// pixel format to specify storage of a color or depth format without data, with GL_FLOAT as the type
+GLenum getPixelFormat(GLenum internalFormat);
@@ -12,9 +12,51 @@
 #include "Light.h"
 #include "CubeMap.h"
 #include "Gui.h"
+#include "Frustum.h"
+#include "GPUCuller.h"
+#include "JobSystem.h"
+#include "EntityStore.h"
+#include "LightClusters.h"
+#include "OcclusionCuller.h"
+#include "OcclusionQueries.h"
+#include "ResolutionScaler.h"
+#include "VPLClusters.h"
+#include "ShadowAtlas.h"
+#include "RenderTargetFormats.h"
 
 using namespace std;
 
+enum class RenderPath
+{
+	Forward,
+	Deferred
+};
+
+enum class PointShadowMode
+{
+	GeometryShader,	// one pass per light, a geometry shader copies triangles to the faces
+	PerFace			// one pass per face with the objects in the face frustum
+};
+
+enum class DirShadowMode
+{
+	PerLayer,	// one pass per light or cascade
+	Layered		// one instanced pass for all of them, every caster is submitted once
+};
+
+enum class ShadowFilter
+{
+	PCF,	// 25 depth comparisons per fragment
+	VSM,	// one filtered fetch of depth moments
+	EVSM	// one filtered fetch of the moments of two exponential warps of depth, less light bleeding
+};
+
+enum class UpscaleFilter
+{
+	Bilinear,
+	Sharpen
+};
+
 class Renderer
 {
 public:
@@ -30,11 +72,16 @@ public:
 
 	void draw(shared_ptr<Object> object, shared_ptr<Shader> shader = nullptr);
 
-	void addObject(string meshName, shared_ptr<Object> mesh);
-	void addLight(string lightName, shared_ptr<Light> light);
-	void addShader(string shaderName, shared_ptr<Shader> shader_);
+	// an empty name adds an unnamed entity
+	Entity addObject(string meshName, shared_ptr<Object> mesh);
+	Entity addLight(string lightName, shared_ptr<Light> light);
+	Entity addShader(string shaderName, shared_ptr<Shader> shader_);
+	void removeEntity(Entity e);
+	Entity findEntity(const string &name);
 	void addSkybox(shared_ptr<CubeMap> skybox_);
 	void addGui(shared_ptr<Gui> gui_);
+	// the IBL maps are precomputed over the next frames, until they are done the previous environment map
+	// stays bound, or the SH ambient of the new one when there is none
 	void addEnvironmentMap(shared_ptr<CubeMap> envMap_);
 	void addPostprocessingShader(shared_ptr<Shader> shader);
 
@@ -42,6 +89,133 @@ public:
 	void setCamera(shared_ptr<Camera> camera_);
 	void setMSAA(bool b);
 	void setPBRMode(bool b);
+	void setIBLBudget(float ms) { IBLBudget = ms; } // GPU time per frame for the IBL precompute, 1 ms by default
+	bool isIBLReady() { return !pendingEnvMap && envMap && envMap->isPreComputed(); }
+	float getIBLProgress() { return pendingEnvMap ? pendingEnvMap->getPreComputeProgress() : (envMap ? 1.0f : 0.0f); }
+	void setFrustumCulling(bool b);
+	void setGPUCulling(bool b); // compute shader culling for main view and shadow views
+	void setOcclusionCulling(bool b); // CPU occlusion culling of the main view, unused with GPU culling
+	shared_ptr<OcclusionCuller> getOcclusionCuller() { return occlusionCuller; }
+	void setOcclusionQueries(bool b); // GPU queries for opted in objects, unused with GPU culling, call after init()
+	shared_ptr<OcclusionQueries> getOcclusionQueries() { return occlusionQueries; }
+	void setDepthPrePass(bool b); // depth only pass before shading, worth it for expensive shaders
+	void setRenderPath(RenderPath path); // deferred shading is used in phong mode only
+	void setClusteredShading(bool b); // point lights are read from per cluster light lists
+	shared_ptr<LightClusters> getLightClusters() { return lightClusters; }
+	// the scene renders at a scale of the window size that holds the target GPU frame time, call after init()
+	void setDynamicResolution(bool b);
+	void setResolutionScaleRange(float minScale, float maxScale); // above 1 supersamples
+	void setTargetFrameTime(float ms);
+	void setUpscaleFilter(UpscaleFilter filter, float sharpness_ = 0.5f);
+	shared_ptr<ResolutionScaler> getResolutionScaler() { return resolutionScaler; }
+	// RSM indirect light of the forward phong pass from a few samples per frame and a history, call after init()
+	void setTemporalRSM(bool b, int sampleNum = 32, int maxHistoryLength = 32);
+	// RSM indirect light in its own pass at 1/downsample of the render size, then bilateral upsampled,
+	// takes the place of the temporal mode, call after init()
+	void setRSMGatherPass(bool b, int downsample = 2);
+	// forward phong pass gathers from a few hundred VPLs reduced from the RSM, call after init()
+	void setVPLClustering(bool b);
+	shared_ptr<VPLClusters> getVPLClusters() { return vplClusters; }
+	// shadow maps and the RSM are kept until their light changes or a caster inside the light volume
+	// moves, is added or removed, on by default
+	void setShadowCaching(bool b);
+	void invalidateShadows(); // render all of them again, for changes that are not tracked such as mesh data
+	int getShadowUpdateNum() { return shadowUpdateNum; } // shadow maps and RSM rendered in the last frame
+	// static objects are drawn into a second set of shadow layers only when they or the light change,
+	// a shadow update copies that layer and draws the dynamic objects on top, call after init()
+	void setStaticShadowCache(bool b);
+	// directional shadows in cascades fitted to the camera frustum up to shadowDistance (0 for the camera
+	// far plane), splits blend linear and log spacing by splitLambda, every cascade takes a layer of the
+	// shadow map array, 0 cascades keeps one fixed box around the origin, call after init()
+	void setShadowCascades(int cascadeNum_, float splitLambda = 0.75f, float shadowDistance_ = 0.0f);
+	const vector<float> &getCascadeSplits() { return cascadeSplits; } // far view depth of each cascade
+	// shadow casters drawn in the last frame per directional layer (light * cascades + cascade) and per
+	// point light, 0 for maps kept from earlier frames, face draws count every cube face a caster went to
+	const vector<int> &getDirCasterNums() { return dirCasterNums; }
+	const vector<int> &getPointCasterNums() { return pointCasterNums; }
+	const vector<int> &getPointFaceDrawNums() { return pointFaceDrawNums; }
+	void setPointShadowMode(PointShadowMode mode) { pointShadowMode = mode; }
+	float getShadowPassTime() { return shadowPassTime; } // GPU time in ms of the shadow maps, RSM excluded
+	void setDirShadowMode(DirShadowMode mode) { dirShadowMode = mode; }
+	int getDirShadowDrawNum() { return dirShadowDrawNum; } // draw calls of the directional layers in the last frame
+	// point light shadows in tiles of one depth atlas instead of the cube map array, without a limit on
+	// the lights: the faces of a light get tiles sized by the share of the screen its range covers, up
+	// to maxTileSize, lights out of view get none, the atlas is the largest power of two square that
+	// fits memoryBudgetMB, faces are drawn one by one, call after init()
+	void setShadowAtlas(bool b, int memoryBudgetMB = 64, int maxTileSize = 1024);
+	float getShadowAtlasUsage() { return shadowAtlas ? atlasLayout.getUsage() : 0.0f; }
+	// with shadow caching, a directional layer where only casters changed is cleared and drawn again only
+	// inside the light space rectangle around their old and new bounds, with the casters overlapping it,
+	// cascades keep that while the camera stands still, on by default
+	void setShadowDirtyRegions(bool b) { shadowDirtyRegions = b; }
+	float getDirShadowUpdateArea() { return dirShadowUpdateArea; } // rendered share of the directional layers in the last frame
+	// shadow maps and the depth pre-pass read a position only stream with welded vertices instead of
+	// the interleaved vertex, on by default
+	void setDepthPositionStream(bool b) { depthPositionStream = b; }
+	// estimated vertex fetch of those passes in the last frame, the vertices of every draw read once,
+	// and the same draws from the interleaved vertex
+	long long getDepthFetchBytes() { return depthFetchBytes; }
+	long long getInterleavedFetchBytes() { return interleavedFetchBytes; }
+	GLuint64 getShadowMapMemory(); // bytes of all shadow map storage, static layers included
+	// internal formats of the render targets, quality() by default, every target is allocated again
+	// and the shadow atlas keeps its size, call after init()
+	void setRenderTargetFormats(const RenderTargetFormats &formats);
+	const RenderTargetFormats &getRenderTargetFormats() { return targetFormats; }
+	vector<pair<string, GLuint64>> getRenderTargetMemory(); // bytes of every render target in use, by name
+	// directional shadows from moments prefiltered whenever a layer is rendered: a separable Gaussian of
+	// blurRadius texels, then mips, lightBleedReduction cuts off the lit tail of the bound and
+	// evsmExponents are the positive and negative warps of EVSM, call after init()
+	void setShadowFilter(ShadowFilter filter, int blurRadius = 2, float lightBleedReduction_ = 0.2f,
+		vec2 evsmExponents_ = vec2(40.0f, 5.0f));
+
+	// main pass statistics of the previous frame, no samples are counted with occlusion queries on,
+	// the RSM gather pass is included
+	GLuint64 getShadedSampleNum() { return shadedSampleNum; }
+	float getMainPassTime() { return mainPassTime; } // GPU time in ms
+
+protected:
+	// Reflective shadow map
+	GLuint RSMBuffer;
+	GLuint RSMBufferSize;
+	shared_ptr<Shader> RSMBufferShader;
+	shared_ptr<Texture> RSM_depth;
+	shared_ptr<Texture> RSM_position;
+	shared_ptr<Texture> RSM_normal;
+	shared_ptr<Texture> RSM_flux;
+	void initialRSMBuffers();
+	void allocateRSMBuffers();
+	void renderRSMBuffers();
+
+	// Temporal RSM, written through extra main pass attachments and read back next frame
+	bool temporalRSM;
+	int temporalRSMSampleNum;
+	int RSMHistoryLength;
+	shared_ptr<Texture> RSMHistory[2];			// RGBA16F, indirect light and view depth
+	shared_ptr<Texture> RSMHistoryNormal[2];	// RGBA16F, normal and history length
+	int RSMHistoryIndex;	// written this frame
+	int RSMFrameIndex;
+	mat4 prevViewProjection;
+	vec2 prevUVScale;
+	void allocateRSMHistory(int width, int height);
+	void beginTemporalRSM();
+	void endTemporalRSM(const mat4 &viewProjection);
+
+	// RSM gather pass, the main pass writes normal and depth for it
+	bool RSMGatherPass;
+	int RSMDownsample;
+	GLuint RSMGatherFBO;
+	shared_ptr<Texture> RSMGeometry;	// RGBA16F, normal and view depth
+	shared_ptr<Texture> RSMIndirect;	// low resolution indirect light
+	shared_ptr<Shader> RSMGatherShader;
+	shared_ptr<Shader> RSMUpsampleShader;
+	void allocateRSMGather(int width, int height);
+	void beginRSMGather();
+	void renderRSMGather();
+
+	// VPL clustering, rebuilt whenever the RSM is rendered
+	bool VPLClustering;
+	shared_ptr<VPLClusters> vplClusters;
+	bool RSMDirty;	// render the RSM and rebuild the VPLs even if cached
 
 private:
 	shared_ptr<Window> window;
@@ -53,11 +227,8 @@ private:
 
 	// Resources
 	shared_ptr<Camera> camera;
-	map<string, shared_ptr<Object>> renderObjects;
-	map<string, shared_ptr<Light>> lights;
-	map<string, shared_ptr<DirectionalLight>> dirLights;
-	map<string, shared_ptr<PointLight>> pointLights;
-	map<string, shared_ptr<Shader>> shaders;
+	EntityStore scene; // objects, lights and shaders
+	void updateBounds();
 
 	// shaders
 	shared_ptr<Shader> pbrShader;
@@ -68,6 +239,105 @@ private:
 
 	// shadow
 	void renderShadowMap();
+	// shadow caching, every slot keeps the version of the light it was rendered with, 0 is never valid
+	bool shadowCaching;
+	vector<unsigned int> dirShadowVersions;
+	vector<unsigned int> pointShadowVersions;
+	unsigned int RSMVersion;
+	vector<BoundingBox> changedBounds;	// old and new bounds of moved, added and removed objects
+	vector<BoundingBox> changedStaticBounds; // the static ones among them
+	int shadowUpdateNum;
+	bool castersChanged(const vector<BoundingBox> &boxes, const Frustum &volume);
+	bool castersChanged(const vector<BoundingBox> &boxes, const vec3 &center, float radius);
+	// static shadow layers, same layout as depthMaps and the cube map array
+	bool staticShadowCache;
+	GLuint staticDepthMaps;
+	GLuint staticCubeDepthMap;
+	vector<GLuint> staticDepthMapFBOs;
+	GLuint staticCubeDepthMapFBO;
+	vector<unsigned int> dirStaticVersions;
+	vector<unsigned int> pointStaticVersions;
+	void initStaticShadowMaps();
+	// cull gets the index of an object in the mesh store and returns 0 to skip it
+	int drawShadowCasters(shared_ptr<Shader> shader, bool staticCasters, const function<int(int)> &cull);
+	bool isShadowPassCaster(const shared_ptr<Object> &object, bool staticCasters);
+	vector<int> dirCasterNums;
+	vector<int> pointCasterNums;
+	vector<int> pointFaceDrawNums;
+	// point shadows without the geometry shader, an FBO per cube face layer
+	PointShadowMode pointShadowMode;
+	shared_ptr<Shader> pointFaceShader;
+	vector<GLuint> cubeFaceFBOs;
+	vector<GLuint> staticCubeFaceFBOs;
+	vector<int> faceMasks;	// of every object for the current point light
+	void initCubeFaceFBOs(GLuint texture, vector<GLuint> &fbos);
+	GLuint shadowPassQueries[2];
+	bool shadowQueryIssued[2];
+	float shadowPassTime;
+	void readShadowPassQuery();
+	// cascades, those of a light are consecutive layers of depthMaps
+	int cascadeNum;
+	float cascadeSplitLambda;
+	float shadowDistance;
+	vector<float> cascadeSplits;
+	vector<mat4> dirShadowMatrices;	// a cached layer is only valid for the same matrix
+	vector<mat4> dirStaticMatrices;
+	int getDirShadowLayerNum() { return dirLightNumMax * std::max(cascadeNum, 1); }
+	void allocateDirShadowMaps();
+	void updateCascadeSplits();
+	mat4 fitCascade(const vec3 &lightDir, float nearDepth, float farDepth);
+	void renderDirShadowLayer(shared_ptr<Light> light, int layer, const mat4 &lightSpaceMatrix);
+	bool dirLayerOutdated(const shared_ptr<Light> &light, int layer, const mat4 &lightSpaceMatrix,
+		const Frustum &volume, bool staticLayer, ivec4 &region);
+	void drawDirShadowLayer(int layer, const mat4 &lightSpaceMatrix, const Frustum &volume,
+		const ivec4 &region, bool staticOutdated, const ivec4 &staticRegion);
+	// layered directional shadows, the matrices of all layers are in a uniform buffer
+	DirShadowMode dirShadowMode;
+	shared_ptr<Shader> layeredDepthShader;
+	GLuint lightSpaceUBO;
+	GLuint depthMapLayeredFBO;
+	GLuint staticDepthMapLayeredFBO;
+	vector<int> layerMasks;	// of every object, the outdated layers it falls in
+	int dirShadowDrawNum;
+	void renderDirShadowLayers(const vector<shared_ptr<Light>> &lights, const vector<mat4> &lightSpaceMatrices);
+	// point shadow atlas, the cube map arrays keep one texel per face while it is used
+	bool shadowAtlas;
+	ShadowAtlas atlasLayout;
+	int atlasMaxTileSize;
+	GLuint atlasDepthMap;
+	GLuint staticAtlasDepthMap;
+	GLuint atlasFBO;
+	GLuint staticAtlasFBO;
+	shared_ptr<Texture> atlasShadowMap;
+	GLuint atlasTileBuffer;	// SSBO binding 8, uv origin and size of every face tile
+	vector<int> pointTiles;	// six per point light, -1 for none
+	void allocateShadowAtlas(int size);
+	void updateShadowAtlas(const vector<shared_ptr<PointLight>> &pointLights);
+	void resizeCubeShadowMaps(int size);
+	// prefiltered shadows, a layer of moments at half the size of every directional layer
+	ShadowFilter shadowFilter;
+	int momentBlurRadius;
+	float lightBleedReduction;
+	vec2 evsmExponents;
+	GLuint momentMaps;
+	GLuint momentFBO;
+	shared_ptr<Texture> shadowMoments;
+	shared_ptr<Texture> momentTemp;	// horizontal pass of the blur
+	shared_ptr<Shader> momentShader;
+	shared_ptr<Shader> momentBlurShader;
+	int updatedDirLayers;	// rendered this frame, one bit each
+	void allocateMomentMaps();
+	void filterShadowMoments();
+	// dirty regions of directional layers, x0 y0 x1 y1 in texels
+	bool shadowDirtyRegions;
+	float dirUpdatedTexels;
+	float dirShadowUpdateArea;
+	ivec4 lightSpaceRect(const BoundingBox &box, const mat4 &lightSpaceMatrix);
+	// depth passes from the position stream
+	bool depthPositionStream;
+	long long depthFetchBytes;
+	long long interleavedFetchBytes;
+	void drawDepth(const shared_ptr<Object> &object, shared_ptr<Shader> shader, int instanceNum = 0);
 	void initShadowMap();	// directional light
 	void initCubeShadowMap();	// point light
 	int pointLightNumMax;
@@ -93,10 +363,60 @@ private:
 
 	// Environment map
 	shared_ptr<CubeMap> envMap;
+	shared_ptr<CubeMap> pendingEnvMap; // precomputed a slice a frame
+	float IBLBudget;
+	void updateEnvironmentMap();
 
 	// GUI
 	shared_ptr<Gui> gui;
 
+	// Culling
+	bool frustumCulling;
+	bool gpuCulling;
+	bool cullerDirty; // object list changed
+	shared_ptr<GPUCuller> gpuCuller;
+	bool occlusionCulling;
+	shared_ptr<OcclusionCuller> occlusionCuller;
+	bool occlusionQuery;
+	shared_ptr<OcclusionQueries> occlusionQueries;
+	vector<shared_ptr<Object>> getVisibleObjects(const mat4 &viewProjection);
+	void cullOccluded(const mat4 &viewProjection, vector<char> &visible);
+	void drawObjects(const vector<shared_ptr<Object>> &objects, const mat4 &viewProjection, shared_ptr<Shader> shader = nullptr);
+
+	// Depth pre-pass
+	bool depthPrePass;
+	shared_ptr<Shader> depthPrePassShader;
+	void renderDepthPrePass(const vector<shared_ptr<Object>> &objects);
+
+	// Main pass statistics
+	GLuint mainPassQueries[2][2]; // samples passed and time elapsed, two frames
+	int queryFrame;
+	bool queryIssued[2];
+	bool samplesIssued[2];
+	GLuint64 shadedSampleNum;
+	float mainPassTime;
+	void beginMainPassQuery();
+	void endMainPassQuery();
+
+	// Deferred shading
+	RenderPath renderPath;
+	GLuint gBuffer;
+	shared_ptr<Texture> gAlbedoSpec;	// RGBA8, albedo and specular intensity
+	shared_ptr<Texture> gNormal;		// RGBA16, octahedral normal and shininess
+	shared_ptr<Texture> gDepth;			// position is reconstructed from depth
+	shared_ptr<Shader> gBufferShader;
+	shared_ptr<Shader> deferredDirShader;
+	shared_ptr<Shader> deferredPointShader;
+	void initGBuffer();
+	void renderDeferred(const vector<shared_ptr<Object>> &objects, const mat4 &viewProjection);
+	bool getScissorRect(const vec3 &center, float radius, const mat4 &viewProjection, ivec4 &rect);
+	void allocateGBuffer(int width, int height);
+
+	// Clustered shading
+	bool clusteredShading;
+	shared_ptr<LightClusters> lightClusters;
+	void updateLightClusters();
+
 	// Mode
 	bool pbrMode;
 
@@ -109,4 +429,22 @@ private:
 	vector<shared_ptr<Shader>> postProcessingShaders;
 	pair<unsigned int, unsigned int> createFrameBuffer(int width, int height);
 	void postProcessing();
+
+	// Dynamic resolution
+	// render targets are allocated at the largest scale, the scene uses their lower left part
+	bool dynamicResolution;
+	shared_ptr<ResolutionScaler> resolutionScaler;
+	UpscaleFilter upscaleFilter;
+	float sharpness;
+	int targetWidth;
+	int targetHeight;
+	int renderWidth;
+	int renderHeight;
+	void updateRenderSize();
+	void resizeRenderTargets(int width, int height);
+	vec2 getUVScale() { return vec2((float)renderWidth / targetWidth, (float)renderHeight / targetHeight); }
+
+	// Render target formats
+	RenderTargetFormats targetFormats;
+	vector<pair<string, GLuint64>> getShadowTargetMemory();
 };
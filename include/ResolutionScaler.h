@@ -0,0 +1,56 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+using namespace std;
+using namespace glm;
+
+// Dynamic resolution
+// GPU time of the whole frame is measured with timestamp queries in a ring of QUERY_FRAME_NUM
+// frames, the driver may queue several frames so the oldest finished one is read and reading
+// never stalls. A PID controller picks the render scale of the next frames.
+// Time grows with the pixel count, so the error is taken in scale units:
+// sqrt(target / measured) - 1, the relative scale change that would hit the target.
+// The controller runs in velocity form, clamping the scale needs no integral anti-windup.
+class ResolutionScaler
+{
+public:
+	ResolutionScaler();
+	~ResolutionScaler();
+
+	void init();
+	void setScaleRange(float minScale_, float maxScale_);	// scale of the window size
+	void setTargetTime(float ms) { targetTime = ms; }
+	void setGains(float kp_, float ki_, float kd_);
+	void reset(float scale_ = 1.0f);
+
+	void beginFrame();
+	void endFrame();	// reads the oldest finished frame and updates the scale
+	void update(float gpuTime_);	// feed a measured frame time in ms, endFrame calls it
+
+	float getScale() { return scale; }
+	float getMinScale() { return minScale; }
+	float getMaxScale() { return maxScale; }
+	float getTargetTime() { return targetTime; }
+	float getGPUTime() { return gpuTime; } // ms, last finished frame
+
+	static const int QUERY_FRAME_NUM = 4;	// frames in flight that can be measured
+
+private:
+	GLuint queries[QUERY_FRAME_NUM][2]; // frame begin and end timestamps
+	bool issued[QUERY_FRAME_NUM];
+	int frame;	// query slot of the current frame
+	int oldest;	// oldest issued slot, results arrive in order
+	bool recording;	// the current frame is measured
+
+	float scale;
+	float minScale;
+	float maxScale;
+	float targetTime;
+	float gpuTime;
+
+	float kp;
+	float ki;
+	float kd;
+	float lastError;
+	float lastError2;
+};
@@ -18,9 +18,13 @@ public:
 
 	// ļ·лȡ/Ƭɫ 
 	Shader(std::string vertexPath, std::string fragmentPath, std::string geometryPath = "");
+	// compute shader
+	Shader(std::string computePath);
 
 	void compile();
 	void use();
+	void dispatch(unsigned int x, unsigned int y = 1, unsigned int z = 1); // run compute shader
+	unsigned int getID() const { return ID; }
 	void setAttributes();
 	void clear();
 
@@ -44,6 +48,8 @@ private:
 	std::string vertexPath;
 	std::string fragmentPath;
 	std::string geometryPath;
+	std::string computePath;
+	void compileCompute();
 	void setBool(const std::string &name, bool value) const;
 	void setInt(const std::string &name, int value) const;
 	void setFloat(const std::string &name, float value) const;
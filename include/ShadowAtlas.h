@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+using namespace std;
+using namespace glm;
+
+// Quadtree allocator of the square tiles of a shadow atlas
+// Tile sizes are the atlas size divided by a power of two, down to minTileSize. A request takes a
+// free node of its size, splitting a larger free node only when no node of that size is free, and
+// released nodes merge with their free siblings, so a steady set of tiles does not fragment the atlas.
+// Only the layout is kept here, the texture belongs to the renderer.
+class ShadowAtlas
+{
+public:
+	ShadowAtlas(int size_ = 4096, int minTileSize_ = 64);
+
+	void reset(int size_, int minTileSize_);	// all tiles are released
+	// a tile of at least tileSize texels, up to the atlas size, -1 if no space is left
+	int allocate(int tileSize);
+	void release(int tile);
+	ivec3 getTile(int tile) { return ivec3(nodes[tile].pos, nodes[tile].size); } // x, y, size in texels
+
+	int getSize() { return size; }
+	int getMinTileSize() { return minTileSize; }
+	float getUsage() { return (float)usedArea / ((float)size * size); } // fraction of the atlas in tiles
+
+private:
+	struct Node
+	{
+		ivec2 pos;
+		int size;
+		int parent;
+		int children;	// first of four consecutive nodes, -1 for a leaf
+		bool used;
+	};
+	vector<Node> nodes;	// 0 is the root
+	vector<int> freeChildren;	// unused groups of four nodes, reused by split
+	int size;
+	int minTileSize;
+	long long usedArea;
+
+	int find(int node, int tileSize);
+	void split(int node);
+};
@@ -0,0 +1,89 @@
+#pragma once
+#include <vector>
+#include <mutex>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+using namespace std;
+using namespace glm;
+
+typedef int TransformID; // index into the transform arrays, -1 for none
+
+// Transform hierarchy
+// Local position, rotation and scale of every transform are stored in separate arrays (SoA).
+// Setters only mark a transform dirty, update() then recomputes the world and normal matrices
+// of dirty transforms and their descendants once per frame, level by level in parent order.
+// Matrices are built with SSE and the normal matrix uses the TRS structure:
+// inverse-transpose(T * R * S) = R * S^-1, and for a parent chain the product of the parents'.
+// Creating, changing and destroying transforms may happen on job workers, a mutex serializes
+// them. update() copies the dirty transforms under the mutex and computes their matrices without
+// it, so jobs the waiting main thread picks up may still create or move transforms. update() and
+// the getters belong to the main thread, the matrices they return are those of the last update().
+class TransformSystem
+{
+public:
+	static TransformID create();
+	static void destroy(TransformID id);
+
+	static void setParent(TransformID id, TransformID parent); // -1 to detach
+	static TransformID getParent(TransformID id) { return parents[id]; }
+
+	static void setLocal(TransformID id, const vec3 &position, const quat &rotation, const vec3 &scale);
+	static void setPosition(TransformID id, const vec3 &position);
+	static void setRotation(TransformID id, const quat &rotation);
+	static void setScale(TransformID id, const vec3 &scale);
+	static vec3 getPosition(TransformID id) { return positions[id]; }
+	static quat getRotation(TransformID id) { return rotations[id]; }
+	static vec3 getScale(TransformID id) { return scales[id]; }
+
+	static void update(); // recompute dirty world matrices, main thread
+
+	static const mat4 &getWorldMatrix(TransformID id) { return worldMatrices[id]; }
+	static const mat4 &getNormalMatrix(TransformID id) { return normalMatrices[id]; } // transpose(inverse(world))
+	static bool isChanged(TransformID id) { return changed[id] != 0; } // world matrix changed in the last update
+	static int getTransformNum() { return positions.size() - freeList.size(); }
+	static int getUpdatedNum() { return updatedNum; } // matrices recomputed in the last update
+
+private:
+	// local TRS
+	static vector<vec3> positions;
+	static vector<quat> rotations;
+	static vector<vec3> scales;
+	// hierarchy
+	static vector<TransformID> parents;
+	static vector<int> childNums;
+	static vector<char> alive;
+	static vector<TransformID> freeList;
+	// results
+	static vector<mat4> worldMatrices;
+	static vector<mat4> normalMatrices;
+	static vector<char> dirty;
+	static vector<char> changed;
+
+	// transforms sorted by depth, levels[i] is the first entry of depth i
+	static vector<TransformID> order;
+	static vector<int> levels;
+	static bool hierarchyDirty;
+	static int updatedNum;
+	static mutex transformMutex;
+
+	// a dirty transform copied out by update()
+	struct PendingTransform
+	{
+		TransformID id;
+		int parentSlot;	// pending parent, -1 for a root or a clean parent
+		vec3 position;
+		quat rotation;
+		vec3 scale;
+		mat4 parentWorld;	// matrices of a clean parent
+		mat4 parentNormal;
+	};
+	static vector<PendingTransform> pending;
+	static vector<int> pendingLevels;	// pending[pendingLevels[i]] is the first entry of depth i
+	static vector<mat4> pendingWorld;
+	static vector<mat4> pendingNormal;
+
+	static void markDirty(TransformID id);
+	static void rebuildOrder();
+	static void collectPending();
+	static void computeMatrices(int begin, int end);
+};
@@ -0,0 +1,52 @@
+#pragma once
+#include <memory>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "Shader.h"
+#include "Texture.h"
+using namespace std;
+using namespace glm;
+
+// Clustered virtual point lights
+// The reflective shadow map is reduced on the GPU into a fixed list of VPLs: the map is split
+// into GRID x GRID tiles and the texels of a tile are grouped by the major axis of their normal,
+// and by depth: each normal bin is split in two at the middle of the tile's depth range.
+// Every group becomes one VPL with the summed flux and the flux weighted position, normal and
+// RSM texel position, empty groups have zero flux. The list lives in SSBO binding 7 and
+// fragments loop over it instead of sampling RSM texels. build() runs the reduction,
+// so it only needs to be called when the RSM changed.
+class VPLClusters
+{
+public:
+	static const int GRID = 8;
+	static const int NORMAL_BIN_NUM = 6;	// normal directions, must match shaders/rsm_vpl.comp
+	static const int DEPTH_BIN_NUM = 2;	// depth layers of a tile
+	static const int BIN_NUM = NORMAL_BIN_NUM * DEPTH_BIN_NUM;
+	static const int VPL_NUM = GRID * GRID * BIN_NUM;
+
+	VPLClusters();
+	~VPLClusters();
+
+	void init();
+	// positionFromDepth rebuilds RSM positions with the inverse light matrix, packedNormal reads octahedral normals
+	void build(shared_ptr<Texture> depth, shared_ptr<Texture> position, shared_ptr<Texture> normal, shared_ptr<Texture> flux,
+		const mat4 &lightSpaceMatrix, bool packedNormal, bool positionFromDepth);
+	void bind();	// bind the SSBO for drawing
+
+	int getVPLNum() { return VPL_NUM; }
+	int getBuildNum() { return buildNum; } // reductions run so far
+
+private:
+	// std430 layout, must match the shaders
+	struct VPL
+	{
+		vec4 position;
+		vec4 normal;
+		vec4 flux;	// rgb: summed flux, a: texel count
+		vec4 uv;	// xy: RSM texture coordinates
+	};
+
+	shared_ptr<Shader> reduceShader;
+	GLuint buffer;
+	int buildNum;
+};
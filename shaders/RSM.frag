@@ -4,7 +4,7 @@ const int SAMPLE_NUM = 800;
 const float PI = 3.141592653589793;
 const float PI2 = 6.283185307179586;
 
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
 
 uniform float shininess;
 struct Material {
@@ -40,31 +40,121 @@ in vec3 Normal;
 in vec2 TexCoords;
 in mat3 TBN;
 
-in vec4 FragPosLightSpace[5];   // frag position in directional light space
  
 uniform vec3 viewPos;
 uniform Material mtl;
 uniform Light lights[16];
 uniform int lightNum;
 uniform sampler2DArray shadowMap;
+// cascades of a directional light are consecutive layers, picked by view depth
+uniform mat4 lightSpaceMatrix[20];  // 5 directional lights with up to 4 cascades
+uniform int cascadeNum = 1;
+uniform float cascadeSplits[4] = float[](1e30, 1e30, 1e30, 1e30); // far view depth of each cascade
+// prefiltered directional shadows: 0 PCF, 1 VSM, 2 EVSM, moments at half the shadow map size with mips
+uniform int shadowFilter = 0;
+uniform sampler2DArray shadowMoments;
+uniform float lightBleedReduction = 0.2;
+uniform vec2 evsmExponents = vec2(40.0, 5.0);
 uniform samplerCubeArray cubeDepthMap;
 uniform float far_plane;
+// point shadows from the atlas instead, the tiles of the six faces of every point light: uv origin and size
+uniform bool shadowAtlas = false;
+uniform sampler2D shadowAtlasMap;
+layout (std430, binding = 8) readonly buffer ShadowAtlasTiles { vec4 atlasTiles[]; };
+
+// clustered point lights, see LightClusters.h
+struct PointLightData {
+    vec4 position;      // w: range
+    vec4 ambient;       // w: cube shadow map index, -1 for none
+    vec4 diffuse;
+    vec4 specular;
+    vec4 attenuation;   // constant, linear, quadratic
+};
+layout (std430, binding = 4) readonly buffer PointLightBuffer { PointLightData pointLights[]; };
+layout (std430, binding = 5) readonly buffer ClusterGridBuffer { uvec2 clusterGrid[]; }; // offset, count
+layout (std430, binding = 6) readonly buffer ClusterIndexBuffer { uint clusterIndices[]; };
+uniform bool clusteredShading;
+uniform vec3 clusterSize;   // tiles x, tiles y, depth slices
+uniform float clusterScale;
+uniform float clusterBias;
+uniform vec2 screenSize;
+uniform mat4 view;
 
 in vec4 RSM_FragPoslightSpace;
 uniform sampler2D RSM_Depth;
 uniform sampler2D RSM_Position;
 uniform sampler2D RSM_Normal;
 uniform sampler2D RSM_Flux;
+uniform mat4 RSM_invLightSpaceMatrix;
+uniform bool RSMPositionFromDepth;
+uniform bool RSMPackedNormal;
+
+// temporal mode, a few samples per frame accumulated in a history, see Renderer::setTemporalRSM
+uniform bool temporalRSM;
+uniform int temporalSampleNum;
+uniform int frameIndex;
+uniform int maxHistoryLength;
+uniform mat4 prevViewProjection;
+uniform vec2 prevUVScale;               // used part of the history textures last frame
+uniform sampler2D RSM_History;          // rgb indirect light, a view depth
+uniform sampler2D RSM_HistoryNormal;    // xyz normal, w history length
+layout (location = 1) out vec4 HistoryColor;
+layout (location = 2) out vec4 HistoryNormal;
+
+// clustered VPLs instead of RSM texels, see VPLClusters.h
+struct VPL {
+    vec4 position;
+    vec4 normal;
+    vec4 flux;      // rgb summed flux, a texel count
+    vec4 uv;        // xy RSM texture coordinates
+};
+layout (std430, binding = 7) readonly buffer VPLBuffer { VPL vpls[]; };
+uniform bool VPLClustering;
+uniform int VPLNum;
+
+// indirect light is gathered in its own pass, see Renderer::setRSMGatherPass
+uniform bool RSMGatherPass;
+layout (location = 3) out vec4 GeometryOut;   // xyz normal, w view depth
 
 vec3 computeLight(Light light, vec3 objDiffuse, vec3 objSpecular);
-float dirShadowCalculation(vec4 fragPosLightSpace, vec3 lightDir, int dirLightNum);
+vec3 computeClusteredLights(vec3 objDiffuse, vec3 objSpecular);
+float dirShadowCalculation(vec3 fragPos, vec3 lightDir, int dirLightNum);
 float pointShadowCalculation(vec3 fragPos, vec3 lightPos, int pointLightNum);
 vec3 RSM();
+vec3 temporalRSMIllumination();
+vec3 clusteredVPLIllumination();
 
 int dirLightNum = 0;
 int pointLightNum = 0;
 vec3 normal;
 
+vec3 decodeNormal(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// RSM texel at c, positions are rebuilt from the depth when they are not stored,
+// normals are octahedral in two components when packed
+vec3 RSMPosition(vec2 c)
+{
+    if(!RSMPositionFromDepth)
+        return texture(RSM_Position, c).rgb;
+    vec2 size = vec2(textureSize(RSM_Depth, 0));
+    vec2 texel = (floor(c * size) + 0.5) / size;
+    vec4 p = RSM_invLightSpaceMatrix * vec4(vec3(texel, texture(RSM_Depth, texel).r) * 2.0 - 1.0, 1.0);
+    return p.xyz / p.w;
+}
+
+vec3 RSMNormal(vec2 c)
+{
+    vec3 n = texture(RSM_Normal, c).rgb;
+    return RSMPackedNormal ? decodeNormal(n.xy) : n;
+}
+
 float random(float x){
     return fract(sin(x)*100000.0);
 }
@@ -91,12 +181,20 @@ void main()
         objSpecular = mtl.specular;
 
     vec3 directIllumination;
-    vec3 indirectIllumination = RSM();
+    vec3 indirectIllumination = vec3(0.0);
+    if(RSMGatherPass)
+        GeometryOut = vec4(normal, -(view * vec4(FragPos, 1.0)).z);
+    else if(VPLClustering)
+        indirectIllumination = clusteredVPLIllumination();
+    else
+        indirectIllumination = temporalRSM ? temporalRSMIllumination() : RSM();
     for(int i=0; i<lightNum; ++i)
     {
 
         directIllumination += computeLight(lights[i], objDiffuse, objSpecular);
     }
+    if(clusteredShading)
+        directIllumination += computeClusteredLights(objDiffuse, objSpecular);
 
     vec3 result = directIllumination + 0.1 * indirectIllumination;
 
@@ -136,12 +234,13 @@ vec3 computeLight(Light light, vec3 objDiffuse, vec3 objSpecular)
         // attenuation
         float dis = length(light.position - FragPos);
         attenuation = 1.0 / (light.constant + light.linear*dis + light.quadratic*(dis*dis));
-        shadow = pointShadowCalculation(FragPos, light.position, pointLightNum);
+        if(pointLightNum >= 0)
+            shadow = pointShadowCalculation(FragPos, light.position, pointLightNum);
         pointLightNum++;
     }
     else if(light.type == 1) // directional light
     {
-        shadow = dirShadowCalculation(FragPosLightSpace[dirLightNum], lightDir, dirLightNum);
+        shadow = dirShadowCalculation(FragPos, lightDir, dirLightNum);
         dirLightNum++;
     }
 
@@ -151,12 +250,76 @@ vec3 computeLight(Light light, vec3 objDiffuse, vec3 objSpecular)
     //return vec3(shadow, shadow, shadow);
 }
 
-float dirShadowCalculation(vec4 fragPosLightSpace, vec3 lightDir, int dirLightNum)
+// point lights of the fragment's cluster
+vec3 computeClusteredLights(vec3 objDiffuse, vec3 objSpecular)
+{
+    ivec3 size = ivec3(clusterSize);
+    float depth = -(view * vec4(FragPos, 1.0)).z;
+    int slice = clamp(int(log(depth) * clusterScale + clusterBias), 0, size.z - 1);
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / screenSize * vec2(size.xy)), ivec2(0), size.xy - 1);
+    uvec2 cluster = clusterGrid[(slice * size.y + tile.y) * size.x + tile.x];
+
+    vec3 result = vec3(0.0);
+    for(uint i=0; i<cluster.y; ++i)
+    {
+        PointLightData data = pointLights[clusterIndices[cluster.x + i]];
+        Light light;
+        light.type = 0;
+        light.position = data.position.xyz;
+        light.direction = vec3(0.0);
+        light.ambient = data.ambient.rgb;
+        light.diffuse = data.diffuse.rgb;
+        light.specular = data.specular.rgb;
+        light.constant = data.attenuation.x;
+        light.linear = data.attenuation.y;
+        light.quadratic = data.attenuation.z;
+        pointLightNum = int(data.ambient.w); // shadow map index
+        result += computeLight(light, objDiffuse, objSpecular);
+    }
+    return result;
+}
+
+// upper bound of the lit fraction, the tail below lightBleedReduction is cut off against light bleeding
+float chebyshevUpperBound(vec2 moments, float depth, float minVariance)
+{
+    if(depth <= moments.x)
+        return 1.0;
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d = depth - moments.x;
+    float pMax = variance / (variance + d * d);
+    return clamp((pMax - lightBleedReduction) / (1.0 - lightBleedReduction), 0.0, 1.0);
+}
+
+// one trilinear fetch of the blurred moments instead of the PCF taps
+float momentShadow(vec3 uvLayer, float depth)
+{
+    vec4 moments = texture(shadowMoments, uvLayer);
+    if(shadowFilter == 1)
+        return 1.0 - chebyshevUpperBound(moments.xy, depth, 0.00002);
+    float d = 2.0 * depth - 1.0;
+    vec2 warped = vec2(exp(evsmExponents.x * d), -exp(-evsmExponents.y * d));
+    vec2 minVariance = 0.0001 * evsmExponents * warped;
+    minVariance *= minVariance;
+    float lit = min(chebyshevUpperBound(moments.xy, warped.x, minVariance.x),
+        chebyshevUpperBound(moments.zw, warped.y, minVariance.y));
+    return 1.0 - lit;
+}
+float dirShadowCalculation(vec3 fragPos, vec3 lightDir, int dirLightNum)
 {
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    if(depth > cascadeSplits[cascadeNum - 1])
+        return 0.0;
+    int cascade = 0;
+    while(depth > cascadeSplits[cascade])
+        cascade++;
+    int layer = dirLightNum * cascadeNum + cascade;
+    vec4 fragPosLightSpace = lightSpaceMatrix[layer] * vec4(fragPos, 1.0);
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     projCoords = projCoords * 0.5 + 0.5;
     if(projCoords.z > 1.0)
         return 0.0;
+    if(shadowFilter != 0)
+        return momentShadow(vec3(projCoords.xy, layer), projCoords.z);
     //float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
     float shadow = 0;
     float currentDepth = projCoords.z;
@@ -165,12 +328,39 @@ float dirShadowCalculation(vec4 fragPosLightSpace, vec3 lightDir, int dirLightNu
         for(int y=-2; y<=2; ++y)
         {    
             //float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x,y)*texelSize).r;
-            float pcfDepth = texture2DArray(shadowMap, vec3(projCoords.xy + vec2(x,y)*texelSize, dirLightNum)).r;
+            float pcfDepth = texture2DArray(shadowMap, vec3(projCoords.xy + vec2(x,y)*texelSize, layer)).r;
             shadow += currentDepth > pcfDepth ? 1.0 : 0.0;
         }
     shadow /= 25.0;
     return shadow;
 }
+// closest depth toward dir in the tile of the cube face it points to, faces are projected as those
+// of a cube map, samples stay half a texel inside the tile
+float atlasDepth(vec3 dir, int pointLight)
+{
+    vec3 a = abs(dir);
+    int face;
+    vec2 uv;
+    if(a.x >= a.y && a.x >= a.z)
+    {
+        face = dir.x > 0.0 ? 0 : 1;
+        uv = vec2(dir.x > 0.0 ? -dir.z : dir.z, -dir.y) / a.x;
+    }
+    else if(a.y >= a.z)
+    {
+        face = dir.y > 0.0 ? 2 : 3;
+        uv = vec2(dir.x, dir.y > 0.0 ? dir.z : -dir.z) / a.y;
+    }
+    else
+    {
+        face = dir.z > 0.0 ? 4 : 5;
+        uv = vec2(dir.z > 0.0 ? dir.x : -dir.x, -dir.y) / a.z;
+    }
+    vec4 tile = atlasTiles[6 * pointLight + face];
+    float border = 0.5 / (tile.z * float(textureSize(shadowAtlasMap, 0).x));
+    uv = clamp(uv * 0.5 + 0.5, border, 1.0 - border);
+    return texture(shadowAtlasMap, tile.xy + uv * tile.z).r;
+}
 vec3 sampleOffsetDirections[20] = vec3[]
 (
    vec3( 1,  1,  1), vec3( 1, -1,  1), vec3(-1, -1,  1), vec3(-1,  1,  1), 
@@ -181,6 +371,8 @@ vec3 sampleOffsetDirections[20] = vec3[]
 );
 float pointShadowCalculation(vec3 fragPos, vec3 lightPos, int pointLightNum)
 {
+    if(shadowAtlas && atlasTiles[6 * pointLightNum].z == 0.0)
+        return 0.0;
     vec3 fragToLight = fragPos - lightPos;
     //float closestDepth = texture(cubeDepthMap, fragToLight).r;
     float shadow = 0.0;
@@ -189,7 +381,7 @@ float pointShadowCalculation(vec3 fragPos, vec3 lightPos, int pointLightNum)
     for(int i=0; i<samples; ++i)
     {
         vec3 samplePos = fragToLight + sampleOffsetDirections[i]*diskRadius;
-        float closestDepth = texture(cubeDepthMap, vec4(samplePos, pointLightNum)).r;
+        float closestDepth = shadowAtlas ? atlasDepth(samplePos, pointLightNum) : texture(cubeDepthMap, vec4(samplePos, pointLightNum)).r;
         closestDepth *= far_plane;
         float currentDepth = length(fragToLight);
 
@@ -200,25 +392,115 @@ float pointShadowCalculation(vec3 fragPos, vec3 lightPos, int pointLightNum)
     return shadow;
 }
 
+// one VPL at polar offset (r1, r2) around the fragment in the RSM
+vec3 RSMSample(vec2 coord, float r1, float r2)
+{
+    vec2 texelSize = 1.0 / textureSize(RSM_Flux, 0).xy;
+    float rMax = textureSize(RSM_Flux, 0).x / 4.0;
+    vec2 c = coord + rMax * vec2(r1*sin(PI2*r2), r1*cos(PI2*r2)) * texelSize;
+    vec3 flux = texture(RSM_Flux, c).rgb;
+    vec3 xp = RSMPosition(c);
+    vec3 np = RSMNormal(c);
+    vec3 e = flux * (max(0, dot(np,FragPos-xp)) * max(0, dot(normal,xp-FragPos)) / pow(distance(xp,FragPos),2.0));
+    return r1*r1 * e;
+}
+
 vec3 RSM()
 {
     vec3 indirectIllumination = vec3(0.0);
-    vec2 texelSize = 1.0 / textureSize(RSM_Position, 0).xy;
-
     vec3 coord = RSM_FragPoslightSpace.xyz / RSM_FragPoslightSpace.w;
     coord = coord * 0.5 + 0.5;
 
-    float rMax = textureSize(RSM_Position, 0).x / 4.0;
     for(float i=1; i<=SAMPLE_NUM; i+=1.0)
+        indirectIllumination += RSMSample(coord.xy, random(i), random(i+0.5));
+    return indirectIllumination;
+}
+
+float radicalInverse(uint i, uint base)
+{
+    float f = 1.0, result = 0.0;
+    while(i > 0u)
     {
-        float r1 = random(i);
-        float r2 = random(i+0.5);
-        vec2 c = coord.xy + rMax * vec2(r1*sin(PI2*r2), r1*cos(PI2*r2)) * texelSize;
-        vec3 flux = texture(RSM_Flux, c).rgb;
-        vec3 xp = texture(RSM_Position, c).rgb;
-        vec3 np = texture(RSM_Normal, c).rgb;
-        vec3 e = flux * (max(0, dot(np,FragPos-xp)) * max(0, dot(normal,xp-FragPos)) / pow(distance(xp,FragPos),2.0));
-        indirectIllumination += r1*r1 * e;
+        f /= float(base);
+        result += f * float(i % base);
+        i /= base;
     }
-    return indirectIllumination;
-}
\ No newline at end of file
+    return result;
+}
+
+// interleaved gradient noise, a cheap blue noise like offset per pixel
+float interleavedGradientNoise(vec2 p)
+{
+    return fract(52.9829189 * fract(dot(p, vec2(0.06711056, 0.00583715))));
+}
+
+// Halton (2, 3) points continuing from frame to frame, rotated per pixel, blended with
+// the reprojected history unless depth or normal show a disocclusion
+vec3 temporalRSMIllumination()
+{
+    vec3 coord = RSM_FragPoslightSpace.xyz / RSM_FragPoslightSpace.w;
+    coord = coord * 0.5 + 0.5;
+    float noise = interleavedGradientNoise(gl_FragCoord.xy);
+    vec3 current = vec3(0.0);
+    for(int i=0; i<temporalSampleNum; ++i)
+    {
+        uint index = uint(frameIndex * temporalSampleNum + i + 1);
+        float r1 = fract(radicalInverse(index, 2u) + noise);
+        float r2 = fract(radicalInverse(index, 3u) + noise);
+        current += RSMSample(coord.xy, r1, r2);
+    }
+    current *= float(SAMPLE_NUM) / float(temporalSampleNum); // same scale as RSM()
+
+    vec3 history = vec3(0.0);
+    float historyLength = 0.0;
+    vec4 prevClip = prevViewProjection * vec4(FragPos, 1.0);
+    vec2 prevUV = prevClip.xy / prevClip.w * 0.5 + 0.5;
+    if(prevClip.w > 0.0 && all(greaterThanEqual(prevUV, vec2(0.0))) && all(lessThanEqual(prevUV, vec2(1.0))))
+    {
+        vec4 h = texture(RSM_History, prevUV * prevUVScale);
+        vec4 hn = texture(RSM_HistoryNormal, prevUV * prevUVScale);
+        bool depthValid = abs(h.a - prevClip.w) < 0.05 * prevClip.w;
+        bool normalValid = dot(hn.xyz, normal) > 0.9;
+        if(depthValid && normalValid)
+        {
+            history = h.rgb;
+            historyLength = hn.w;
+        }
+    }
+    historyLength = min(historyLength + 1.0, float(maxHistoryLength));
+    vec3 result = mix(history, current, 1.0 / historyLength);
+
+    HistoryColor = vec4(result, -(view * vec4(FragPos, 1.0)).z);
+    HistoryNormal = vec4(normal, historyLength);
+    return result;
+}
+
+// Every VPL stands for the RSM texels it was reduced from. RSM() sums SAMPLE_NUM samples
+// r1*r1*e with radius r1*rMax, a pdf of 1 / (2 PI r rMax) per texel, so its expected value is
+// SAMPLE_NUM / (2 PI rMax^3) times the sum of r*e over the texels inside rMax. The same sum
+// is taken over VPLs with their texel distance r and summed flux.
+vec3 clusteredVPLIllumination()
+{
+    vec3 coord = RSM_FragPoslightSpace.xyz / RSM_FragPoslightSpace.w;
+    coord = coord * 0.5 + 0.5;
+    float size = textureSize(RSM_Flux, 0).x;
+    float rMax = size / 4.0;
+
+    vec3 indirectIllumination = vec3(0.0);
+    for(int i=0; i<VPLNum; ++i)
+    {
+        VPL vpl = vpls[i];
+        if(vpl.flux.a == 0.0)
+            continue;
+        float r = distance(coord.xy, vpl.uv.xy) * size;
+        if(r > rMax)
+            continue;
+        vec3 xp = vpl.position.xyz;
+        vec3 np = vpl.normal.xyz;
+        // a VPL covers an area, keep fragments next to it from blowing up
+        float d2 = max(dot(xp - FragPos, xp - FragPos), 0.01);
+        vec3 e = vpl.flux.rgb * (max(0, dot(np,FragPos-xp)) * max(0, dot(normal,xp-FragPos)) / d2);
+        indirectIllumination += r * e;
+    }
+    return indirectIllumination * float(SAMPLE_NUM) / (PI2 * rMax * rMax * rMax);
+}
@@ -17,6 +17,19 @@ in mat3 TBN;
 uniform bool useNormalMap;
 uniform bool useDiffuseMap;
 uniform Material mtl;
+uniform bool packedNormal;  // octahedral normal in rg, for RG16_SNORM targets
+
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// unit vector to [-1, 1]^2
+vec2 encodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    return n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signNotZero(n.xy);
+}
 
 void main()
 {
@@ -28,6 +41,8 @@ void main()
         gNormal = normalize(gNormal * 2.0 - 1.0);
         gNormal = normalize(TBN * gNormal);
     }
+    if(packedNormal)
+        gNormal = vec3(encodeNormal(gNormal), 0.0);
     
     if(useDiffuseMap)
         gFlux = texture(mtl.diffuseT, TexCoords).rgb;
@@ -14,18 +14,29 @@ uniform mat4 model;
 uniform mat4 lightSpaceMatrix;
 uniform mat4 transInvModel;
 
+// GPU culled multi draws read the matrices of the draw's object
+struct ObjectMatrices {
+    mat4 model;
+    mat4 transInvModel;
+};
+layout (std430, binding = 9) readonly buffer ObjectBuffer { ObjectMatrices objectMatrices[]; };
+layout (location = 5) in uint objectIndex; // instanced, offset by the base instance of the draw command
+uniform bool indirectDraw;
+
 void main()
 {
-	vec4 wordPos = model * vec4(position, 1.0);
+    mat4 modelMatrix = indirectDraw ? objectMatrices[objectIndex].model : model;
+    mat4 normalMatrix = indirectDraw ? objectMatrices[objectIndex].transInvModel : transInvModel;
+	vec4 wordPos = modelMatrix * vec4(position, 1.0);
 	FragPos = wordPos.xyz;
-    Normal = vec3(transInvModel * vec4(normal, 1.0));
+    Normal = vec3(normalMatrix * vec4(normal, 1.0));
 	TexCoords = texCoords;
 
     // compute TBN matrix
-    vec3 T = normalize(vec3(model * vec4(tangent, 0.0)));
-    vec3 B = normalize(vec3(model * vec4(bitangent, 0.0)));
-    vec3 N = normalize(vec3(model * vec4(normal, 0.0)));
+    vec3 T = normalize(vec3(modelMatrix * vec4(tangent, 0.0)));
+    vec3 B = normalize(vec3(modelMatrix * vec4(bitangent, 0.0)));
+    vec3 N = normalize(vec3(modelMatrix * vec4(normal, 0.0)));
     TBN = mat3(T, B, N);
 
-	gl_Position = lightSpaceMatrix * model * vec4(position, 1.0);
+	gl_Position = lightSpaceMatrix * modelMatrix * vec4(position, 1.0);
 }
\ No newline at end of file
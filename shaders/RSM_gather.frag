@@ -0,0 +1,94 @@
+#version 460 core
+// RSM indirect light at a fraction of the render resolution, see Renderer::setRSMGatherPass
+const int SAMPLE_NUM = 800;
+const float PI2 = 6.283185307179586;
+
+out vec4 FragColor;
+
+uniform sampler2D geometry;         // full resolution, xyz normal, w view depth, 0 for background
+uniform sampler2D RSM_Depth;
+uniform sampler2D RSM_Position;
+uniform sampler2D RSM_Normal;
+uniform sampler2D RSM_Flux;
+uniform mat4 RSM_lightSpaceMatrix;
+uniform mat4 RSM_invLightSpaceMatrix;
+uniform bool RSMPositionFromDepth;
+uniform bool RSMPackedNormal;
+uniform mat4 invView;
+uniform mat4 invProjection;
+uniform vec2 renderSize;
+uniform int downsample;
+
+vec3 decodeNormal(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// RSM texel at c, positions are rebuilt from the depth when they are not stored,
+// normals are octahedral in two components when packed
+vec3 RSMPosition(vec2 c)
+{
+    if(!RSMPositionFromDepth)
+        return texture(RSM_Position, c).rgb;
+    vec2 size = vec2(textureSize(RSM_Depth, 0));
+    vec2 texel = (floor(c * size) + 0.5) / size;
+    vec4 p = RSM_invLightSpaceMatrix * vec4(vec3(texel, texture(RSM_Depth, texel).r) * 2.0 - 1.0, 1.0);
+    return p.xyz / p.w;
+}
+
+vec3 RSMNormal(vec2 c)
+{
+    vec3 n = texture(RSM_Normal, c).rgb;
+    return RSMPackedNormal ? decodeNormal(n.xy) : n;
+}
+
+float random(float x){
+    return fract(sin(x)*100000.0);
+}
+
+// full resolution pixel that stands for a low resolution pixel
+ivec2 sourcePixel(ivec2 pixel)
+{
+    return min(pixel * downsample + downsample / 2, ivec2(renderSize) - 1);
+}
+
+void main()
+{
+    ivec2 pixel = sourcePixel(ivec2(gl_FragCoord.xy));
+    vec4 g = texelFetch(geometry, pixel, 0);
+    if(g.w == 0.0)
+    {
+        FragColor = vec4(0.0);
+        return;
+    }
+    vec3 normal = normalize(g.xyz);
+
+    // world position from the view depth along the pixel's view ray
+    vec2 ndc = (vec2(pixel) + 0.5) / renderSize * 2.0 - 1.0;
+    vec4 ray = invProjection * vec4(ndc, 1.0, 1.0);
+    vec3 viewPoint = ray.xyz / ray.w;
+    viewPoint *= g.w / -viewPoint.z;
+    vec3 FragPos = vec3(invView * vec4(viewPoint, 1.0));
+
+    vec4 lightSpace = RSM_lightSpaceMatrix * vec4(FragPos, 1.0);
+    vec2 coord = lightSpace.xy / lightSpace.w * 0.5 + 0.5;
+    vec2 texelSize = 1.0 / textureSize(RSM_Flux, 0).xy;
+    float rMax = textureSize(RSM_Flux, 0).x / 4.0;
+    vec3 indirectIllumination = vec3(0.0);
+    for(float i=1; i<=SAMPLE_NUM; i+=1.0)
+    {
+        float r1 = random(i);
+        float r2 = random(i+0.5);
+        vec2 c = coord + rMax * vec2(r1*sin(PI2*r2), r1*cos(PI2*r2)) * texelSize;
+        vec3 flux = texture(RSM_Flux, c).rgb;
+        vec3 xp = RSMPosition(c);
+        vec3 np = RSMNormal(c);
+        vec3 e = flux * (max(0, dot(np,FragPos-xp)) * max(0, dot(normal,xp-FragPos)) / pow(distance(xp,FragPos),2.0));
+        indirectIllumination += r1*r1 * e;
+    }
+    FragColor = vec4(indirectIllumination, 1.0);
+}
@@ -0,0 +1,56 @@
+#version 460 core
+// joint bilateral upsampling of the low resolution RSM gather, added to the lit image
+out vec4 FragColor;
+
+uniform sampler2D geometry;     // full resolution, xyz normal, w view depth, 0 for background
+uniform sampler2D indirectLight;
+uniform vec2 renderSize;
+uniform int downsample;
+uniform float depthSigma;       // relative view depth difference
+uniform float normalPower;
+
+ivec2 sourcePixel(ivec2 pixel)
+{
+    return min(pixel * downsample + downsample / 2, ivec2(renderSize) - 1);
+}
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 g = texelFetch(geometry, pixel, 0);
+    if(g.w == 0.0)
+        discard;
+    vec3 normal = normalize(g.xyz);
+
+    // the four low resolution pixels around this one, weighted by distance, depth and normal
+    ivec2 lowSize = (ivec2(renderSize) + downsample - 1) / downsample;
+    vec2 lowPos = (vec2(pixel) + 0.5) / float(downsample) - 0.5;
+    ivec2 base = ivec2(floor(lowPos));
+    vec2 f = lowPos - vec2(base);
+    vec3 sum = vec3(0.0);
+    float weightSum = 0.0;
+    vec3 nearest = vec3(0.0);
+    float nearestDiff = 1e20;
+    for(int i=0; i<4; ++i)
+    {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 lowPixel = clamp(base + offset, ivec2(0), lowSize - 1);
+        vec4 s = texelFetch(geometry, sourcePixel(lowPixel), 0);
+        vec3 light = texelFetch(indirectLight, lowPixel, 0).rgb;
+        if(s.w == 0.0)
+            continue;
+        float depthDiff = abs(s.w - g.w) / g.w;
+        float bilinear = (offset.x == 1 ? f.x : 1.0 - f.x) * (offset.y == 1 ? f.y : 1.0 - f.y);
+        float w = (bilinear + 1e-3) * exp(-depthDiff / depthSigma) * pow(max(dot(normalize(s.xyz), normal), 0.0), normalPower);
+        sum += w * light;
+        weightSum += w;
+        if(depthDiff < nearestDiff)
+        {
+            nearestDiff = depthDiff;
+            nearest = light;
+        }
+    }
+    // no sample on the same surface, take the closest in depth
+    vec3 indirectIllumination = weightSum > 1e-4 ? sum / weightSum : nearest;
+    FragColor = vec4(0.1 * indirectIllumination, 0.0);
+}
@@ -0,0 +1,11 @@
+#version 460 core
+layout (location = 0) in vec3 position; // unit cube centered at the origin
+
+uniform mat4 viewProjection;
+uniform vec3 boxCenter;
+uniform vec3 boxSize;
+
+void main()
+{
+    gl_Position = viewProjection * vec4(boxCenter + position * boxSize, 1.0);
+}
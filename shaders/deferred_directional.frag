@@ -0,0 +1,330 @@
+#version 460 core
+// Lighting pass of the deferred path: directional lights and RSM indirect light, once per pixel,
+// and the point lights of the pixel's cluster in clustered mode
+const int SAMPLE_NUM = 800;
+const float PI2 = 6.283185307179586;
+
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+struct Light {
+    int type;
+    vec3 position;
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+uniform sampler2D gAlbedoSpec;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform mat4 invViewProjection;
+
+uniform vec3 viewPos;
+uniform Light lights[16];
+uniform int lightNum;
+uniform sampler2DArray shadowMap;
+// cascades of a directional light are consecutive layers, picked by view depth
+uniform mat4 lightSpaceMatrix[20];  // 5 directional lights with up to 4 cascades
+uniform int cascadeNum = 1;
+uniform float cascadeSplits[4] = float[](1e30, 1e30, 1e30, 1e30); // far view depth of each cascade
+// prefiltered directional shadows: 0 PCF, 1 VSM, 2 EVSM, moments at half the shadow map size with mips
+uniform int shadowFilter = 0;
+uniform sampler2DArray shadowMoments;
+uniform float lightBleedReduction = 0.2;
+uniform vec2 evsmExponents = vec2(40.0, 5.0);
+uniform samplerCubeArray cubeDepthMap;
+uniform float far_plane;
+// point shadows from the atlas instead, the tiles of the six faces of every point light: uv origin and size
+uniform bool shadowAtlas = false;
+uniform sampler2D shadowAtlasMap;
+layout (std430, binding = 8) readonly buffer ShadowAtlasTiles { vec4 atlasTiles[]; };
+
+// clustered point lights, see LightClusters.h
+struct PointLightData {
+    vec4 position;      // w: range
+    vec4 ambient;       // w: cube shadow map index, -1 for none
+    vec4 diffuse;
+    vec4 specular;
+    vec4 attenuation;   // constant, linear, quadratic
+};
+layout (std430, binding = 4) readonly buffer PointLightBuffer { PointLightData pointLights[]; };
+layout (std430, binding = 5) readonly buffer ClusterGridBuffer { uvec2 clusterGrid[]; }; // offset, count
+layout (std430, binding = 6) readonly buffer ClusterIndexBuffer { uint clusterIndices[]; };
+uniform bool clusteredShading;
+uniform vec3 clusterSize;   // tiles x, tiles y, depth slices
+uniform float clusterScale;
+uniform float clusterBias;
+uniform vec2 screenSize;
+uniform mat4 view;
+
+uniform mat4 RSM_lightSpaceMatrix;
+uniform mat4 RSM_invLightSpaceMatrix;
+uniform bool RSMPositionFromDepth;
+uniform bool RSMPackedNormal;
+uniform sampler2D RSM_Depth;
+uniform sampler2D RSM_Position;
+uniform sampler2D RSM_Normal;
+uniform sampler2D RSM_Flux;
+
+vec3 FragPos;
+vec3 normal;
+vec3 objDiffuse;
+float objSpecular;
+float shininess;
+
+vec3 decodeNormal(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// RSM texel at c, positions are rebuilt from the depth when they are not stored,
+// normals are octahedral in two components when packed
+vec3 RSMPosition(vec2 c)
+{
+    if(!RSMPositionFromDepth)
+        return texture(RSM_Position, c).rgb;
+    vec2 size = vec2(textureSize(RSM_Depth, 0));
+    vec2 texel = (floor(c * size) + 0.5) / size;
+    vec4 p = RSM_invLightSpaceMatrix * vec4(vec3(texel, texture(RSM_Depth, texel).r) * 2.0 - 1.0, 1.0);
+    return p.xyz / p.w;
+}
+
+vec3 RSMNormal(vec2 c)
+{
+    vec3 n = texture(RSM_Normal, c).rgb;
+    return RSMPackedNormal ? decodeNormal(n.xy) : n;
+}
+
+float random(float x){
+    return fract(sin(x)*100000.0);
+}
+
+// upper bound of the lit fraction, the tail below lightBleedReduction is cut off against light bleeding
+float chebyshevUpperBound(vec2 moments, float depth, float minVariance)
+{
+    if(depth <= moments.x)
+        return 1.0;
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d = depth - moments.x;
+    float pMax = variance / (variance + d * d);
+    return clamp((pMax - lightBleedReduction) / (1.0 - lightBleedReduction), 0.0, 1.0);
+}
+
+// one trilinear fetch of the blurred moments instead of the PCF taps
+float momentShadow(vec3 uvLayer, float depth)
+{
+    vec4 moments = texture(shadowMoments, uvLayer);
+    if(shadowFilter == 1)
+        return 1.0 - chebyshevUpperBound(moments.xy, depth, 0.00002);
+    float d = 2.0 * depth - 1.0;
+    vec2 warped = vec2(exp(evsmExponents.x * d), -exp(-evsmExponents.y * d));
+    vec2 minVariance = 0.0001 * evsmExponents * warped;
+    minVariance *= minVariance;
+    float lit = min(chebyshevUpperBound(moments.xy, warped.x, minVariance.x),
+        chebyshevUpperBound(moments.zw, warped.y, minVariance.y));
+    return 1.0 - lit;
+}
+float dirShadowCalculation(vec3 fragPos, int dirLightNum)
+{
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    if(depth > cascadeSplits[cascadeNum - 1])
+        return 0.0;
+    int cascade = 0;
+    while(depth > cascadeSplits[cascade])
+        cascade++;
+    int layer = dirLightNum * cascadeNum + cascade;
+    vec4 fragPosLightSpace = lightSpaceMatrix[layer] * vec4(fragPos, 1.0);
+    vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
+    projCoords = projCoords * 0.5 + 0.5;
+    if(projCoords.z > 1.0)
+        return 0.0;
+    if(shadowFilter != 0)
+        return momentShadow(vec3(projCoords.xy, layer), projCoords.z);
+    float shadow = 0;
+    float currentDepth = projCoords.z;
+    vec2 texelSize = 1.0 / textureSize(shadowMap, 0).xy;
+    for(int x=-2; x<=2; ++x)
+        for(int y=-2; y<=2; ++y)
+        {
+            float pcfDepth = texture(shadowMap, vec3(projCoords.xy + vec2(x,y)*texelSize, layer)).r;
+            shadow += currentDepth > pcfDepth ? 1.0 : 0.0;
+        }
+    shadow /= 25.0;
+    return shadow;
+}
+
+vec3 computeLight(Light light, int dirLightNum)
+{
+    vec3 lightDir = normalize(-light.direction);
+    vec3 ambient = light.ambient * objDiffuse;
+
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 diffuse = light.diffuse * diff * objDiffuse;
+
+    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    vec3 specular = light.specular * spec * objSpecular;
+
+    float shadow = dirShadowCalculation(FragPos, dirLightNum);
+    return ambient + (1.0 - shadow) * (diffuse + specular);
+}
+
+// closest depth toward dir in the tile of the cube face it points to, faces are projected as those
+// of a cube map, samples stay half a texel inside the tile
+float atlasDepth(vec3 dir, int pointLight)
+{
+    vec3 a = abs(dir);
+    int face;
+    vec2 uv;
+    if(a.x >= a.y && a.x >= a.z)
+    {
+        face = dir.x > 0.0 ? 0 : 1;
+        uv = vec2(dir.x > 0.0 ? -dir.z : dir.z, -dir.y) / a.x;
+    }
+    else if(a.y >= a.z)
+    {
+        face = dir.y > 0.0 ? 2 : 3;
+        uv = vec2(dir.x, dir.y > 0.0 ? dir.z : -dir.z) / a.y;
+    }
+    else
+    {
+        face = dir.z > 0.0 ? 4 : 5;
+        uv = vec2(dir.z > 0.0 ? dir.x : -dir.x, -dir.y) / a.z;
+    }
+    vec4 tile = atlasTiles[6 * pointLight + face];
+    float border = 0.5 / (tile.z * float(textureSize(shadowAtlasMap, 0).x));
+    uv = clamp(uv * 0.5 + 0.5, border, 1.0 - border);
+    return texture(shadowAtlasMap, tile.xy + uv * tile.z).r;
+}
+vec3 sampleOffsetDirections[20] = vec3[]
+(
+   vec3( 1,  1,  1), vec3( 1, -1,  1), vec3(-1, -1,  1), vec3(-1,  1,  1), 
+   vec3( 1,  1, -1), vec3( 1, -1, -1), vec3(-1, -1, -1), vec3(-1,  1, -1),
+   vec3( 1,  1,  0), vec3( 1, -1,  0), vec3(-1, -1,  0), vec3(-1,  1,  0),
+   vec3( 1,  0,  1), vec3(-1,  0,  1), vec3( 1,  0, -1), vec3(-1,  0, -1),
+   vec3( 0,  1,  1), vec3( 0, -1,  1), vec3( 0, -1, -1), vec3( 0,  1, -1)
+);
+float pointShadowCalculation(vec3 lightPos, int pointLightIndex)
+{
+    if(shadowAtlas && atlasTiles[6 * pointLightIndex].z == 0.0)
+        return 0.0;
+    vec3 fragToLight = FragPos - lightPos;
+    float shadow = 0.0;
+    float diskRadius = 0.05;
+    int samples = 20;
+    float currentDepth = length(fragToLight);
+    for(int i=0; i<samples; ++i)
+    {
+        vec3 samplePos = fragToLight + sampleOffsetDirections[i]*diskRadius;
+        float closestDepth = shadowAtlas ? atlasDepth(samplePos, pointLightIndex) : texture(cubeDepthMap, vec4(samplePos, pointLightIndex)).r;
+        closestDepth *= far_plane;
+        shadow += currentDepth > closestDepth ? 1.0 : 0.0;
+    }
+    shadow /= float(samples);
+    return shadow;
+}
+
+// point lights of the pixel's cluster
+vec3 computeClusteredLights()
+{
+    ivec3 size = ivec3(clusterSize);
+    float depth = -(view * vec4(FragPos, 1.0)).z;
+    int slice = clamp(int(log(depth) * clusterScale + clusterBias), 0, size.z - 1);
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / screenSize * vec2(size.xy)), ivec2(0), size.xy - 1);
+    uvec2 cluster = clusterGrid[(slice * size.y + tile.y) * size.x + tile.x];
+
+    vec3 result = vec3(0.0);
+    vec3 viewDir = normalize(viewPos - FragPos);
+    for(uint i=0; i<cluster.y; ++i)
+    {
+        PointLightData light = pointLights[clusterIndices[cluster.x + i]];
+        vec3 lightDir = normalize(light.position.xyz - FragPos);
+        vec3 ambient = light.ambient.rgb * objDiffuse;
+
+        float diff = max(dot(normal, lightDir), 0.0);
+        vec3 diffuse = light.diffuse.rgb * diff * objDiffuse;
+
+        vec3 reflectDir = reflect(-lightDir, normal);
+        float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+        vec3 specular = light.specular.rgb * spec * objSpecular;
+
+        float dis = length(light.position.xyz - FragPos);
+        float attenuation = 1.0 / (light.attenuation.x + light.attenuation.y*dis + light.attenuation.z*(dis*dis));
+        float shadow = 0.0;
+        if(light.ambient.w >= 0.0)
+            shadow = pointShadowCalculation(light.position.xyz, int(light.ambient.w));
+        result += attenuation * (ambient + (1.0 - shadow) * (diffuse + specular));
+    }
+    return result;
+}
+
+vec3 RSM()
+{
+    vec3 indirectIllumination = vec3(0.0);
+    vec2 texelSize = 1.0 / textureSize(RSM_Flux, 0).xy;
+
+    vec4 RSM_FragPoslightSpace = RSM_lightSpaceMatrix * vec4(FragPos, 1.0);
+    vec3 coord = RSM_FragPoslightSpace.xyz / RSM_FragPoslightSpace.w;
+    coord = coord * 0.5 + 0.5;
+
+    float rMax = textureSize(RSM_Flux, 0).x / 4.0;
+    for(float i=1; i<=SAMPLE_NUM; i+=1.0)
+    {
+        float r1 = random(i);
+        float r2 = random(i+0.5);
+        vec2 c = coord.xy + rMax * vec2(r1*sin(PI2*r2), r1*cos(PI2*r2)) * texelSize;
+        vec3 flux = texture(RSM_Flux, c).rgb;
+        vec3 xp = RSMPosition(c);
+        vec3 np = RSMNormal(c);
+        vec3 e = flux * (max(0, dot(np,FragPos-xp)) * max(0, dot(normal,xp-FragPos)) / pow(distance(xp,FragPos),2.0));
+        indirectIllumination += r1*r1 * e;
+    }
+    return indirectIllumination;
+}
+
+void main()
+{
+    // the G-buffer may be larger than the viewport, fetch by pixel
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    if(depth == 1.0) // background keeps the clear color
+        discard;
+
+    vec4 p = invViewProjection * vec4(vec3(TexCoords, depth) * 2.0 - 1.0, 1.0);
+    FragPos = p.xyz / p.w;
+
+    vec4 albedoSpec = texelFetch(gAlbedoSpec, pixel, 0);
+    vec4 normalShininess = texelFetch(gNormal, pixel, 0);
+    objDiffuse = albedoSpec.rgb;
+    objSpecular = albedoSpec.a;
+    normal = decodeNormal(normalShininess.xy * 2.0 - 1.0);
+    shininess = exp2(normalShininess.z * 11.0);
+
+    vec3 directIllumination = vec3(0.0);
+    int dirLightNum = 0;
+    for(int i=0; i<lightNum; ++i)
+    {
+        if(lights[i].type != 1)
+            continue;
+        directIllumination += computeLight(lights[i], dirLightNum);
+        dirLightNum++;
+    }
+    if(clusteredShading)
+        directIllumination += computeClusteredLights();
+
+    vec3 result = directIllumination + 0.1 * RSM();
+    FragColor = vec4(result, 1.0);
+}
@@ -0,0 +1,136 @@
+#version 460 core
+// Lighting pass of the deferred path: one point light, drawn additively inside its scissor rect
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+struct Light {
+    int type;
+    vec3 position;
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+uniform sampler2D gAlbedoSpec;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform mat4 invViewProjection;
+
+uniform vec3 viewPos;
+uniform Light lights[16];
+uniform int lightIndex;			// index in lights
+uniform int pointLightIndex;	// index in the cube shadow map array
+uniform samplerCubeArray cubeDepthMap;
+uniform float far_plane;
+// point shadows from the atlas instead, the tiles of the six faces of every point light: uv origin and size
+uniform bool shadowAtlas = false;
+uniform sampler2D shadowAtlasMap;
+layout (std430, binding = 8) readonly buffer ShadowAtlasTiles { vec4 atlasTiles[]; };
+
+vec3 decodeNormal(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+// closest depth toward dir in the tile of the cube face it points to, faces are projected as those
+// of a cube map, samples stay half a texel inside the tile
+float atlasDepth(vec3 dir, int pointLight)
+{
+    vec3 a = abs(dir);
+    int face;
+    vec2 uv;
+    if(a.x >= a.y && a.x >= a.z)
+    {
+        face = dir.x > 0.0 ? 0 : 1;
+        uv = vec2(dir.x > 0.0 ? -dir.z : dir.z, -dir.y) / a.x;
+    }
+    else if(a.y >= a.z)
+    {
+        face = dir.y > 0.0 ? 2 : 3;
+        uv = vec2(dir.x, dir.y > 0.0 ? dir.z : -dir.z) / a.y;
+    }
+    else
+    {
+        face = dir.z > 0.0 ? 4 : 5;
+        uv = vec2(dir.z > 0.0 ? dir.x : -dir.x, -dir.y) / a.z;
+    }
+    vec4 tile = atlasTiles[6 * pointLight + face];
+    float border = 0.5 / (tile.z * float(textureSize(shadowAtlasMap, 0).x));
+    uv = clamp(uv * 0.5 + 0.5, border, 1.0 - border);
+    return texture(shadowAtlasMap, tile.xy + uv * tile.z).r;
+}
+vec3 sampleOffsetDirections[20] = vec3[]
+(
+   vec3( 1,  1,  1), vec3( 1, -1,  1), vec3(-1, -1,  1), vec3(-1,  1,  1), 
+   vec3( 1,  1, -1), vec3( 1, -1, -1), vec3(-1, -1, -1), vec3(-1,  1, -1),
+   vec3( 1,  1,  0), vec3( 1, -1,  0), vec3(-1, -1,  0), vec3(-1,  1,  0),
+   vec3( 1,  0,  1), vec3(-1,  0,  1), vec3( 1,  0, -1), vec3(-1,  0, -1),
+   vec3( 0,  1,  1), vec3( 0, -1,  1), vec3( 0, -1, -1), vec3( 0,  1, -1)
+);
+float pointShadowCalculation(vec3 fragPos, vec3 lightPos)
+{
+    if(shadowAtlas && atlasTiles[6 * pointLightIndex].z == 0.0)
+        return 0.0;
+    vec3 fragToLight = fragPos - lightPos;
+    float shadow = 0.0;
+    float diskRadius = 0.05;
+    int samples = 20;
+    float currentDepth = length(fragToLight);
+    for(int i=0; i<samples; ++i)
+    {
+        vec3 samplePos = fragToLight + sampleOffsetDirections[i]*diskRadius;
+        float closestDepth = shadowAtlas ? atlasDepth(samplePos, pointLightIndex) : texture(cubeDepthMap, vec4(samplePos, pointLightIndex)).r;
+        closestDepth *= far_plane;
+        shadow += currentDepth > closestDepth ? 1.0 : 0.0;
+    }
+    shadow /= float(samples);
+    return shadow;
+}
+
+void main()
+{
+    // the G-buffer may be larger than the viewport, fetch by pixel
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    if(depth == 1.0)
+        discard;
+
+    vec4 p = invViewProjection * vec4(vec3(TexCoords, depth) * 2.0 - 1.0, 1.0);
+    vec3 FragPos = p.xyz / p.w;
+
+    vec4 albedoSpec = texelFetch(gAlbedoSpec, pixel, 0);
+    vec4 normalShininess = texelFetch(gNormal, pixel, 0);
+    vec3 objDiffuse = albedoSpec.rgb;
+    float objSpecular = albedoSpec.a;
+    vec3 normal = decodeNormal(normalShininess.xy * 2.0 - 1.0);
+    float shininess = exp2(normalShininess.z * 11.0);
+
+    Light light = lights[lightIndex];
+    vec3 lightDir = normalize(light.position - FragPos);
+    vec3 ambient = light.ambient * objDiffuse;
+
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 diffuse = light.diffuse * diff * objDiffuse;
+
+    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+    vec3 specular = light.specular * spec * objSpecular;
+
+    float dis = length(light.position - FragPos);
+    float attenuation = 1.0 / (light.constant + light.linear*dis + light.quadratic*(dis*dis));
+    float shadow = pointShadowCalculation(FragPos, light.position);
+
+    FragColor = vec4(attenuation * (ambient + (1.0 - shadow) * (diffuse + specular)), 1.0);
+}
@@ -0,0 +1,25 @@
+#version 460 core
+layout (location = 0) in vec3 position;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+// GPU culled multi draws read the matrices of the draw's object
+struct ObjectMatrices {
+    mat4 model;
+    mat4 transInvModel;
+};
+layout (std430, binding = 9) readonly buffer ObjectBuffer { ObjectMatrices objectMatrices[]; };
+layout (location = 5) in uint objectIndex; // instanced, offset by the base instance of the draw command
+uniform bool indirectDraw;
+
+// same expression as the shading vertex shaders, depth must match exactly
+invariant gl_Position;
+
+void main()
+{
+    mat4 modelMatrix = indirectDraw ? objectMatrices[objectIndex].model : model;
+    vec3 FragPos = vec3(modelMatrix * vec4(position, 1.0));
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
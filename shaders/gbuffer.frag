@@ -0,0 +1,65 @@
+#version 460 core
+// Geometry pass of the deferred path
+// gAlbedoSpec: diffuse color and specular intensity
+// gNormal: octahedral normal in rg, log2(shininess) / 11 in b
+// position is reconstructed from depth in the lighting pass
+layout (location = 0) out vec4 gAlbedoSpec;
+layout (location = 1) out vec4 gNormal;
+
+uniform float shininess;
+struct Material {
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;   
+
+    sampler2D diffuseT;
+    sampler2D normalT;
+    sampler2D specularT; 
+};
+
+uniform bool useDiffuseMap;
+uniform bool useSpecularMap;
+uniform bool useNormalMap;
+uniform Material mtl;
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+in mat3 TBN;
+
+vec2 signNotZero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// unit vector to [-1, 1]^2
+vec2 encodeNormal(vec3 n)
+{
+    n /= abs(n.x) + abs(n.y) + abs(n.z);
+    return n.z >= 0.0 ? n.xy : (1.0 - abs(n.yx)) * signNotZero(n.xy);
+}
+
+void main()
+{
+    vec3 normal = normalize(Normal);
+    if(useNormalMap)
+    {
+        normal = texture(mtl.normalT, TexCoords).rgb;
+        normal = normalize(normal * 2.0 - 1.0);
+        normal = normalize(TBN * normal);
+    }
+
+    vec3 objDiffuse;
+    vec3 objSpecular;
+    if(useDiffuseMap)
+        objDiffuse = texture(mtl.diffuseT, TexCoords).rgb;
+    else
+        objDiffuse = mtl.diffuse;
+    if(useSpecularMap)
+        objSpecular = texture(mtl.specularT, TexCoords).rgb;
+    else
+        objSpecular = mtl.specular;
+
+    gAlbedoSpec = vec4(objDiffuse, dot(objSpecular, vec3(0.2126, 0.7152, 0.0722)));
+    gNormal = vec4(encodeNormal(normal) * 0.5 + 0.5, log2(max(shininess, 1.0)) / 11.0, 1.0);
+}
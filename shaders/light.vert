@@ -5,7 +5,11 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+// matches the depth pre-pass
+invariant gl_Position;
+
 void main()
 {
-	gl_Position = projection * view * model * vec4(position, 1.0);
+	vec3 FragPos = vec3(model * vec4(position, 1.0));
+	gl_Position = projection * view * vec4(FragPos, 1.0);
 }
\ No newline at end of file
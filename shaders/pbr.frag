@@ -21,6 +21,8 @@ struct Material {
 uniform samplerCube irradianceMap;
 uniform samplerCube prefilterMap;
 uniform sampler2D brdfLUT;
+uniform bool IBLReady;          // false while the maps are precomputed
+uniform vec3 SHIrradiance[9];   // irradiance over PI, the ambient until IBLReady
 
 struct Light {
     int type;
@@ -41,7 +43,6 @@ in vec3 Normal;
 in vec2 TexCoords;
 in mat3 TBN;
 
-in vec4 FragPosLightSpace[5];   // frag position in directional light space
  
 uniform bool useAlbedoMap;
 uniform bool useNormalMap;
@@ -58,6 +59,24 @@ uniform sampler2DArray shadowMap;
 uniform samplerCubeArray cubeDepthMap;
 uniform float far_plane;
 
+// clustered point lights, see LightClusters.h
+struct PointLightData {
+    vec4 position;      // w: range
+    vec4 ambient;       // w: cube shadow map index, -1 for none
+    vec4 diffuse;
+    vec4 specular;
+    vec4 attenuation;   // constant, linear, quadratic
+};
+layout (std430, binding = 4) readonly buffer PointLightBuffer { PointLightData pointLights[]; };
+layout (std430, binding = 5) readonly buffer ClusterGridBuffer { uvec2 clusterGrid[]; }; // offset, count
+layout (std430, binding = 6) readonly buffer ClusterIndexBuffer { uint clusterIndices[]; };
+uniform bool clusteredShading;
+uniform vec3 clusterSize;   // tiles x, tiles y, depth slices
+uniform float clusterScale;
+uniform float clusterBias;
+uniform vec2 screenSize;
+uniform mat4 view;
+
 int dirLightNum = 0;
 int pointLightNum = 0;
 vec3 N;
@@ -75,6 +94,13 @@ float G_Smith(float NdotV, float NdotL, float roughness);
 vec3 Fresnel_Schlick(float NdotL, vec3 F0);
 vec3 Fresnel_Schlick_Roughness(float NdotL, vec3 F0, float roughness);
 
+// outgoing radiance of one light
+vec3 reflectance(vec3 L, vec3 radiance, vec3 albedo, float metallic, float roughness, vec3 F0);
+
+// low quality ambient until the IBL maps are done
+vec3 SHAmbient(vec3 n);
+vec2 envBRDFApprox(float NdotV, float roughness);
+
 void main()
 {
     // surface normal
@@ -115,9 +141,6 @@ void main()
         // calculate per-light radiance -----------------------
         // light direction
         vec3 L = normalize(lights[i].type * (-lights[i].direction) + (1-lights[i].type) * (lights[i].position - FragPos));
-        // halfway vector
-        vec3 H = normalize(V + L); 	
-        float NdotL = max(dot(N, L), 0.0);
     
         float attenuation = 1.0;
         if(lights[i].type == 0) // point light
@@ -127,24 +150,24 @@ void main()
             attenuation = 1.0 / (lights[i].constant + lights[i].linear*dis + lights[i].quadratic*(dis*dis));
         }
         vec3 radiance = lights[i].diffuse * attenuation;
-
-        // cook-torrance brdf -------------------------------
-        // Fresnel
-        vec3 F = Fresnel_Schlick(max(dot(H, V), 0.0), F0); // H,V replace N,L
-        // NDF
-        float NDF = NDF_GGX(N, H, roughness);
-        // Geometry value 
-        float G = G_Smith(NdotV, NdotL, roughness);
-
-        vec3 nominator = NDF * G * F;
-        float denom = 4.0 * NdotV * NdotL + 0.001;
-        vec3 specular = nominator / denom;
-
-        vec3 kS = F;
-        vec3 kD = vec3(1.0) - kS;
-        kD *= 1.0 - metallic;
-    
-        Lo += (kD * albedo / PI + specular) * radiance * NdotL;
+        Lo += reflectance(L, radiance, albedo, metallic, roughness, F0);
+    }
+    if(clusteredShading)
+    {
+        // point lights of the fragment's cluster
+        ivec3 size = ivec3(clusterSize);
+        float depth = -(view * vec4(FragPos, 1.0)).z;
+        int slice = clamp(int(log(depth) * clusterScale + clusterBias), 0, size.z - 1);
+        ivec2 tile = clamp(ivec2(gl_FragCoord.xy / screenSize * vec2(size.xy)), ivec2(0), size.xy - 1);
+        uvec2 cluster = clusterGrid[(slice * size.y + tile.y) * size.x + tile.x];
+        for(uint i=0; i<cluster.y; ++i)
+        {
+            PointLightData light = pointLights[clusterIndices[cluster.x + i]];
+            vec3 L = normalize(light.position.xyz - FragPos);
+            float dis = length(light.position.xyz - FragPos);
+            float attenuation = 1.0 / (light.attenuation.x + light.attenuation.y*dis + light.attenuation.z*(dis*dis));
+            Lo += reflectance(L, light.diffuse.rgb * attenuation, albedo, metallic, roughness, F0);
+        }
     }
 
     // ambient lighting
@@ -153,13 +176,23 @@ void main()
     vec3 kS = F;
     vec3 kD = vec3(1.0) - kS;
     kD *= 1.0 - metallic;
-    vec3 irradiance = texture(irradianceMap, N).rgb;
+    vec3 irradiance = IBLReady ? texture(irradianceMap, N).rgb : SHAmbient(N);
     vec3 diffuse = irradiance * albedo;
 
-    // specular term
+    // specular term, the SH ambient around R and an analytic BRDF until the maps are done
     const float MAX_REFLECTION_LOD = 4.0;
-    vec3 prefilteredColor = textureLod(prefilterMap, R, roughness * MAX_REFLECTION_LOD).rgb;
-    vec2 brdf = texture(brdfLUT, vec2(NdotV, roughness)).rg;
+    vec3 prefilteredColor;
+    vec2 brdf;
+    if(IBLReady)
+    {
+        prefilteredColor = textureLod(prefilterMap, R, roughness * MAX_REFLECTION_LOD).rgb;
+        brdf = texture(brdfLUT, vec2(NdotV, roughness)).rg;
+    }
+    else
+    {
+        prefilteredColor = SHAmbient(R);
+        brdf = envBRDFApprox(NdotV, roughness);
+    }
     vec3 specular = prefilteredColor * (F * brdf.x + brdf.y);
     
     vec3 ambient = (kD * diffuse + specular) * ao;
@@ -174,6 +207,32 @@ void main()
     FragColor = vec4(color, 1.0);
 }
 
+vec3 reflectance(vec3 L, vec3 radiance, vec3 albedo, float metallic, float roughness, vec3 F0)
+{
+    // halfway vector
+    vec3 H = normalize(V + L);
+    float NdotL = max(dot(N, L), 0.0);
+    float NdotV = max(dot(N, V), 0.0);
+
+    // cook-torrance brdf -------------------------------
+    // Fresnel
+    vec3 F = Fresnel_Schlick(max(dot(H, V), 0.0), F0); // H,V replace N,L
+    // NDF
+    float NDF = NDF_GGX(N, H, roughness);
+    // Geometry value 
+    float G = G_Smith(NdotV, NdotL, roughness);
+
+    vec3 nominator = NDF * G * F;
+    float denom = 4.0 * NdotV * NdotL + 0.001;
+    vec3 specular = nominator / denom;
+
+    vec3 kS = F;
+    vec3 kD = vec3(1.0) - kS;
+    kD *= 1.0 - metallic;
+
+    return (kD * albedo / PI + specular) * radiance * NdotL;
+}
+
 // Normal Distribution Function
 float NDF_GGX(vec3 N, vec3 H, float roughness)
 {
@@ -210,4 +269,25 @@ vec3 Fresnel_Schlick(float NdotL, vec3 F0)
 vec3 Fresnel_Schlick_Roughness(float NdotL, vec3 F0, float roughness)
 {
     return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(1.0 - NdotL, 5.0);
-}   
\ No newline at end of file
+}   
+
+// 9 SH coefficients, the basis order matches CubeMap.cpp
+vec3 SHAmbient(vec3 n)
+{
+    vec3 color = SHIrradiance[0] * 0.282095
+        + SHIrradiance[1] * 0.488603 * n.y + SHIrradiance[2] * 0.488603 * n.z + SHIrradiance[3] * 0.488603 * n.x
+        + SHIrradiance[4] * 1.092548 * n.x * n.y + SHIrradiance[5] * 1.092548 * n.y * n.z
+        + SHIrradiance[6] * 0.315392 * (3.0 * n.z * n.z - 1.0) + SHIrradiance[7] * 1.092548 * n.x * n.z
+        + SHIrradiance[8] * 0.546274 * (n.x * n.x - n.y * n.y);
+    return max(color, vec3(0.0));
+}
+
+// fitted environment BRDF scale and bias, Karis 2014
+vec2 envBRDFApprox(float NdotV, float roughness)
+{
+    const vec4 c0 = vec4(-1.0, -0.0275, -0.572, 0.022);
+    const vec4 c1 = vec4(1.0, 0.0425, 1.04, -0.04);
+    vec4 r = roughness * c0 + c1;
+    float a004 = min(r.x * r.x, exp2(-9.28 * NdotV)) * r.x + r.y;
+    return vec2(-1.04, 1.04) * a004 + r.zw;
+}
@@ -36,18 +36,49 @@ in vec3 Normal;
 in vec2 TexCoords;
 in mat3 TBN;
 
-in vec4 FragPosLightSpace[5];   // frag position in directional light space
  
 uniform vec3 viewPos;
 uniform Material mtl;
 uniform Light lights[16];
 uniform int lightNum;
 uniform sampler2DArray shadowMap;
+// cascades of a directional light are consecutive layers, picked by view depth
+uniform mat4 lightSpaceMatrix[20];  // 5 directional lights with up to 4 cascades
+uniform int cascadeNum = 1;
+uniform float cascadeSplits[4] = float[](1e30, 1e30, 1e30, 1e30); // far view depth of each cascade
+// prefiltered directional shadows: 0 PCF, 1 VSM, 2 EVSM, moments at half the shadow map size with mips
+uniform int shadowFilter = 0;
+uniform sampler2DArray shadowMoments;
+uniform float lightBleedReduction = 0.2;
+uniform vec2 evsmExponents = vec2(40.0, 5.0);
 uniform samplerCubeArray cubeDepthMap;
 uniform float far_plane;
+// point shadows from the atlas instead, the tiles of the six faces of every point light: uv origin and size
+uniform bool shadowAtlas = false;
+uniform sampler2D shadowAtlasMap;
+layout (std430, binding = 8) readonly buffer ShadowAtlasTiles { vec4 atlasTiles[]; };
+
+// clustered point lights, see LightClusters.h
+struct PointLightData {
+    vec4 position;      // w: range
+    vec4 ambient;       // w: cube shadow map index, -1 for none
+    vec4 diffuse;
+    vec4 specular;
+    vec4 attenuation;   // constant, linear, quadratic
+};
+layout (std430, binding = 4) readonly buffer PointLightBuffer { PointLightData pointLights[]; };
+layout (std430, binding = 5) readonly buffer ClusterGridBuffer { uvec2 clusterGrid[]; }; // offset, count
+layout (std430, binding = 6) readonly buffer ClusterIndexBuffer { uint clusterIndices[]; };
+uniform bool clusteredShading;
+uniform vec3 clusterSize;   // tiles x, tiles y, depth slices
+uniform float clusterScale;
+uniform float clusterBias;
+uniform vec2 screenSize;
+uniform mat4 view;
 
 vec3 computeLight(Light light, vec3 objDiffuse, vec3 objSpecular);
-float dirShadowCalculation(vec4 fragPosLightSpace, vec3 lightDir, int dirLightNum);
+vec3 computeClusteredLights(vec3 objDiffuse, vec3 objSpecular);
+float dirShadowCalculation(vec3 fragPos, vec3 lightDir, int dirLightNum);
 float pointShadowCalculation(vec3 fragPos, vec3 lightPos, int pointLightNum);
 
 int dirLightNum = 0;
@@ -81,6 +112,8 @@ void main()
     {
         result += computeLight(lights[i], objDiffuse, objSpecular);
     }
+    if(clusteredShading)
+        result += computeClusteredLights(objDiffuse, objSpecular);
     
     FragColor = vec4(result, 1.0);
     
@@ -124,12 +157,13 @@ vec3 computeLight(Light light, vec3 objDiffuse, vec3 objSpecular)
         // attenuation
         float dis = length(light.position - FragPos);
         attenuation = 1.0 / (light.constant + light.linear*dis + light.quadratic*(dis*dis));
-        shadow = pointShadowCalculation(FragPos, light.position, pointLightNum);
+        if(pointLightNum >= 0)
+            shadow = pointShadowCalculation(FragPos, light.position, pointLightNum);
         pointLightNum++;
     }
     else if(light.type == 1) // directional light
     {
-        shadow = dirShadowCalculation(FragPosLightSpace[dirLightNum], lightDir, dirLightNum);
+        shadow = dirShadowCalculation(FragPos, lightDir, dirLightNum);
         dirLightNum++;
     }
 
@@ -139,12 +173,76 @@ vec3 computeLight(Light light, vec3 objDiffuse, vec3 objSpecular)
     //return vec3(shadow, shadow, shadow);
 }
 
-float dirShadowCalculation(vec4 fragPosLightSpace, vec3 lightDir, int dirLightNum)
+// point lights of the fragment's cluster
+vec3 computeClusteredLights(vec3 objDiffuse, vec3 objSpecular)
 {
+    ivec3 size = ivec3(clusterSize);
+    float depth = -(view * vec4(FragPos, 1.0)).z;
+    int slice = clamp(int(log(depth) * clusterScale + clusterBias), 0, size.z - 1);
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / screenSize * vec2(size.xy)), ivec2(0), size.xy - 1);
+    uvec2 cluster = clusterGrid[(slice * size.y + tile.y) * size.x + tile.x];
+
+    vec3 result = vec3(0.0);
+    for(uint i=0; i<cluster.y; ++i)
+    {
+        PointLightData data = pointLights[clusterIndices[cluster.x + i]];
+        Light light;
+        light.type = 0;
+        light.position = data.position.xyz;
+        light.direction = vec3(0.0);
+        light.ambient = data.ambient.rgb;
+        light.diffuse = data.diffuse.rgb;
+        light.specular = data.specular.rgb;
+        light.constant = data.attenuation.x;
+        light.linear = data.attenuation.y;
+        light.quadratic = data.attenuation.z;
+        pointLightNum = int(data.ambient.w); // shadow map index
+        result += computeLight(light, objDiffuse, objSpecular);
+    }
+    return result;
+}
+
+// upper bound of the lit fraction, the tail below lightBleedReduction is cut off against light bleeding
+float chebyshevUpperBound(vec2 moments, float depth, float minVariance)
+{
+    if(depth <= moments.x)
+        return 1.0;
+    float variance = max(moments.y - moments.x * moments.x, minVariance);
+    float d = depth - moments.x;
+    float pMax = variance / (variance + d * d);
+    return clamp((pMax - lightBleedReduction) / (1.0 - lightBleedReduction), 0.0, 1.0);
+}
+
+// one trilinear fetch of the blurred moments instead of the PCF taps
+float momentShadow(vec3 uvLayer, float depth)
+{
+    vec4 moments = texture(shadowMoments, uvLayer);
+    if(shadowFilter == 1)
+        return 1.0 - chebyshevUpperBound(moments.xy, depth, 0.00002);
+    float d = 2.0 * depth - 1.0;
+    vec2 warped = vec2(exp(evsmExponents.x * d), -exp(-evsmExponents.y * d));
+    vec2 minVariance = 0.0001 * evsmExponents * warped;
+    minVariance *= minVariance;
+    float lit = min(chebyshevUpperBound(moments.xy, warped.x, minVariance.x),
+        chebyshevUpperBound(moments.zw, warped.y, minVariance.y));
+    return 1.0 - lit;
+}
+float dirShadowCalculation(vec3 fragPos, vec3 lightDir, int dirLightNum)
+{
+    float depth = -(view * vec4(fragPos, 1.0)).z;
+    if(depth > cascadeSplits[cascadeNum - 1])
+        return 0.0;
+    int cascade = 0;
+    while(depth > cascadeSplits[cascade])
+        cascade++;
+    int layer = dirLightNum * cascadeNum + cascade;
+    vec4 fragPosLightSpace = lightSpaceMatrix[layer] * vec4(fragPos, 1.0);
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     projCoords = projCoords * 0.5 + 0.5;
     if(projCoords.z > 1.0)
         return 0.0;
+    if(shadowFilter != 0)
+        return momentShadow(vec3(projCoords.xy, layer), projCoords.z);
     //float bias = max(0.05 * (1.0 - dot(normal, lightDir)), 0.005);
     float shadow = 0;
     float currentDepth = projCoords.z;
@@ -153,12 +251,39 @@ float dirShadowCalculation(vec4 fragPosLightSpace, vec3 lightDir, int dirLightNu
         for(int y=-2; y<=2; ++y)
         {    
             //float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x,y)*texelSize).r;
-            float pcfDepth = texture2DArray(shadowMap, vec3(projCoords.xy + vec2(x,y)*texelSize, dirLightNum)).r;
+            float pcfDepth = texture2DArray(shadowMap, vec3(projCoords.xy + vec2(x,y)*texelSize, layer)).r;
             shadow += currentDepth > pcfDepth ? 1.0 : 0.0;
         }
     shadow /= 25.0;
     return shadow;
 }
+// closest depth toward dir in the tile of the cube face it points to, faces are projected as those
+// of a cube map, samples stay half a texel inside the tile
+float atlasDepth(vec3 dir, int pointLight)
+{
+    vec3 a = abs(dir);
+    int face;
+    vec2 uv;
+    if(a.x >= a.y && a.x >= a.z)
+    {
+        face = dir.x > 0.0 ? 0 : 1;
+        uv = vec2(dir.x > 0.0 ? -dir.z : dir.z, -dir.y) / a.x;
+    }
+    else if(a.y >= a.z)
+    {
+        face = dir.y > 0.0 ? 2 : 3;
+        uv = vec2(dir.x, dir.y > 0.0 ? dir.z : -dir.z) / a.y;
+    }
+    else
+    {
+        face = dir.z > 0.0 ? 4 : 5;
+        uv = vec2(dir.z > 0.0 ? dir.x : -dir.x, -dir.y) / a.z;
+    }
+    vec4 tile = atlasTiles[6 * pointLight + face];
+    float border = 0.5 / (tile.z * float(textureSize(shadowAtlasMap, 0).x));
+    uv = clamp(uv * 0.5 + 0.5, border, 1.0 - border);
+    return texture(shadowAtlasMap, tile.xy + uv * tile.z).r;
+}
 vec3 sampleOffsetDirections[20] = vec3[]
 (
    vec3( 1,  1,  1), vec3( 1, -1,  1), vec3(-1, -1,  1), vec3(-1,  1,  1), 
@@ -169,6 +294,8 @@ vec3 sampleOffsetDirections[20] = vec3[]
 );
 float pointShadowCalculation(vec3 fragPos, vec3 lightPos, int pointLightNum)
 {
+    if(shadowAtlas && atlasTiles[6 * pointLightNum].z == 0.0)
+        return 0.0;
     vec3 fragToLight = fragPos - lightPos;
     //float closestDepth = texture(cubeDepthMap, fragToLight).r;
     float shadow = 0.0;
@@ -177,7 +304,7 @@ float pointShadowCalculation(vec3 fragPos, vec3 lightPos, int pointLightNum)
     for(int i=0; i<samples; ++i)
     {
         vec3 samplePos = fragToLight + sampleOffsetDirections[i]*diskRadius;
-        float closestDepth = texture(cubeDepthMap, vec4(samplePos, pointLightNum)).r;
+        float closestDepth = shadowAtlas ? atlasDepth(samplePos, pointLightNum) : texture(cubeDepthMap, vec4(samplePos, pointLightNum)).r;
         closestDepth *= far_plane;
         float currentDepth = length(fragToLight);
 
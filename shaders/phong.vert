@@ -8,27 +8,37 @@ layout (location = 4) in vec3 bitangent;
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
-out vec4 FragPosLightSpace[5];
 out mat3 TBN;
 
 uniform mat4 model;
 uniform mat4 transInvModel;
 uniform mat4 view;
 uniform mat4 projection;
-uniform mat4 lightSpaceMatrix[5];
+
+// GPU culled multi draws read the matrices of the draw's object
+struct ObjectMatrices {
+    mat4 model;
+    mat4 transInvModel;
+};
+layout (std430, binding = 9) readonly buffer ObjectBuffer { ObjectMatrices objectMatrices[]; };
+layout (location = 5) in uint objectIndex; // instanced, offset by the base instance of the draw command
+uniform bool indirectDraw;
+
+// matches the depth pre-pass
+invariant gl_Position;
 
 void main()
 {
-    FragPos = vec3(model * vec4(position, 1.0));
-    Normal = vec3(transInvModel * vec4(normal, 1.0));
+    mat4 modelMatrix = indirectDraw ? objectMatrices[objectIndex].model : model;
+    mat4 normalMatrix = indirectDraw ? objectMatrices[objectIndex].transInvModel : transInvModel;
+    FragPos = vec3(modelMatrix * vec4(position, 1.0));
+    Normal = vec3(normalMatrix * vec4(normal, 1.0));
     TexCoords = texCoords;
-    for(int i=0; i<5; ++i)
-        FragPosLightSpace[i] = lightSpaceMatrix[i] * vec4(FragPos, 1.0);
 
     // compute TBN matrix
-    vec3 T = normalize(vec3(model * vec4(tangent, 0.0)));
-    vec3 B = normalize(vec3(model * vec4(bitangent, 0.0)));
-    vec3 N = normalize(vec3(model * vec4(normal, 0.0)));
+    vec3 T = normalize(vec3(modelMatrix * vec4(tangent, 0.0)));
+    vec3 B = normalize(vec3(modelMatrix * vec4(bitangent, 0.0)));
+    vec3 N = normalize(vec3(modelMatrix * vec4(normal, 0.0)));
     TBN = mat3(T, B, N);
     
     gl_Position = projection * view * vec4(FragPos, 1.0);
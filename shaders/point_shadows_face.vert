@@ -0,0 +1,14 @@
+#version 330 core
+// one cube face per pass, used in place of the geometry shader of point_shadows_depth
+layout (location = 0) in vec3 position;
+
+uniform mat4 model;
+uniform mat4 shadowMatrix; // projection and view of the face
+
+out vec4 FragPos;
+
+void main()
+{
+    FragPos = model * vec4(position, 1.0);
+    gl_Position = shadowMatrix * FragPos;
+}
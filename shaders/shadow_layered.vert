@@ -0,0 +1,23 @@
+#version 460 core
+layout (location = 0) in vec3 position;
+
+// every directional shadow layer (light * cascades + cascade)
+layout (std140, binding = 0) uniform LightSpaceMatrices
+{
+	mat4 lightSpaceMatrices[20];
+};
+
+uniform mat4 model;
+uniform int layerMask; // layers the object is drawn to, one instance each
+
+flat out int Layer;
+
+void main()
+{
+	// the layer of an instance is the gl_InstanceID-th set bit of the mask
+	int mask = layerMask;
+	for (int i = 0; i < gl_InstanceID; ++i)
+		mask &= mask - 1;
+	Layer = findLSB(mask);
+	gl_Position = lightSpaceMatrices[Layer] * model * vec4(position, 1.0);
+}
\ No newline at end of file
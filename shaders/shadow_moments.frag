@@ -0,0 +1,41 @@
+#version 460 core
+out vec4 FragColor;
+
+uniform sampler2DArray shadowMap;
+uniform int layer;
+uniform int blurRadius;
+uniform bool evsm;
+uniform vec2 evsmExponents;	// positive and negative warp
+
+// moments of a depth, of its exponential warps for EVSM
+vec4 moments(float depth)
+{
+	if(!evsm)
+		return vec4(depth, depth * depth, 0.0, 0.0);
+	float d = 2.0 * depth - 1.0;
+	float pos = exp(evsmExponents.x * d);
+	float neg = -exp(-evsmExponents.y * d);
+	return vec4(pos, pos * pos, neg, neg * neg);
+}
+
+// mean moments of the 2x2 depth texels under a moment texel, blurred horizontally
+void main()
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	ivec2 size = textureSize(shadowMap, 0).xy;
+	float sigma = max(float(blurRadius) * 0.5, 0.5);
+	vec4 result = vec4(0.0);
+	float weightSum = 0.0;
+	for(int i = -blurRadius; i <= blurRadius; ++i)
+	{
+		ivec2 p = clamp(ivec2(texel.x + i, texel.y) * 2, ivec2(0), size - 2);
+		vec4 m = moments(texelFetch(shadowMap, ivec3(p, layer), 0).r)
+			+ moments(texelFetch(shadowMap, ivec3(p + ivec2(1, 0), layer), 0).r)
+			+ moments(texelFetch(shadowMap, ivec3(p + ivec2(0, 1), layer), 0).r)
+			+ moments(texelFetch(shadowMap, ivec3(p + ivec2(1, 1), layer), 0).r);
+		float w = exp(-float(i * i) / (2.0 * sigma * sigma));
+		result += w * 0.25 * m;
+		weightSum += w;
+	}
+	FragColor = result / weightSum;
+}
\ No newline at end of file
@@ -0,0 +1,22 @@
+#version 460 core
+out vec4 FragColor;
+
+uniform sampler2D moments;
+uniform int blurRadius;
+
+// vertical pass of the moment blur
+void main()
+{
+	ivec2 texel = ivec2(gl_FragCoord.xy);
+	int height = textureSize(moments, 0).y;
+	float sigma = max(float(blurRadius) * 0.5, 0.5);
+	vec4 result = vec4(0.0);
+	float weightSum = 0.0;
+	for(int i = -blurRadius; i <= blurRadius; ++i)
+	{
+		float w = exp(-float(i * i) / (2.0 * sigma * sigma));
+		result += w * texelFetch(moments, ivec2(texel.x, clamp(texel.y + i, 0, height - 1)), 0);
+		weightSum += w;
+	}
+	FragColor = result / weightSum;
+}
\ No newline at end of file
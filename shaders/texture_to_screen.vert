@@ -4,8 +4,10 @@ layout (location = 2) in vec2 texCoords;
 
 out vec2 TexCoords;
 
+uniform vec2 uvScale = vec2(1.0); // used part of a larger render target
+
 void main()
 {
 	gl_Position = vec4(position.x, position.y, 0.0, 1.0);
-	TexCoords = texCoords;
-}
\ No newline at end of file
+	TexCoords = texCoords * uvScale;
+}
@@ -0,0 +1,30 @@
+#version 460 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D screenTexture;
+uniform vec2 uvScale = vec2(1.0);
+uniform int upscaleFilter;	// 0 bilinear, 1 sharpen
+uniform float sharpness;
+
+void main()
+{
+	// stay inside the rendered part, the rest of the target is stale
+	vec2 texelSize = 1.0 / textureSize(screenTexture, 0);
+	vec2 uv = clamp(TexCoords, 0.5 * texelSize, uvScale - 0.5 * texelSize);
+	vec3 color = texture(screenTexture, uv).rgb;
+	if (upscaleFilter == 1)
+	{
+		// unsharp mask on the source texels, clamped to the neighbourhood to avoid halos
+		vec3 n = texture(screenTexture, clamp(uv + vec2(0.0, texelSize.y), vec2(0.0), uvScale)).rgb;
+		vec3 s = texture(screenTexture, clamp(uv - vec2(0.0, texelSize.y), vec2(0.0), uvScale)).rgb;
+		vec3 e = texture(screenTexture, clamp(uv + vec2(texelSize.x, 0.0), vec2(0.0), uvScale)).rgb;
+		vec3 w = texture(screenTexture, clamp(uv - vec2(texelSize.x, 0.0), vec2(0.0), uvScale)).rgb;
+		vec3 minColor = min(color, min(min(n, s), min(e, w)));
+		vec3 maxColor = max(color, max(max(n, s), max(e, w)));
+		vec3 sharpened = color + sharpness * (4.0 * color - n - s - e - w);
+		color = clamp(sharpened, minColor, maxColor);
+	}
+	FragColor = vec4(color, 1.0);
+}
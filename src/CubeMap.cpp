@@ -1,6 +1,120 @@
 #include "../include/CubeMap.h"
 #include "../include/stb_image.h"
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+
+static const float PI = 3.14159265359f;
+// samples per texel of the shaders, irradiance_convolution.frag steps 0.025 in phi and theta
+static const float irradianceSamples = (2.0f * PI / 0.025f) * (0.5f * PI / 0.025f);
+static const float prefilterSamples = 2048.0f;
+static const float brdfLUTSamples = 1024.0f;
+static const float tileSamples = 4194304.0f; // samples of a precompute tile
+static const int prefilterMipNum = 5;
+
+// direction through (u, v) in [-1, 1] of a cube map face, v grows with the uploaded rows
+glm::vec3 CubeMap::faceDirection(int face, float u, float v)
+{
+    switch (face)
+    {
+    case 0: return glm::vec3(1.0f, -v, -u);
+    case 1: return glm::vec3(-1.0f, -v, u);
+    case 2: return glm::vec3(u, 1.0f, v);
+    case 3: return glm::vec3(u, -1.0f, -v);
+    case 4: return glm::vec3(u, -v, 1.0f);
+    default: return glm::vec3(-u, -v, -1.0f);
+    }
+}
+
+// radiance sample projected on the 9 SH basis functions
+static void addSHSample(vector<glm::vec3> &sh, glm::vec3 dir, glm::vec3 color, float weight)
+{
+    float x = dir.x, y = dir.y, z = dir.z;
+    float basis[9] = {
+        0.282095f,
+        0.488603f * y, 0.488603f * z, 0.488603f * x,
+        1.092548f * x * y, 1.092548f * y * z, 0.315392f * (3.0f * z * z - 1.0f), 1.092548f * x * z, 0.546274f * (x * x - y * y)
+    };
+    for (int i = 0; i < 9; ++i)
+        sh[i] += color * (basis[i] * weight);
+}
+
+// scale the projection to irradiance over PI, the bands convolved with the clamped cosine
+void CubeMap::normalizeSH(vector<glm::vec3> &sh, float weightSum)
+{
+    if (weightSum <= 0.0f)
+        return;
+    const float band[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+    for (int i = 0; i < 9; ++i)
+        sh[i] = sh[i] * (4.0f * PI / weightSum * band[i]);
+}
+
+// color at (x, y) in texels, filtered between the four nearest texels
+template <typename T>
+static glm::vec3 sampleBilinear(const T *data, int width, int height, int channels, float x, float y)
+{
+    int x0 = std::max(0, std::min(width - 2, (int)floor(x - 0.5f)));
+    int y0 = std::max(0, std::min(height - 2, (int)floor(y - 0.5f)));
+    float fx = std::max(0.0f, std::min(1.0f, x - 0.5f - x0));
+    float fy = std::max(0.0f, std::min(1.0f, y - 0.5f - y0));
+    glm::vec3 color(0.0f);
+    for (int i = 0; i < 4; ++i)
+    {
+        int tx = std::min(width - 1, x0 + (i & 1)), ty = std::min(height - 1, y0 + (i >> 1));
+        const T *texel = data + ((size_t)ty * width + tx) * channels;
+        float weight = ((i & 1) ? fx : 1.0f - fx) * ((i >> 1) ? fy : 1.0f - fy);
+        color += glm::vec3(texel[0], texel[std::min(1, channels - 1)], texel[std::min(2, channels - 1)]) * weight;
+    }
+    return color;
+}
+
+// about 32x32 samples of the face, each filtered at the middle of the block of texels it stands for
+// and weighted by the solid angle of the block
+float CubeMap::addSHFace(vector<glm::vec3> &sh, int face, const unsigned char *data, int width, int height, int channels)
+{
+    float weightSum = 0.0f;
+    int stride = std::max(1, width / 32);
+    for (int y = 0; y < height; y += stride)
+    {
+        int blockHeight = std::min(stride, height - y);
+        for (int x = 0; x < width; x += stride)
+        {
+            int blockWidth = std::min(stride, width - x);
+            float cx = x + 0.5f * blockWidth, cy = y + 0.5f * blockHeight;
+            float u = 2.0f * cx / width - 1.0f;
+            float v = 2.0f * cy / height - 1.0f;
+            float weight = pow(1.0f + u * u + v * v, -1.5f) * blockWidth * blockHeight;
+            glm::vec3 color = sampleBilinear(data, width, height, channels, cx, cy) / 255.0f;
+            addSHSample(sh, glm::normalize(faceDirection(face, u, v)), color, weight);
+            weightSum += weight;
+        }
+    }
+    return weightSum;
+}
+
+// about 128x64 samples of the image, bottom row first, filtered and weighted as the face samples
+float CubeMap::addSHEquirect(vector<glm::vec3> &sh, const float *data, int width, int height, int channels)
+{
+    float weightSum = 0.0f;
+    int stride = std::max(1, width / 128);
+    for (int y = 0; y < height; y += stride)
+    {
+        int blockHeight = std::min(stride, height - y);
+        float cy = y + 0.5f * blockHeight;
+        float latitude = (cy / height - 0.5f) * PI;
+        for (int x = 0; x < width; x += stride)
+        {
+            int blockWidth = std::min(stride, width - x);
+            float cx = x + 0.5f * blockWidth;
+            float phi = (cx / width - 0.5f) * 2.0f * PI;
+            float weight = cos(latitude) * blockWidth * blockHeight;
+            glm::vec3 dir(cos(latitude) * cos(phi), sin(latitude), cos(latitude) * sin(phi));
+            addSHSample(sh, dir, sampleBilinear(data, width, height, channels, cx, cy), weight);
+            weightSum += weight;
+        }
+    }
+    return weightSum;
+}
 
 CubeMap::CubeMap()
 {
@@ -29,12 +143,16 @@ void CubeMap::load(const vector<string>& facesPath)
 
     int width, height, nrChannels;
     stbi_set_flip_vertically_on_load(false);
+    SHIrradiance.assign(9, glm::vec3(0.0f));
+    float weightSum = 0.0f;
     for (unsigned int i = 0; i < facesPath.size(); i++)
     {
         unsigned char *data = stbi_load(facesPath[i].c_str(), &width, &height, &nrChannels, 0);
         if (data)
         {
             glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+            // SH ambient, see getSHIrradiance
+            weightSum += addSHFace(SHIrradiance, i, data, width, height, nrChannels);
             stbi_image_free(data);
         }
         else
@@ -50,6 +168,7 @@ void CubeMap::load(const vector<string>& facesPath)
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
     cubeMap->set(cubeMapID, TextureType::TEXTURE_CUBE_MAP);
+    normalizeSH(SHIrradiance, weightSum);
 }
 
 void CubeMap::loadHdr(const string &path, int cubeSideLength)
@@ -71,6 +190,10 @@ void CubeMap::loadHdr(const string &path, int cubeSideLength)
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        // SH ambient, see getSHIrradiance
+        SHIrradiance.assign(9, glm::vec3(0.0f));
+        normalizeSH(SHIrradiance, addSHEquirect(SHIrradiance, data, width, height, nrChannels));
     }
     else
     {
@@ -81,12 +204,12 @@ void CubeMap::loadHdr(const string &path, int cubeSideLength)
     stbi_image_free(data);
 
     // setup framebuffer
-    unsigned int captureFBO;
+    unsigned int conversionFBO;
     //unsigned int captureRBO;
-    glGenFramebuffers(1, &captureFBO);
+    glGenFramebuffers(1, &conversionFBO);
     //glGenRenderbuffers(1, &captureRBO);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, conversionFBO);
     //glBindRenderbuffer(GL_RENDERBUFFER, captureRBO);
     glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, cubeSideLength, cubeSideLength);
     //glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, captureRBO);
@@ -113,7 +236,7 @@ void CubeMap::loadHdr(const string &path, int cubeSideLength)
     equirectangularToCubemapShader->setTexture("equirectangularMap", 0, hdrTexture);
 
     glViewport(0, 0, cubeSideLength, cubeSideLength);
-    glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, conversionFBO);
     glDisable(GL_CULL_FACE);
     for (unsigned int i = 0; i < 6; ++i)
     {
@@ -125,7 +248,7 @@ void CubeMap::loadHdr(const string &path, int cubeSideLength)
     }
     glEnable(GL_CULL_FACE);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
+    glDeleteFramebuffers(1, &conversionFBO);
 }
 
 void CubeMap::drawAsSkybox(const glm::mat4 & view, const glm::mat4 & projection)
@@ -144,58 +267,107 @@ void CubeMap::drawAsSkybox(const glm::mat4 & view, const glm::mat4 & projection)
     glEnable(GL_CULL_FACE);
 }
 
-// generate irradianceMap, prefilterMap, brdfLUTTexture for IBL
+// generate irradianceMap, prefilterMap, brdfLUTTexture for IBL at once
 void CubeMap::preComputeMaps()
 {
-    generateIrradianceMap();
-    generatePrefilterMap();
-    generateBrdfLUTTexture();
+    beginPreCompute();
+    while (!isPreComputed())
+        preComputeStep(1e9f);
 }
 
-// generate irradiance map from the environment map
-void CubeMap::generateIrradianceMap()
+void CubeMap::beginPreCompute(shared_ptr<Texture> brdfLUT)
 {
-    unsigned int irradianceMapID;
-    glGenTextures(1, &irradianceMapID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, irradianceMapID);
-    for (unsigned int i = 0; i < 6; ++i)
-        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 32, 32, 0, GL_RGB, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    irradianceMap->set(irradianceMapID, TextureType::TEXTURE_CUBE_MAP);
+    if (preComputeStarted)
+        return;
+    preComputeStarted = true;
+    allocateMaps(brdfLUT);
 
-    unsigned int captureFBO;
     glGenFramebuffers(1, &captureFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 32, 32);
-
-    shared_ptr<Shader> convolutionShader = make_shared<Shader>("Shaders/cube_map.vert", "Shaders/irradiance_convolution.frag");
+    glGenQueries(2, timeQueries);
+    convolutionShader = make_shared<Shader>("Shaders/cube_map.vert", "Shaders/irradiance_convolution.frag");
     convolutionShader->use();
     convolutionShader->setAttrMat4("projection", captureProjection);
     convolutionShader->setTexture("environmentMap", 0, cubeMap);
+    prefilterShader = make_shared<Shader>("Shaders/cube_map.vert", "Shaders/prefilter.frag");
+    prefilterShader->use();
+    prefilterShader->setAttrMat4("projection", captureProjection);
+    prefilterShader->setTexture("environmentMap", 0, cubeMap);
+
+    // irradiance first, the diffuse light shows the most
+    for (int face = 0; face < 6; ++face)
+        queueTiles(0, face, 0, 32, irradianceSamples);
+    for (int mip = prefilterMipNum - 1; mip >= 0; --mip)
+        for (int face = 0; face < 6; ++face)
+            queueTiles(1, face, mip, 128 >> mip, prefilterSamples);
+    if (!brdfLUT)
+    {
+        brdfLUTShader = make_shared<Shader>("Shaders/brdfLUT.vert", "Shaders/brdfLUT.frag");
+        queueTiles(2, 0, 0, 512, brdfLUTSamples);
+    }
+}
 
-    glViewport(0, 0, 32, 32);
+// the tiles that fit in the budget at the measured time of a sample
+void CubeMap::preComputeStep(float budget)
+{
+    if (!preComputeStarted || isPreComputed())
+        return;
+
+    // the query of this slot is two steps old
+    int slot = stepNum % 2;
+    if (sliceCost[slot] > 0.0f)
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(timeQueries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 time;
+            glGetQueryObjectui64v(timeQueries[slot], GL_QUERY_RESULT, &time);
+            msPerSample = 0.5f * (msPerSample + time / 1000000.0f / sliceCost[slot]);
+        }
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, timeQueries[slot]);
     glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
     glDisable(GL_CULL_FACE);
-    for (unsigned int i = 0; i < 6; ++i)
+    glEnable(GL_SCISSOR_TEST);
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    float cost = 0.0f;
+    while (nextTask < tasks.size())
     {
-        convolutionShader->setAttrMat4("view", captureViews[i]);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, irradianceMapID, 0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        box.draw(convolutionShader);
+        const PreComputeTask &task = tasks[nextTask];
+        if (cost > 0.0f && (cost + task.cost) * msPerSample > budget)
+            break;
+        runTask(task);
+        cost += task.cost;
+        ++nextTask;
     }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDisable(GL_SCISSOR_TEST);
     glEnable(GL_CULL_FACE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glEndQuery(GL_TIME_ELAPSED);
+    sliceCost[slot] = cost;
+    doneCost += cost;
+    ++stepNum;
 
+    if (isPreComputed())
+        endPreCompute();
 }
 
-// generate prefilter map for specular IBL
-void CubeMap::generatePrefilterMap()
+void CubeMap::allocateMaps(shared_ptr<Texture> brdfLUT)
 {
+    unsigned int irradianceMapID;
+    glGenTextures(1, &irradianceMapID);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, irradianceMapID);
+    for (unsigned int i = 0; i < 6; ++i)
+        glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB16F, 32, 32, 0, GL_RGB, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    irradianceMap->set(irradianceMapID, TextureType::TEXTURE_CUBE_MAP);
+
+    // prefilter map for specular IBL
     unsigned int prefilterMapID;
     glGenTextures(1, &prefilterMapID);
     glBindTexture(GL_TEXTURE_CUBE_MAP, prefilterMapID);
@@ -210,48 +382,13 @@ void CubeMap::generatePrefilterMap()
     glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
     prefilterMap->set(prefilterMapID, TextureType::TEXTURE_CUBE_MAP);
 
-    unsigned int captureFBO;
-    glGenFramebuffers(1, &captureFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-    //glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 32, 32);
-
-    shared_ptr<Shader> prefilterShader = make_shared<Shader>("Shaders/cube_map.vert", "Shaders/prefilter.frag");
-    prefilterShader->use();
-    prefilterShader->setAttrMat4("projection", captureProjection);
-    prefilterShader->setTexture("environmentMap", 0, cubeMap);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-    unsigned int maxMipLevels = 5;
-    glDisable(GL_CULL_FACE); 
-    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
-    for (unsigned int mip = 0; mip < maxMipLevels; ++mip)
+    if (brdfLUT)
     {
-        unsigned int mipWidth = 128 * pow(0.5, mip);
-        unsigned int mipHeight = 128 * pow(0.5, mip);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, mipWidth, mipHeight);
-        glViewport(0, 0, mipWidth, mipHeight);
-
-        float roughness = (float)mip / (float)(maxMipLevels - 1);
-        prefilterShader->setAttrF("roughness", roughness);
-
-        for (unsigned int i = 0; i < 6; ++i)
-        {
-            prefilterShader->setAttrMat4("view", captureViews[i]);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, prefilterMapID, mip);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-            box.draw(prefilterShader);
-        }
+        brdfLUTTexture = brdfLUT;
+        return;
     }
-    glEnable(GL_CULL_FACE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-}
-
-void CubeMap::generateBrdfLUTTexture()
-{
     unsigned int brdfLUTTextureID;
     glGenTextures(1, &brdfLUTTextureID);
-
     glBindTexture(GL_TEXTURE_2D, brdfLUTTextureID);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, 512, 512, 0, GL_RG, GL_FLOAT, 0);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -259,24 +396,52 @@ void CubeMap::generateBrdfLUTTexture()
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     brdfLUTTexture->set(brdfLUTTextureID, TextureType::TEXTURE_2D);
+}
 
-    unsigned int captureFBO;
-    glGenFramebuffers(1, &captureFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, captureFBO);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 512, 512);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, brdfLUTTextureID, 0);
-
-    shared_ptr<Shader> brdfLUTShader = make_shared<Shader>("Shaders/brdfLUT.vert", "Shaders/brdfLUT.frag");
-    brdfLUTShader->use();
-    Rectangle rect;
-    rect.bind();
+// row tiles of one face mip, each about tileSamples samples
+void CubeMap::queueTiles(int pass, int face, int mip, int size, float samples)
+{
+    int rows = std::max(1, std::min(size, (int)(tileSamples / (size * samples))));
+    for (int y = 0; y < size; y += rows)
+    {
+        int y1 = std::min(y + rows, size);
+        tasks.push_back({ pass, face, mip, y, y1, size * (y1 - y) * samples });
+        totalCost += tasks.back().cost;
+    }
+}
 
-    glViewport(0, 0, 512, 512);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+void CubeMap::runTask(const PreComputeTask &task)
+{
+    if (task.pass == 2)
+    {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, brdfLUTTexture->getID(), 0);
+        glViewport(0, 0, 512, 512);
+        glScissor(0, task.y0, 512, task.y1 - task.y0);
+        rect.draw(brdfLUTShader);
+        return;
+    }
 
-    rect.draw(brdfLUTShader);
+    shared_ptr<Shader> shader = task.pass == 0 ? convolutionShader : prefilterShader;
+    shared_ptr<Texture> target = task.pass == 0 ? irradianceMap : prefilterMap;
+    int size = (task.pass == 0 ? 32 : 128) >> task.mip;
+    if (task.pass == 1)
+        shader->setAttrF("roughness", (float)task.mip / (float)(prefilterMipNum - 1));
+    shader->setAttrMat4("view", captureViews[task.face]);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + task.face, target->getID(), task.mip);
+    glViewport(0, 0, size, size);
+    glScissor(0, task.y0, size, task.y1 - task.y0);
+    box.draw(shader);
+}
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+// the capture objects are only needed while tiles are queued
+void CubeMap::endPreCompute()
+{
+    glDeleteFramebuffers(1, &captureFBO);
+    glDeleteQueries(2, timeQueries);
+    captureFBO = 0;
+    convolutionShader = nullptr;
+    prefilterShader = nullptr;
+    brdfLUTShader = nullptr;
 }
 
 void CubeMap::init()
@@ -284,6 +449,17 @@ void CubeMap::init()
     gammaCorrection = false;
     skyboxShader = make_shared<Shader>("Shaders/skybox.vert", "Shaders/skybox.frag");
     box.bind();
+    rect.bind();
+
+    preComputeStarted = false;
+    nextTask = 0;
+    totalCost = 0.0f;
+    doneCost = 0.0f;
+    msPerSample = 1.0f / 16777216.0f; // a first guess, measured from the first slices on
+    captureFBO = 0;
+    sliceCost[0] = sliceCost[1] = 0.0f;
+    stepNum = 0;
+    SHIrradiance.assign(9, glm::vec3(0.0f));
 
     // set up projection and view matrices for capturing data onto the 6 cubemap face directions
     captureProjection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 10.0f);
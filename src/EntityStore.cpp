@@ -0,0 +1,72 @@
+#include "../include/EntityStore.h"
+
+Entity EntityStore::create(const string &name)
+{
+	if (!name.empty() && nameIndex.find(name) != nameIndex.end())
+		return Entity();
+
+	unsigned int index;
+	if (!freeIndices.empty())
+	{
+		index = freeIndices.back();
+		freeIndices.pop_back();
+	}
+	else
+	{
+		index = generations.size();
+		generations.push_back(0);
+	}
+
+	Entity e(index, generations[index]);
+	if (!name.empty())
+	{
+		nameIndex[name] = e;
+		entityNames[index] = name;
+	}
+	return e;
+}
+
+void EntityStore::destroy(Entity e)
+{
+	if (!isAlive(e))
+		return;
+
+	transforms.remove(e);
+	meshes.remove(e);
+	bounds.remove(e);
+	lights.remove(e);
+	shaders.remove(e);
+
+	auto iter = entityNames.find(e.index);
+	if (iter != entityNames.end())
+	{
+		nameIndex.erase(iter->second);
+		entityNames.erase(iter);
+	}
+
+	generations[e.index]++;
+	freeIndices.push_back(e.index);
+}
+
+bool EntityStore::isAlive(Entity e) const
+{
+	return e.valid() && e.index < generations.size() && generations[e.index] == e.generation;
+}
+
+Entity EntityStore::find(const string &name) const
+{
+	auto iter = nameIndex.find(name);
+	if (iter == nameIndex.end())
+		return Entity();
+	return iter->second;
+}
+
+string EntityStore::getName(Entity e) const
+{
+	if (!isAlive(e))
+		return "";
+	auto iter = entityNames.find(e.index);
+	if (iter == entityNames.end())
+		return "";
+	return iter->second;
+}
@@ -0,0 +1,84 @@
+#include "../include/Frustum.h"
+
+void BoundingBox::expand(const vec3 &p)
+{
+	if (!valid)
+	{
+		minPos = p;
+		maxPos = p;
+		valid = true;
+		return;
+	}
+	minPos = min(minPos, p);
+	maxPos = max(maxPos, p);
+}
+
+// transform center and extent instead of the 8 corners
+BoundingBox BoundingBox::transform(const mat4 &m) const
+{
+	if (!valid)
+		return BoundingBox();
+
+	vec3 c = vec3(m * vec4(center(), 1.0f));
+	vec3 e = extent();
+	vec3 newExtent;
+	for (int i = 0; i < 3; ++i)
+		newExtent[i] = abs(m[0][i]) * e.x + abs(m[1][i]) * e.y + abs(m[2][i]) * e.z;
+
+	return BoundingBox(c - newExtent, c + newExtent);
+}
+
+Frustum::Frustum()
+{
+	for (int i = 0; i < 6; ++i)
+		planes[i] = vec4(0.0f);
+}
+
+Frustum::Frustum(const mat4 &viewProjection)
+{
+	set(viewProjection);
+}
+
+// Gribb-Hartmann plane extraction
+void Frustum::set(const mat4 &m)
+{
+	vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	planes[0] = row3 + row0; // left
+	planes[1] = row3 - row0; // right
+	planes[2] = row3 + row1; // bottom
+	planes[3] = row3 - row1; // top
+	planes[4] = row3 + row2; // near
+	planes[5] = row3 - row2; // far
+
+	for (int i = 0; i < 6; ++i)
+		planes[i] = planes[i] / length(vec3(planes[i]));
+}
+
+bool Frustum::intersects(const BoundingBox &box) const
+{
+	if (!box.valid)
+		return true;
+
+	for (int i = 0; i < 6; ++i)
+	{
+		// the box corner furthest along the plane normal
+		vec3 p(planes[i].x > 0 ? box.maxPos.x : box.minPos.x,
+			planes[i].y > 0 ? box.maxPos.y : box.minPos.y,
+			planes[i].z > 0 ? box.maxPos.z : box.minPos.z);
+		if (dot(vec3(planes[i]), p) + planes[i].w < 0)
+			return false;
+	}
+	return true;
+}
+
+bool Frustum::intersects(const vec3 &center, float radius) const
+{
+	for (int i = 0; i < 6; ++i)
+		if (dot(vec3(planes[i]), center) + planes[i].w < -radius)
+			return false;
+	return true;
+}
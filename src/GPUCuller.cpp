@@ -0,0 +1,419 @@
+#include "../include/GPUCuller.h"
+#include "../include/Frustum.h"
+#include <iostream>
+#include <cmath>
+#include <map>
+
+// cull modes, must match shaders/gpu_cull.comp
+const int CULL_FRUSTUM = 0;
+const int CULL_FRUSTUM_HIZ = 1;
+const int CULL_SPHERE = 2;
+
+GPUCuller::GPUCuller() :
+    drawNum(0),
+    visibleNum(0),
+    boundsBuffer(0),
+    drawInfoBuffer(0),
+    commandBuffer(0),
+    drawCommandBuffer(0),
+    groupCountBuffer(0),
+    readbackBuffer(0),
+    objectBuffer(0),
+    mergedVAO(0),
+    mergedVBO(0),
+    mergedEBO(0),
+    mergedDepthVAO(0),
+    mergedDepthVBO(0),
+    mergedDepthEBO(0),
+    objectIndexVBO(0),
+    hiZFBO(0),
+    hiZDepth(nullptr),
+    hiZ(nullptr),
+    hiZWidth(0),
+    hiZHeight(0),
+    hiZLevels(0),
+    hiZRenderWidth(0),
+    hiZRenderHeight(0),
+    hiZViewProjection(mat4(1.0f)),
+    hiZValid(false)
+{
+}
+
+GPUCuller::~GPUCuller()
+{
+    GLuint buffers[12] = { boundsBuffer, drawInfoBuffer, commandBuffer, drawCommandBuffer, groupCountBuffer, readbackBuffer,
+        objectBuffer, mergedVBO, mergedEBO, mergedDepthVBO, mergedDepthEBO, objectIndexVBO };
+    glDeleteBuffers(12, buffers);
+    GLuint vertexArrays[2] = { mergedVAO, mergedDepthVAO };
+    glDeleteVertexArrays(2, vertexArrays);
+    if (hiZFBO != 0)
+        glDeleteFramebuffers(1, &hiZFBO);
+}
+
+void GPUCuller::init()
+{
+    cullShader = make_shared<Shader>("./shaders/gpu_cull.comp");
+    hiZShader = make_shared<Shader>("./shaders/hiz_build.comp");
+
+    glGenBuffers(1, &boundsBuffer);
+    glGenBuffers(1, &drawInfoBuffer);
+    glGenBuffers(1, &commandBuffer);
+    glGenBuffers(1, &drawCommandBuffer);
+    glGenBuffers(1, &groupCountBuffer);
+    glGenBuffers(1, &readbackBuffer);
+    glGenBuffers(1, &objectBuffer);
+    glGenVertexArrays(1, &mergedVAO);
+    glGenBuffers(1, &mergedVBO);
+    glGenBuffers(1, &mergedEBO);
+    glGenVertexArrays(1, &mergedDepthVAO);
+    glGenBuffers(1, &mergedDepthVBO);
+    glGenBuffers(1, &mergedDepthEBO);
+    glGenBuffers(1, &objectIndexVBO);
+}
+
+void GPUCuller::setObjects(const vector<shared_ptr<Object>> &objects_)
+{
+    objects = objects_;
+
+    // draw info: object index, index count, first merged index, group, first command of the group
+    vector<GLuint> drawInfos;
+    mergeGeometry(drawInfos);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawInfoBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, drawInfos.size() * sizeof(GLuint), drawInfos.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, boundsBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, objects.size() * 2 * sizeof(vec4), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, objects.size() * 2 * sizeof(mat4), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, groupCountBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, groups.size() * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    vector<GLuint> zeros(groups.size(), 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, groups.size() * sizeof(GLuint), zeros.data(), GL_DYNAMIC_READ);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    // commands default to drawing everything
+    vector<GLuint> commands;
+    for (int i = 0; i < drawNum; ++i)
+    {
+        commands.push_back(drawInfos[5 * i + 1]); // count
+        commands.push_back(1); // instance count
+        commands.push_back(0); // first index
+        commands.push_back(0); // base vertex
+        commands.push_back(0); // base instance
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(GLuint), commands.data(), GL_DYNAMIC_COPY);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+// All objects in one vertex and index buffer, once interleaved and once as positions. Sub meshes
+// are grouped by material, every group takes a contiguous range of the compacted commands.
+void GPUCuller::mergeGeometry(vector<GLuint> &drawInfos)
+{
+    vector<float> vertexData;
+    vector<vec3> positions;
+    vector<GLuint> indices;
+    vector<GLuint> depthIndices;
+    vector<int> drawGroups;
+    map<Material *, int> groupIndices;
+    firstCommands.clear();
+    groups.clear();
+    drawNum = 0;
+    for (size_t i = 0; i < objects.size(); ++i)
+    {
+        const vector<vec3> &vertices = objects[i]->getVertices();
+        GLuint vertexBase = positions.size();
+        vector<float> interleaved = objects[i]->getInterleavedData();
+        vertexData.insert(vertexData.end(), interleaved.begin(), interleaved.end());
+        positions.insert(positions.end(), vertices.begin(), vertices.end());
+
+        firstCommands.push_back(drawNum);
+        for (int j = 0; j < objects[i]->getSubMeshNum(); ++j)
+        {
+            shared_ptr<Material> material = objects[i]->getMaterial(j);
+            auto group = groupIndices.emplace(material.get(), groups.size());
+            if (group.second)
+                groups.push_back({ material, 0, 0 });
+            groups[group.first->second].commandNum++;
+            drawGroups.push_back(group.first->second);
+
+            drawInfos.push_back(i);
+            drawInfos.push_back(objects[i]->getIndexNum(j));
+            drawInfos.push_back(indices.size());
+            drawInfos.push_back(group.first->second);
+            drawInfos.push_back(0);
+            for (GLuint index : objects[i]->getIndices(j))
+            {
+                indices.push_back(vertexBase + index);
+                depthIndices.push_back(vertexBase + index);
+            }
+            drawNum++;
+        }
+    }
+    int firstCommand = 0;
+    for (auto &group : groups)
+    {
+        group.firstCommand = firstCommand;
+        firstCommand += group.commandNum;
+    }
+    for (int i = 0; i < drawNum; ++i)
+        drawInfos[5 * i + 4] = groups[drawGroups[i]].firstCommand;
+
+    // read at the base instance of each command, the object index
+    vector<GLuint> objectIndices(objects.size());
+    for (size_t i = 0; i < objects.size(); ++i)
+        objectIndices[i] = i;
+    glBindBuffer(GL_ARRAY_BUFFER, objectIndexVBO);
+    glBufferData(GL_ARRAY_BUFFER, objectIndices.size() * sizeof(GLuint), objectIndices.data(), GL_STATIC_DRAW);
+
+    glBindVertexArray(mergedVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, mergedVBO);
+    glBufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(float), vertexData.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mergedEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    int stride = 14 * sizeof(float);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void *)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void *)(6 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (void *)(8 * sizeof(float)));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, stride, (void *)(11 * sizeof(float)));
+    glEnableVertexAttribArray(4);
+    bindObjectIndices();
+
+    glBindVertexArray(mergedDepthVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, mergedDepthVBO);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(vec3), positions.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mergedDepthEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, depthIndices.size() * sizeof(GLuint), depthIndices.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void *)0);
+    glEnableVertexAttribArray(0);
+    bindObjectIndices();
+    glBindVertexArray(0);
+}
+
+// one index per instance into the bound VAO, a command's base instance selects its object
+void GPUCuller::bindObjectIndices()
+{
+    glBindBuffer(GL_ARRAY_BUFFER, objectIndexVBO);
+    glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, sizeof(GLuint), (void *)0);
+    glVertexAttribDivisor(5, 1);
+    glEnableVertexAttribArray(5);
+}
+
+// bounds for the culling pass and matrices for the multi draws
+void GPUCuller::updateBounds()
+{
+    if (objects.empty())
+        return;
+
+    vector<vec4> bounds;
+    vector<mat4> matrices;
+    bounds.reserve(objects.size() * 2);
+    matrices.reserve(objects.size() * 2);
+    for (auto &object : objects)
+    {
+        BoundingBox box = object->getBoundingBox();
+        // invalid bounds always pass, min > max marks them
+        bounds.push_back(vec4(box.minPos, box.valid ? 1.0f : 0.0f));
+        bounds.push_back(vec4(box.maxPos, 1.0f));
+        matrices.push_back(TransformSystem::getWorldMatrix(object->getTransform()));
+        matrices.push_back(TransformSystem::getNormalMatrix(object->getTransform()));
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, boundsBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bounds.size() * sizeof(vec4), bounds.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, matrices.size() * sizeof(mat4), matrices.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GPUCuller::cull(const mat4 &viewProjection, bool occlusion)
+{
+    int mode = (occlusion && hiZValid) ? CULL_FRUSTUM_HIZ : CULL_FRUSTUM;
+    dispatch(viewProjection, vec4(0.0f), mode);
+
+    // the main view result is read back in the next frame to avoid a stall
+    if (occlusion && !groups.empty())
+    {
+        vector<GLuint> counts(groups.size());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, readbackBuffer);
+        glGetBufferSubData(GL_COPY_WRITE_BUFFER, 0, counts.size() * sizeof(GLuint), counts.data());
+        visibleNum = 0;
+        for (GLuint count : counts)
+            visibleNum += count;
+        glBindBuffer(GL_COPY_READ_BUFFER, groupCountBuffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, counts.size() * sizeof(GLuint));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+}
+
+void GPUCuller::cullSphere(const vec3 &center, float radius)
+{
+    dispatch(mat4(1.0f), vec4(center, radius), CULL_SPHERE);
+}
+
+void GPUCuller::dispatch(const mat4 &viewProjection, const vec4 &sphere, int mode)
+{
+    if (drawNum == 0)
+        return;
+
+    // unused commands of a group range stay zero
+    GLuint zero = 0;
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandBuffer);
+    glClearBufferData(GL_DRAW_INDIRECT_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, groupCountBuffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    Frustum frustum(viewProjection);
+    for (int i = 0; i < 6; ++i)
+        cullShader->setAttrVec4("planes[" + to_string(i) + "]", frustum.getPlane(i));
+    cullShader->setAttrVec4("sphere", sphere);
+    cullShader->setAttrI("mode", mode);
+    cullShader->setAttrI("drawNum", drawNum);
+    if (mode == CULL_FRUSTUM_HIZ)
+    {
+        cullShader->setAttrMat4("hiZViewProjection", hiZViewProjection);
+        cullShader->setAttrI("hiZLevels", hiZLevels);
+        cullShader->setAttrVec2("hiZSize", vec2(hiZRenderWidth, hiZRenderHeight));
+        cullShader->setTexture("hiZ", 0, hiZ);
+    }
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, boundsBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, drawInfoBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, commandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, drawCommandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 10, groupCountBuffer);
+
+    cullShader->dispatch((drawNum + 63) / 64);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+// the group materials are set in turn, the object matrices come from the object buffer
+void GPUCuller::draw(shared_ptr<Shader> shader, bool positionStream, bool materials)
+{
+    if (groups.empty())
+        return;
+
+    bool drawCount = GLAD_GL_VERSION_4_6;
+    shader->use();
+    shader->setAttrB("indirectDraw", true);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 9, objectBuffer);
+    glBindVertexArray(positionStream ? mergedDepthVAO : mergedVAO);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandBuffer);
+    if (drawCount)
+        glBindBuffer(GL_PARAMETER_BUFFER, groupCountBuffer);
+    for (size_t i = 0; i < groups.size(); ++i)
+    {
+        if (materials && groups[i].material)
+            shader->setMeterial(groups[i].material);
+        shader->setAttributes();
+        if (materials)
+            shader->applyTextures();
+
+        const void *offset = (void *)(groups[i].firstCommand * 5 * sizeof(GLuint));
+        if (drawCount)
+            glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, offset, i * sizeof(GLuint), groups[i].commandNum, 0);
+        else
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, offset, groups[i].commandNum, 0);
+    }
+    if (drawCount)
+        glBindBuffer(GL_PARAMETER_BUFFER, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+    shader->setAttrB("indirectDraw", false);
+}
+
+void GPUCuller::bindCommands()
+{
+    for (size_t i = 0; i < objects.size(); ++i)
+        objects[i]->setIndirectBuffer(commandBuffer, firstCommands[i]);
+}
+
+void GPUCuller::unbindCommands()
+{
+    for (auto &object : objects)
+        object->setIndirectBuffer(0);
+}
+
+void GPUCuller::createHiZ(int width, int height)
+{
+    hiZWidth = width;
+    hiZHeight = height;
+    hiZLevels = 1 + (int)floor(log2((float)std::max(width, height)));
+
+    // depth copy of the scene framebuffer
+    GLuint depth;
+    glGenTextures(1, &depth);
+    glBindTexture(GL_TEXTURE_2D, depth);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    hiZDepth = make_shared<Texture>(depth, TextureType::TEXTURE_2D);
+
+    if (hiZFBO == 0)
+        glGenFramebuffers(1, &hiZFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, hiZFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "Hi-Z framebuffer not complete!" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // max depth pyramid
+    GLuint pyramid;
+    glGenTextures(1, &pyramid);
+    glBindTexture(GL_TEXTURE_2D, pyramid);
+    glTexStorage2D(GL_TEXTURE_2D, hiZLevels, GL_R32F, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    hiZ = make_shared<Texture>(pyramid, TextureType::TEXTURE_2D);
+}
+
+// build the max depth pyramid from the scene depth, every level covers the rendered part only,
+// the next frame tests bounds against it with this frame's view projection
+void GPUCuller::buildHiZ(GLuint framebuffer, int width, int height, int targetWidth, int targetHeight, const mat4 &viewProjection)
+{
+    if (!hiZ || targetWidth != hiZWidth || targetHeight != hiZHeight)
+        createHiZ(targetWidth, targetHeight);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, hiZFBO);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    hiZShader->setTexture("depthTexture", 0, hiZDepth);
+    int srcWidth = width, srcHeight = height;
+    for (int level = 0; level < hiZLevels; ++level)
+    {
+        int dstWidth = level == 0 ? width : std::max(1, srcWidth / 2);
+        int dstHeight = level == 0 ? height : std::max(1, srcHeight / 2);
+        glBindImageTexture(0, hiZ->getID(), std::max(level - 1, 0), GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+        glBindImageTexture(1, hiZ->getID(), level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        hiZShader->setAttrI("level", level);
+        hiZShader->setAttrVec2("srcSize", vec2(srcWidth, srcHeight));
+        hiZShader->setAttrVec2("dstSize", vec2(dstWidth, dstHeight));
+        hiZShader->dispatch((dstWidth + 7) / 8, (dstHeight + 7) / 8);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+        srcWidth = dstWidth;
+        srcHeight = dstHeight;
+    }
+
+    hiZRenderWidth = width;
+    hiZRenderHeight = height;
+    hiZViewProjection = viewProjection;
+    hiZValid = true;
+}
@@ -12,15 +12,15 @@ Gui::~Gui()
 
 void Gui::add(string name, shared_ptr<Object> obj)
 {
-    auto iter = objects.find(name);
+    Entity e = items.create(name);
     // object name already exists
-    if (iter != objects.end())
+    if (!e.valid())
     {
         cout << "Add Object GUI Failed! Object name \"" << name << "\" already exists!" << endl;
         return;
     }
 
-    objects[name] = obj;
+    items.meshes.insert(e, obj);
     names.push_back(name);
     cNames = new char*[names.size()];
     for (int i = 0; i < names.size(); ++i)
@@ -34,15 +34,15 @@ void Gui::add(string name, shared_ptr<Object> obj)
 
 void Gui::add(string name, shared_ptr<Light> light)
 {
-    auto iter = lights.find(name);
+    Entity e = items.create(name);
     // object name already exists
-    if (iter != lights.end())
+    if (!e.valid())
     {
         cout << "Add Light GUI Failed! Light name \"" << name << "\" already exists!" << endl;
         return;
     }
 
-    lights[name] = light;
+    items.lights.insert(e, light);
     names.push_back(name);
     cNames = new char*[names.size()];
     for (int i = 0; i < names.size(); ++i)
@@ -56,15 +56,15 @@ void Gui::add(string name, shared_ptr<Light> light)
 
 void Gui::add(string name, shared_ptr<Material> mtl)
 {
-    auto iter = lights.find(name);
+    Entity e = items.create(name);
     // object name already exists
-    if (iter != lights.end())
+    if (!e.valid())
     {
-        cout << "Add Light GUI Failed! Material name \"" << name << "\" already exists!" << endl;
+        cout << "Add Material GUI Failed! Material name \"" << name << "\" already exists!" << endl;
         return;
     }
 
-    materials[name] = mtl;
+    materials.insert(e, mtl);
     names.push_back(name);
     cNames = new char *[names.size()];
     for (int i = 0; i < names.size(); ++i)
@@ -108,21 +108,13 @@ void Gui::show()
     static int item = 0;
     ImGui::Combo("Object", &item, cNames, names.size(), names.size());
 
-    auto iter = objects.find(names[item]);
-    if (iter != objects.end())
+    Entity e = items.find(names[item]);
+    if (items.meshes.has(e))
         objectGui(names[item]);
-    else
-    {
-        auto iter2 = lights.find(names[item]);
-        if (iter2 != lights.end())
-            lightGui(names[item]);
-        else
-        {
-            auto iter3 = materials.find(names[item]);
-            if (iter3 != materials.end())
-                mtlGUI(names[item]);
-        }
-    }
+    else if (items.lights.has(e))
+        lightGui(names[item]);
+    else if (materials.has(e))
+        mtlGUI(names[item]);
 
     // show FPS on the bottom
     ImGui::SetCursorPosY(ImGui::GetWindowHeight() - 20);
@@ -136,10 +128,10 @@ void Gui::show()
 
 void Gui::objectGui(string objectName)
 {
-    shared_ptr<Object> obj = objects[objectName];
+    shared_ptr<Object> obj = *items.meshes.get(items.find(objectName));
     vec3 pos = obj->getPosition();
     vec3 scale = obj->getScale();
-    vector<float> rotation = obj->getRotation();
+    vec3 rotation = obj->getRotation();
 
     ImGui::Text("Position:");
     ImGui::PushItemWidth(70);
@@ -157,9 +149,9 @@ void Gui::objectGui(string objectName)
 
     ImGui::Text("Rotation:");
     ImGui::PushItemWidth(70);
-    ImGui::DragFloat("X ##rotation", &rotation[0], 1, 0, 0, "%.2f", 1); ImGui::SameLine();
-    ImGui::DragFloat("Y ##rotation", &rotation[1], 1, 0, 0, "%.2f", 1); ImGui::SameLine();
-    ImGui::DragFloat("Z ##rotation", &rotation[2], 1, 0, 0, "%.2f", 1);
+    ImGui::DragFloat("X ##rotation", &rotation.x, 1, 0, 0, "%.2f", 1); ImGui::SameLine();
+    ImGui::DragFloat("Y ##rotation", &rotation.y, 1, 0, 0, "%.2f", 1); ImGui::SameLine();
+    ImGui::DragFloat("Z ##rotation", &rotation.z, 1, 0, 0, "%.2f", 1);
     ImGui::PopItemWidth();
 
     obj->setTransform(pos, scale, rotation);
@@ -167,7 +159,7 @@ void Gui::objectGui(string objectName)
 
 void Gui::lightGui(string lightName)
 {
-    shared_ptr<Light> light = lights[lightName];
+    shared_ptr<Light> light = *items.lights.get(items.find(lightName));
     vec3 color = light->getColor();
     float c[3] = { color.r, color.g, color.b };
     ImGui::Text("Color:");
@@ -201,16 +193,18 @@ void Gui::lightGui(string lightName)
 
         ImGui::Text("Attenuation Coefficient:");
         ImGui::PushItemWidth(70);
-        ImGui::DragFloat("constant", &pointL->constant, 0.01, 0, 0, "%.2f", 1); ImGui::SameLine();
-        ImGui::DragFloat("linear", &pointL->linear, 0.001, 0, 0, "%.3f", 1); ImGui::SameLine();
-        ImGui::DragFloat("quadratic", &pointL->quadratic, 0.001, 0, 0, "%.3f", 1);
+        float constant = pointL->getConstant(), linear = pointL->getLinear(), quadratic = pointL->getQuadratic();
+        ImGui::DragFloat("constant", &constant, 0.01, 0, 0, "%.2f", 1); ImGui::SameLine();
+        ImGui::DragFloat("linear", &linear, 0.001, 0, 0, "%.3f", 1); ImGui::SameLine();
+        ImGui::DragFloat("quadratic", &quadratic, 0.001, 0, 0, "%.3f", 1);
         ImGui::PopItemWidth();
+        pointL->setAttenuation(constant, linear, quadratic);
     }
 }
 
 void Gui::mtlGUI(string mtlName)
 {
-    shared_ptr<Material> mtl = materials[mtlName];
+    shared_ptr<Material> mtl = *materials.get(items.find(mtlName));
     // PBR material
     if (mtl->usePBR)
     {
@@ -0,0 +1,214 @@
+#include "../include/JobSystem.h"
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+
+vector<unique_ptr<JobSystem::WorkQueue>> JobSystem::queues;
+vector<thread> JobSystem::workers;
+atomic<bool> JobSystem::running(false);
+mutex JobSystem::sleepMutex;
+condition_variable JobSystem::wakeUp;
+mutex JobSystem::mainThreadMutex;
+vector<function<void()>> JobSystem::mainThreadJobs;
+thread::id JobSystem::mainThreadID;
+thread_local int JobSystem::threadIndex = 0;
+
+// should be called from the main thread, other functions call it lazily
+void JobSystem::init(int workerNum)
+{
+    if (running)
+        shutdown();
+
+    if (workerNum < 0)
+        workerNum = std::max((int)thread::hardware_concurrency() - 1, 0);
+
+    static bool registered = false;
+    if (!registered)
+    {
+        atexit(JobSystem::shutdown);
+        registered = true;
+    }
+
+    mainThreadID = this_thread::get_id();
+    threadIndex = 0;
+    queues.clear();
+    for (int i = 0; i <= workerNum; ++i)
+        queues.push_back(unique_ptr<WorkQueue>(new WorkQueue()));
+
+    running = true;
+    for (int i = 1; i <= workerNum; ++i)
+        workers.push_back(thread(&JobSystem::workerLoop, i));
+}
+
+void JobSystem::shutdown()
+{
+    if (!running)
+        return;
+    running = false;
+    wakeUp.notify_all();
+    for (auto &worker : workers)
+        worker.join();
+    workers.clear();
+    queues.clear();
+}
+
+int JobSystem::getThreadNum()
+{
+    if (!running)
+        init();
+    return queues.size();
+}
+
+bool JobSystem::isMainThread()
+{
+    return this_thread::get_id() == mainThreadID;
+}
+
+JobHandle JobSystem::create(function<void()> task, JobHandle parent)
+{
+    JobHandle job = make_shared<Job>();
+    job->task = task;
+    job->parent = parent;
+    job->unfinished = 1;
+    if (parent)
+        parent->unfinished++;
+    return job;
+}
+
+void JobSystem::run(JobHandle job)
+{
+    if (!running)
+        init();
+
+    WorkQueue &queue = *queues[threadIndex];
+    {
+        lock_guard<mutex> lock(queue.queueMutex);
+        queue.jobs.push_back(job);
+    }
+    wakeUp.notify_one();
+}
+
+void JobSystem::wait(JobHandle job)
+{
+    while (job->unfinished > 0)
+    {
+        if (isMainThread())
+            processMainThreadJobs();
+
+        JobHandle next = getJob();
+        if (next)
+            execute(next);
+        else
+            this_thread::yield();
+    }
+}
+
+void JobSystem::parallelFor(int count, function<void(int, int)> func, int grainSize)
+{
+    if (count <= 0)
+        return;
+    if (grainSize <= 0)
+        grainSize = std::max(count / (getThreadNum() * 4), 1);
+    // not worth splitting
+    if (count <= grainSize || getThreadNum() == 1)
+    {
+        func(0, count);
+        return;
+    }
+
+    JobHandle root = create([]() {});
+    for (int begin = 0; begin < count; begin += grainSize)
+    {
+        int end = std::min(begin + grainSize, count);
+        run(create([func, begin, end]() { func(begin, end); }, root));
+    }
+    run(root);
+    wait(root);
+}
+
+void JobSystem::runOnMainThread(function<void()> task)
+{
+    lock_guard<mutex> lock(mainThreadMutex);
+    mainThreadJobs.push_back(task);
+}
+
+void JobSystem::processMainThreadJobs()
+{
+    vector<function<void()>> tasks;
+    {
+        lock_guard<mutex> lock(mainThreadMutex);
+        tasks.swap(mainThreadJobs);
+    }
+    for (auto &task : tasks)
+        task();
+}
+
+void JobSystem::workerLoop(int index)
+{
+    threadIndex = index;
+    while (running)
+    {
+        JobHandle job = getJob();
+        if (job)
+            execute(job);
+        else
+        {
+            unique_lock<mutex> lock(sleepMutex);
+            wakeUp.wait_for(lock, chrono::milliseconds(1));
+        }
+    }
+}
+
+// pop from own queue, otherwise steal from the others
+JobHandle JobSystem::getJob()
+{
+    if (queues.empty())
+        return nullptr;
+
+    WorkQueue &own = *queues[threadIndex];
+    {
+        lock_guard<mutex> lock(own.queueMutex);
+        if (!own.jobs.empty())
+        {
+            JobHandle job = own.jobs.back();
+            own.jobs.pop_back();
+            return job;
+        }
+    }
+
+    // per thread xorshift, rand() is not thread safe everywhere
+    static thread_local unsigned int seed = 2463534242u + threadIndex;
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    int n = queues.size();
+    int start = seed % n;
+    for (int i = 0; i < n; ++i)
+    {
+        int victim = (start + i) % n;
+        if (victim == threadIndex)
+            continue;
+        WorkQueue &queue = *queues[victim];
+        lock_guard<mutex> lock(queue.queueMutex);
+        if (!queue.jobs.empty())
+        {
+            JobHandle job = queue.jobs.front();
+            queue.jobs.pop_front();
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+void JobSystem::execute(JobHandle job)
+{
+    if (job->task)
+        job->task();
+    finish(job.get());
+}
+
+void JobSystem::finish(Job *job)
+{
+    if (--job->unfinished == 0 && job->parent)
+        finish(job->parent.get());
+}
@@ -1,14 +1,22 @@
 #include "../include/Light.h"
+#include <algorithm>
+#include <cmath>
+
+unsigned int Light::versionCounter = 0;
 
 Light::Light()
 {
+	markChanged();
 	lightColor = vec3(1.0f, 1.0f, 1.0f);
 	updateLightStrength();
 }
 
 void Light::setColor(vec3 color)
 {
+	if (color == lightColor)
+		return;
 	lightColor = color;
+	markChanged();
 	updateLightStrength();
 }
 
@@ -43,14 +51,32 @@ PointLight::PointLight(vec3 pos, vec3 color) :
 
 void PointLight::setPosition(vec3 pos)
 {
+	if (pos == position)
+		return;
 	position = pos;
+	markChanged();
 }
 
 void PointLight::setAttenuation(float constant_, float linear_, float quadratic_)
 {
+	if (constant_ == constant && linear_ == linear && quadratic_ == quadratic)
+		return;
 	constant = constant_;
 	linear = linear_;
 	quadratic = quadratic_;
+	markChanged();
+}
+
+// solve quadratic * d^2 + linear * d + constant = maxColor / threshold
+float PointLight::getRange(float threshold)
+{
+	float maxColor = std::max(std::max(diffuseStrength.r, diffuseStrength.g), diffuseStrength.b);
+	float c = constant - maxColor / threshold;
+	if (quadratic <= 0.0f)
+		return linear > 0.0f ? std::max(-c / linear, 0.0f) : 1e30f;
+	if (c >= 0.0f)
+		return 0.0f;
+	return (-linear + std::sqrt(linear * linear - 4.0f * quadratic * c)) / (2.0f * quadratic);
 }
 
 void PointLight::setShaderAttr(std::shared_ptr<Shader> shader, int lightNum)
@@ -83,7 +109,11 @@ DirectionalLight::DirectionalLight(vec3 dir, vec3 color)
 
 void DirectionalLight::setDir(vec3 dir)
 {
-	direction = normalize(dir);
+	dir = normalize(dir);
+	if (dir == direction)
+		return;
+	direction = dir;
+	markChanged();
 }
 
 void DirectionalLight::setShaderAttr(std::shared_ptr<Shader> shader, int lightNum)
@@ -0,0 +1,179 @@
+#include "../include/LightClusters.h"
+#include "../include/JobSystem.h"
+#include <algorithm>
+#include <cmath>
+
+LightClusters::LightClusters(int tileX_, int tileY_, int sliceNum_) :
+    tileX(tileX_),
+    tileY(tileY_),
+    sliceNum(sliceNum_),
+    near(0.1f),
+    far(100.0f),
+    sliceScale(0.0f),
+    sliceBias(0.0f),
+    lightNum(0),
+    maxClusterLightNum(0),
+    lightBuffer(0),
+    gridBuffer(0),
+    indexBuffer(0)
+{
+    clusterLights.resize(getClusterNum());
+    grid.resize(2 * getClusterNum(), 0);
+}
+
+LightClusters::~LightClusters()
+{
+    GLuint buffers[3] = { lightBuffer, gridBuffer, indexBuffer };
+    glDeleteBuffers(3, buffers);
+}
+
+void LightClusters::init()
+{
+    glGenBuffers(1, &lightBuffer);
+    glGenBuffers(1, &gridBuffer);
+    glGenBuffers(1, &indexBuffer);
+}
+
+// exponential slicing keeps froxels roughly cubic: slice = log(depth / near) / log(far / near) * sliceNum
+void LightClusters::assign(const vector<shared_ptr<PointLight>> &lights, const mat4 &view, const mat4 &projection,
+    float near_, float far_, int shadowNum)
+{
+    near = near_;
+    far = far_;
+    sliceScale = sliceNum / log(far / near);
+    sliceBias = -sliceNum * log(near) / log(far / near);
+
+    lightNum = lights.size();
+    lightData.resize(lightNum);
+    lightBounds.resize(lightNum);
+    JobSystem::parallelFor(lightNum, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i)
+        {
+            PointLight &light = *lights[i];
+            float range = light.getRange();
+            LightData &data = lightData[i];
+            data.position = vec4(light.getPos(), range);
+            data.ambient = vec4(light.getAmbient(), i < shadowNum ? (float)i : -1.0f);
+            data.diffuse = vec4(light.getDiffuse(), 0.0f);
+            data.specular = vec4(light.getSpecular(), 0.0f);
+            data.attenuation = vec4(light.getConstant(), light.getLinear(), light.getQuadratic(), 0.0f);
+
+            LightBounds &bounds = lightBounds[i];
+            bounds.center = vec3(view * vec4(light.getPos(), 1.0f));
+            bounds.radius = range;
+            float depth = -bounds.center.z;
+            if (depth + range < near || depth - range > far)
+            {
+                bounds.firstSlice = 0;
+                bounds.lastSlice = -1;
+                continue;
+            }
+            float sliceMin = log(std::max(depth - range, near)) * sliceScale + sliceBias;
+            float sliceMax = log(std::min(depth + range, far)) * sliceScale + sliceBias;
+            bounds.firstSlice = std::max((int)sliceMin, 0);
+            bounds.lastSlice = std::min((int)sliceMax, sliceNum - 1);
+        }
+    }, 256);
+
+    // a slice only writes its own clusters, so slices need no synchronization
+    float projX = projection[0][0];
+    float projY = projection[1][1];
+    JobSystem::parallelFor(sliceNum, [&](int begin, int end) {
+        for (int slice = begin; slice < end; ++slice)
+            assignSlice(slice, projX, projY);
+    }, 1);
+
+    // pack the cluster lists
+    int indexNum = 0;
+    maxClusterLightNum = 0;
+    for (int i = 0; i < (int)clusterLights.size(); ++i)
+    {
+        int num = clusterLights[i].size();
+        grid[2 * i] = indexNum;
+        grid[2 * i + 1] = num;
+        indexNum += num;
+        maxClusterLightNum = std::max(maxClusterLightNum, num);
+    }
+    indices.resize(indexNum);
+    JobSystem::parallelFor(clusterLights.size(), [&](int begin, int end) {
+        for (int i = begin; i < end; ++i)
+            copy(clusterLights[i].begin(), clusterLights[i].end(), indices.begin() + grid[2 * i]);
+    }, 256);
+}
+
+float LightClusters::sliceDepth(int slice)
+{
+    return near * pow(far / near, (float)slice / sliceNum);
+}
+
+// the part of a sphere inside a slice is bounded by a cylinder of the largest cross section,
+// its screen rect is taken at the near and far depth of that part
+void LightClusters::assignSlice(int slice, float projX, float projY)
+{
+    int first = slice * tileX * tileY;
+    for (int i = 0; i < tileX * tileY; ++i)
+        clusterLights[first + i].clear();
+
+    float sliceNear = sliceDepth(slice);
+    float sliceFar = sliceDepth(slice + 1);
+    for (int i = 0; i < lightNum; ++i)
+    {
+        const LightBounds &bounds = lightBounds[i];
+        if (slice < bounds.firstSlice || slice > bounds.lastSlice)
+            continue;
+
+        float depth = -bounds.center.z;
+        float r = bounds.radius;
+        float d0 = std::max(sliceNear, depth - r);
+        float d1 = std::min(sliceFar, depth + r);
+        if (d0 > d1)
+            continue;
+        float dz = depth - std::min(std::max(depth, d0), d1);
+        float crossRadius = sqrt(std::max(r * r - dz * dz, 0.0f));
+
+        // NDC rect
+        float x0 = bounds.center.x - crossRadius, x1 = bounds.center.x + crossRadius;
+        float y0 = bounds.center.y - crossRadius, y1 = bounds.center.y + crossRadius;
+        float minX = std::min(projX * x0 / d0, projX * x0 / d1);
+        float maxX = std::max(projX * x1 / d0, projX * x1 / d1);
+        float minY = std::min(projY * y0 / d0, projY * y0 / d1);
+        float maxY = std::max(projY * y1 / d0, projY * y1 / d1);
+        if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+            continue;
+
+        int tx0 = std::max((int)((minX * 0.5f + 0.5f) * tileX), 0);
+        int tx1 = std::min((int)((maxX * 0.5f + 0.5f) * tileX), tileX - 1);
+        int ty0 = std::max((int)((minY * 0.5f + 0.5f) * tileY), 0);
+        int ty1 = std::min((int)((maxY * 0.5f + 0.5f) * tileY), tileY - 1);
+        for (int ty = ty0; ty <= ty1; ++ty)
+            for (int tx = tx0; tx <= tx1; ++tx)
+                clusterLights[first + ty * tileX + tx].push_back(i);
+    }
+}
+
+// buffers are orphaned every frame, empty buffers keep one element so they can be bound
+void LightClusters::upload()
+{
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, lightBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max(lightNum, 1) * sizeof(LightData), lightData.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, gridBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, grid.size() * sizeof(GLuint), grid.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, indexBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, std::max((int)indices.size(), 1) * sizeof(GLuint), indices.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void LightClusters::bind()
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, lightBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, gridBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, indexBuffer);
+}
+
+void LightClusters::setShaderAttr(shared_ptr<Shader> shader, vec2 screenSize)
+{
+    shader->setAttrVec3("clusterSize", vec3(tileX, tileY, sliceNum));
+    shader->setAttrF("clusterScale", sliceScale);
+    shader->setAttrF("clusterBias", sliceBias);
+    shader->setAttrVec2("screenSize", screenSize);
+}
@@ -3,30 +3,53 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <fstream>
 #include <sstream>
+#include <tuple>
 #include <iostream>
 #include "../include/Mesh.h"
 #include "../include/Utility.h"
+#include "../include/JobSystem.h"
 
 using namespace glm;
 
 Object::Object() :
+	depthVBO(0),
+	vertexFetchBytes(0),
+	depthFetchBytes(0),
 	drawVertexNum(0),
 	faceNum(0),
 	position(vec3(0, 0, 0)),
 	scale(vec3(1.0, 1.0, 1.0)),
-	modelMatrix(mat4(1.0f)),
-	transInvModelMatrix(mat4(1.0f))
+	rotateAngle(vec3(0, 0, 0)),
+	transform(TransformSystem::create()),
+	indirectBuffer(0),
+	indirectFirstCommand(0),
+	occluder(false),
+	occlusionQuery(false),
+	staticObject(false)
 {
-	rotateAngle.resize(3, 0);
 }
 
 Object::~Object()
 {
+	TransformSystem::destroy(transform);
 	glDeleteBuffers(1, &VBO);
 	for (int i = 0; i < VAOs.size(); ++i)
 		glDeleteVertexArrays(1, &VAOs[i]);
 	for (int i = 0; i < EBOs.size(); ++i)
 		glDeleteBuffers(1, &EBOs[i]);
+	glDeleteBuffers(1, &depthVBO);
+	for (int i = 0; i < (int)depthVAOs.size(); ++i)
+		glDeleteVertexArrays(1, &depthVAOs[i]);
+	for (int i = 0; i < (int)depthEBOs.size(); ++i)
+		glDeleteBuffers(1, &depthEBOs[i]);
+}
+
+int Object::getTriangleNum()
+{
+	int num = 0;
+	for (int i = 0; i < (int)indices.size(); ++i)
+		num += indices[i].size() / 3;
+	return num;
 }
 
 void Object::setMaterial(shared_ptr<Material> mtl)
@@ -40,12 +63,19 @@ void Object::setMaterial(shared_ptr<Material> mtl)
 	}
 }
 
+shared_ptr<Material> Object::getMaterial(int subMesh)
+{
+	if (subMesh < (int)materials.size())
+		return materials[subMesh];
+	return nullptr;
+}
+
 void Object::draw(shared_ptr<Shader> shader)
 {
 	shader->use();
 
-	shader->setAttrMat4("model", modelMatrix);
-	shader->setAttrMat4("transInvModel", transInvModelMatrix);
+	shader->setAttrMat4("model", TransformSystem::getWorldMatrix(transform));
+	shader->setAttrMat4("transInvModel", TransformSystem::getNormalMatrix(transform));
 
 
 	for (int i = 0; i < indices.size(); ++i)
@@ -56,13 +86,59 @@ void Object::draw(shared_ptr<Shader> shader)
 		shader->setAttributes();
 		shader->applyTextures();
 
-		glBindVertexArray(VAOs[i]);
-		glDrawElements(GL_TRIANGLES, indices[i].size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		drawSubMesh(i);
+	}
+}
+
+void Object::drawDepth(shared_ptr<Shader> shader, bool positionStream)
+{
+	shader->use();
+
+	shader->setAttrMat4("model", TransformSystem::getWorldMatrix(transform));
+	shader->setAttributes();
+
+	for (int i = 0; i < (int)indices.size(); ++i)
+		drawSubMesh(i, positionStream);
+}
+
+void Object::drawInstanced(shared_ptr<Shader> shader, int instanceNum, bool positionStream)
+{
+	shader->use();
+
+	shader->setAttrMat4("model", TransformSystem::getWorldMatrix(transform));
+	shader->setAttributes();
+
+	for (int i = 0; i < (int)indices.size(); ++i)
+	{
+		glBindVertexArray(positionStream ? depthVAOs[i] : VAOs[i]);
+		glDrawElementsInstanced(GL_TRIANGLES, indices[i].size(), GL_UNSIGNED_INT, 0, instanceNum);
+	}
+	glBindVertexArray(0);
+}
+
+void Object::setIndirectBuffer(unsigned int buffer, int firstCommand)
+{
+	indirectBuffer = buffer;
+	indirectFirstCommand = firstCommand;
+}
+
+// the indirect command of a culled sub mesh has zero instance count, so it costs no GPU work,
+// welding keeps the index count, so the position stream takes the same commands
+void Object::drawSubMesh(int i, bool positionStream)
+{
+	glBindVertexArray(positionStream ? depthVAOs[i] : VAOs[i]);
+	if (indirectBuffer)
+	{
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+		glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void *)((indirectFirstCommand + i) * 5 * sizeof(GLuint)));
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 	}
+	else
+		glDrawElements(GL_TRIANGLES, indices[i].size(), GL_UNSIGNED_INT, 0);
+	glBindVertexArray(0);
 }
 
-void Object::setTransform(const vec3 & pos_, const vec3 & scale_, const vector<float>& rotation_)
+void Object::setTransform(const vec3 & pos_, const vec3 & scale_, const vec3& rotation_)
 {
 	position = pos_;
 	scale = scale_;
@@ -82,7 +158,7 @@ void Object::setScale(const vec3& scale_)
 	updateModelMatrix();
 }
 
-void Object::setRotation(const vector<float>& rotation_)
+void Object::setRotation(const vec3& rotation_)
 {
 	rotateAngle = rotation_;
 	updateModelMatrix();
@@ -133,15 +209,18 @@ vector<float> Object::transformToInterleavedData()
 	return interleavedData;
 }
 
+// matrices are recomputed by TransformSystem::update, once per frame
 void Object::updateModelMatrix()
 {
-	modelMatrix = glm::mat4(1.0f);
-	modelMatrix = glm::translate(modelMatrix, position);
-	modelMatrix = glm::rotate(modelMatrix, radians(rotateAngle[0]), vec3(1, 0, 0));
-	modelMatrix = glm::rotate(modelMatrix, radians(rotateAngle[1]), vec3(0, 1, 0));
-	modelMatrix = glm::rotate(modelMatrix, radians(rotateAngle[2]), vec3(0, 0, 1));
-	modelMatrix = glm::scale(modelMatrix, scale);
-	transInvModelMatrix = glm::transpose(glm::inverse(modelMatrix));
+	quat rotation = angleAxis(radians(rotateAngle[0]), vec3(1, 0, 0))
+		* angleAxis(radians(rotateAngle[1]), vec3(0, 1, 0))
+		* angleAxis(radians(rotateAngle[2]), vec3(0, 0, 1));
+	TransformSystem::setLocal(transform, position, rotation, scale);
+}
+
+void Object::setParent(shared_ptr<Object> parent)
+{
+	TransformSystem::setParent(transform, parent ? parent->transform : -1);
 }
 
 pair<vec3, vec3> Object::computeTB(const vec3 & pos1, const vec3 & pos2, const vec3 & pos3, 
@@ -170,6 +249,11 @@ pair<vec3, vec3> Object::computeTB(const vec3 & pos1, const vec3 & pos2, const v
 
 void Object::bind()
 {
+	localBounds = BoundingBox();
+	for (int i = 0; i < (int)indices.size(); ++i)
+		for (int j = 0; j < (int)indices[i].size(); ++j)
+			localBounds.expand(vertices[indices[i][j]]);
+
 	vector<float> interleavedData = transformToInterleavedData();
 
 	glGenBuffers(1, &VBO);
@@ -204,6 +288,70 @@ void Object::bind()
 		VAOs.push_back(vao);
 		EBOs.push_back(ebo);
 	}
+	bindDepthStream();
+}
+
+// Positions must match exactly, they are kept in the order of their first vertex
+void Object::weldPositions(const vector<vec3> &points, vector<vec3> &positions, vector<unsigned int> &remap)
+{
+	map<tuple<float, float, float>, unsigned int> weldedIndices;
+	positions.clear();
+	remap.resize(points.size());
+	for (int i = 0; i < (int)points.size(); ++i)
+	{
+		auto it = weldedIndices.emplace(make_tuple(points[i].x, points[i].y, points[i].z), positions.size());
+		if (it.second)
+			positions.push_back(points[i]);
+		remap[i] = it.first->second;
+	}
+}
+
+// Depth passes read only positions, 12 bytes a vertex instead of 56. Vertices split for their normals,
+// uvs or tangents share a position, they are welded so the post transform cache also sees them as one.
+// The triangles stay the same.
+void Object::bindDepthStream()
+{
+	vector<unsigned int> remap;
+	vector<vec3> positions;
+	weldPositions(vertices, positions, remap);
+
+	glGenBuffers(1, &depthVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, depthVBO);
+	glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(vec3), positions.data(), GL_STATIC_DRAW);
+
+	vertexFetchBytes = 0;
+	depthFetchBytes = 0;
+	for (int i = 0; i < (int)indices.size(); ++i)
+	{
+		vector<unsigned int> depthIndices(indices[i].size());
+		vector<char> used(vertices.size(), 0), usedWelded(positions.size(), 0);
+		for (int j = 0; j < (int)indices[i].size(); ++j)
+		{
+			depthIndices[j] = remap[indices[i][j]];
+			if (!used[indices[i][j]])
+				vertexFetchBytes += 14 * sizeof(float);
+			if (!usedWelded[depthIndices[j]])
+				depthFetchBytes += sizeof(vec3);
+			used[indices[i][j]] = usedWelded[depthIndices[j]] = 1;
+		}
+
+		unsigned int vao, ebo;
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &ebo);
+
+		glBindVertexArray(vao);
+
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, depthIndices.size() * sizeof(unsigned int), depthIndices.data(), GL_STATIC_DRAW);
+
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (void*)0);
+		glEnableVertexAttribArray(0);
+
+		glBindVertexArray(0);
+
+		depthVAOs.push_back(vao);
+		depthEBOs.push_back(ebo);
+	}
 }
 
 // Cube ---------------------------------------------------------------------
@@ -212,8 +360,7 @@ Cube::Cube(float length_, float width_, float height_, vec3 pos) :
 {	
 	position = pos;
 	scale = vec3(length_, width_, height_);
-	modelMatrix = glm::translate(modelMatrix, position);
-	modelMatrix = glm::scale(modelMatrix, scale);
+	updateModelMatrix();
 
 	create();
 }
@@ -303,9 +450,7 @@ Model::Model(vec3 position_, vec3 scale_) :
 {
 	position = position_;
 	scale = scale_;
-	modelMatrix = glm::mat4(1.0f);
-	modelMatrix = glm::translate(modelMatrix, position);
-	modelMatrix = glm::scale(modelMatrix, scale);
+	updateModelMatrix();
 }
 
 Model::Model(const string &path)
@@ -323,91 +468,65 @@ void Model::loadObj(const string &path)
 		return;
 	}
 
-	vector<vec3> vertices_;
-	vector<vec2> texCoords_;
-	vector<vec3> normals_;
-	vertices_.push_back(vec3()); // start from index 1
-	texCoords_.push_back(vec2());
-	normals_.push_back(vec3());
-	vector<vector<Face>> facesGroupsIdx_;
-	vector<Face> faces;
+	vector<string> lines;
 	string line;
 	while (!in.eof())
 	{
 		getline(in, line);
-		if (line.empty())
+		lines.push_back(line);
+	}
+
+	// classify lines and give every element its index, materials are handled in order here
+	enum class LineType { Else, Vertex, TexCoord, Normal, Face };
+	vector<LineType> types(lines.size(), LineType::Else);
+	vector<int> slots(lines.size(), 0);
+	vector<int> faceGroups; // material group of each face line
+	int vertexNum = 1, texCoordNum = 1, normalNum = 1; // start from index 1
+	int faceLineNum = 0;
+	int groupNum = 0;
+	bool groupEmpty = true;
+	for (int i = 0; i < (int)lines.size(); ++i)
+	{
+		const string &l = lines[i];
+		if (l.size() < 2)
 			continue;
-		vector<string> tokens;
-		Utility::split(line, tokens, " ");
-		if (tokens[0] == "v") // vertices
+		if (l[0] == 'v' && l[1] == ' ') // vertices
 		{
-			vec3 v;
-			for (int i = 1; i <= 3; ++i)
-				v[i-1] = atof(tokens[i].c_str());
-			vertices_.push_back(v);
+			types[i] = LineType::Vertex;
+			slots[i] = vertexNum++;
 		}
-		else if (tokens[0] == "vt") // texture coord
+		else if (l[0] == 'v' && l[1] == 't') // texture coord
 		{
-			vec2 texCoord;
-			for (int i = 1; i <= 2; ++i)
-				texCoord[i-1] = atof(tokens[i].c_str());
-			texCoords_.push_back(texCoord);
+			types[i] = LineType::TexCoord;
+			slots[i] = texCoordNum++;
 		}
-		else if (tokens[0] == "vn") // vertex normal
+		else if (l[0] == 'v' && l[1] == 'n') // vertex normal
 		{
-			vec3 n;
-			for (int i = 1; i <= 3; ++i)
-				n[i-1] = atof(tokens[i].c_str());
-			normals_.push_back(n);
+			types[i] = LineType::Normal;
+			slots[i] = normalNum++;
 		}
-		else if (tokens[0] == "f") // face
+		else if (l[0] == 'f' && l[1] == ' ') // face
 		{
-			Face f;
-			for (int i = 1; i <=3 ; ++i)
-			{
-				VertexIndex vi;
-				vector<string> indices;
-				Utility::replace(tokens[i], "//", "/0/");
-				Utility::split(tokens[i], indices, "/");
-				assert(indices.size() == 3);
-				vi.posIdx = atoi(indices[0].c_str());
-				vi.texIdx = atoi(indices[1].c_str());
-				vi.nIdx = atoi(indices[2].c_str());
-				f.push_back(vi);
-			}
-			faces.push_back(f);
-			// ı
-			if (tokens.size() == 5)
-			{
-				Face f1;
-				for (int i = 1; i <= 4; ++i)
-				{
-					if (i == 2)
-						continue;
-					VertexIndex vi;
-					vector<string> indices;
-					Utility::replace(tokens[i], "//", "/0/");
-					Utility::split(tokens[i], indices, "/");
-					assert(indices.size() == 3);
-					vi.posIdx = atoi(indices[0].c_str());
-					vi.texIdx = atoi(indices[1].c_str());
-					vi.nIdx = atoi(indices[2].c_str());
-					f1.push_back(vi);
-				}
-				faces.push_back(f1);
-			}
+			types[i] = LineType::Face;
+			slots[i] = faceLineNum++;
+			faceGroups.push_back(groupNum);
+			groupEmpty = false;
 		}
-		else if (tokens[0] == "usemtl") // material
+		else if (l.compare(0, 6, "usemtl") == 0) // material
 		{
+			vector<string> tokens;
+			Utility::split(l, tokens, " ");
 			materialName.push_back(tokens[1]);
-			if (!faces.empty())
+			if (!groupEmpty)
 			{
-				facesGroupsIdx_.push_back(faces);
-				faces.clear();
+				groupNum++;
+				groupEmpty = true;
 			}
 		}
-		else if (tokens[0] == "mtllib")
+		else if (l.compare(0, 6, "mtllib") == 0)
 		{
+			vector<string> tokens;
+			Utility::split(l, tokens, " ");
 			size_t pos = path.find_last_of("/");
 			if(pos == string::npos)
 				pos = path.find_last_of("\\");
@@ -418,46 +537,116 @@ void Model::loadObj(const string &path)
 			}
 		}
 	}
-	if (!faces.empty())
-		facesGroupsIdx_.push_back(faces);
 
-	// 
+	// parse elements in parallel, a quad face is split into two triangles
+	vector<vec3> vertices_(vertexNum, vec3(0.0f));
+	vector<vec2> texCoords_(texCoordNum, vec2(0.0f));
+	vector<vec3> normals_(normalNum, vec3(0.0f));
+	vector<Face> faceLines(faceLineNum * 2);
+	vector<char> isQuad(faceLineNum, 0);
+	JobSystem::parallelFor(lines.size(), [&](int begin, int end) {
+		for (int i = begin; i < end; ++i)
+		{
+			if (types[i] == LineType::Else)
+				continue;
+			vector<string> tokens;
+			Utility::split(lines[i], tokens, " ");
+			if (types[i] == LineType::Vertex)
+			{
+				for (int k = 1; k <= 3; ++k)
+					vertices_[slots[i]][k - 1] = atof(tokens[k].c_str());
+			}
+			else if (types[i] == LineType::TexCoord)
+			{
+				for (int k = 1; k <= 2; ++k)
+					texCoords_[slots[i]][k - 1] = atof(tokens[k].c_str());
+			}
+			else if (types[i] == LineType::Normal)
+			{
+				for (int k = 1; k <= 3; ++k)
+					normals_[slots[i]][k - 1] = atof(tokens[k].c_str());
+			}
+			else if (types[i] == LineType::Face)
+			{
+				int corners[2][3] = { { 1, 2, 3 }, { 1, 3, 4 } };
+				int faceNum_ = tokens.size() == 5 ? 2 : 1;
+				isQuad[slots[i]] = faceNum_ == 2;
+				for (int f = 0; f < faceNum_; ++f)
+				{
+					Face &face = faceLines[2 * slots[i] + f];
+					for (int k = 0; k < 3; ++k)
+					{
+						VertexIndex vi;
+						vector<string> indices;
+						string token = tokens[corners[f][k]];
+						Utility::replace(token, "//", "/0/");
+						Utility::split(token, indices, "/");
+						assert(indices.size() == 3);
+						vi.posIdx = atoi(indices[0].c_str());
+						vi.texIdx = atoi(indices[1].c_str());
+						vi.nIdx = atoi(indices[2].c_str());
+						face.push_back(vi);
+					}
+				}
+			}
+		}
+	});
+
+	vector<vector<Face>> facesGroupsIdx_(faceLineNum > 0 ? faceGroups.back() + 1 : 0);
+	for (int i = 0; i < faceLineNum; ++i)
+	{
+		facesGroupsIdx_[faceGroups[i]].push_back(move(faceLines[2 * i]));
+		if (isQuad[i])
+			facesGroupsIdx_[faceGroups[i]].push_back(move(faceLines[2 * i + 1]));
+	}
+
+	// default material
 	if (modelMaterials.empty())
 	{
 		shared_ptr<Material> mtl = make_shared<Material>();
 		materials.push_back(mtl);
 	}
 
-	// תʽ
-	vertices.push_back(vec3(0));
-	normals.push_back(vec3(0));
-	texCoords.push_back(vec3(0));
-	tangents.push_back(vec3(0));
-	bitangents.push_back(vec3(0));
-	int indicesIdx = 1;
+	// convert to per vertex data, vertex k of triangle t is stored at 1 + 3t + k
+	vector<const Face *> triangles;
 	for (int i = 0; i < facesGroupsIdx_.size(); ++i)
-	{
-		vector<unsigned int> indices_;
 		for (int j = 0; j < facesGroupsIdx_[i].size(); ++j)
+			triangles.push_back(&facesGroupsIdx_[i][j]);
+	int dataNum = 1 + 3 * triangles.size();
+	vertices.assign(dataNum, vec3(0.0f));
+	normals.assign(dataNum, vec3(0.0f));
+	texCoords.assign(dataNum, vec2(0.0f));
+	tangents.assign(dataNum, vec3(0.0f));
+	bitangents.assign(dataNum, vec3(0.0f));
+	faceNum += triangles.size();
+	JobSystem::parallelFor(triangles.size(), [&](int begin, int end) {
+		for (int t = begin; t < end; ++t)
 		{
-			faceNum++;
-			Face f = facesGroupsIdx_[i][j];
+			const Face &f = *triangles[t];
+			int base = 1 + 3 * t;
 			for (int k = 0; k < 3; ++k)
 			{
-				indices_.push_back(indicesIdx++);
-				vertices.push_back(vertices_[f[k].posIdx]);
-				normals.push_back(normals_[f[k].nIdx]);
-				texCoords.push_back(texCoords_[f[k].texIdx]);
+				vertices[base + k] = vertices_[f[k].posIdx];
+				normals[base + k] = normals_[f[k].nIdx];
+				texCoords[base + k] = texCoords_[f[k].texIdx];
 			}
 
-			pair<vec3, vec3> tan = computeTB(vertices[indicesIdx-3], vertices[indicesIdx - 2], vertices[indicesIdx - 1],
-				texCoords[indicesIdx-3], texCoords[indicesIdx - 2], texCoords[indicesIdx - 1]);
+			pair<vec3, vec3> tan = computeTB(vertices[base], vertices[base + 1], vertices[base + 2],
+				texCoords[base], texCoords[base + 1], texCoords[base + 2]);
 			for (int k = 0; k < 3; ++k)
 			{
-				tangents.push_back(tan.first);
-				bitangents.push_back(tan.second);
+				tangents[base + k] = tan.first;
+				bitangents[base + k] = tan.second;
 			}
 		}
+	});
+
+	int indicesIdx = 1;
+	for (int i = 0; i < (int)facesGroupsIdx_.size(); ++i)
+	{
+		vector<unsigned int> indices_;
+		for (int j = 0; j < 3 * (int)facesGroupsIdx_[i].size(); ++j)
+			indices_.push_back(indicesIdx++);
 		indices.push_back(indices_);
 	}
 }
@@ -466,29 +655,28 @@ void Model::draw(shared_ptr<Shader> shader)
 {
 	shader->use();
 
-	shader->setAttrMat4("model", modelMatrix);
-	shader->setAttrMat4("transInvModel", transInvModelMatrix);
+	shader->setAttrMat4("model", TransformSystem::getWorldMatrix(transform));
+	shader->setAttrMat4("transInvModel", TransformSystem::getNormalMatrix(transform));
 
 	for (int i = 0; i < indices.size(); ++i)
 	{
-		shared_ptr<Material> mtl;
-		if (modelMaterials.empty())
-			mtl = materials[0];
-		else
-			mtl = modelMaterials[materialName[i]];
-
-		shader->setMeterial(mtl);
+		shader->setMeterial(getMaterial(i));
 
 		shader->setAttributes();
 		shader->applyTextures();
 
-		glBindVertexArray(VAOs[i]);
-		glDrawElements(GL_TRIANGLES, indices[i].size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		drawSubMesh(i);
 	}
 
 }
 
+shared_ptr<Material> Model::getMaterial(int subMesh)
+{
+	if (modelMaterials.empty())
+		return materials[0];
+	return modelMaterials[materialName[subMesh]];
+}
+
 // ȡmtlʽļ
 void Model::loadMaterialLib(string path)
 {
@@ -586,7 +774,7 @@ Sphere::Sphere(float r, int detailLevel_, vec3 pos) :
 	detailLevel(detailLevel_)
 {
 	position = pos;
-	modelMatrix = glm::translate(modelMatrix, position);
+	updateModelMatrix();
 	if (detailLevel_ > 10)
 		detailLevel = 10;
 	else if (detailLevel_ < 1)
@@ -675,27 +863,38 @@ void Sphere::create(int detail)
 
 	normals = vertices;
 	// compute uv texcoords
-	for (int i = 0; i < vertices.size(); ++i)
-	{
-		texCoords.push_back(computeUV(vertices[i]));
+	texCoords.resize(vertices.size());
+	JobSystem::parallelFor(vertices.size(), [&](int begin, int end) {
+		for (int i = begin; i < end; ++i)
+		{
+			texCoords[i] = computeUV(vertices[i]);
 
-		vertices[i] = vertices[i] * radius;
-	}
+			vertices[i] = vertices[i] * radius;
+		}
+	});
 
 	// tangent bitangent
+	// computed per triangle in parallel, then written to the vertices in triangle order
+	const vector<unsigned int> &idx = indices[0];
+	vector<pair<vec3, vec3>> triangleTB(idx.size() / 3);
+	JobSystem::parallelFor(triangleTB.size(), [&](int begin, int end) {
+		for (int t = begin; t < end; ++t)
+		{
+			int i = 3 * t;
+			triangleTB[t] = computeTB(vertices[idx[i]], vertices[idx[i + 1]], vertices[idx[i + 2]],
+				texCoords[idx[i]], texCoords[idx[i + 1]], texCoords[idx[i + 2]]);
+		}
+	});
+
 	tangents.resize(vertices.size());
 	bitangents.resize(vertices.size());
-	for (int i = 0; i < indices[0].size(); i += 3)
+	for (int t = 0; t < (int)triangleTB.size(); ++t)
 	{
-		pair<vec3, vec3> tan = computeTB(vertices[indices[0][i]], vertices[indices[0][i + 1]], vertices[indices[0][i + 2]],
-			texCoords[indices[0][i]], texCoords[indices[0][i + 1]], texCoords[indices[0][i + 2]]);
-
-		tangents[indices[0][i]] = tan.first;
-		bitangents[indices[0][i]] = tan.second;
-		tangents[indices[0][i+1]] = tan.first;
-		bitangents[indices[0][i+1]] = tan.second;
-		tangents[indices[0][i+2]] = tan.first;
-		bitangents[indices[0][i+2]] = tan.second;
+		for (int k = 0; k < 3; ++k)
+		{
+			tangents[idx[3 * t + k]] = triangleTB[t].first;
+			bitangents[idx[3 * t + k]] = triangleTB[t].second;
+		}
 	}
 }
 
@@ -742,8 +941,7 @@ Rectangle::Rectangle(float width_, float height_, vec3 pos) :
 {
 	position = pos;
 	scale = vec3(width, height, 1);
-	modelMatrix = glm::translate(modelMatrix, position);
-	modelMatrix = glm::scale(modelMatrix, scale);
+	updateModelMatrix();
 
 	create();
 }
@@ -0,0 +1,358 @@
+#include "../include/OcclusionCuller.h"
+#include "../include/JobSystem.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define OCCLUSION_SSE
+#endif
+
+const int TILE_SIZE = 32;		// pixels, one job per tile
+const int BLOCK_SIZE = 8;		// pixels, coarse depth
+const int CHUNK_SIZE = 2048;	// triangles per setup job
+const float DEPTH_BIAS = 1.0f / 1024.0f; // relative, keeps surfaces from occluding their own bounds
+
+OcclusionCuller::OcclusionCuller(int width_, int height_) :
+	minScreenArea(0.05f),
+	maxTriangleNum(20000),
+	viewProjection(mat4(1.0f)),
+	testedNum(0),
+	occludedNum(0),
+	rasterizeTime(0.0f),
+	testTime(0.0f)
+{
+	// whole tiles
+	width = (width_ + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE;
+	height = (height_ + TILE_SIZE - 1) / TILE_SIZE * TILE_SIZE;
+	tileNumX = width / TILE_SIZE;
+	tileNumY = height / TILE_SIZE;
+	blockNumX = width / BLOCK_SIZE;
+	blockNumY = height / BLOCK_SIZE;
+	tileTriangles.resize(tileNumX * tileNumY);
+	depth.resize(width * height, 0.0f);
+	blockDepth.resize(blockNumX * blockNumY, 0.0f);
+}
+
+void OcclusionCuller::setOccluderSelection(float minScreenArea_, int maxTriangleNum_)
+{
+	minScreenArea = minScreenArea_;
+	maxTriangleNum = maxTriangleNum_;
+}
+
+bool OcclusionCuller::selectOccluder(const BoundingBox &box, int triangleNum) const
+{
+	return triangleNum <= maxTriangleNum && getScreenArea(box) >= minScreenArea;
+}
+
+float OcclusionCuller::getScreenArea(const BoundingBox &box) const
+{
+	if (!box.valid)
+		return 0.0f;
+	vec2 minPos(1.0f), maxPos(-1.0f);
+	for (int i = 0; i < 8; ++i)
+	{
+		vec3 corner(i & 1 ? box.maxPos.x : box.minPos.x, i & 2 ? box.maxPos.y : box.minPos.y, i & 4 ? box.maxPos.z : box.minPos.z);
+		vec4 p = viewProjection * vec4(corner, 1.0f);
+		if (p.z < -p.w)
+			return 1.0f;
+		minPos = min(minPos, vec2(p) / p.w);
+		maxPos = max(maxPos, vec2(p) / p.w);
+	}
+	minPos = clamp(minPos, vec2(-1.0f), vec2(1.0f));
+	maxPos = clamp(maxPos, vec2(-1.0f), vec2(1.0f));
+	return std::max(maxPos.x - minPos.x, 0.0f) * std::max(maxPos.y - minPos.y, 0.0f) / 4.0f;
+}
+
+void OcclusionCuller::begin(const mat4 &viewProjection_)
+{
+	viewProjection = viewProjection_;
+	occluders.clear();
+	triangles.clear();
+	fill(depth.begin(), depth.end(), 0.0f);
+	fill(blockDepth.begin(), blockDepth.end(), 0.0f);
+}
+
+void OcclusionCuller::addOccluder(const vec3 *vertices, const unsigned int *indices, int triangleNum, const mat4 &model)
+{
+	Occluder occluder;
+	occluder.vertices = vertices;
+	occluder.indices = indices;
+	occluder.triangleNum = triangleNum;
+	occluder.mvp = viewProjection * model;
+	occluders.push_back(occluder);
+}
+
+// transform and clip in chunks, bin into tiles, then rasterize the tiles in parallel
+void OcclusionCuller::rasterize()
+{
+	auto start = chrono::high_resolution_clock::now();
+
+	vector<pair<int, int>> chunks; // occluder, first triangle
+	for (int i = 0; i < (int)occluders.size(); ++i)
+		for (int t = 0; t < occluders[i].triangleNum; t += CHUNK_SIZE)
+			chunks.push_back({ i, t });
+	vector<vector<ScreenTriangle>> chunkTriangles(chunks.size());
+	JobSystem::parallelFor(chunks.size(), [&](int begin, int end) {
+		for (int i = begin; i < end; ++i)
+		{
+			const Occluder &occluder = occluders[chunks[i].first];
+			int first = chunks[i].second;
+			setupTriangles(occluder, first, std::min(CHUNK_SIZE, occluder.triangleNum - first), chunkTriangles[i]);
+		}
+	}, 1);
+
+	triangles.clear();
+	for (auto &chunk : chunkTriangles)
+		triangles.insert(triangles.end(), chunk.begin(), chunk.end());
+
+	for (auto &list : tileTriangles)
+		list.clear();
+	for (int i = 0; i < (int)triangles.size(); ++i)
+	{
+		const ScreenTriangle &tri = triangles[i];
+		for (int ty = tri.minY / TILE_SIZE; ty <= tri.maxY / TILE_SIZE; ++ty)
+			for (int tx = tri.minX / TILE_SIZE; tx <= tri.maxX / TILE_SIZE; ++tx)
+				tileTriangles[ty * tileNumX + tx].push_back(i);
+	}
+
+	JobSystem::parallelFor(tileNumX * tileNumY, [&](int begin, int end) {
+		for (int tile = begin; tile < end; ++tile)
+			rasterizeTile(tile);
+	}, 1);
+
+	auto end = chrono::high_resolution_clock::now();
+	rasterizeTime = chrono::duration<float, milli>(end - start).count();
+}
+
+void OcclusionCuller::setupTriangles(const Occluder &occluder, int first, int num, vector<ScreenTriangle> &out) const
+{
+	for (int t = first; t < first + num; ++t)
+	{
+		vec4 clip[4];
+		float dist[3]; // to the near plane
+		int inside = 0;
+		for (int k = 0; k < 3; ++k)
+		{
+			clip[k] = occluder.mvp * vec4(occluder.vertices[occluder.indices[3 * t + k]], 1.0f);
+			dist[k] = clip[k].z + clip[k].w;
+			inside += dist[k] >= 0.0f;
+		}
+		if (inside == 3)
+		{
+			addTriangle(clip, 3, out);
+			continue;
+		}
+		if (inside == 0)
+			continue;
+
+		// clip against the near plane, one or two triangles remain
+		vec4 polygon[4];
+		int n = 0;
+		for (int k = 0; k < 3; ++k)
+		{
+			int next = (k + 1) % 3;
+			if (dist[k] >= 0.0f)
+				polygon[n++] = clip[k];
+			if ((dist[k] >= 0.0f) != (dist[next] >= 0.0f))
+			{
+				float s = dist[k] / (dist[k] - dist[next]);
+				polygon[n++] = clip[k] + (clip[next] - clip[k]) * s;
+			}
+		}
+		addTriangle(polygon, n, out);
+	}
+}
+
+// project a convex polygon and split it into a fan
+void OcclusionCuller::addTriangle(const vec4 *clip, int vertexNum, vector<ScreenTriangle> &out) const
+{
+	vec3 screen[4];
+	for (int k = 0; k < vertexNum; ++k)
+	{
+		float invW = 1.0f / clip[k].w;
+		screen[k] = vec3((clip[k].x * invW * 0.5f + 0.5f) * width, (clip[k].y * invW * 0.5f + 0.5f) * height, invW);
+	}
+
+	for (int k = 1; k + 1 < vertexNum; ++k)
+	{
+		ScreenTriangle tri;
+		tri.v[0] = screen[0];
+		tri.v[1] = screen[k];
+		tri.v[2] = screen[k + 1];
+		float area = (tri.v[1].x - tri.v[0].x) * (tri.v[2].y - tri.v[0].y) - (tri.v[1].y - tri.v[0].y) * (tri.v[2].x - tri.v[0].x);
+		if (area == 0.0f)
+			continue;
+
+		// pixels whose center may be covered
+		float minX = std::min(std::min(tri.v[0].x, tri.v[1].x), tri.v[2].x);
+		float maxX = std::max(std::max(tri.v[0].x, tri.v[1].x), tri.v[2].x);
+		float minY = std::min(std::min(tri.v[0].y, tri.v[1].y), tri.v[2].y);
+		float maxY = std::max(std::max(tri.v[0].y, tri.v[1].y), tri.v[2].y);
+		tri.minX = std::max((int)ceil(minX - 0.5f), 0);
+		tri.maxX = std::min((int)floor(maxX - 0.5f), width - 1);
+		tri.minY = std::max((int)ceil(minY - 0.5f), 0);
+		tri.maxY = std::min((int)floor(maxY - 0.5f), height - 1);
+		if (tri.minX > tri.maxX || tri.minY > tri.maxY)
+			continue;
+		out.push_back(tri);
+	}
+}
+
+void OcclusionCuller::rasterizeTile(int tile)
+{
+	int tileX = tile % tileNumX * TILE_SIZE;
+	int tileY = tile / tileNumX * TILE_SIZE;
+
+	for (int index : tileTriangles[tile])
+	{
+		const ScreenTriangle &tri = triangles[index];
+		const vec3 *v = tri.v;
+
+		// edge i is opposite to vertex i, e = a * x + b * y + c, positive inside
+		float a[3], b[3], c[3];
+		for (int i = 0; i < 3; ++i)
+		{
+			const vec3 &p0 = v[(i + 1) % 3];
+			const vec3 &p1 = v[(i + 2) % 3];
+			a[i] = p0.y - p1.y;
+			b[i] = p1.x - p0.x;
+			c[i] = p0.x * p1.y - p0.y * p1.x;
+		}
+		float area = c[0] + c[1] + c[2];
+		if (area < 0.0f)
+		{
+			for (int i = 0; i < 3; ++i)
+			{
+				a[i] = -a[i];
+				b[i] = -b[i];
+				c[i] = -c[i];
+			}
+			area = -area;
+		}
+		// 1/w plane
+		float za = (a[0] * v[0].z + a[1] * v[1].z + a[2] * v[2].z) / area;
+		float zb = (b[0] * v[0].z + b[1] * v[1].z + b[2] * v[2].z) / area;
+		float zc = (c[0] * v[0].z + c[1] * v[1].z + c[2] * v[2].z) / area;
+
+		int x0 = std::max(tri.minX, tileX) & ~3;
+		int x1 = std::min(tri.maxX, tileX + TILE_SIZE - 1);
+		int y0 = std::max(tri.minY, tileY);
+		int y1 = std::min(tri.maxY, tileY + TILE_SIZE - 1);
+		for (int y = y0; y <= y1; ++y)
+		{
+			float py = y + 0.5f;
+			float *row = depth.data() + y * width;
+#ifdef OCCLUSION_SSE
+			__m128 e0Row = _mm_set1_ps(b[0] * py + c[0]);
+			__m128 e1Row = _mm_set1_ps(b[1] * py + c[1]);
+			__m128 e2Row = _mm_set1_ps(b[2] * py + c[2]);
+			__m128 zRow = _mm_set1_ps(zb * py + zc);
+			__m128 zero = _mm_setzero_ps();
+			for (int x = x0; x <= x1; x += 4)
+			{
+				__m128 px = _mm_add_ps(_mm_set1_ps(x + 0.5f), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+				__m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[0]), px), e0Row);
+				__m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[1]), px), e1Row);
+				__m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[2]), px), e2Row);
+				__m128 mask = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+				if (_mm_movemask_ps(mask) == 0)
+					continue;
+				__m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(za), px), zRow);
+				__m128 d = _mm_loadu_ps(row + x);
+				__m128 nearest = _mm_max_ps(d, z);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(mask, nearest), _mm_andnot_ps(mask, d)));
+			}
+#else
+			for (int x = x0; x <= x1; ++x)
+			{
+				float px = x + 0.5f;
+				if (a[0] * px + b[0] * py + c[0] < 0.0f || a[1] * px + b[1] * py + c[1] < 0.0f || a[2] * px + b[2] * py + c[2] < 0.0f)
+					continue;
+				row[x] = std::max(row[x], za * px + zb * py + zc);
+			}
+#endif
+		}
+	}
+
+	// farthest depth of each block
+	for (int by = tileY / BLOCK_SIZE; by < (tileY + TILE_SIZE) / BLOCK_SIZE; ++by)
+		for (int bx = tileX / BLOCK_SIZE; bx < (tileX + TILE_SIZE) / BLOCK_SIZE; ++bx)
+		{
+			float farthest = 1e30f;
+			for (int y = by * BLOCK_SIZE; y < (by + 1) * BLOCK_SIZE; ++y)
+				for (int x = bx * BLOCK_SIZE; x < (bx + 1) * BLOCK_SIZE; ++x)
+					farthest = std::min(farthest, depth[y * width + x]);
+			blockDepth[by * blockNumX + bx] = farthest;
+		}
+}
+
+// visible if some pixel under the box's screen rect is not nearer than the box's nearest corner
+bool OcclusionCuller::isVisible(const BoundingBox &box) const
+{
+	if (!box.valid)
+		return true;
+
+	vec2 minPos(1e30f), maxPos(-1e30f);
+	float nearest = 0.0f;
+	for (int i = 0; i < 8; ++i)
+	{
+		vec3 corner(i & 1 ? box.maxPos.x : box.minPos.x, i & 2 ? box.maxPos.y : box.minPos.y, i & 4 ? box.maxPos.z : box.minPos.z);
+		vec4 p = viewProjection * vec4(corner, 1.0f);
+		if (p.z < -p.w)
+			return true;
+		float invW = 1.0f / p.w;
+		minPos = min(minPos, vec2(p.x * invW, p.y * invW));
+		maxPos = max(maxPos, vec2(p.x * invW, p.y * invW));
+		nearest = std::max(nearest, invW);
+	}
+	nearest *= 1.0f + DEPTH_BIAS;
+
+	int x0 = std::max((int)floor((minPos.x * 0.5f + 0.5f) * width), 0);
+	int x1 = std::min((int)floor((maxPos.x * 0.5f + 0.5f) * width), width - 1);
+	int y0 = std::max((int)floor((minPos.y * 0.5f + 0.5f) * height), 0);
+	int y1 = std::min((int)floor((maxPos.y * 0.5f + 0.5f) * height), height - 1);
+	if (x0 > x1 || y0 > y1)
+		return true; // off screen, left to frustum culling
+
+	for (int by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; ++by)
+		for (int bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; ++bx)
+		{
+			if (blockDepth[by * blockNumX + bx] > nearest)
+				continue; // the whole block is in front of the box
+			for (int y = std::max(y0, by * BLOCK_SIZE); y <= std::min(y1, (by + 1) * BLOCK_SIZE - 1); ++y)
+				for (int x = std::max(x0, bx * BLOCK_SIZE); x <= std::min(x1, (bx + 1) * BLOCK_SIZE - 1); ++x)
+					if (depth[y * width + x] <= nearest)
+						return true;
+		}
+	return false;
+}
+
+void OcclusionCuller::cull(const vector<BoundingBox> &bounds, vector<char> &visible)
+{
+	auto start = chrono::high_resolution_clock::now();
+	atomic<int> tested(0), occluded(0);
+	JobSystem::parallelFor(bounds.size(), [&](int begin, int end) {
+		int localTested = 0, localOccluded = 0;
+		for (int i = begin; i < end; ++i)
+		{
+			if (!visible[i])
+				continue;
+			localTested++;
+			if (!isVisible(bounds[i]))
+			{
+				visible[i] = 0;
+				localOccluded++;
+			}
+		}
+		tested += localTested;
+		occluded += localOccluded;
+	}, 256);
+	testedNum = tested;
+	occludedNum = occluded;
+
+	auto end = chrono::high_resolution_clock::now();
+	testTime = chrono::duration<float, milli>(end - start).count();
+}
@@ -0,0 +1,200 @@
+#include "../include/OcclusionQueries.h"
+
+OcclusionQueries::OcclusionQueries() :
+    frame(0),
+    boxVAO(0),
+    boxVBO(0),
+    boxEBO(0),
+    queryNum(0),
+    resultNum(0),
+    conditionalNum(0),
+    hitRate(0.0f),
+    latency(0.0f)
+{
+}
+
+OcclusionQueries::~OcclusionQueries()
+{
+    for (auto &iter : queries)
+        glDeleteQueries(1, &iter.second.id);
+    glDeleteVertexArrays(1, &boxVAO);
+    glDeleteBuffers(1, &boxVBO);
+    glDeleteBuffers(1, &boxEBO);
+}
+
+void OcclusionQueries::init()
+{
+    boxShader = make_shared<Shader>("./shaders/bounding_box.vert", "./shaders/shadow_mapping.frag");
+
+    float vertices[24] = {
+        -0.5f, -0.5f, -0.5f,   0.5f, -0.5f, -0.5f,  -0.5f,  0.5f, -0.5f,   0.5f,  0.5f, -0.5f,
+        -0.5f, -0.5f,  0.5f,   0.5f, -0.5f,  0.5f,  -0.5f,  0.5f,  0.5f,   0.5f,  0.5f,  0.5f
+    };
+    unsigned int indices[36] = {
+        0, 2, 1, 1, 2, 3,   4, 5, 6, 5, 7, 6,
+        0, 1, 4, 1, 5, 4,   2, 6, 3, 3, 6, 7,
+        0, 4, 2, 2, 4, 6,   1, 3, 5, 3, 7, 5
+    };
+    glGenVertexArrays(1, &boxVAO);
+    glGenBuffers(1, &boxVBO);
+    glGenBuffers(1, &boxEBO);
+    glBindVertexArray(boxVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, boxVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, boxEBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
+    glEnableVertexAttribArray(0);
+    glBindVertexArray(0);
+}
+
+void OcclusionQueries::render(const vector<shared_ptr<Object>> &objects, const mat4 &viewProjection,
+    const function<void(shared_ptr<Object>)> &drawObject)
+{
+    frame++;
+    readResults();
+    queryNum = 0;
+    conditionalNum = 0;
+
+    vector<shared_ptr<Object>> visibleObjects, occludedObjects;
+    for (auto &object : objects)
+    {
+        if (!object->isOcclusionQuery())
+        {
+            drawObject(object);
+            continue;
+        }
+
+        auto iter = queries.find(object.get());
+        if (iter == queries.end())
+        {
+            Query query;
+            query.object = object;
+            glGenQueries(1, &query.id);
+            query.pending = false;
+            query.visible = true;
+            query.issueFrame = frame;
+            iter = queries.insert({ object.get(), query }).first;
+        }
+
+        // a box crossing the near plane can not be tested
+        BoundingBox box = object->getBoundingBox();
+        bool nearCrossing = !box.valid;
+        for (int i = 0; i < 8 && !nearCrossing; ++i)
+        {
+            vec3 corner(i & 1 ? box.maxPos.x : box.minPos.x, i & 2 ? box.maxPos.y : box.minPos.y, i & 4 ? box.maxPos.z : box.minPos.z);
+            vec4 p = viewProjection * vec4(corner, 1.0f);
+            nearCrossing = p.z < -p.w;
+        }
+        if (nearCrossing)
+            iter->second.visible = true;
+
+        if (iter->second.visible)
+            visibleObjects.push_back(object);
+        else
+            occludedObjects.push_back(object);
+    }
+
+    // visible last time, the object itself is the query geometry
+    for (auto &object : visibleObjects)
+    {
+        Query &query = queries[object.get()];
+        if (query.pending)
+        {
+            drawObject(object);
+            continue;
+        }
+        glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, query.id);
+        drawObject(object);
+        glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+        query.pending = true;
+        query.issueFrame = frame;
+        queryNum++;
+    }
+
+    if (occludedObjects.empty())
+        return;
+
+    // occluded last time, test all boxes first
+    GLboolean depthMask;
+    glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glDisable(GL_CULL_FACE); // the inside of the box counts too
+    boxShader->use();
+    boxShader->setAttrMat4("viewProjection", viewProjection);
+    glBindVertexArray(boxVAO);
+    for (auto &object : occludedObjects)
+    {
+        Query &query = queries[object.get()];
+        if (query.pending)
+            continue;
+        glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, query.id);
+        drawBox(object->getBoundingBox());
+        glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+        query.pending = true;
+        query.issueFrame = frame;
+        queryNum++;
+    }
+    glBindVertexArray(0);
+    glEnable(GL_CULL_FACE);
+    glDepthMask(depthMask);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    // the GPU skips the draw if the box was hidden, the CPU does not wait
+    for (auto &object : occludedObjects)
+    {
+        glBeginConditionalRender(queries[object.get()].id, GL_QUERY_WAIT);
+        drawObject(object);
+        glEndConditionalRender();
+        conditionalNum++;
+    }
+}
+
+// collect finished queries without waiting, drop queries of deleted objects
+void OcclusionQueries::readResults()
+{
+    resultNum = 0;
+    int occludedNum = 0;
+    int latencySum = 0;
+    for (auto iter = queries.begin(); iter != queries.end();)
+    {
+        Query &query = iter->second;
+        if (query.object.expired())
+        {
+            glDeleteQueries(1, &query.id);
+            iter = queries.erase(iter);
+            continue;
+        }
+        if (query.pending)
+        {
+            GLint available = 0;
+            glGetQueryObjectiv(query.id, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                GLuint passed = 0;
+                glGetQueryObjectuiv(query.id, GL_QUERY_RESULT, &passed);
+                query.visible = passed != 0;
+                query.pending = false;
+                resultNum++;
+                occludedNum += !query.visible;
+                latencySum += frame - query.issueFrame;
+            }
+        }
+        ++iter;
+    }
+
+    if (resultNum > 0)
+    {
+        hitRate = (float)occludedNum / resultNum;
+        latency = (float)latencySum / resultNum;
+    }
+}
+
+void OcclusionQueries::drawBox(const BoundingBox &box)
+{
+    boxShader->setAttrVec3("boxCenter", box.center());
+    boxShader->setAttrVec3("boxSize", box.maxPos - box.minPos);
+    boxShader->setAttributes();
+    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
+}
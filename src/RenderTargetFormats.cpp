@@ -0,0 +1,72 @@
+#include "../include/RenderTargetFormats.h"
+#include <iostream>
+
+RenderTargetFormats RenderTargetFormats::quality()
+{
+    RenderTargetFormats formats;
+    formats.sceneColor = GL_RGB8;
+    formats.dirShadow = GL_DEPTH_COMPONENT24;
+    formats.pointShadow = GL_DEPTH_COMPONENT32F;
+    formats.RSMDepth = GL_DEPTH_COMPONENT24;
+    formats.RSMNormal = GL_RGB16F;
+    formats.RSMPosition = true;
+    formats.RSMFlux = GL_RGBA8;
+    formats.RSMIndirect = GL_RGBA16F;
+    return formats;
+}
+
+RenderTargetFormats RenderTargetFormats::bandwidth()
+{
+    RenderTargetFormats formats;
+    formats.sceneColor = GL_R11F_G11F_B10F;
+    formats.dirShadow = GL_DEPTH_COMPONENT24;
+    formats.pointShadow = GL_DEPTH_COMPONENT16;
+    formats.RSMDepth = GL_DEPTH_COMPONENT24;
+    formats.RSMNormal = GL_RG16_SNORM;
+    formats.RSMPosition = false;
+    formats.RSMFlux = GL_RGBA8;
+    formats.RSMIndirect = GL_R11F_G11F_B10F;
+    return formats;
+}
+
+int getBytesPerTexel(GLenum internalFormat)
+{
+    switch (internalFormat)
+    {
+    case GL_DEPTH_COMPONENT16:
+        return 2;
+    case GL_RGB8:
+    case GL_RGBA8:
+    case GL_R11F_G11F_B10F:
+    case GL_RG16_SNORM:
+    case GL_RG16F:
+    case GL_R32F:
+    case GL_DEPTH_COMPONENT24:
+    case GL_DEPTH_COMPONENT32F:
+    case GL_DEPTH24_STENCIL8:
+        return 4;
+    case GL_RGB16F:
+    case GL_RGBA16F:
+    case GL_RGBA16:
+    case GL_RG32F:
+    case GL_DEPTH32F_STENCIL8:
+        return 8;
+    case GL_RGB32F:
+    case GL_RGBA32F:
+        return 16;
+    }
+    std::cout << "Unknown render target format " << internalFormat << ", counted at 4 bytes a texel" << std::endl;
+    return 4;
+}
+
+GLenum getPixelFormat(GLenum internalFormat)
+{
+    switch (internalFormat)
+    {
+    case GL_DEPTH_COMPONENT16:
+    case GL_DEPTH_COMPONENT24:
+    case GL_DEPTH_COMPONENT32F:
+        return GL_DEPTH_COMPONENT;
+    }
+    return GL_RGBA;
+}
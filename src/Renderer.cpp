@@ -1,30 +1,120 @@
 #include <iostream>
+#include <algorithm>
+#include <bitset>
 #include "../include/Renderer.h"
 #include "../include/Utility.h"
 
+// box against the reach of a point light
+static bool intersectsSphere(const BoundingBox &box, const vec3 &center, float radius)
+{
+    if (!box.valid)
+        return true;
+    vec3 d = center - glm::clamp(center, box.minPos, box.maxPos);
+    return dot(d, d) <= radius * radius;
+}
+
 Renderer::Renderer() :
+    RSMBufferSize(1024),
+    temporalRSM(false),
+    temporalRSMSampleNum(32),
+    RSMHistoryLength(32),
+    RSMHistoryIndex(0),
+    RSMFrameIndex(0),
+    prevViewProjection(mat4(1.0f)),
+    prevUVScale(vec2(1.0f)),
+    RSMGatherPass(false),
+    RSMDownsample(2),
+    RSMGatherFBO(0),
+    VPLClustering(false),
+    vplClusters(nullptr),
+    RSMDirty(true),
     window(nullptr),
-    camera(nullptr),
     glfwWindow(nullptr),
     deltaTime(0.0f),
     lastFrame(0.0f),
+    camera(nullptr),
+    pbrShader(nullptr),
+    phongShader(nullptr),
     clearColor(vec3(0, 0, 0)),
+    shadowCaching(true),
+    RSMVersion(0),
+    shadowUpdateNum(0),
+    staticShadowCache(false),
+    staticDepthMaps(0),
+    staticCubeDepthMap(0),
+    staticCubeDepthMapFBO(0),
+    pointShadowMode(PointShadowMode::PerFace),
+    shadowPassTime(0.0f),
+    cascadeNum(0),
+    cascadeSplitLambda(0.75f),
+    shadowDistance(0.0f),
+    dirShadowMode(DirShadowMode::Layered),
+    lightSpaceUBO(0),
+    depthMapLayeredFBO(0),
+    staticDepthMapLayeredFBO(0),
+    dirShadowDrawNum(0),
+    shadowAtlas(false),
+    atlasMaxTileSize(1024),
+    atlasDepthMap(0),
+    staticAtlasDepthMap(0),
+    atlasFBO(0),
+    staticAtlasFBO(0),
+    atlasTileBuffer(0),
+    shadowFilter(ShadowFilter::PCF),
+    momentBlurRadius(2),
+    lightBleedReduction(0.2f),
+    evsmExponents(vec2(40.0f, 5.0f)),
+    momentMaps(0),
+    momentFBO(0),
+    updatedDirLayers(0),
+    shadowDirtyRegions(true),
+    dirUpdatedTexels(0.0f),
+    dirShadowUpdateArea(0.0f),
+    depthPositionStream(true),
+    depthFetchBytes(0),
+    interleavedFetchBytes(0),
+    pointLightNumMax(10),
+    dirLightNumMax(5),
     dirShadowWidth(2048),
     dirShadowHeight(2048),
     pointShadowWidth(512),
     pointShadowHeight(512),
     lightNearPlane(1.0f),
     lightFarPlane(100.0f),
-    dirLightNumMax(5),
-    pointLightNumMax(10),
-    RSMBufferSize(1024),
-    gui(nullptr),
     skybox(nullptr),
-    pbrShader(nullptr),
-    phongShader(nullptr),
-    pbrMode(false)
+    IBLBudget(1.0f),
+    gui(nullptr),
+    frustumCulling(true),
+    gpuCulling(false),
+    cullerDirty(false),
+    gpuCuller(nullptr),
+    occlusionCulling(false),
+    occlusionCuller(nullptr),
+    occlusionQuery(false),
+    occlusionQueries(nullptr),
+    depthPrePass(false),
+    queryFrame(0),
+    shadedSampleNum(0),
+    mainPassTime(0.0f),
+    renderPath(RenderPath::Forward),
+    gBuffer(0),
+    clusteredShading(false),
+    lightClusters(nullptr),
+    pbrMode(false),
+    dynamicResolution(false),
+    resolutionScaler(nullptr),
+    upscaleFilter(UpscaleFilter::Bilinear),
+    sharpness(0.5f),
+    targetWidth(0),
+    targetHeight(0),
+    renderWidth(0),
+    renderHeight(0),
+    targetFormats(RenderTargetFormats::quality())
 {
-    depthMapFBOs.resize(dirLightNumMax, 0);
+    pointShadowVersions.resize(pointLightNumMax, 0);
+    pointStaticVersions.resize(pointLightNumMax, 0);
+    pointCasterNums.resize(pointLightNumMax, 0);
+    pointFaceDrawNums.resize(pointLightNumMax, 0);
 }
 
 
@@ -33,8 +123,28 @@ Renderer::~Renderer()
     for (int i = 0; i < depthMapFBOs.size(); ++i)
         if (depthMapFBOs[i] != 0)
             glDeleteFramebuffers(1, &depthMapFBOs[i]);
+    glDeleteFramebuffers(1, &depthMapLayeredFBO);
+    glDeleteBuffers(1, &lightSpaceUBO);
 
     glDeleteFramebuffers(1, &cubeDepthMapFBO);
+    if (staticDepthMaps)
+    {
+        glDeleteFramebuffers(staticDepthMapFBOs.size(), staticDepthMapFBOs.data());
+        glDeleteFramebuffers(1, &staticDepthMapLayeredFBO);
+        glDeleteFramebuffers(1, &staticCubeDepthMapFBO);
+        glDeleteTextures(1, &staticDepthMaps);
+        glDeleteTextures(1, &staticCubeDepthMap);
+    }
+    glDeleteQueries(4, &mainPassQueries[0][0]);
+    glDeleteQueries(2, shadowPassQueries);
+    glDeleteFramebuffers(cubeFaceFBOs.size(), cubeFaceFBOs.data());
+    glDeleteFramebuffers(staticCubeFaceFBOs.size(), staticCubeFaceFBOs.data());
+    glDeleteFramebuffers(1, &atlasFBO);
+    glDeleteFramebuffers(1, &staticAtlasFBO);
+    glDeleteTextures(1, &staticAtlasDepthMap); // the live atlas belongs to atlasShadowMap
+    glDeleteBuffers(1, &atlasTileBuffer);
+    glDeleteFramebuffers(1, &momentFBO);
+    glDeleteTextures(1, &momentMaps);
 }
 
 void Renderer::init(string windowName, int windowWidth, int windowHeight)
@@ -43,6 +153,9 @@ void Renderer::init(string windowName, int windowWidth, int windowHeight)
 	//window->setCamera(camera);
     glfwWindow = window->getGLFWWindow();
 
+    // worker threads for loading and culling, the calling thread owns the GL context
+    JobSystem::init();
+
     // configure global opengl state
     // -----------------------------
     glEnable(GL_DEPTH_TEST);
@@ -52,15 +165,22 @@ void Renderer::init(string windowName, int windowWidth, int windowHeight)
 
     shadowMap = make_shared<Texture>();
     cubeShadowMap = make_shared<Texture>();
+    atlasShadowMap = make_shared<Texture>(0, TextureType::TEXTURE_2D);
+    shadowMoments = make_shared<Texture>(0, TextureType::TEXTURE_2D_ARRAY);
     renderTexture = make_shared<Texture>();
 
     // loading shader
     depthMapShader = make_shared<Shader>("./shaders/shadow_mapping.vert", "./shaders/shadow_mapping.frag");
     cubeDepthMapShader = make_shared<Shader>("./shaders/point_shadows_depth.vert", "./shaders/point_shadows_depth.frag", "./shaders/point_shadows_depth.geom");
+    pointFaceShader = make_shared<Shader>("./shaders/point_shadows_face.vert", "./shaders/point_shadows_depth.frag");
+    layeredDepthShader = make_shared<Shader>("./shaders/shadow_layered.vert", "./shaders/shadow_mapping.frag", "./shaders/shadow_layered.geom");
+    depthPrePassShader = make_shared<Shader>("./shaders/depth_prepass.vert", "./shaders/shadow_mapping.frag");
     phongShader = Shader::phong();
     addShader("phong", phongShader);
-    screenShader = make_shared<Shader>("./shaders/texture_to_screen.vert", "./shaders/texture_to_screen.frag");
+    screenShader = make_shared<Shader>("./shaders/texture_to_screen.vert", "./shaders/upscale.frag");
     screenShader->setTexture("screenTexture", 0, renderTexture);
+    screenShader->setAttrI("upscaleFilter", (int)upscaleFilter);
+    screenShader->setAttrF("sharpness", sharpness);
 
     pair<unsigned int, unsigned int> bufferIDs = createFrameBuffer(windowWidth, windowHeight);
     framebuffer = bufferIDs.first;
@@ -68,18 +188,31 @@ void Renderer::init(string windowName, int windowWidth, int windowHeight)
     bufferIDs = createFrameBuffer(windowWidth, windowHeight);
     postProcessFB = bufferIDs.first;
     postProcessRenderTexture = bufferIDs.second;
+    targetWidth = renderWidth = windowWidth;
+    targetHeight = renderHeight = windowHeight;
     screenQuad.bind();
 
     initShadowMap();
     initCubeShadowMap();
     phongShader->setTexture("shadowMap", 0, shadowMap);
     phongShader->setTexture("cubeDepthMap", 1, cubeShadowMap);
+    phongShader->setTexture("shadowAtlasMap", 12, atlasShadowMap);
+    phongShader->setTexture("shadowMoments", 13, shadowMoments);
     initialRSMBuffers();
     phongShader->setTexture("RSM_Depth", 5, RSM_depth);
     phongShader->setTexture("RSM_Position", 6, RSM_position);
     phongShader->setTexture("RSM_Normal", 7, RSM_normal);
     phongShader->setTexture("RSM_Flux", 8, RSM_flux);
 
+    // main pass statistics, double buffered so reading never stalls
+    glGenQueries(4, &mainPassQueries[0][0]);
+    glGenQueries(2, shadowPassQueries);
+    queryIssued[0] = queryIssued[1] = false;
+    samplesIssued[0] = samplesIssued[1] = false;
+    shadowQueryIssued[0] = shadowQueryIssued[1] = false;
+    resolutionScaler = make_shared<ResolutionScaler>();
+    resolutionScaler->init();
+
     // print gl versions
     //const GLubyte *renderer = glGetString(GL_RENDERER);
     //const GLubyte *vendor = glGetString(GL_VENDOR);
@@ -115,6 +248,9 @@ void Renderer::run()
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+        // GL work queued by jobs
+        JobSystem::processMainThreadJobs();
+
         // input
         processInput();
 
@@ -122,48 +258,128 @@ void Renderer::run()
         if (gui)
             gui->show();
 
+        // scene resolution of this frame
+        if (dynamicResolution)
+            resolutionScaler->beginFrame();
+        updateRenderSize();
+
+        // world matrices and bounds of moved objects
+        TransformSystem::update();
+        updateBounds();
+
+        // upload object bounds for GPU culling
+        if (gpuCulling)
+        {
+            if (cullerDirty)
+            {
+                gpuCuller->setObjects(scene.meshes.getData());
+                cullerDirty = false;
+            }
+            gpuCuller->updateBounds();
+        }
+
+        // bin point lights into view clusters
+        if (clusteredShading)
+            updateLightClusters();
+
         // render shadow map
         glEnable(GL_DEPTH_TEST);
+        shadowUpdateNum = 0;
+        depthFetchBytes = 0;
+        interleavedFetchBytes = 0;
+        glBeginQuery(GL_TIME_ELAPSED, shadowPassQueries[queryFrame]);
         renderShadowMap();
+        glEndQuery(GL_TIME_ELAPSED);
+        readShadowPassQuery();
         renderRSMBuffers();
+        changedBounds.clear();
+        changedStaticBounds.clear();
+
+        // IBL precompute slice of a new environment map
+        updateEnvironmentMap();
 
         // set shader uniforms
-        for (auto &shader_ : shaders)
+        vec2 screenSize(renderWidth, renderHeight);
+        for (auto &shader : scene.shaders.getData())
         {
-            shared_ptr<Shader>& shader = shader_.second;
             // set shader camera
             shader->setCamera(*camera);
 
-            // set shader light
-            shader->setAttrI("lightNum", lights.size());
+            // set shader light, point lights come from the cluster buffers in clustered mode
             int n = 0;
-            for (auto &light : lights)
+            for (auto &light : scene.lights.getData())
             {
-                light.second->setShaderAttr(shader, n++);
+                if (!clusteredShading || light->getType() != LightType::Point)
+                    light->setShaderAttr(shader, n++);
             }
+            shader->setAttrI("lightNum", n);
+            shader->setAttrB("clusteredShading", clusteredShading);
+            if (clusteredShading)
+                lightClusters->setShaderAttr(shader, screenSize);
         }
         
         // render scene
         // render to texture
         glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
-        glViewport(0, 0, window->getWidth(), window->getHeight());
+        glViewport(0, 0, renderWidth, renderHeight);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glClearColor(clearColor.x, clearColor.y, clearColor.z, 1.0); 
         glEnable(GL_DEPTH_TEST);
-        for (auto &obj : renderObjects)
-            draw(obj.second);
+        mat4 viewProjection = camera->getProjectionMatrix() * camera->getViewMatrix();
+        vector<shared_ptr<Object>> drawList;
+        if (gpuCulling)
+        {
+            gpuCuller->cull(viewProjection, true);
+            drawList = scene.meshes.getData();
+        }
+        else
+            drawList = getVisibleObjects(viewProjection);
+
+        // the deferred path only has a phong lighting pass
+        bool deferred = renderPath == RenderPath::Deferred && !pbrMode;
+        if (depthPrePass && !deferred)
+            renderDepthPrePass(drawList);
+        bool gather = RSMGatherPass && !deferred && !pbrMode;
+        bool temporal = temporalRSM && !gather && !deferred && !pbrMode;
+        if (temporal)
+            beginTemporalRSM();
+        if (gather)
+            beginRSMGather();
+        beginMainPassQuery();
+        if (deferred)
+            renderDeferred(drawList, viewProjection);
+        else
+            drawObjects(drawList, viewProjection);
+        if (gather)
+            renderRSMGather();
+        endMainPassQuery();
+        if (temporal)
+            endTemporalRSM(viewProjection);
+        if (depthPrePass && !deferred)
+        {
+            glDepthMask(GL_TRUE);
+            glDepthFunc(GL_LESS);
+        }
+
         if (skybox) // draw skybox
             skybox->drawAsSkybox(mat4(mat3(camera->getViewMatrix())), camera->getProjectionMatrix());
+        // depth pyramid for next frame's occlusion test
+        if (gpuCulling)
+            gpuCuller->buildHiZ(framebuffer, renderWidth, renderHeight, targetWidth, targetHeight, viewProjection);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
         // post processing
         postProcessing();
-        // render texture to screen
+        // render texture to screen, upscaled from the render size
+        glViewport(0, 0, window->getWidth(), window->getHeight());
         glDisable(GL_DEPTH_TEST);
         glClear(GL_COLOR_BUFFER_BIT);
+        screenShader->setAttrVec2("uvScale", getUVScale());
         screenQuad.draw(screenShader);
 
         if(gui)
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        if (dynamicResolution)
+            resolutionScaler->endFrame();
 
         // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
         glfwSwapBuffers(glfwWindow);
@@ -188,51 +404,119 @@ void Renderer::draw(shared_ptr<Object> object, shared_ptr<Shader> shader)
     }
 }
 
+// depth passes, instanced when instanceNum is above 0, every vertex a draw uses counts as fetched once
+void Renderer::drawDepth(const shared_ptr<Object> &object, shared_ptr<Shader> shader, int instanceNum)
+{
+    if (instanceNum > 0)
+        object->drawInstanced(shader, instanceNum, depthPositionStream);
+    else
+        object->drawDepth(shader, depthPositionStream);
+    long long drawNum = std::max(instanceNum, 1);
+    interleavedFetchBytes += drawNum * object->getVertexFetchBytes();
+    depthFetchBytes += drawNum * (depthPositionStream ? object->getDepthFetchBytes() : object->getVertexFetchBytes());
+}
+
 void Renderer::addResources()
 {
 }
 
-void Renderer::addObject(string meshName, shared_ptr<Object> mesh)
+Entity Renderer::addObject(string meshName, shared_ptr<Object> mesh)
 {
-    auto iter = renderObjects.find(meshName);
+    Entity e = scene.create(meshName);
     // mesh name already exists
-    if (iter != renderObjects.end())
+    if (!e.valid())
     {
         cout << "Add Object Failed! Object name \"" << meshName << "\" already exists!" << endl;
-        return;
+        return e;
     }
 
     mesh->bind();
-    renderObjects[meshName] = mesh;
+    scene.meshes.insert(e, mesh);
+    scene.transforms.insert(e, mesh->getTransform());
+    scene.bounds.insert(e, mesh->getBoundingBox());
+    changedBounds.push_back(mesh->getBoundingBox());
+    if (mesh->isStatic())
+        changedStaticBounds.push_back(mesh->getBoundingBox());
+    cullerDirty = true;
+    RSMDirty = true;
+    return e;
 }
 
-void Renderer::addLight(string lightName, shared_ptr<Light> light)
+Entity Renderer::addLight(string lightName, shared_ptr<Light> light)
 {
-    auto iter = lights.find(lightName);
+    Entity e = scene.create(lightName);
     // light name already exists
-    if (iter != lights.end())
+    if (!e.valid())
     {
         cout << "Add Light Failed! Light name \"" << lightName << "\" already exists!" << endl;
-        return;
+        return e;
     }
-    lights[lightName] = light;
-    if (light->getType() == LightType::Directional)
-        dirLights[lightName] = dynamic_pointer_cast<DirectionalLight>(light);
-    else if (light->getType() == LightType::Point)
-        pointLights[lightName] = dynamic_pointer_cast<PointLight>(light);
+    scene.lights.insert(e, light);
+    return e;
 }
 
-void Renderer::addShader(string shaderName, shared_ptr<Shader> shader_)
+Entity Renderer::addShader(string shaderName, shared_ptr<Shader> shader_)
 {
-    auto iter = shaders.find(shaderName);
+    Entity e = scene.create(shaderName);
     // shader name already exists
-    if (iter != shaders.end())
+    if (!e.valid())
     {
         cout << "Add Shader Failed! Shader name \"" << shaderName << "\" already exists!" << endl;
-        return;
+        return e;
+    }
+
+    scene.shaders.insert(e, shader_);
+    return e;
+}
+
+void Renderer::removeEntity(Entity e)
+{
+    if (scene.meshes.has(e))
+        cullerDirty = RSMDirty = true;
+    if (scene.bounds.has(e))
+    {
+        changedBounds.push_back(*scene.bounds.get(e));
+        if ((*scene.meshes.get(e))->isStatic())
+            changedStaticBounds.push_back(*scene.bounds.get(e));
     }
+    scene.destroy(e);
+}
+
+Entity Renderer::findEntity(const string &name)
+{
+    return scene.find(name);
+}
 
-    shaders[shaderName] = shader_;
+// world bounds only change with the transform
+void Renderer::updateBounds()
+{
+    if (TransformSystem::getUpdatedNum() == 0)
+        return;
+    vector<BoundingBox> &bounds = scene.bounds.getData();
+    const vector<Entity> &entities = scene.bounds.getEntities();
+    mutex changedMutex;
+    JobSystem::parallelFor(bounds.size(), [&](int begin, int end) {
+        // both bounds, a caster leaving a light volume changes its shadow too
+        vector<BoundingBox> changed, changedStatic;
+        for (int i = begin; i < end; ++i)
+        {
+            if (TransformSystem::isChanged(*scene.transforms.get(entities[i])))
+            {
+                shared_ptr<Object> &mesh = *scene.meshes.get(entities[i]);
+                vector<BoundingBox> &out = mesh->isStatic() ? changedStatic : changed;
+                out.push_back(bounds[i]);
+                bounds[i] = mesh->getBoundingBox();
+                out.push_back(bounds[i]);
+            }
+        }
+        if (!changed.empty() || !changedStatic.empty())
+        {
+            lock_guard<mutex> lock(changedMutex);
+            changedBounds.insert(changedBounds.end(), changed.begin(), changed.end());
+            changedBounds.insert(changedBounds.end(), changedStatic.begin(), changedStatic.end());
+            changedStaticBounds.insert(changedStaticBounds.end(), changedStatic.begin(), changedStatic.end());
+        }
+    }, 1024);
 }
 
 void Renderer::addSkybox(shared_ptr<CubeMap> skybox_)
@@ -247,16 +531,36 @@ void Renderer::addGui(shared_ptr<Gui> gui_)
 
 void Renderer::addEnvironmentMap(shared_ptr<CubeMap> envMap_)
 {
-    envMap_->preComputeMaps();
-    envMap = envMap_;
+    // the BRDF LUT does not depend on the environment, a finished one is reused
+    envMap_->beginPreCompute(envMap && envMap->isPreComputed() ? envMap->getBrdfLUTTextureID() : nullptr);
+    pendingEnvMap = envMap_;
 
     if (!pbrShader)
         pbrShader = Shader::pbr();
+}
 
-    pbrShader->setTexture("irradianceMap", 7, envMap_->getIrradianceMap());
-    pbrShader->setTexture("prefilterMap", 8, envMap_->getPrefilterMapID());
-    pbrShader->setTexture("brdfLUT", 9, envMap_->getBrdfLUTTextureID());
+// the pending map replaces the bound one once it is done, or right away for its SH ambient when the bound
+// one is not done either
+void Renderer::updateEnvironmentMap()
+{
+    if (pendingEnvMap)
+    {
+        pendingEnvMap->preComputeStep(IBLBudget);
+        if (!envMap || !envMap->isPreComputed() || pendingEnvMap->isPreComputed())
+            envMap = pendingEnvMap;
+        if (pendingEnvMap->isPreComputed())
+            pendingEnvMap = nullptr;
+    }
+    if (!envMap || !pbrShader)
+        return;
 
+    pbrShader->setAttrB("IBLReady", envMap->isPreComputed());
+    pbrShader->setTexture("irradianceMap", 7, envMap->getIrradianceMap());
+    pbrShader->setTexture("prefilterMap", 8, envMap->getPrefilterMapID());
+    pbrShader->setTexture("brdfLUT", 9, envMap->getBrdfLUTTextureID());
+    const vector<vec3> &sh = envMap->getSHIrradiance();
+    for (int i = 0; i < 9; ++i)
+        pbrShader->setAttrVec3("SHIrradiance[" + to_string(i) + "]", sh[i]);
 }
 
 // Add postprocessing shader by sequence
@@ -289,8 +593,7 @@ void Renderer::setPBRMode(bool b)
     pbrMode = b;
     if (pbrMode)
     {
-        auto iter = shaders.find("pbrShader");
-        if (iter == shaders.end())
+        if (!scene.find("pbrShader").valid())
         {
             pbrShader = Shader::pbr();
             addShader("pbrShader", pbrShader);
@@ -298,55 +601,491 @@ void Renderer::setPBRMode(bool b)
     }
     else
     {
-        auto iter = shaders.find("pbrShader");
-        if (iter != shaders.end())
-            shaders.erase(iter);
+        scene.destroy(scene.find("pbrShader"));
+    }
+}
+
+void Renderer::setFrustumCulling(bool b)
+{
+    frustumCulling = b;
+}
+
+void Renderer::setDepthPrePass(bool b)
+{
+    depthPrePass = b;
+}
+
+// cluster buffers are created on first use, call after init()
+void Renderer::setClusteredShading(bool b)
+{
+    clusteredShading = b;
+    if (clusteredShading && !lightClusters)
+    {
+        lightClusters = make_shared<LightClusters>();
+        lightClusters->init();
+    }
+}
+
+void Renderer::updateLightClusters()
+{
+    vector<shared_ptr<PointLight>> pointLights;
+    for (auto &light : scene.lights.getData())
+        if (light->getType() == LightType::Point)
+            pointLights.push_back(static_pointer_cast<PointLight>(light));
+
+    lightClusters->assign(pointLights, camera->getViewMatrix(), camera->getProjectionMatrix(),
+        camera->getNear(), camera->getFar(), shadowAtlas ? (int)pointLights.size() : pointLightNumMax);
+    lightClusters->upload();
+    lightClusters->bind();
+}
+
+// the G-buffer is created on first use, call after init()
+void Renderer::setRenderPath(RenderPath path)
+{
+    renderPath = path;
+    if (renderPath == RenderPath::Deferred && !gBuffer)
+        initGBuffer();
+}
+
+void Renderer::initGBuffer()
+{
+    glGenFramebuffers(1, &gBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+
+    GLuint textures[3];
+    glGenTextures(3, textures);
+    for (GLuint texture : textures)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    gAlbedoSpec = make_shared<Texture>(textures[0], TextureType::TEXTURE_2D);
+    gNormal = make_shared<Texture>(textures[1], TextureType::TEXTURE_2D);
+    gDepth = make_shared<Texture>(textures[2], TextureType::TEXTURE_2D);
+    allocateGBuffer(targetWidth, targetHeight);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gAlbedoSpec->getID(), 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormal->getID(), 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, gDepth->getID(), 0);
+    GLuint attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    glDrawBuffers(2, attachments);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::FRAMEBUFFER:: G-buffer is not complete!" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    gBufferShader = make_shared<Shader>("./shaders/phong.vert", "./shaders/gbuffer.frag");
+    deferredDirShader = make_shared<Shader>("./shaders/texture_to_screen.vert", "./shaders/deferred_directional.frag");
+    deferredPointShader = make_shared<Shader>("./shaders/texture_to_screen.vert", "./shaders/deferred_point.frag");
+    for (auto &shader : { deferredDirShader, deferredPointShader })
+    {
+        shader->setTexture("shadowMap", 0, shadowMap);
+        shader->setTexture("cubeDepthMap", 1, cubeShadowMap);
+        shader->setTexture("shadowAtlasMap", 12, atlasShadowMap);
+        shader->setTexture("shadowMoments", 13, shadowMoments);
+        shader->setTexture("gAlbedoSpec", 2, gAlbedoSpec);
+        shader->setTexture("gNormal", 3, gNormal);
+        shader->setTexture("gDepth", 4, gDepth);
+    }
+    deferredDirShader->setTexture("RSM_Depth", 5, RSM_depth);
+    deferredDirShader->setTexture("RSM_Position", 6, RSM_position);
+    deferredDirShader->setTexture("RSM_Normal", 7, RSM_normal);
+    deferredDirShader->setTexture("RSM_Flux", 8, RSM_flux);
+    // receive camera, light and shadow uniforms with the other scene shaders
+    addShader("deferredDirectional", deferredDirShader);
+    addShader("deferredPoint", deferredPointShader);
+}
+
+// storage of the G-buffer textures, also used to resize them in place
+void Renderer::allocateGBuffer(int width, int height)
+{
+    // albedo and specular intensity
+    glBindTexture(GL_TEXTURE_2D, gAlbedoSpec->getID());
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    // octahedral normal and shininess
+    glBindTexture(GL_TEXTURE_2D, gNormal->getID());
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16, width, height, 0, GL_RGBA, GL_UNSIGNED_SHORT, NULL);
+    // depth, same format as the render target so it can be blitted, positions are rebuilt from it
+    glBindTexture(GL_TEXTURE_2D, gDepth->getID());
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// geometry pass into the G-buffer, then one full screen pass for directional lights
+// and one scissored pass per point light, clustered point lights are done in the full screen pass
+void Renderer::renderDeferred(const vector<shared_ptr<Object>> &objects, const mat4 &viewProjection)
+{
+    int width = renderWidth;
+    int height = renderHeight;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    gBufferShader->setCamera(*camera);
+    drawObjects(objects, viewProjection, gBufferShader);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glDisable(GL_DEPTH_TEST);
+    mat4 invViewProjection = inverse(viewProjection);
+    deferredDirShader->setAttrMat4("invViewProjection", invViewProjection);
+    screenQuad.draw(deferredDirShader);
+
+    if (!clusteredShading)
+    {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glEnable(GL_SCISSOR_TEST);
+        deferredPointShader->setAttrMat4("invViewProjection", invViewProjection);
+        int lightIndex = 0;
+        int pointLightIndex = 0;
+        for (auto &light : scene.lights.getData())
+        {
+            if (light->getType() == LightType::Point)
+            {
+                shared_ptr<PointLight> pointLight = static_pointer_cast<PointLight>(light);
+                ivec4 rect;
+                if (getScissorRect(pointLight->getPos(), pointLight->getRange(), viewProjection, rect))
+                {
+                    glScissor(rect.x, rect.y, rect.z, rect.w);
+                    deferredPointShader->setAttrI("lightIndex", lightIndex);
+                    deferredPointShader->setAttrI("pointLightIndex", pointLightIndex);
+                    screenQuad.draw(deferredPointShader);
+                }
+                pointLightIndex++;
+            }
+            lightIndex++;
+        }
+        glDisable(GL_SCISSOR_TEST);
+        glDisable(GL_BLEND);
+    }
+
+    // scene depth for the skybox and the Hi-Z pyramid
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glEnable(GL_DEPTH_TEST);
+}
+
+// pixel rect (x, y, width, height) covering a sphere, false if it is not visible
+bool Renderer::getScissorRect(const vec3 &center, float radius, const mat4 &viewProjection, ivec4 &rect)
+{
+    int width = renderWidth;
+    int height = renderHeight;
+    Frustum frustum(viewProjection);
+    if (!frustum.intersects(center, radius))
+        return false;
+
+    // project the corners of the sphere's bounding box, the whole screen if one is behind the camera
+    vec2 minPos(1.0f), maxPos(-1.0f);
+    for (int i = 0; i < 8; ++i)
+    {
+        vec3 corner = center + radius * vec3(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f);
+        vec4 p = viewProjection * vec4(corner, 1.0f);
+        if (p.w <= 0.0f)
+        {
+            rect = ivec4(0, 0, width, height);
+            return true;
+        }
+        minPos = min(minPos, vec2(p) / p.w);
+        maxPos = max(maxPos, vec2(p) / p.w);
+    }
+    minPos = clamp(minPos * 0.5f + 0.5f, vec2(0.0f), vec2(1.0f));
+    maxPos = clamp(maxPos * 0.5f + 0.5f, vec2(0.0f), vec2(1.0f));
+
+    int x0 = (int)(minPos.x * width);
+    int y0 = (int)(minPos.y * height);
+    int x1 = (int)ceil(maxPos.x * width);
+    int y1 = (int)ceil(maxPos.y * height);
+    if (x1 <= x0 || y1 <= y0)
+        return false;
+    rect = ivec4(x0, y0, x1 - x0, y1 - y0);
+    return true;
+}
+
+// test the packed world bounds in parallel, draw calls stay on this thread
+vector<shared_ptr<Object>> Renderer::getVisibleObjects(const mat4 &viewProjection)
+{
+    const vector<BoundingBox> &bounds = scene.bounds.getData();
+    const vector<Entity> &entities = scene.bounds.getEntities();
+    vector<char> visible(bounds.size(), 1);
+    if (frustumCulling)
+    {
+        Frustum frustum(viewProjection);
+        JobSystem::parallelFor(bounds.size(), [&](int begin, int end) {
+            for (int i = begin; i < end; ++i)
+                visible[i] = frustum.intersects(bounds[i]);
+        }, 1024);
+    }
+    if (occlusionCulling)
+        cullOccluded(viewProjection, visible);
+
+    // front to back, so near surfaces fill the depth buffer first
+    vector<pair<float, int>> order;
+    vec3 cameraPos = camera->getPos();
+    for (int i = 0; i < (int)bounds.size(); ++i)
+    {
+        if (!visible[i])
+            continue;
+        vec3 d = bounds[i].valid ? bounds[i].center() - cameraPos : vec3(0.0f);
+        order.push_back({ dot(d, d), i });
+    }
+    if (depthPrePass || renderPath == RenderPath::Deferred)
+        sort(order.begin(), order.end());
+
+    vector<shared_ptr<Object>> objects;
+    for (auto &item : order)
+        objects.push_back(*scene.meshes.get(entities[item.second]));
+    return objects;
+}
+
+// rasterize flagged and large visible objects as occluders, then test every visible box against them
+void Renderer::cullOccluded(const mat4 &viewProjection, vector<char> &visible)
+{
+    const vector<BoundingBox> &bounds = scene.bounds.getData();
+    const vector<Entity> &entities = scene.bounds.getEntities();
+    occlusionCuller->begin(viewProjection);
+    for (int i = 0; i < (int)bounds.size(); ++i)
+    {
+        if (!visible[i])
+            continue;
+        shared_ptr<Object> object = *scene.meshes.get(entities[i]);
+        if (!object->isOccluder() && !occlusionCuller->selectOccluder(bounds[i], object->getTriangleNum()))
+            continue;
+        for (int j = 0; j < object->getSubMeshNum(); ++j)
+            occlusionCuller->addOccluder(object->getVertices().data(), object->getIndices(j).data(),
+                object->getIndexNum(j) / 3, object->getTransMat());
+    }
+    occlusionCuller->rasterize();
+    occlusionCuller->cull(bounds, visible);
+}
+
+// main pass draw, opted in objects go through occlusion queries,
+// GPU culling draws the compacted commands of the last cull instead
+void Renderer::drawObjects(const vector<shared_ptr<Object>> &objects, const mat4 &viewProjection, shared_ptr<Shader> shader)
+{
+    if (gpuCulling)
+    {
+        gpuCuller->draw(shader ? shader : (pbrMode ? pbrShader : phongShader));
+        return;
+    }
+    if (!occlusionQuery)
+    {
+        for (auto &object : objects)
+            draw(object, shader);
+        return;
+    }
+    occlusionQueries->render(objects, viewProjection, [&](shared_ptr<Object> object) { draw(object, shader); });
+}
+
+// lay down depth with a position only shader, the main pass then shades every pixel once
+void Renderer::renderDepthPrePass(const vector<shared_ptr<Object>> &objects)
+{
+    depthPrePassShader->setCamera(*camera);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    if (gpuCulling)
+        gpuCuller->draw(depthPrePassShader, depthPositionStream, false);
+    else
+    {
+        for (auto &object : objects)
+            drawDepth(object, depthPrePassShader);
+    }
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+    // depth is final, only the visible surface passes
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_FALSE);
+}
+
+// only one occlusion query can be active, the samples query gives way to occlusion queries
+void Renderer::beginMainPassQuery()
+{
+    if (!occlusionQuery)
+        glBeginQuery(GL_SAMPLES_PASSED, mainPassQueries[queryFrame][0]);
+    glBeginQuery(GL_TIME_ELAPSED, mainPassQueries[queryFrame][1]);
+}
+
+// results of the other query pair are one frame old and normally ready
+void Renderer::endMainPassQuery()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+    if (!occlusionQuery)
+        glEndQuery(GL_SAMPLES_PASSED);
+    queryIssued[queryFrame] = true;
+    samplesIssued[queryFrame] = !occlusionQuery;
+
+    queryFrame = 1 - queryFrame;
+    if (!queryIssued[queryFrame])
+        return;
+    GLint available = 0;
+    glGetQueryObjectiv(mainPassQueries[queryFrame][1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available)
+    {
+        GLuint64 samples = 0, time;
+        if (samplesIssued[queryFrame])
+            glGetQueryObjectui64v(mainPassQueries[queryFrame][0], GL_QUERY_RESULT, &samples);
+        glGetQueryObjectui64v(mainPassQueries[queryFrame][1], GL_QUERY_RESULT, &time);
+        shadedSampleNum = samples;
+        mainPassTime = time / 1000000.0f;
+    }
+}
+
+// the query of the other frame slot is one frame old
+void Renderer::readShadowPassQuery()
+{
+    shadowQueryIssued[queryFrame] = true;
+    int other = 1 - queryFrame;
+    if (!shadowQueryIssued[other])
+        return;
+    GLint available = 0;
+    glGetQueryObjectiv(shadowPassQueries[other], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available)
+    {
+        GLuint64 time;
+        glGetQueryObjectui64v(shadowPassQueries[other], GL_QUERY_RESULT, &time);
+        shadowPassTime = time / 1000000.0f;
+    }
+}
+
+void Renderer::setOcclusionCulling(bool b)
+{
+    occlusionCulling = b;
+    if (occlusionCulling && !occlusionCuller)
+        occlusionCuller = make_shared<OcclusionCuller>();
+}
+
+// needs an OpenGL context, call after init()
+void Renderer::setOcclusionQueries(bool b)
+{
+    occlusionQuery = b;
+    if (occlusionQuery && !occlusionQueries)
+    {
+        occlusionQueries = make_shared<OcclusionQueries>();
+        occlusionQueries->init();
+    }
+}
+
+// GPU culling uses compute shaders and multi draw indirect of OpenGL 4.3, the draw counts come from
+// the GPU on 4.6, call after init()
+void Renderer::setGPUCulling(bool b)
+{
+    gpuCulling = b;
+    if (gpuCulling && !gpuCuller)
+    {
+        gpuCuller = make_shared<GPUCuller>();
+        gpuCuller->init();
     }
+    cullerDirty = true;
 }
 
 void Renderer::renderShadowMap()
 {
     // render directional light shadow map
-    mat4 lightProjection, lightView;
+    mat4 lightProjection;
     mat4 lightSpaceMatrix;
+    vector<shared_ptr<Light>> layerLights;
+    vector<mat4> layerMatrices;
     int dirLightNum = 0;
-    glCullFace(GL_FRONT); // use cull front face to avoid peter panning
-    glViewport(0, 0, dirShadowWidth, dirShadowHeight);
-    for (auto &light : dirLights)
-    {
-        shared_ptr<DirectionalLight> dirLight = light.second;
-        lightProjection = ortho(-30.0f, 30.0f, -30.0f, 30.0f, lightNearPlane, lightFarPlane);
-        lightView = lookAt(-dirLight->getDir() * vec3(20.0f), vec3(0.0f), vec3(0.0, 1.0, 0.0));
-        lightSpaceMatrix = lightProjection * lightView;
-        depthMapShader->setAttrMat4("lightSpaceMatrix", lightSpaceMatrix);
-        for (auto &shader_ : shaders)
+    int layerNum = std::max(cascadeNum, 1);
+    if (cascadeNum > 0)
+        updateCascadeSplits();
+    for (auto &shader : scene.shaders.getData())
+    {
+        shader->setAttrI("cascadeNum", layerNum);
+        shader->setAttrI("shadowFilter", (int)shadowFilter);
+        shader->setAttrF("lightBleedReduction", lightBleedReduction);
+        shader->setAttrVec2("evsmExponents", evsmExponents);
+        for (int i = 0; i < layerNum; ++i)
+            shader->setAttrF("cascadeSplits[" + to_string(i) + "]", cascadeNum > 0 ? cascadeSplits[i] : 1e30f);
+    }
+    fill(dirCasterNums.begin(), dirCasterNums.end(), 0);
+    fill(pointCasterNums.begin(), pointCasterNums.end(), 0);
+    fill(pointFaceDrawNums.begin(), pointFaceDrawNums.end(), 0);
+    dirShadowDrawNum = 0;
+    updatedDirLayers = 0;
+    for (auto &light : scene.lights.getData())
+    {
+        if (light->getType() != LightType::Directional)
+            continue;
+        if (dirLightNum >= dirLightNumMax)
+            break;
+        shared_ptr<DirectionalLight> dirLight = static_pointer_cast<DirectionalLight>(light);
+        for (int i = 0; i < layerNum; ++i)
         {
-            shared_ptr<Shader>& shader = shader_.second;
-            shader->setAttrMat4("lightSpaceMatrix[" + std::to_string(dirLightNum) + "]", lightSpaceMatrix);
+            if (cascadeNum > 0)
+                lightSpaceMatrix = fitCascade(dirLight->getDir(), i == 0 ? camera->getNear() : cascadeSplits[i - 1], cascadeSplits[i]);
+            else
+            {
+                lightProjection = ortho(-30.0f, 30.0f, -30.0f, 30.0f, lightNearPlane, lightFarPlane);
+                mat4 lightView = lookAt(-dirLight->getDir() * vec3(20.0f), vec3(0.0f), vec3(0.0, 1.0, 0.0));
+                lightSpaceMatrix = lightProjection * lightView;
+            }
+            // layer dirLightNum * layerNum + i
+            layerLights.push_back(light);
+            layerMatrices.push_back(lightSpaceMatrix);
         }
-
-        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBOs[dirLightNum]);
-        glClear(GL_DEPTH_BUFFER_BIT);
-        //for (int i = 0; i < renderObjects.size(); ++i)
-        //    renderObjects[i]->draw(depthMapShader);
-        for (auto &object : renderObjects)
-            object.second->draw(depthMapShader);
-
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
         dirLightNum++;
     }
+    for (int layer = 0; layer < (int)layerMatrices.size(); ++layer)
+        for (auto &shader : scene.shaders.getData())
+            shader->setAttrMat4("lightSpaceMatrix[" + std::to_string(layer) + "]", layerMatrices[layer]);
+
+    glCullFace(GL_FRONT); // use cull front face to avoid peter panning
+    // casters in front of the near plane are flattened onto it instead of clipped
+    glEnable(GL_DEPTH_CLAMP);
+    glViewport(0, 0, dirShadowWidth, dirShadowHeight);
+    dirUpdatedTexels = 0.0f;
+    if (dirShadowMode == DirShadowMode::Layered)
+        renderDirShadowLayers(layerLights, layerMatrices);
+    else
+        for (int layer = 0; layer < (int)layerMatrices.size(); ++layer)
+            renderDirShadowLayer(layerLights[layer], layer, layerMatrices[layer]);
+    glDisable(GL_DEPTH_CLAMP);
+    dirShadowUpdateArea = layerMatrices.empty() ? 0.0f
+        : dirUpdatedTexels / ((float)dirShadowWidth * dirShadowHeight * layerMatrices.size());
 
 
-    // render point light shadow map
+    // render point light shadow map, the six layers of a light are updated on their own to keep the others
     int pointLightNum = 0;
+    float farPlane = 30.0f;
+    float clearDepth = 1.0f;
     glViewport(0, 0, pointShadowWidth, pointShadowHeight);
-    glBindFramebuffer(GL_FRAMEBUFFER, cubeDepthMapFBO);
-    glClear(GL_DEPTH_BUFFER_BIT);
-    for (auto &light : pointLights)
+    for (auto &shader : scene.shaders.getData())
     {
-        shared_ptr<PointLight> pointLight = light.second;
+        shader->setAttrF("far_plane", farPlane);
+        shader->setAttrB("shadowAtlas", shadowAtlas);
+    }
+    if (shadowAtlas)
+    {
+        vector<shared_ptr<PointLight>> pointLights;
+        for (auto &light : scene.lights.getData())
+            if (light->getType() == LightType::Point)
+                pointLights.push_back(static_pointer_cast<PointLight>(light));
+        updateShadowAtlas(pointLights);
+    }
+    for (auto &light : scene.lights.getData())
+    {
+        if (light->getType() != LightType::Point)
+            continue;
+        // lights past the cube map array are unshadowed, in the atlas those without tiles
+        if (!shadowAtlas && pointLightNum >= pointLightNumMax)
+            break;
+        if (shadowAtlas && pointTiles[6 * pointLightNum] < 0)
+        {
+            pointLightNum++;
+            continue;
+        }
+        shared_ptr<PointLight> pointLight = static_pointer_cast<PointLight>(light);
+        if (shadowCaching && pointShadowVersions[pointLightNum] == light->getVersion()
+            && !castersChanged(changedBounds, pointLight->getPos(), farPlane))
+        {
+            pointLightNum++;
+            continue;
+        }
+        pointShadowVersions[pointLightNum] = light->getVersion();
+        shadowUpdateNum++;
+
         GLfloat aspect = (GLfloat)pointShadowWidth / (GLfloat)pointShadowHeight;
-        float farPlane = 30.0f;
         lightProjection = perspective(radians(90.0f), aspect, 1.0f, farPlane);
         vector<mat4> shadowTransforms;
         shadowTransforms.push_back(lightProjection * lookAt(pointLight->getPos(), pointLight->getPos() + vec3(1.0, 0.0, 0.0), vec3(0.0, -1.0, 0.0)));
@@ -360,72 +1099,537 @@ void Renderer::renderShadowMap()
         cubeDepthMapShader->setAttrF("far_plane", farPlane);
         cubeDepthMapShader->setAttrVec3("lightPos", pointLight->getPos());
         cubeDepthMapShader->setAttrI("lightNum", pointLightNum);
-        for (auto &shader_ : shaders)
+        pointFaceShader->setAttrF("far_plane", farPlane);
+        pointFaceShader->setAttrVec3("lightPos", pointLight->getPos());
+
+        // objects in reach of the light, then only the faces that see them
+        Frustum faces[6];
+        for (int i = 0; i < 6; ++i)
+            faces[i].set(shadowTransforms[i]);
+        const vector<Entity> &entities = scene.meshes.getEntities();
+        faceMasks.assign(entities.size(), 0);
+        for (int i = 0; i < (int)entities.size(); ++i)
         {
-            shared_ptr<Shader>& shader = shader_.second;
-            shader->setAttrF("far_plane", farPlane);
+            const BoundingBox &box = *scene.bounds.get(entities[i]);
+            if (!intersectsSphere(box, pointLight->getPos(), farPlane))
+                continue;
+            for (int j = 0; j < 6; ++j)
+                if (faces[j].intersects(box))
+                    faceMasks[i] |= 1 << j;
         }
+        int n = pointLightNum;
+        auto drawPass = [&](bool staticCasters, GLuint layeredFBO, const vector<GLuint> &faceFBOs) {
+            if (pointShadowMode == PointShadowMode::GeometryShader && !shadowAtlas)
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, layeredFBO);
+                pointCasterNums[n] += drawShadowCasters(cubeDepthMapShader, staticCasters, [&](int i) {
+                    if (faceMasks[i])
+                    {
+                        cubeDepthMapShader->setAttrI("faceMask", faceMasks[i]);
+                        pointFaceDrawNums[n] += bitset<6>(faceMasks[i]).count();
+                    }
+                    return faceMasks[i];
+                });
+                return;
+            }
+            for (int face = 0; face < 6; ++face)
+            {
+                if (shadowAtlas)
+                {
+                    ivec3 tile = atlasLayout.getTile(pointTiles[6 * n + face]);
+                    glBindFramebuffer(GL_FRAMEBUFFER, staticCasters ? staticAtlasFBO : atlasFBO);
+                    glViewport(tile.x, tile.y, tile.z, tile.z);
+                }
+                else
+                    glBindFramebuffer(GL_FRAMEBUFFER, faceFBOs[6 * n + face]);
+                pointFaceShader->setAttrMat4("shadowMatrix", shadowTransforms[face]);
+                pointFaceDrawNums[n] += drawShadowCasters(pointFaceShader, staticCasters, [&](int i) { return faceMasks[i] >> face & 1; });
+            }
+            vector<shared_ptr<Object>> &meshes = scene.meshes.getData();
+            for (int i = 0; i < (int)meshes.size(); ++i)
+                if (faceMasks[i] && isShadowPassCaster(meshes[i], staticCasters))
+                    pointCasterNums[n]++;
+        };
 
         //for (int i = 0; i < renderObjects.size(); ++i)
         //    renderObjects[i]->draw(cubeDepthMapShader);
-        for (auto &object : renderObjects)
-            object.second->draw(cubeDepthMapShader);
+        if (gpuCulling)
+        {
+            gpuCuller->cullSphere(pointLight->getPos(), farPlane);
+            gpuCuller->bindCommands();
+        }
+        // the six layers of the light in the cube map arrays, or its six tiles in the atlases
+        auto clearFaces = [&](GLuint texture) {
+            if (!shadowAtlas)
+            {
+                glClearTexSubImage(texture, 0, 0, 0, 6 * n, pointShadowWidth, pointShadowHeight, 6,
+                    GL_DEPTH_COMPONENT, GL_FLOAT, &clearDepth);
+                return;
+            }
+            for (int face = 0; face < 6; ++face)
+            {
+                ivec3 tile = atlasLayout.getTile(pointTiles[6 * n + face]);
+                glClearTexSubImage(texture, 0, tile.x, tile.y, 0, tile.z, tile.z, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &clearDepth);
+            }
+        };
+        auto copyStaticFaces = [&]() {
+            if (!shadowAtlas)
+            {
+                glCopyImageSubData(staticCubeDepthMap, GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, 6 * n,
+                    cubeShadowMap->getID(), GL_TEXTURE_CUBE_MAP_ARRAY, 0, 0, 0, 6 * n,
+                    pointShadowWidth, pointShadowHeight, 6);
+                return;
+            }
+            for (int face = 0; face < 6; ++face)
+            {
+                ivec3 tile = atlasLayout.getTile(pointTiles[6 * n + face]);
+                glCopyImageSubData(staticAtlasDepthMap, GL_TEXTURE_2D, 0, tile.x, tile.y, 0,
+                    atlasDepthMap, GL_TEXTURE_2D, 0, tile.x, tile.y, 0, tile.z, tile.z, 1);
+            }
+        };
+        if (staticShadowCache)
+        {
+            if (pointStaticVersions[pointLightNum] != light->getVersion()
+                || castersChanged(changedStaticBounds, pointLight->getPos(), farPlane))
+            {
+                pointStaticVersions[pointLightNum] = light->getVersion();
+                clearFaces(shadowAtlas ? staticAtlasDepthMap : staticCubeDepthMap);
+                drawPass(true, staticCubeDepthMapFBO, staticCubeFaceFBOs);
+            }
+            copyStaticFaces();
+        }
+        else
+            clearFaces(shadowAtlas ? atlasDepthMap : cubeShadowMap->getID());
+        drawPass(false, cubeDepthMapFBO, cubeFaceFBOs);
+        if (gpuCulling)
+            gpuCuller->unbindCommands();
 
         pointLightNum++;
     }
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
     glCullFace(GL_BACK);
+    filterShadowMoments();
 
     //glActiveTexture(GL_TEXTURE1);
     //glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, cubeDepthMap);
 }
 
-void Renderer::initShadowMap()
+// a layer is outdated unless it still holds this light and box and no caster in the box changed,
+// casters toward the light count as well, an outdated layer takes the new light and box.
+// region is the part to render again, the whole layer unless only casters changed, then with
+// dirty regions on it is the light space rectangle around the old and new bounds of those casters
+bool Renderer::dirLayerOutdated(const shared_ptr<Light> &light, int layer, const mat4 &lightSpaceMatrix,
+    const Frustum &volume, bool staticLayer, ivec4 &region)
 {
-    // create depth map FBO
-    for (int i = 0; i < dirLightNumMax; ++i)
-        glGenFramebuffers(1, &depthMapFBOs[i]);
-
-    // create depth texture
-    GLuint depthMaps;
-    glGenTextures(1, &depthMaps);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, depthMaps);
-    //glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT,
-        dirShadowWidth, dirShadowHeight, dirLightNumMax, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    GLfloat borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
-    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
-
-    // attach depth texture as FBO's depth buffer
-    for (int i = 0; i < dirLightNumMax; ++i)
+    vector<unsigned int> &versions = staticLayer ? dirStaticVersions : dirShadowVersions;
+    vector<mat4> &matrices = staticLayer ? dirStaticMatrices : dirShadowMatrices;
+    const vector<BoundingBox> &changed = staticLayer ? changedStaticBounds : changedBounds;
+    region = ivec4(0, 0, dirShadowWidth, dirShadowHeight);
+    // static layers are always kept while valid
+    bool valid = (staticLayer || shadowCaching) && versions[layer] == light->getVersion() && matrices[layer] == lightSpaceMatrix;
+    if (valid && !castersChanged(changed, volume))
+        return false;
+    if (valid && shadowDirtyRegions)
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBOs[i]);
-        //glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D_ARRAY, depthMap, 0);
-        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthMaps, 0, i);
-        glDrawBuffer(GL_NONE);
-        glReadBuffer(GL_NONE);
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-            std::cout << "Framebuffer not complete!" << std::endl;
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        region = ivec4(dirShadowWidth, dirShadowHeight, 0, 0);
+        for (auto &box : changed)
+        {
+            if (!volume.intersects(box))
+                continue;
+            ivec4 rect = lightSpaceRect(box, lightSpaceMatrix);
+            region = ivec4(std::min(region.x, rect.x), std::min(region.y, rect.y), std::max(region.z, rect.z), std::max(region.w, rect.w));
+        }
     }
+    versions[layer] = light->getVersion();
+    matrices[layer] = lightSpaceMatrix;
+    return true;
+}
 
-    shadowMap->set(depthMaps, TextureType::TEXTURE_2D_ARRAY);
+// texels of a directional layer covered by the box, x0 y0 x1 y1 with one texel of margin
+ivec4 Renderer::lightSpaceRect(const BoundingBox &box, const mat4 &lightSpaceMatrix)
+{
+    vec2 minPos(1e30f), maxPos(-1e30f);
+    for (int i = 0; i < 8; ++i)
+    {
+        vec3 corner(i & 1 ? box.maxPos.x : box.minPos.x, i & 2 ? box.maxPos.y : box.minPos.y, i & 4 ? box.maxPos.z : box.minPos.z);
+        vec4 p = lightSpaceMatrix * vec4(corner, 1.0f);
+        minPos = glm::min(minPos, vec2(p) / p.w);
+        maxPos = glm::max(maxPos, vec2(p) / p.w);
+    }
+    minPos = (minPos * 0.5f + 0.5f) * vec2(dirShadowWidth, dirShadowHeight);
+    maxPos = (maxPos * 0.5f + 0.5f) * vec2(dirShadowWidth, dirShadowHeight);
+    int width = dirShadowWidth, height = dirShadowHeight;
+    return ivec4(glm::clamp((int)floor(minPos.x) - 1, 0, width), glm::clamp((int)floor(minPos.y) - 1, 0, height),
+        glm::clamp((int)ceil(maxPos.x) + 1, 0, width), glm::clamp((int)ceil(maxPos.y) + 1, 0, height));
 }
 
-void Renderer::initCubeShadowMap()
+void Renderer::renderDirShadowLayer(shared_ptr<Light> light, int layer, const mat4 &lightSpaceMatrix)
 {
-    // using cube map
+    Frustum volume(lightSpaceMatrix);
+    volume.extrudeNear();
+    ivec4 region, staticRegion;
+    if (!dirLayerOutdated(light, layer, lightSpaceMatrix, volume, false, region))
+        return;
+    bool staticOutdated = staticShadowCache && dirLayerOutdated(light, layer, lightSpaceMatrix, volume, true, staticRegion);
+    drawDirShadowLayer(layer, lightSpaceMatrix, volume, region, staticOutdated, staticRegion);
+}
+
+// renders the region of an outdated layer, and the static region of its static layer first if that is
+// outdated as well, only casters that overlap the region are drawn and the scissor keeps the rest
+void Renderer::drawDirShadowLayer(int layer, const mat4 &lightSpaceMatrix, const Frustum &volume,
+    const ivec4 &region, bool staticOutdated, const ivec4 &staticRegion)
+{
+    const vector<Entity> &entities = scene.meshes.getEntities();
+    ivec4 fullRegion(0, 0, dirShadowWidth, dirShadowHeight);
+    auto inRegion = [&](int i, const ivec4 &rect) {
+        const BoundingBox &box = *scene.bounds.get(entities[i]);
+        if (!volume.intersects(box))
+            return 0;
+        if (rect == fullRegion)
+            return 1;
+        ivec4 boxRect = lightSpaceRect(box, lightSpaceMatrix);
+        return boxRect.x < rect.z && rect.x < boxRect.z && boxRect.y < rect.w && rect.y < boxRect.w ? 1 : 0;
+    };
+    auto setScissor = [&](const ivec4 &rect) { glScissor(rect.x, rect.y, rect.z - rect.x, rect.w - rect.y); };
+    shadowUpdateNum++;
+    updatedDirLayers |= 1 << layer;
+    dirUpdatedTexels += (float)(region.z - region.x) * (region.w - region.y);
+
+    depthMapShader->setAttrMat4("lightSpaceMatrix", lightSpaceMatrix);
+    //for (int i = 0; i < renderObjects.size(); ++i)
+    //    renderObjects[i]->draw(depthMapShader);
+    if (gpuCulling)
+    {
+        gpuCuller->cull(lightSpaceMatrix);
+        gpuCuller->bindCommands();
+    }
+    glEnable(GL_SCISSOR_TEST);
+    if (staticShadowCache)
+    {
+        if (staticOutdated)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, staticDepthMapFBOs[layer]);
+            setScissor(staticRegion);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            dirCasterNums[layer] += drawShadowCasters(depthMapShader, true, [&](int i) { return inRegion(i, staticRegion); });
+        }
+        glCopyImageSubData(staticDepthMaps, GL_TEXTURE_2D_ARRAY, 0, region.x, region.y, layer,
+            depthMaps, GL_TEXTURE_2D_ARRAY, 0, region.x, region.y, layer, region.z - region.x, region.w - region.y, 1);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBOs[layer]);
+    setScissor(region);
+    if (!staticShadowCache)
+        glClear(GL_DEPTH_BUFFER_BIT);
+    dirCasterNums[layer] += drawShadowCasters(depthMapShader, false, [&](int i) { return inRegion(i, region); });
+    glDisable(GL_SCISSOR_TEST);
+    if (gpuCulling)
+        gpuCuller->unbindCommands();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    dirShadowDrawNum += dirCasterNums[layer];
+}
+
+// Every outdated layer in one pass: a caster is drawn once with an instance per layer it falls in,
+// the vertex shader takes the matrix of the instance from the uniform buffer and the geometry shader
+// sends the triangle to that layer. The layer masks take the place of GPU culling here.
+// Layers with a dirty region are drawn on their own with drawDirShadowLayer while the layers are
+// classified, before the instanced pass, since its scissor would be the same for all layers.
+void Renderer::renderDirShadowLayers(const vector<shared_ptr<Light>> &lights, const vector<mat4> &lightSpaceMatrices)
+{
+    int layerNum = lightSpaceMatrices.size();
+    vector<Frustum> volumes(layerNum);
+    vector<ivec4> regions(layerNum), staticRegions(layerNum);
+    ivec4 fullRegion(0, 0, dirShadowWidth, dirShadowHeight);
+    int outdatedMask = 0;
+    int staticOutdatedMask = 0;
+    for (int layer = 0; layer < layerNum; ++layer)
+    {
+        volumes[layer].set(lightSpaceMatrices[layer]);
+        volumes[layer].extrudeNear();
+        if (!dirLayerOutdated(lights[layer], layer, lightSpaceMatrices[layer], volumes[layer], false, regions[layer]))
+            continue;
+        bool staticOutdated = staticShadowCache
+            && dirLayerOutdated(lights[layer], layer, lightSpaceMatrices[layer], volumes[layer], true, staticRegions[layer]);
+        if (regions[layer] != fullRegion || (staticOutdated && staticRegions[layer] != fullRegion))
+        {
+            drawDirShadowLayer(layer, lightSpaceMatrices[layer], volumes[layer], regions[layer], staticOutdated, staticRegions[layer]);
+            continue;
+        }
+        outdatedMask |= 1 << layer;
+        shadowUpdateNum++;
+        dirUpdatedTexels += (float)dirShadowWidth * dirShadowHeight;
+        if (staticOutdated)
+            staticOutdatedMask |= 1 << layer;
+    }
+    updatedDirLayers |= outdatedMask;
+    if (!outdatedMask)
+        return;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, lightSpaceUBO);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, layerNum * sizeof(mat4), lightSpaceMatrices.data());
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, lightSpaceUBO);
+
+    const vector<Entity> &entities = scene.meshes.getEntities();
+    layerMasks.assign(entities.size(), 0);
+    for (int i = 0; i < (int)entities.size(); ++i)
+    {
+        const BoundingBox &box = *scene.bounds.get(entities[i]);
+        for (int layer = 0; layer < layerNum; ++layer)
+            if ((outdatedMask >> layer & 1) && volumes[layer].intersects(box))
+                layerMasks[i] |= 1 << layer;
+    }
+    vector<shared_ptr<Object>> &meshes = scene.meshes.getData();
+    auto drawPass = [&](bool staticCasters, int mask) {
+        for (int i = 0; i < (int)meshes.size(); ++i)
+        {
+            int objectMask = layerMasks[i] & mask;
+            if (!objectMask || !isShadowPassCaster(meshes[i], staticCasters))
+                continue;
+            layeredDepthShader->setAttrI("layerMask", objectMask);
+            drawDepth(meshes[i], layeredDepthShader, bitset<32>(objectMask).count());
+            dirShadowDrawNum++;
+            for (int layer = 0; layer < layerNum; ++layer)
+                dirCasterNums[layer] += objectMask >> layer & 1;
+        }
+    };
+    auto clearLayers = [&](GLuint texture, int mask) {
+        float clearDepth = 1.0f;
+        for (int layer = 0; layer < layerNum; ++layer)
+            if (mask >> layer & 1)
+                glClearTexSubImage(texture, 0, 0, 0, layer, dirShadowWidth, dirShadowHeight, 1,
+                    GL_DEPTH_COMPONENT, GL_FLOAT, &clearDepth);
+    };
+
+    if (staticShadowCache)
+    {
+        if (staticOutdatedMask)
+        {
+            clearLayers(staticDepthMaps, staticOutdatedMask);
+            glBindFramebuffer(GL_FRAMEBUFFER, staticDepthMapLayeredFBO);
+            drawPass(true, staticOutdatedMask);
+        }
+        for (int layer = 0; layer < layerNum; ++layer)
+            if (outdatedMask >> layer & 1)
+                glCopyImageSubData(staticDepthMaps, GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer,
+                    depthMaps, GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, dirShadowWidth, dirShadowHeight, 1);
+    }
+    else
+        clearLayers(depthMaps, outdatedMask);
+    glBindFramebuffer(GL_FRAMEBUFFER, depthMapLayeredFBO);
+    drawPass(false, outdatedMask);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Renderer::setShadowCascades(int cascadeNum_, float splitLambda, float shadowDistance_)
+{
+    if (cascadeNum_ > 4)
+        cout << "Shadow cascades are limited to 4!" << endl;
+    cascadeNum = glm::clamp(cascadeNum_, 0, 4);
+    cascadeSplitLambda = splitLambda;
+    shadowDistance = shadowDistance_;
+    allocateDirShadowMaps();
+}
+
+// practical split scheme, a blend of the uniform and the logarithmic split of the view depth range
+void Renderer::updateCascadeSplits()
+{
+    float nearDepth = camera->getNear();
+    float farDepth = shadowDistance > 0.0f ? std::min(shadowDistance, camera->getFar()) : camera->getFar();
+    cascadeSplits.resize(cascadeNum);
+    for (int i = 1; i <= cascadeNum; ++i)
+    {
+        float p = (float)i / cascadeNum;
+        float logSplit = nearDepth * pow(farDepth / nearDepth, p);
+        float linearSplit = nearDepth + (farDepth - nearDepth) * p;
+        cascadeSplits[i - 1] = mix(linearSplit, logSplit, cascadeSplitLambda);
+    }
+}
+
+// The box is the bounding sphere of the camera frustum slice, so its size does not change while the
+// camera turns, and it moves in whole shadow map texels, which keeps the shadow edges from shimmering.
+// Casters up to lightFarPlane in front of the sphere are kept.
+mat4 Renderer::fitCascade(const vec3 &lightDir, float nearDepth, float farDepth)
+{
+    mat4 invViewProjection = inverse(camera->getProjectionMatrix() * camera->getViewMatrix());
+    float cameraNear = camera->getNear(), cameraFar = camera->getFar();
+    vec3 corners[8];
+    for (int i = 0; i < 4; ++i)
+    {
+        vec2 ndc(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f);
+        vec4 n = invViewProjection * vec4(ndc, -1.0f, 1.0f);
+        vec4 f = invViewProjection * vec4(ndc, 1.0f, 1.0f);
+        vec3 nearCorner = vec3(n) / n.w, farCorner = vec3(f) / f.w;
+        // view depth is linear along a frustum edge
+        corners[i] = mix(nearCorner, farCorner, (nearDepth - cameraNear) / (cameraFar - cameraNear));
+        corners[i + 4] = mix(nearCorner, farCorner, (farDepth - cameraNear) / (cameraFar - cameraNear));
+    }
+    vec3 center(0.0f);
+    for (int i = 0; i < 8; ++i)
+        center += corners[i] / 8.0f;
+    float radius = 0.0f;
+    for (int i = 0; i < 8; ++i)
+        radius = std::max(radius, length(corners[i] - center));
+    radius = ceil(radius * 16.0f) / 16.0f;
+
+    vec3 up = abs(lightDir.y) > 0.99f ? vec3(0.0f, 0.0f, 1.0f) : vec3(0.0f, 1.0f, 0.0f);
+    mat4 lightView = lookAt(center, center + lightDir, up);
+    mat4 lightProjection = ortho(-radius, radius, -radius, radius, -radius - lightFarPlane, radius);
+
+    // snap the world origin to a texel
+    vec4 origin = lightProjection * lightView * vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    vec2 texel = vec2(origin) * vec2(dirShadowWidth, dirShadowHeight) * 0.5f;
+    vec2 offset = (round(texel) - texel) * 2.0f / vec2(dirShadowWidth, dirShadowHeight);
+    lightProjection[3][0] += offset.x;
+    lightProjection[3][1] += offset.y;
+    return lightProjection * lightView;
+}
+
+// without the static cache every object is drawn in the dynamic pass
+bool Renderer::isShadowPassCaster(const shared_ptr<Object> &object, bool staticCasters)
+{
+    return staticShadowCache ? object->isStatic() == staticCasters : !staticCasters;
+}
+
+// returns the objects drawn
+int Renderer::drawShadowCasters(shared_ptr<Shader> shader, bool staticCasters, const function<int(int)> &cull)
+{
+    vector<shared_ptr<Object>> &meshes = scene.meshes.getData();
+    int drawNum = 0;
+    for (int i = 0; i < (int)meshes.size(); ++i)
+    {
+        if (!isShadowPassCaster(meshes[i], staticCasters) || !cull(i))
+            continue;
+        drawDepth(meshes[i], shader);
+        drawNum++;
+    }
+    return drawNum;
+}
+
+void Renderer::setStaticShadowCache(bool b)
+{
+    staticShadowCache = b;
+    if (staticShadowCache && !staticDepthMaps)
+        initStaticShadowMaps();
+    invalidateShadows();
+}
+
+// layers are never sampled, only copied into the shadow maps, so they share their formats and sizes,
+// copies also need complete textures, hence the non mipmap filters
+void Renderer::initStaticShadowMaps()
+{
+    glGenTextures(1, &staticDepthMaps);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, staticDepthMaps);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    allocateDirShadowMaps();
+
+    glGenTextures(1, &staticCubeDepthMap);
+    glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, staticCubeDepthMap);
+    glTexImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, targetFormats.pointShadow, shadowAtlas ? 1 : pointShadowWidth,
+        shadowAtlas ? 1 : pointShadowHeight, 6 * pointLightNumMax, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glGenFramebuffers(1, &staticCubeDepthMapFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, staticCubeDepthMapFBO);
+    glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticCubeDepthMap, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "Static point light shadow framebuffer not complete!" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    initCubeFaceFBOs(staticCubeDepthMap, staticCubeFaceFBOs);
+    if (shadowAtlas)
+    {
+        allocateShadowAtlas(atlasLayout.getSize());
+        resizeCubeShadowMaps(1);
+    }
+}
+
+void Renderer::initShadowMap()
+{
+    // create depth texture
+    glGenTextures(1, &depthMaps);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, depthMaps);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    GLfloat borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+    shadowMap->set(depthMaps, TextureType::TEXTURE_2D_ARRAY);
+
+    // matrices of the layered pass, as many as the shaders declare
+    glGenBuffers(1, &lightSpaceUBO);
+    glBindBuffer(GL_UNIFORM_BUFFER, lightSpaceUBO);
+    glBufferData(GL_UNIFORM_BUFFER, 20 * sizeof(mat4), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    allocateDirShadowMaps();
+}
+
+// storage and FBOs of every layer, one per light or per cascade of a light, the cached layers are lost
+void Renderer::allocateDirShadowMaps()
+{
+    int layerNum = getDirShadowLayerNum();
+    auto allocate = [&](GLuint texture, vector<GLuint> &fbos, GLuint &layeredFBO) {
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        //glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, targetFormats.dirShadow,
+            dirShadowWidth, dirShadowHeight, layerNum, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+
+        // attach depth texture as FBO's depth buffer
+        for (int i = 0; i < (int)fbos.size(); ++i)
+            if (fbos[i] != 0)
+                glDeleteFramebuffers(1, &fbos[i]);
+        fbos.assign(layerNum, 0);
+        glGenFramebuffers(layerNum, fbos.data());
+        for (int i = 0; i < layerNum; ++i)
+        {
+            glBindFramebuffer(GL_FRAMEBUFFER, fbos[i]);
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, i);
+            glDrawBuffer(GL_NONE);
+            glReadBuffer(GL_NONE);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "Framebuffer not complete!" << std::endl;
+        }
+
+        // all layers at once for the layered pass
+        if (layeredFBO == 0)
+            glGenFramebuffers(1, &layeredFBO);
+        glBindFramebuffer(GL_FRAMEBUFFER, layeredFBO);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Layered framebuffer not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    };
+    allocate(depthMaps, depthMapFBOs, depthMapLayeredFBO);
+    if (staticDepthMaps)
+        allocate(staticDepthMaps, staticDepthMapFBOs, staticDepthMapLayeredFBO);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    dirShadowVersions.assign(layerNum, 0);
+    dirStaticVersions.assign(layerNum, 0);
+    dirShadowMatrices.assign(layerNum, mat4(1.0f));
+    dirStaticMatrices.assign(layerNum, mat4(1.0f));
+    dirCasterNums.assign(layerNum, 0);
+    if (momentMaps)
+        allocateMomentMaps();
+}
+
+void Renderer::initCubeShadowMap()
+{
+    // using cube map
     glGenFramebuffers(1, &cubeDepthMapFBO);
 
     GLuint cubeDepthMap;
     glGenTextures(1, &cubeDepthMap);
     glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, cubeDepthMap);
-    glTexImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, GL_DEPTH_COMPONENT,
+    glTexImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, targetFormats.pointShadow,
         pointShadowWidth, pointShadowHeight, 6*pointLightNumMax, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
     //for (GLuint i = 0; i < 6 * pointLightNumMax; ++i)
     //    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT,
@@ -448,6 +1652,340 @@ void Renderer::initCubeShadowMap()
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
     cubeShadowMap->set(cubeDepthMap, TextureType::TEXTURE_CUBE_MAP_ARRAY);
+    initCubeFaceFBOs(cubeDepthMap, cubeFaceFBOs);
+}
+
+void Renderer::initCubeFaceFBOs(GLuint texture, vector<GLuint> &fbos)
+{
+    fbos.assign(6 * pointLightNumMax, 0);
+    glGenFramebuffers(fbos.size(), fbos.data());
+    for (int i = 0; i < (int)fbos.size(); ++i)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbos[i]);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, i);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Cube face shadow framebuffer not complete!" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Renderer::setShadowAtlas(bool b, int memoryBudgetMB, int maxTileSize)
+{
+    shadowAtlas = b;
+    // largest power of two square in the budget
+    int size = 256;
+    while ((GLuint64)size * size * 4 * getBytesPerTexel(targetFormats.pointShadow) <= (GLuint64)memoryBudgetMB << 20)
+        size *= 2;
+    atlasMaxTileSize = std::min(maxTileSize, size);
+    atlasLayout.reset(size, 64);
+    pointTiles.clear();
+    if (shadowAtlas && !atlasTileBuffer)
+        glGenBuffers(1, &atlasTileBuffer);
+    allocateShadowAtlas(shadowAtlas ? size : 0);
+    resizeCubeShadowMaps(shadowAtlas ? 1 : pointShadowWidth);
+    invalidateShadows();
+}
+
+// storage of the atlas and of its static copy once the static cache is on, size 0 frees them
+void Renderer::allocateShadowAtlas(int size)
+{
+    auto allocate = [&](GLuint &texture, GLuint &fbo) {
+        if (size == 0)
+        {
+            glDeleteFramebuffers(1, &fbo);
+            glDeleteTextures(1, &texture);
+            fbo = texture = 0;
+            return;
+        }
+        if (!texture)
+        {
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glGenFramebuffers(1, &fbo);
+        }
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, targetFormats.pointShadow, size, size, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Shadow atlas framebuffer not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    };
+    allocate(atlasDepthMap, atlasFBO);
+    if (staticDepthMaps || staticAtlasDepthMap)
+        allocate(staticAtlasDepthMap, staticAtlasFBO);
+    atlasShadowMap->set(atlasDepthMap, TextureType::TEXTURE_2D);
+}
+
+// Tile sizes follow the share of the screen height covered by the range of a light. The lights covering
+// most are served first, a light that does not get its size tries smaller ones and keeps its old tiles
+// while none is free. Shrinking by one step keeps the tiles, so lights near a size boundary
+// do not move every frame.
+void Renderer::updateShadowAtlas(const vector<shared_ptr<PointLight>> &pointLights)
+{
+    int lightNum = pointLights.size();
+    for (int i = 6 * lightNum; i < (int)pointTiles.size(); ++i)
+        atlasLayout.release(pointTiles[i]);
+    pointTiles.resize(6 * lightNum, -1);
+    if ((int)pointShadowVersions.size() < lightNum)
+    {
+        pointShadowVersions.resize(lightNum, 0);
+        pointStaticVersions.resize(lightNum, 0);
+        pointCasterNums.resize(lightNum, 0);
+        pointFaceDrawNums.resize(lightNum, 0);
+    }
+
+    Frustum frustum(camera->getProjectionMatrix() * camera->getViewMatrix());
+    float tanHalfFov = 1.0f / camera->getProjectionMatrix()[1][1];
+    vector<pair<float, int>> coverages;
+    for (int i = 0; i < lightNum; ++i)
+    {
+        vec3 pos = pointLights[i]->getPos();
+        float range = pointLights[i]->getRange();
+        float dis = length(pos - camera->getPos());
+        float coverage = 0.0f;
+        if (frustum.intersects(BoundingBox(pos - vec3(range), pos + vec3(range))))
+            coverage = dis <= range ? 1.0f : std::min(range / (dis * tanHalfFov), 1.0f);
+        coverages.push_back({ coverage, i });
+    }
+    sort(coverages.begin(), coverages.end(), greater<pair<float, int>>());
+
+    for (auto &lightCoverage : coverages)
+    {
+        float coverage = lightCoverage.first;
+        int i = lightCoverage.second;
+        int *tiles = &pointTiles[6 * i];
+        int current = tiles[0] >= 0 ? atlasLayout.getTile(tiles[0]).z : 0;
+        int wanted = 0;
+        if (coverage > 0.0f)
+            for (wanted = atlasLayout.getMinTileSize(); wanted < atlasMaxTileSize && wanted < coverage * atlasMaxTileSize; wanted *= 2);
+        if (wanted == current || (wanted > 0 && wanted * 2 == current))
+            continue;
+        if (wanted == 0)
+        {
+            for (int face = 0; face < 6; ++face)
+                atlasLayout.release(tiles[face]);
+            fill(tiles, tiles + 6, -1);
+            continue;
+        }
+        for (int tileSize = wanted; tileSize >= atlasLayout.getMinTileSize() && tileSize != current; tileSize /= 2)
+        {
+            int newTiles[6];
+            int face = 0;
+            for (; face < 6; ++face)
+                if ((newTiles[face] = atlasLayout.allocate(tileSize)) < 0)
+                    break;
+            if (face < 6)
+            {
+                while (face-- > 0)
+                    atlasLayout.release(newTiles[face]);
+                continue;
+            }
+            for (face = 0; face < 6; ++face)
+            {
+                atlasLayout.release(tiles[face]);
+                tiles[face] = newTiles[face];
+            }
+            pointShadowVersions[i] = 0;
+            pointStaticVersions[i] = 0;
+            break;
+        }
+    }
+
+    // uv origin and size of every face, zero size for lights without tiles
+    vector<vec4> tileData(std::max(6 * lightNum, 6), vec4(0.0f));
+    float atlasSize = atlasLayout.getSize();
+    for (int i = 0; i < (int)pointTiles.size(); ++i)
+        if (pointTiles[i] >= 0)
+            tileData[i] = vec4(vec3(atlasLayout.getTile(pointTiles[i])) / atlasSize, 0.0f);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, atlasTileBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, tileData.size() * sizeof(vec4), tileData.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 8, atlasTileBuffer);
+}
+
+// the face FBOs stay attached, a new storage keeps the layer count
+void Renderer::resizeCubeShadowMaps(int size)
+{
+    for (GLuint texture : { cubeShadowMap->getID(), staticCubeDepthMap })
+    {
+        if (!texture)
+            continue;
+        glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, texture);
+        glTexImage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 0, targetFormats.pointShadow,
+            size, size, 6 * pointLightNumMax, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    }
+    glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
+}
+
+GLuint64 Renderer::getShadowMapMemory()
+{
+    GLuint64 bytes = 0;
+    for (auto &target : getShadowTargetMemory())
+        bytes += target.second;
+    return bytes;
+}
+
+// static copies are counted once the static cache was turned on
+vector<pair<string, GLuint64>> Renderer::getShadowTargetMemory()
+{
+    GLuint64 copies = staticDepthMaps ? 2 : 1;
+    GLuint64 cubeSize = shadowAtlas ? 1 : pointShadowWidth;
+    GLuint64 atlasSize = shadowAtlas ? atlasLayout.getSize() : 0;
+    GLuint64 momentBytes = 0;
+    if (shadowFilter != ShadowFilter::PCF)
+    {
+        // a third more for the mips, one more layer for the blur
+        GLuint64 momentTexels = (GLuint64)(dirShadowWidth / 2) * (dirShadowHeight / 2);
+        momentBytes = momentTexels * (getDirShadowLayerNum() * 4 / 3 + 1) * (shadowFilter == ShadowFilter::VSM ? 8 : 16);
+    }
+    return {
+        { "directional shadows", (GLuint64)dirShadowWidth * dirShadowHeight * getDirShadowLayerNum()
+            * getBytesPerTexel(targetFormats.dirShadow) * copies },
+        { "point shadows", cubeSize * cubeSize * 6 * pointLightNumMax * getBytesPerTexel(targetFormats.pointShadow) * copies },
+        { "shadow atlas", atlasSize * atlasSize * getBytesPerTexel(targetFormats.pointShadow) * copies },
+        { "shadow moments", momentBytes }
+    };
+}
+
+// the screen sized targets are counted at their allocated size, targets not in use are left out
+vector<pair<string, GLuint64>> Renderer::getRenderTargetMemory()
+{
+    GLuint64 texels = (GLuint64)targetWidth * targetHeight;
+    GLuint64 RSMTexels = (GLuint64)RSMBufferSize * RSMBufferSize;
+    vector<pair<string, GLuint64>> targets = {
+        { "scene color", texels * getBytesPerTexel(targetFormats.sceneColor) },
+        { "scene depth stencil", texels * getBytesPerTexel(GL_DEPTH24_STENCIL8) },
+        { "post process color", texels * getBytesPerTexel(targetFormats.sceneColor) },
+        { "post process depth stencil", texels * getBytesPerTexel(GL_DEPTH24_STENCIL8) }
+    };
+    if (gBuffer)
+        targets.push_back({ "G-buffer", texels * (getBytesPerTexel(GL_RGBA8) + getBytesPerTexel(GL_RGBA16) + getBytesPerTexel(GL_DEPTH24_STENCIL8)) });
+    for (auto &target : getShadowTargetMemory())
+        if (target.second)
+            targets.push_back(target);
+    targets.push_back({ "RSM depth", RSMTexels * getBytesPerTexel(targetFormats.RSMDepth) });
+    if (targetFormats.RSMPosition)
+        targets.push_back({ "RSM position", RSMTexels * getBytesPerTexel(GL_RGB16F) });
+    targets.push_back({ "RSM normal", RSMTexels * getBytesPerTexel(targetFormats.RSMNormal) });
+    targets.push_back({ "RSM flux", RSMTexels * getBytesPerTexel(targetFormats.RSMFlux) });
+    if (RSMHistory[0])
+        targets.push_back({ "RSM history", texels * 4 * getBytesPerTexel(GL_RGBA16F) });
+    if (RSMGatherFBO)
+    {
+        GLuint64 lowTexels = (GLuint64)((targetWidth + RSMDownsample - 1) / RSMDownsample) * ((targetHeight + RSMDownsample - 1) / RSMDownsample);
+        targets.push_back({ "RSM gather", texels * getBytesPerTexel(GL_RGBA16F) + lowTexels * getBytesPerTexel(targetFormats.RSMIndirect) });
+    }
+    return targets;
+}
+
+// every target is allocated again in the new formats, so all shadows are rendered again
+void Renderer::setRenderTargetFormats(const RenderTargetFormats &formats)
+{
+    targetFormats = formats;
+    resizeRenderTargets(targetWidth, targetHeight);
+    allocateDirShadowMaps();
+    resizeCubeShadowMaps(shadowAtlas ? 1 : pointShadowWidth);
+    if (shadowAtlas)
+        allocateShadowAtlas(atlasLayout.getSize());
+    allocateRSMBuffers();
+    invalidateShadows();
+}
+
+void Renderer::setShadowFilter(ShadowFilter filter, int blurRadius, float lightBleedReduction_, vec2 evsmExponents_)
+{
+    shadowFilter = filter;
+    momentBlurRadius = blurRadius;
+    lightBleedReduction = lightBleedReduction_;
+    evsmExponents = evsmExponents_;
+    if (shadowFilter != ShadowFilter::PCF && !momentShader)
+    {
+        momentShader = make_shared<Shader>("./shaders/texture_to_screen.vert", "./shaders/shadow_moments.frag");
+        momentBlurShader = make_shared<Shader>("./shaders/texture_to_screen.vert", "./shaders/shadow_moments_blur.frag");
+        momentTemp = make_shared<Texture>();
+        glGenTextures(1, &momentMaps);
+        GLuint tempID;
+        glGenTextures(1, &tempID);
+        momentTemp->set(tempID, TextureType::TEXTURE_2D);
+        glGenFramebuffers(1, &momentFBO);
+    }
+    if (momentMaps)
+        allocateMomentMaps();
+    // the moments follow the layers, so all of them are rendered again
+    invalidateShadows();
+}
+
+// VSM keeps two moments, EVSM four, at 32 bits as the exponential warps need the range,
+// outside the map the moments are those of the far plane, PCF frees the storage
+void Renderer::allocateMomentMaps()
+{
+    bool pcf = shadowFilter == ShadowFilter::PCF;
+    int width = pcf ? 0 : dirShadowWidth / 2, height = pcf ? 0 : dirShadowHeight / 2;
+    bool evsm = shadowFilter == ShadowFilter::EVSM;
+    GLenum format = evsm ? GL_RGBA32F : GL_RG32F;
+    vec2 far = evsm ? vec2(exp(evsmExponents.x), -exp(-evsmExponents.y)) : vec2(1.0f);
+    GLfloat borderColor[] = { far.x, far.x * far.x, evsm ? far.y : 0.0f, evsm ? far.y * far.y : 0.0f };
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, momentMaps);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format, width, height, pcf ? 0 : getDirShadowLayerNum(), 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+    if (!pcf)
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY); // allocates the mip levels
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    shadowMoments->set(momentMaps, TextureType::TEXTURE_2D_ARRAY);
+
+    glBindTexture(GL_TEXTURE_2D, momentTemp->getID());
+    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Every directional layer rendered this frame: the 2x2 depth texels under a moment texel are resolved
+// into their mean moments and blurred horizontally into momentTemp, then blurred vertically into the
+// layer. The mips are rebuilt once for all of them.
+void Renderer::filterShadowMoments()
+{
+    if (shadowFilter == ShadowFilter::PCF || !updatedDirLayers)
+        return;
+    glViewport(0, 0, dirShadowWidth / 2, dirShadowHeight / 2);
+    glDisable(GL_DEPTH_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, momentFBO);
+    momentShader->setTexture("shadowMap", 0, shadowMap);
+    momentShader->setAttrI("blurRadius", momentBlurRadius);
+    momentShader->setAttrB("evsm", shadowFilter == ShadowFilter::EVSM);
+    momentShader->setAttrVec2("evsmExponents", evsmExponents);
+    momentBlurShader->setTexture("moments", 0, momentTemp);
+    momentBlurShader->setAttrI("blurRadius", momentBlurRadius);
+    for (int layer = 0; layer < getDirShadowLayerNum(); ++layer)
+    {
+        if (!(updatedDirLayers >> layer & 1))
+            continue;
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, momentTemp->getID(), 0);
+        momentShader->setAttrI("layer", layer);
+        screenQuad.draw(momentShader);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, momentMaps, 0, layer);
+        screenQuad.draw(momentBlurShader);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glEnable(GL_DEPTH_TEST);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, momentMaps);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
 }
 
 void Renderer::drawSkybox()
@@ -467,7 +2005,7 @@ pair<unsigned int, unsigned int> Renderer::createFrameBuffer(int width, int heig
     unsigned int texColorBuffer;
     glGenTextures(1, &texColorBuffer);
     glBindTexture(GL_TEXTURE_2D, texColorBuffer);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    glTexImage2D(GL_TEXTURE_2D, 0, targetFormats.sceneColor, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glBindTexture(GL_TEXTURE_2D, 0);
@@ -502,15 +2040,261 @@ void Renderer::postProcessing()
         glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, postProcessFB);
-        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, window->getWidth(), window->getHeight());
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, renderWidth, renderHeight);
 
         glBindTexture(GL_TEXTURE_2D, postProcessRenderTexture);
         glClear(GL_COLOR_BUFFER_BIT);
+        shader->setAttrVec2("uvScale", getUVScale());
         screenQuad.draw(shader);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
     }
 }
 
+void Renderer::setDynamicResolution(bool b)
+{
+    dynamicResolution = b;
+    resolutionScaler->reset();
+}
+
+void Renderer::setResolutionScaleRange(float minScale, float maxScale)
+{
+    resolutionScaler->setScaleRange(minScale, maxScale);
+}
+
+void Renderer::setTargetFrameTime(float ms)
+{
+    resolutionScaler->setTargetTime(ms);
+}
+
+void Renderer::setUpscaleFilter(UpscaleFilter filter, float sharpness_)
+{
+    upscaleFilter = filter;
+    sharpness = sharpness_;
+    screenShader->setAttrI("upscaleFilter", (int)upscaleFilter);
+    screenShader->setAttrF("sharpness", sharpness);
+}
+
+// scale steps of 1/64 keep the size from changing on every frame
+void Renderer::updateRenderSize()
+{
+    int width = window->getWidth();
+    int height = window->getHeight();
+    float maxScale = std::max(resolutionScaler->getMaxScale(), 1.0f);
+    int neededWidth = (int)ceil(width * maxScale);
+    int neededHeight = (int)ceil(height * maxScale);
+    if (neededWidth != targetWidth || neededHeight != targetHeight)
+        resizeRenderTargets(neededWidth, neededHeight);
+
+    float scale = dynamicResolution ? round(resolutionScaler->getScale() * 64.0f) / 64.0f : 1.0f;
+    renderWidth = glm::clamp((int)(width * scale), 1, targetWidth);
+    renderHeight = glm::clamp((int)(height * scale), 1, targetHeight);
+}
+
+// re-specify the storage of every screen sized target, attachments stay valid
+void Renderer::resizeRenderTargets(int width, int height)
+{
+    targetWidth = width;
+    targetHeight = height;
+    for (GLuint fb : { framebuffer, postProcessFB })
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, fb);
+        GLint color, depth;
+        glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &color);
+        glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &depth);
+        glBindTexture(GL_TEXTURE_2D, color);
+        glTexImage2D(GL_TEXTURE_2D, 0, targetFormats.sceneColor, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (gBuffer)
+        allocateGBuffer(width, height);
+    if (RSMHistory[0])
+        allocateRSMHistory(width, height);
+    if (RSMGatherFBO)
+        allocateRSMGather(width, height);
+}
+
+// the history textures are created on first use
+void Renderer::setTemporalRSM(bool b, int sampleNum, int maxHistoryLength)
+{
+    temporalRSM = b;
+    temporalRSMSampleNum = std::max(sampleNum, 1);
+    RSMHistoryLength = std::max(maxHistoryLength, 1);
+    phongShader->setAttrB("temporalRSM", temporalRSM);
+    if (temporalRSM && !RSMHistory[0])
+    {
+        GLuint textures[4];
+        glGenTextures(4, textures);
+        for (int i = 0; i < 2; ++i)
+        {
+            RSMHistory[i] = make_shared<Texture>(textures[i], TextureType::TEXTURE_2D);
+            RSMHistoryNormal[i] = make_shared<Texture>(textures[i + 2], TextureType::TEXTURE_2D);
+        }
+        allocateRSMHistory(targetWidth, targetHeight);
+    }
+}
+
+// cleared to zero, a depth of zero is rejected as history
+void Renderer::allocateRSMHistory(int width, int height)
+{
+    float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 2; ++i)
+    {
+        for (auto &texture : { RSMHistory[i], RSMHistoryNormal[i] })
+        {
+            glBindTexture(GL_TEXTURE_2D, texture->getID());
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glClearTexImage(texture->getID(), 0, GL_RGBA, GL_FLOAT, zero);
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// write this frame's history next to the color, read last frame's
+void Renderer::beginTemporalRSM()
+{
+    int write = RSMHistoryIndex;
+    int read = 1 - write;
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, RSMHistory[write]->getID(), 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, RSMHistoryNormal[write]->getID(), 0);
+    GLuint attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glDrawBuffers(3, attachments);
+    float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 1, zero);
+    glClearBufferfv(GL_COLOR, 2, zero);
+
+    phongShader->setAttrI("temporalSampleNum", temporalRSMSampleNum);
+    phongShader->setAttrI("maxHistoryLength", RSMHistoryLength);
+    phongShader->setAttrI("frameIndex", RSMFrameIndex);
+    phongShader->setAttrMat4("prevViewProjection", prevViewProjection);
+    phongShader->setAttrVec2("prevUVScale", prevUVScale);
+    phongShader->setTexture("RSM_History", 10, RSMHistory[read]);
+    phongShader->setTexture("RSM_HistoryNormal", 11, RSMHistoryNormal[read]);
+}
+
+// only the color attachment is written by the passes after the main pass
+void Renderer::endTemporalRSM(const mat4 &viewProjection)
+{
+    GLuint attachment = GL_COLOR_ATTACHMENT0;
+    glDrawBuffers(1, &attachment);
+    prevViewProjection = viewProjection;
+    prevUVScale = getUVScale();
+    RSMHistoryIndex = 1 - RSMHistoryIndex;
+    RSMFrameIndex = (RSMFrameIndex + 1) % 1024; // keeps the Halton index in range
+}
+
+// the targets and shaders are created on first use
+void Renderer::setRSMGatherPass(bool b, int downsample)
+{
+    RSMGatherPass = b;
+    phongShader->setAttrB("RSMGatherPass", RSMGatherPass);
+    if (!RSMGatherPass)
+        return;
+    if (!RSMGatherFBO)
+    {
+        glGenFramebuffers(1, &RSMGatherFBO);
+        GLuint textures[2];
+        glGenTextures(2, textures);
+        RSMGeometry = make_shared<Texture>(textures[0], TextureType::TEXTURE_2D);
+        RSMIndirect = make_shared<Texture>(textures[1], TextureType::TEXTURE_2D);
+
+        RSMGatherShader = make_shared<Shader>("./shaders/texture_to_screen.vert", "./shaders/RSM_gather.frag");
+        RSMGatherShader->setTexture("geometry", 0, RSMGeometry);
+        RSMGatherShader->setTexture("RSM_Depth", 5, RSM_depth);
+        RSMGatherShader->setTexture("RSM_Position", 6, RSM_position);
+        RSMGatherShader->setTexture("RSM_Normal", 7, RSM_normal);
+        RSMGatherShader->setTexture("RSM_Flux", 8, RSM_flux);
+        // receives the RSM light space matrix with the other scene shaders
+        addShader("RSMGather", RSMGatherShader);
+        RSMUpsampleShader = make_shared<Shader>("./shaders/texture_to_screen.vert", "./shaders/RSM_upsample.frag");
+        RSMUpsampleShader->setTexture("geometry", 0, RSMGeometry);
+        RSMUpsampleShader->setTexture("indirectLight", 1, RSMIndirect);
+        RSMUpsampleShader->setAttrF("depthSigma", 0.02f);
+        RSMUpsampleShader->setAttrF("normalPower", 16.0f);
+    }
+    RSMDownsample = std::max(downsample, 1);
+    allocateRSMGather(targetWidth, targetHeight);
+}
+
+void Renderer::allocateRSMGather(int width, int height)
+{
+    glBindTexture(GL_TEXTURE_2D, RSMGeometry->getID());
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, RSMIndirect->getID());
+    glTexImage2D(GL_TEXTURE_2D, 0, targetFormats.RSMIndirect, (width + RSMDownsample - 1) / RSMDownsample,
+        (height + RSMDownsample - 1) / RSMDownsample, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, RSMGatherFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, RSMIndirect->getID(), 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::FRAMEBUFFER:: RSM gather buffer is not complete!" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// the main pass leaves out indirect light and writes normal and view depth next to the color
+void Renderer::beginRSMGather()
+{
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, RSMGeometry->getID(), 0);
+    GLuint attachments[4] = { GL_COLOR_ATTACHMENT0, GL_NONE, GL_NONE, GL_COLOR_ATTACHMENT3 };
+    glDrawBuffers(4, attachments);
+    float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    glClearBufferfv(GL_COLOR, 3, zero);
+}
+
+// gather at low resolution, then upsample guided by the full resolution normal and depth
+// and add the result to the lit image
+void Renderer::renderRSMGather()
+{
+    GLuint attachment = GL_COLOR_ATTACHMENT0;
+    glDrawBuffers(1, &attachment);
+    glDisable(GL_DEPTH_TEST);
+
+    vec2 renderSize(renderWidth, renderHeight);
+    for (auto &shader : { RSMGatherShader, RSMUpsampleShader })
+    {
+        shader->setAttrVec2("renderSize", renderSize);
+        shader->setAttrI("downsample", RSMDownsample);
+    }
+    RSMGatherShader->setAttrMat4("invView", inverse(camera->getViewMatrix()));
+    RSMGatherShader->setAttrMat4("invProjection", inverse(camera->getProjectionMatrix()));
+    glBindFramebuffer(GL_FRAMEBUFFER, RSMGatherFBO);
+    glViewport(0, 0, (renderWidth + RSMDownsample - 1) / RSMDownsample, (renderHeight + RSMDownsample - 1) / RSMDownsample);
+    screenQuad.draw(RSMGatherShader);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, renderWidth, renderHeight);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    screenQuad.draw(RSMUpsampleShader);
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
+}
+
+void Renderer::setVPLClustering(bool b)
+{
+    VPLClustering = b;
+    phongShader->setAttrB("VPLClustering", VPLClustering);
+    phongShader->setAttrI("VPLNum", VPLClusters::VPL_NUM);
+    if (VPLClustering && !vplClusters)
+    {
+        vplClusters = make_shared<VPLClusters>();
+        vplClusters->init();
+    }
+    RSMDirty = true;
+}
+
 void Renderer::initialRSMBuffers()
 {
     glGenFramebuffers(1, &RSMBuffer);
@@ -520,72 +2304,149 @@ void Renderer::initialRSMBuffers()
     // depth
     glGenTextures(1, &depth);
     glBindTexture(GL_TEXTURE_2D, depth);
-    //glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, RSMBufferSize, RSMBufferSize, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
     GLfloat borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
     glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
     // position
     glGenTextures(1, &pos);
     glBindTexture(GL_TEXTURE_2D, pos);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, RSMBufferSize, RSMBufferSize, 0, GL_RGB, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pos, 0);
     // normal
     glGenTextures(1, &normal);
     glBindTexture(GL_TEXTURE_2D, normal);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, RSMBufferSize, RSMBufferSize, 0, GL_RGB, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, normal, 0);
     // flux
     glGenTextures(1, &flux);
     glBindTexture(GL_TEXTURE_2D, flux);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, RSMBufferSize, RSMBufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, flux, 0);
-
-    GLuint attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
-    glDrawBuffers(3, attachments);
 
     RSM_depth = make_shared<Texture>(depth, TextureType::TEXTURE_2D);
     RSM_position = make_shared<Texture>(pos, TextureType::TEXTURE_2D);
     RSM_normal = make_shared<Texture>(normal, TextureType::TEXTURE_2D);
     RSM_flux = make_shared<Texture>(flux, TextureType::TEXTURE_2D);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    allocateRSMBuffers();
 
     RSMBufferShader = make_shared<Shader>("./shaders/RSM_buffer.vert", "./shaders/RSM_buffer.frag");
 }
 
+// storage in the current formats, without a position target the shaders rebuild positions from depth
+void Renderer::allocateRSMBuffers()
+{
+    auto allocate = [&](shared_ptr<Texture> texture, GLenum format, int size) {
+        glBindTexture(GL_TEXTURE_2D, texture->getID());
+        glTexImage2D(GL_TEXTURE_2D, 0, format, size, size, 0, getPixelFormat(format), GL_FLOAT, NULL);
+    };
+    allocate(RSM_depth, targetFormats.RSMDepth, RSMBufferSize);
+    allocate(RSM_position, GL_RGB16F, targetFormats.RSMPosition ? RSMBufferSize : 0);
+    allocate(RSM_normal, targetFormats.RSMNormal, RSMBufferSize);
+    allocate(RSM_flux, targetFormats.RSMFlux, RSMBufferSize);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, RSMBuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, RSM_depth->getID(), 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, targetFormats.RSMPosition ? RSM_position->getID() : 0, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, RSM_normal->getID(), 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, RSM_flux->getID(), 0);
+    GLuint attachments[3] = { targetFormats.RSMPosition ? (GLuint)GL_COLOR_ATTACHMENT0 : (GLuint)GL_NONE, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glDrawBuffers(3, attachments);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::FRAMEBUFFER:: RSM buffer is not complete!" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
 void Renderer::renderRSMBuffers()
 {
-    shared_ptr<DirectionalLight> dirLight = dirLights.begin()->second;
+    // the first directional light
+    shared_ptr<DirectionalLight> dirLight;
+    for (auto &light : scene.lights.getData())
+    {
+        if (light->getType() == LightType::Directional)
+        {
+            dirLight = static_pointer_cast<DirectionalLight>(light);
+            break;
+        }
+    }
+    if (!dirLight)
+        return;
     mat4 lightProjection = ortho(-30.0f, 30.0f, -30.0f, 30.0f, lightNearPlane, lightFarPlane);
     mat4 lightView = lookAt(-dirLight->getDir() * vec3(25.0f), vec3(0.0f), vec3(0.0, 1.0, 0.0));
     mat4 lightSpaceMatrix = lightProjection * lightView;
 
-    RSMBufferShader->setAttrMat4("lightSpaceMatrix", lightSpaceMatrix);
-    for (auto &shader_ : shaders)
+    bool packedNormal = targetFormats.RSMNormal == GL_RG16_SNORM;
+    for (auto &shader : scene.shaders.getData())
     {
-        shared_ptr<Shader> &shader = shader_.second;
         shader->setAttrMat4("RSM_lightSpaceMatrix", lightSpaceMatrix);
+        shader->setAttrMat4("RSM_invLightSpaceMatrix", inverse(lightSpaceMatrix));
+        shader->setAttrB("RSMPackedNormal", packedNormal);
+        shader->setAttrB("RSMPositionFromDepth", !targetFormats.RSMPosition);
     }
+    if (VPLClustering)
+        vplClusters->bind();
+
+    if (shadowCaching && !RSMDirty && RSMVersion == dirLight->getVersion()
+        && !castersChanged(changedBounds, Frustum(lightSpaceMatrix)))
+        return;
+    RSMVersion = dirLight->getVersion();
+    RSMDirty = false;
+    shadowUpdateNum++;
 
+    RSMBufferShader->setAttrMat4("lightSpaceMatrix", lightSpaceMatrix);
+    RSMBufferShader->setAttrB("packedNormal", packedNormal);
     glBindFramebuffer(GL_FRAMEBUFFER, RSMBuffer);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glViewport(0, 0, RSMBufferSize, RSMBufferSize);
-    for (auto &object : renderObjects)
-        object.second->draw(RSMBufferShader);
+    if (gpuCulling)
+    {
+        gpuCuller->cull(lightSpaceMatrix);
+        gpuCuller->draw(RSMBufferShader);
+    }
+    else
+    {
+        for (auto &object : scene.meshes.getData())
+            object->draw(RSMBufferShader);
+    }
 
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+    // the VPLs only change with the RSM
+    if (VPLClustering)
+        vplClusters->build(RSM_depth, RSM_position, RSM_normal, RSM_flux, lightSpaceMatrix, packedNormal, !targetFormats.RSMPosition);
+}
+
+void Renderer::setShadowCaching(bool b)
+{
+    shadowCaching = b;
+}
+
+void Renderer::invalidateShadows()
+{
+    fill(dirShadowVersions.begin(), dirShadowVersions.end(), 0);
+    fill(pointShadowVersions.begin(), pointShadowVersions.end(), 0);
+    fill(dirStaticVersions.begin(), dirStaticVersions.end(), 0);
+    fill(pointStaticVersions.begin(), pointStaticVersions.end(), 0);
+    RSMDirty = true;
+}
+
+bool Renderer::castersChanged(const vector<BoundingBox> &boxes, const Frustum &volume)
+{
+    for (auto &box : boxes)
+        if (volume.intersects(box))
+            return true;
+    return false;
+}
+
+bool Renderer::castersChanged(const vector<BoundingBox> &boxes, const vec3 &center, float radius)
+{
+    for (auto &box : boxes)
+        if (intersectsSphere(box, center, radius))
+            return true;
+    return false;
 }
 
 void Renderer::userEvents()
@@ -0,0 +1,106 @@
+#include "../include/ResolutionScaler.h"
+#include <algorithm>
+#include <cmath>
+
+ResolutionScaler::ResolutionScaler() :
+    frame(0),
+    oldest(0),
+    recording(false),
+    scale(1.0f),
+    minScale(0.5f),
+    maxScale(1.0f),
+    targetTime(16.0f),
+    gpuTime(0.0f),
+    kp(0.2f),
+    ki(0.1f),
+    kd(0.05f),
+    lastError(0.0f),
+    lastError2(0.0f)
+{
+    for (int i = 0; i < QUERY_FRAME_NUM; ++i)
+    {
+        queries[i][0] = queries[i][1] = 0;
+        issued[i] = false;
+    }
+}
+
+ResolutionScaler::~ResolutionScaler()
+{
+    // never initialized without a GL context
+    if (queries[0][0] != 0)
+        glDeleteQueries(QUERY_FRAME_NUM * 2, &queries[0][0]);
+}
+
+void ResolutionScaler::init()
+{
+    glGenQueries(QUERY_FRAME_NUM * 2, &queries[0][0]);
+}
+
+void ResolutionScaler::setScaleRange(float minScale_, float maxScale_)
+{
+    minScale = std::max(minScale_, 0.1f);
+    maxScale = std::max(maxScale_, minScale);
+    scale = glm::clamp(scale, minScale, maxScale);
+}
+
+void ResolutionScaler::setGains(float kp_, float ki_, float kd_)
+{
+    kp = kp_;
+    ki = ki_;
+    kd = kd_;
+}
+
+void ResolutionScaler::reset(float scale_)
+{
+    scale = glm::clamp(scale_, minScale, maxScale);
+    lastError = lastError2 = 0.0f;
+}
+
+// timestamps do not nest with the main pass GL_TIME_ELAPSED query
+// when the GPU is QUERY_FRAME_NUM frames behind every slot is still pending, the frame is not measured
+void ResolutionScaler::beginFrame()
+{
+    recording = !issued[frame];
+    if (recording)
+        glQueryCounter(queries[frame][0], GL_TIMESTAMP);
+}
+
+void ResolutionScaler::endFrame()
+{
+    if (recording)
+    {
+        glQueryCounter(queries[frame][1], GL_TIMESTAMP);
+        issued[frame] = true;
+        frame = (frame + 1) % QUERY_FRAME_NUM;
+    }
+
+    // read every finished frame, the newest one drives the controller
+    float measured = 0.0f;
+    while (issued[oldest])
+    {
+        GLint available = 0;
+        glGetQueryObjectiv(queries[oldest][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+        GLuint64 begin, end;
+        glGetQueryObjectui64v(queries[oldest][0], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(queries[oldest][1], GL_QUERY_RESULT, &end);
+        issued[oldest] = false;
+        oldest = (oldest + 1) % QUERY_FRAME_NUM;
+        measured = (end - begin) / 1000000.0f;
+    }
+    if (measured > 0.0f)
+        update(measured);
+}
+
+void ResolutionScaler::update(float gpuTime_)
+{
+    gpuTime = gpuTime_;
+    if (gpuTime <= 0.0f || targetTime <= 0.0f)
+        return;
+    float error = glm::clamp(sqrt(targetTime / gpuTime) - 1.0f, -0.5f, 0.5f);
+    float delta = kp * (error - lastError) + ki * error + kd * (error - 2.0f * lastError + lastError2);
+    scale = glm::clamp(scale + delta * scale, minScale, maxScale);
+    lastError2 = lastError;
+    lastError = error;
+}
@@ -38,6 +38,13 @@ Shader::Shader(string vertexPath_, string fragmentPath_, string geometryPath_)
 	compile();
 }
 
+Shader::Shader(string computePath_)
+{
+	computePath = computePath_;
+
+	compile();
+}
+
 void Shader::setAttrB(const std::string & name, bool value)
 {
 	attributesBool[name] = value;
@@ -186,6 +193,12 @@ void Shader::applyTextures()
 
 void Shader::compile()
 {
+	if (computePath != "")
+	{
+		compileCompute();
+		return;
+	}
+
 	// 1. ļ·лȡ/Ƭɫ
 	string vertexCode;
 	string fragmentCode;
@@ -311,11 +324,59 @@ void Shader::compile()
 		glDeleteShader(geometry);
 }
 
+void Shader::compileCompute()
+{
+	ifstream cShaderFile;
+	cShaderFile.open(computePath.c_str());
+	if (!cShaderFile.good())
+	{
+		cout << "Shader file " << computePath << " not exist!" << endl;
+		return;
+	}
+	stringstream cShaderStream;
+	cShaderStream << cShaderFile.rdbuf();
+	cShaderFile.close();
+	string computeCode = cShaderStream.str();
+
+	int success;
+	char infoLog[512];
+	const char *cShaderCode = computeCode.c_str();
+	unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(compute, 1, &cShaderCode, NULL);
+	glCompileShader(compute);
+	glGetShaderiv(compute, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		glGetShaderInfoLog(compute, 512, NULL, infoLog);
+		std::cout << "ERROR::SHADER::COMPUTE::COMPILATION_FAILED\n" << infoLog << std::endl;
+	};
+
+	ID = glCreateProgram();
+	glAttachShader(ID, compute);
+	glLinkProgram(ID);
+	glGetProgramiv(ID, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		glGetProgramInfoLog(ID, 512, NULL, infoLog);
+		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+	}
+	glDeleteShader(compute);
+}
+
 void Shader::use()
 {
 	glUseProgram(ID);
 }
 
+// run compute shader with current attributes and textures
+void Shader::dispatch(unsigned int x, unsigned int y, unsigned int z)
+{
+	use();
+	setAttributes();
+	applyTextures();
+	glDispatchCompute(x, y, z);
+}
+
 // set shader's attributes
 void Shader::setAttributes()
 {
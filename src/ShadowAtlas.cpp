@@ -0,0 +1,103 @@
+#include "../include/ShadowAtlas.h"
+
+ShadowAtlas::ShadowAtlas(int size_, int minTileSize_)
+{
+    reset(size_, minTileSize_);
+}
+
+void ShadowAtlas::reset(int size_, int minTileSize_)
+{
+    size = size_;
+    minTileSize = std::min(minTileSize_, size);
+    usedArea = 0;
+    nodes.assign(1, { ivec2(0), size, -1, -1, false });
+    freeChildren.clear();
+}
+
+int ShadowAtlas::allocate(int tileSize)
+{
+    int nodeSize = minTileSize;
+    while (nodeSize < tileSize && nodeSize < size)
+        nodeSize *= 2;
+    // a free node of the size first, then split the smallest larger one
+    int tile = find(0, nodeSize);
+    for (int splitSize = nodeSize * 2; tile < 0 && splitSize <= size; splitSize *= 2)
+    {
+        int node = find(0, splitSize);
+        if (node < 0)
+            continue;
+        nodes[node].used = false;
+        while (nodes[node].size > nodeSize)
+        {
+            split(node);
+            node = nodes[node].children;
+        }
+        nodes[node].used = true;
+        tile = node;
+    }
+    if (tile >= 0)
+        usedArea += (long long)nodeSize * nodeSize;
+    return tile;
+}
+
+void ShadowAtlas::release(int tile)
+{
+    if (tile < 0 || !nodes[tile].used)
+        return;
+    nodes[tile].used = false;
+    usedArea -= (long long)nodes[tile].size * nodes[tile].size;
+
+    // merge up while all four siblings are free leaves
+    int parent = nodes[tile].parent;
+    while (parent >= 0)
+    {
+        int first = nodes[parent].children;
+        for (int i = 0; i < 4; ++i)
+            if (nodes[first + i].used || nodes[first + i].children >= 0)
+                return;
+        freeChildren.push_back(first);
+        nodes[parent].children = -1;
+        parent = nodes[parent].parent;
+    }
+}
+
+// a free leaf of tileSize in the subtree, marked as used
+int ShadowAtlas::find(int node, int tileSize)
+{
+    Node &n = nodes[node];
+    if (n.size < tileSize || n.used)
+        return -1;
+    if (n.children < 0)
+    {
+        if (n.size != tileSize)
+            return -1;
+        n.used = true;
+        return node;
+    }
+    for (int i = 0; i < 4; ++i)
+    {
+        int tile = find(nodes[node].children + i, tileSize);
+        if (tile >= 0)
+            return tile;
+    }
+    return -1;
+}
+
+void ShadowAtlas::split(int node)
+{
+    int first;
+    if (!freeChildren.empty())
+    {
+        first = freeChildren.back();
+        freeChildren.pop_back();
+    }
+    else
+    {
+        first = nodes.size();
+        nodes.resize(nodes.size() + 4);
+    }
+    int half = nodes[node].size / 2;
+    for (int i = 0; i < 4; ++i)
+        nodes[first + i] = { nodes[node].pos + ivec2(i & 1, i >> 1) * half, half, node, -1, false };
+    nodes[node].children = first;
+}
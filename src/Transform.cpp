@@ -0,0 +1,356 @@
+#include "../include/Transform.h"
+#include "../include/JobSystem.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define TRANSFORM_SSE
+#endif
+
+vector<vec3> TransformSystem::positions;
+vector<quat> TransformSystem::rotations;
+vector<vec3> TransformSystem::scales;
+vector<TransformID> TransformSystem::parents;
+vector<int> TransformSystem::childNums;
+vector<char> TransformSystem::alive;
+vector<TransformID> TransformSystem::freeList;
+vector<mat4> TransformSystem::worldMatrices;
+vector<mat4> TransformSystem::normalMatrices;
+vector<char> TransformSystem::dirty;
+vector<char> TransformSystem::changed;
+vector<TransformID> TransformSystem::order;
+vector<int> TransformSystem::levels;
+bool TransformSystem::hierarchyDirty = false;
+int TransformSystem::updatedNum = 0;
+mutex TransformSystem::transformMutex;
+vector<TransformSystem::PendingTransform> TransformSystem::pending;
+vector<int> TransformSystem::pendingLevels;
+vector<mat4> TransformSystem::pendingWorld;
+vector<mat4> TransformSystem::pendingNormal;
+
+// r = a * b, column major, r must not alias a or b
+static inline void multiply(const float *a, const float *b, float *r)
+{
+#ifdef TRANSFORM_SSE
+	__m128 a0 = _mm_loadu_ps(a);
+	__m128 a1 = _mm_loadu_ps(a + 4);
+	__m128 a2 = _mm_loadu_ps(a + 8);
+	__m128 a3 = _mm_loadu_ps(a + 12);
+	for (int i = 0; i < 4; ++i)
+	{
+		__m128 c = _mm_mul_ps(a0, _mm_set1_ps(b[4 * i]));
+		c = _mm_add_ps(c, _mm_mul_ps(a1, _mm_set1_ps(b[4 * i + 1])));
+		c = _mm_add_ps(c, _mm_mul_ps(a2, _mm_set1_ps(b[4 * i + 2])));
+		c = _mm_add_ps(c, _mm_mul_ps(a3, _mm_set1_ps(b[4 * i + 3])));
+		_mm_storeu_ps(r + 4 * i, c);
+	}
+#else
+	for (int i = 0; i < 4; ++i)
+		for (int j = 0; j < 4; ++j)
+			r[4 * i + j] = a[j] * b[4 * i] + a[4 + j] * b[4 * i + 1] + a[8 + j] * b[4 * i + 2] + a[12 + j] * b[4 * i + 3];
+#endif
+}
+
+TransformID TransformSystem::create()
+{
+	lock_guard<mutex> lock(transformMutex);
+	TransformID id;
+	if (!freeList.empty())
+	{
+		id = freeList.back();
+		freeList.pop_back();
+	}
+	else
+	{
+		id = positions.size();
+		positions.push_back(vec3(0.0f));
+		rotations.push_back(quat(1.0f, 0.0f, 0.0f, 0.0f));
+		scales.push_back(vec3(1.0f));
+		parents.push_back(-1);
+		childNums.push_back(0);
+		alive.push_back(0);
+		worldMatrices.push_back(mat4(1.0f));
+		normalMatrices.push_back(mat4(1.0f));
+		dirty.push_back(0);
+		changed.push_back(0);
+	}
+
+	positions[id] = vec3(0.0f);
+	rotations[id] = quat(1.0f, 0.0f, 0.0f, 0.0f);
+	scales[id] = vec3(1.0f);
+	parents[id] = -1;
+	childNums[id] = 0;
+	alive[id] = 1;
+	worldMatrices[id] = mat4(1.0f);
+	normalMatrices[id] = mat4(1.0f);
+	dirty[id] = 1;
+	changed[id] = 0;
+	hierarchyDirty = true;
+	return id;
+}
+
+// children of a destroyed transform become roots
+void TransformSystem::destroy(TransformID id)
+{
+	lock_guard<mutex> lock(transformMutex);
+	if (id < 0 || id >= (TransformID)alive.size() || !alive[id])
+		return;
+
+	if (childNums[id] > 0)
+	{
+		for (TransformID i = 0; i < (TransformID)parents.size(); ++i)
+			if (parents[i] == id)
+			{
+				parents[i] = -1;
+				markDirty(i);
+			}
+	}
+	if (parents[id] >= 0)
+		childNums[parents[id]]--;
+
+	parents[id] = -1;
+	childNums[id] = 0;
+	alive[id] = 0;
+	dirty[id] = 0;
+	freeList.push_back(id);
+	hierarchyDirty = true;
+}
+
+void TransformSystem::setParent(TransformID id, TransformID parent)
+{
+	lock_guard<mutex> lock(transformMutex);
+	if (parents[id] == parent)
+		return;
+
+	// refuse cycles
+	for (TransformID p = parent; p >= 0; p = parents[p])
+	{
+		if (p == id)
+		{
+			cout << "Set parent failed! Transform " << parent << " is a descendant of " << id << endl;
+			return;
+		}
+	}
+
+	if (parents[id] >= 0)
+		childNums[parents[id]]--;
+	parents[id] = parent;
+	if (parent >= 0)
+		childNums[parent]++;
+	markDirty(id);
+	hierarchyDirty = true;
+}
+
+void TransformSystem::setLocal(TransformID id, const vec3 &position, const quat &rotation, const vec3 &scale)
+{
+	lock_guard<mutex> lock(transformMutex);
+	// unchanged values keep the transform clean, editors set them every frame
+	if (positions[id] == position && rotations[id] == rotation && scales[id] == scale)
+		return;
+	positions[id] = position;
+	rotations[id] = rotation;
+	scales[id] = scale;
+	markDirty(id);
+}
+
+void TransformSystem::setPosition(TransformID id, const vec3 &position)
+{
+	lock_guard<mutex> lock(transformMutex);
+	if (positions[id] == position)
+		return;
+	positions[id] = position;
+	markDirty(id);
+}
+
+void TransformSystem::setRotation(TransformID id, const quat &rotation)
+{
+	lock_guard<mutex> lock(transformMutex);
+	if (rotations[id] == rotation)
+		return;
+	rotations[id] = rotation;
+	markDirty(id);
+}
+
+void TransformSystem::setScale(TransformID id, const vec3 &scale)
+{
+	lock_guard<mutex> lock(transformMutex);
+	if (scales[id] == scale)
+		return;
+	scales[id] = scale;
+	markDirty(id);
+}
+
+void TransformSystem::markDirty(TransformID id)
+{
+	dirty[id] = 1;
+}
+
+// a dirty transform and all of its descendants are recomputed,
+// every level only depends on the previous one so it is split into jobs.
+// The mutex is not held while the jobs run: the main thread helps with other jobs while it
+// waits, and one of them creating or moving a transform would lock it again.
+void TransformSystem::update()
+{
+	{
+		lock_guard<mutex> lock(transformMutex);
+		collectPending();
+	}
+
+	for (int level = 0; level + 1 < (int)pendingLevels.size(); ++level)
+	{
+		JobSystem::parallelFor(pendingLevels[level + 1] - pendingLevels[level], [level](int begin, int end) {
+			computeMatrices(pendingLevels[level] + begin, pendingLevels[level] + end);
+		}, 1024);
+	}
+
+	// transforms destroyed meanwhile are left out, moved ones are dirty again for the next update
+	lock_guard<mutex> lock(transformMutex);
+	for (int i = 0; i < (int)pending.size(); ++i)
+	{
+		TransformID id = pending[i].id;
+		if (!alive[id])
+			continue;
+		worldMatrices[id] = pendingWorld[i];
+		normalMatrices[id] = pendingNormal[i];
+	}
+	updatedNum = pending.size();
+}
+
+// copy the dirty transforms and their descendants level by level, with the matrices of their clean parents
+void TransformSystem::collectPending()
+{
+	if (hierarchyDirty)
+		rebuildOrder();
+
+	fill(changed.begin(), changed.end(), 0);
+	pending.clear();
+	pendingLevels.assign(1, 0);
+	vector<int> slots(parents.size(), -1);
+	for (int level = 0; level + 1 < (int)levels.size(); ++level)
+	{
+		for (int i = levels[level]; i < levels[level + 1]; ++i)
+		{
+			TransformID id = order[i];
+			TransformID parent = parents[id];
+			if (!dirty[id] && !(parent >= 0 && changed[parent]))
+				continue;
+
+			PendingTransform entry;
+			entry.id = id;
+			entry.parentSlot = parent >= 0 ? slots[parent] : -1;
+			entry.position = positions[id];
+			entry.rotation = rotations[id];
+			entry.scale = scales[id];
+			entry.parentWorld = parent >= 0 ? worldMatrices[parent] : mat4(1.0f);
+			entry.parentNormal = parent >= 0 ? normalMatrices[parent] : mat4(1.0f);
+			slots[id] = pending.size();
+			pending.push_back(entry);
+			changed[id] = 1;
+			dirty[id] = 0;
+		}
+		pendingLevels.push_back(pending.size());
+	}
+	pendingWorld.resize(pending.size());
+	pendingNormal.resize(pending.size());
+}
+
+// sort alive transforms by depth
+void TransformSystem::rebuildOrder()
+{
+	vector<int> depths(parents.size(), -1);
+	vector<TransformID> path;
+	int maxDepth = -1;
+	for (TransformID i = 0; i < (TransformID)parents.size(); ++i)
+	{
+		if (!alive[i] || depths[i] >= 0)
+			continue;
+
+		// walk up until a known depth
+		path.clear();
+		TransformID p = i;
+		while (p >= 0 && depths[p] < 0)
+		{
+			path.push_back(p);
+			p = parents[p];
+		}
+		int depth = p >= 0 ? depths[p] : -1;
+		for (int k = path.size() - 1; k >= 0; --k)
+			depths[path[k]] = ++depth;
+		maxDepth = std::max(maxDepth, depths[i]);
+	}
+
+	// counting sort
+	levels.assign(maxDepth + 2, 0);
+	for (TransformID i = 0; i < (TransformID)parents.size(); ++i)
+		if (alive[i])
+			levels[depths[i] + 1]++;
+	for (int d = 1; d < (int)levels.size(); ++d)
+		levels[d] += levels[d - 1];
+
+	order.resize(levels.back());
+	vector<int> next(levels.begin(), levels.end() - 1);
+	for (TransformID i = 0; i < (TransformID)parents.size(); ++i)
+		if (alive[i])
+			order[next[depths[i]]++] = i;
+
+	hierarchyDirty = false;
+}
+
+// world = parent * T * R * S
+// normal = transpose(inverse(world)) = parentNormal * R * S^-1, no general inverse needed
+void TransformSystem::computeMatrices(int begin, int end)
+{
+	alignas(16) float local[16];
+	alignas(16) float normal[16];
+	for (int n = begin; n < end; ++n)
+	{
+		const PendingTransform &entry = pending[n];
+		const quat &q = entry.rotation;
+		const vec3 &s = entry.scale;
+		const vec3 &p = entry.position;
+
+		// rotation columns, scaled by 2 / |q|^2 so the quaternion need not be normalized
+		float k = 2.0f / (q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+		float xx = q.x * q.x * k, yy = q.y * q.y * k, zz = q.z * q.z * k;
+		float xy = q.x * q.y * k, xz = q.x * q.z * k, yz = q.y * q.z * k;
+		float wx = q.w * q.x * k, wy = q.w * q.y * k, wz = q.w * q.z * k;
+		float r[12] = {
+			1.0f - yy - zz, xy + wz, xz - wy, 0.0f,
+			xy - wz, 1.0f - xx - zz, yz + wx, 0.0f,
+			xz + wy, yz - wx, 1.0f - xx - yy, 0.0f
+		};
+
+		for (int i = 0; i < 3; ++i)
+		{
+			float invScale = s[i] != 0.0f ? 1.0f / s[i] : 0.0f;
+#ifdef TRANSFORM_SSE
+			__m128 column = _mm_loadu_ps(r + 4 * i);
+			_mm_store_ps(local + 4 * i, _mm_mul_ps(column, _mm_set1_ps(s[i])));
+			_mm_store_ps(normal + 4 * i, _mm_mul_ps(column, _mm_set1_ps(invScale)));
+#else
+			for (int j = 0; j < 4; ++j)
+			{
+				local[4 * i + j] = r[4 * i + j] * s[i];
+				normal[4 * i + j] = r[4 * i + j] * invScale;
+			}
+#endif
+		}
+		local[12] = p.x;
+		local[13] = p.y;
+		local[14] = p.z;
+		local[15] = 1.0f;
+		normal[12] = 0.0f;
+		normal[13] = 0.0f;
+		normal[14] = 0.0f;
+		normal[15] = 1.0f;
+
+		// a pending parent is on the previous level, already computed
+		const mat4 &parentWorld = entry.parentSlot >= 0 ? pendingWorld[entry.parentSlot] : entry.parentWorld;
+		const mat4 &parentNormal = entry.parentSlot >= 0 ? pendingNormal[entry.parentSlot] : entry.parentNormal;
+		multiply(&parentWorld[0][0], local, &pendingWorld[n][0][0]);
+		multiply(&parentNormal[0][0], normal, &pendingNormal[n][0][0]);
+	}
+}
@@ -0,0 +1,43 @@
+#include "../include/VPLClusters.h"
+
+VPLClusters::VPLClusters() :
+    buffer(0),
+    buildNum(0)
+{
+}
+
+VPLClusters::~VPLClusters()
+{
+    glDeleteBuffers(1, &buffer);
+}
+
+void VPLClusters::init()
+{
+    reduceShader = make_shared<Shader>("./shaders/rsm_vpl.comp");
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, VPL_NUM * sizeof(VPL), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+// one work group per tile
+void VPLClusters::build(shared_ptr<Texture> depth, shared_ptr<Texture> position, shared_ptr<Texture> normal, shared_ptr<Texture> flux,
+    const mat4 &lightSpaceMatrix, bool packedNormal, bool positionFromDepth)
+{
+    reduceShader->setAttrMat4("RSM_invLightSpaceMatrix", inverse(lightSpaceMatrix));
+    reduceShader->setAttrB("RSMPackedNormal", packedNormal);
+    reduceShader->setAttrB("RSMPositionFromDepth", positionFromDepth);
+    reduceShader->setTexture("RSM_Depth", 0, depth);
+    reduceShader->setTexture("RSM_Position", 1, position);
+    reduceShader->setTexture("RSM_Normal", 2, normal);
+    reduceShader->setTexture("RSM_Flux", 3, flux);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, buffer);
+    reduceShader->dispatch(GRID, GRID);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    buildNum++;
+}
+
+void VPLClusters::bind()
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, buffer);
+}